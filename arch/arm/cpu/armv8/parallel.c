@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Start secondary CPUs for parallel_run() with PSCI CPU_ON
+ */
+
+#include <common.h>
+#include <cpu_func.h>
+#include <dm.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <parallel.h>
+#include <asm/system.h>
+#include <dm/ofnode.h>
+#include <linux/psci.h>
+#include <linux/sizes.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#define PARALLEL_STACK_SIZE	SZ_32K
+#define PARALLEL_MAX_CPUS	16
+
+/* How long a CPU may take to turn off after its last run, in ms */
+#define PARALLEL_OFF_TIMEOUT	100
+
+#define MPIDR_HWID_MASK		0xff00ffffffUL
+
+/*
+ * Handed to a secondary CPU as the PSCI context_id. It is read with the
+ * MMU off, so it is cache-line aligned and flushed before the CPU is
+ * started. parallel_entry() relies on the order of the first fields.
+ */
+struct parallel_cpu {
+	ulong sp;
+	ulong gd;
+	ulong vbar;
+	ulong ttbr0;
+	ulong tcr;
+	ulong mair;
+	ulong sctlr;
+	void (*func)(void *arg);
+	void *arg;
+	u64 mpidr;
+	void *stack;
+};
+
+void parallel_save_mmu(struct parallel_cpu *cpu);
+void parallel_entry(void);
+
+static struct parallel_cpu *parallel_cpus[PARALLEL_MAX_CPUS];
+/* number of CPUs found, -1 before looking */
+static int parallel_ncpus = -1;
+
+void parallel_secondary_entry(struct parallel_cpu *cpu)
+{
+	cpu->func(cpu->arg);
+	invoke_psci_fn(PSCI_0_2_FN_CPU_OFF, 0, 0, 0);
+	while (1)
+		wfi();
+}
+
+static int parallel_psci_ready(void)
+{
+	struct udevice *dev;
+	ulong ver;
+
+	/* Probing the driver selects the PSCI conduit */
+	if (uclass_get_device_by_driver(UCLASS_FIRMWARE, DM_GET_DRIVER(psci),
+					&dev))
+		return -ENODEV;
+	if (current_el() == 3)
+		return -ENOSYS;
+	ver = invoke_psci_fn(PSCI_0_2_FN_PSCI_VERSION, 0, 0, 0);
+	if ((long)ver < 0 ||
+	    (!PSCI_VERSION_MAJOR(ver) && PSCI_VERSION_MINOR(ver) < 2))
+		return -ENOSYS;
+
+	return 0;
+}
+
+/* Find the secondary CPUs in the device tree */
+static void parallel_find_cpus(void)
+{
+	u64 self = read_mpidr() & MPIDR_HWID_MASK;
+	struct parallel_cpu *cpu;
+	const fdt32_t *reg;
+	ofnode node;
+	u64 mpidr;
+	int len;
+
+	parallel_ncpus = 0;
+	if (parallel_psci_ready())
+		return;
+
+	ofnode_for_each_subnode(node, ofnode_path("/cpus")) {
+		if (parallel_ncpus == PARALLEL_MAX_CPUS)
+			break;
+		if (strcmp(ofnode_read_string(node, "device_type") ?: "",
+			   "cpu") || !ofnode_is_available(node))
+			continue;
+		reg = ofnode_get_property(node, "reg", &len);
+		if (!reg)
+			continue;
+		if (len == sizeof(u64))
+			mpidr = fdt64_to_cpu(*(fdt64_t *)reg);
+		else if (len == sizeof(u32))
+			mpidr = fdt32_to_cpu(*reg);
+		else
+			continue;
+		if ((mpidr & MPIDR_HWID_MASK) == self)
+			continue;
+
+		cpu = malloc_cache_aligned(ALIGN(sizeof(*cpu),
+						 ARCH_DMA_MINALIGN));
+		if (!cpu)
+			break;
+		memset(cpu, '\0', sizeof(*cpu));
+		cpu->stack = memalign(16, PARALLEL_STACK_SIZE);
+		if (!cpu->stack) {
+			free(cpu);
+			break;
+		}
+		cpu->mpidr = mpidr;
+		parallel_cpus[parallel_ncpus++] = cpu;
+	}
+	debug("%s: %d secondary CPUs\n", __func__, parallel_ncpus);
+}
+
+int cpu_parallel_count(void)
+{
+	if (parallel_ncpus < 0)
+		parallel_find_cpus();
+
+	return parallel_ncpus;
+}
+
+int cpu_parallel_start(int n, void (*func)(void *arg), void *arg)
+{
+	struct parallel_cpu *cpu;
+	ulong start;
+	long ret;
+
+	if (n < 0 || n >= cpu_parallel_count())
+		return -ENODEV;
+	cpu = parallel_cpus[n];
+
+	/* The CPU may still be on its way off after its last run */
+	start = get_timer(0);
+	while (invoke_psci_fn(PSCI_0_2_FN64_AFFINITY_INFO, cpu->mpidr, 0, 0) !=
+	       PSCI_0_2_AFFINITY_LEVEL_OFF) {
+		if (get_timer(start) > PARALLEL_OFF_TIMEOUT)
+			return -EBUSY;
+	}
+
+	cpu->sp = (ulong)cpu->stack + PARALLEL_STACK_SIZE;
+	cpu->gd = (ulong)gd;
+	cpu->func = func;
+	cpu->arg = arg;
+	parallel_save_mmu(cpu);
+	flush_dcache_range((ulong)cpu,
+			   (ulong)cpu + ALIGN(sizeof(*cpu), ARCH_DMA_MINALIGN));
+
+	ret = invoke_psci_fn(PSCI_0_2_FN64_CPU_ON, cpu->mpidr,
+			     (ulong)parallel_entry, (ulong)cpu);
+	if (ret) {
+		debug("%s: CPU %llx did not start: %ld\n", __func__,
+		      cpu->mpidr, ret);
+		return -EIO;
+	}
+
+	return 0;
+}
@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * SHA-1 block function using the ARMv8 Crypto Extensions
+ */
+
+#include <common.h>
+#include <u-boot/sha1.h>
+
+void sha1_armv8_ce_process(uint32_t state[5], const uint8_t *src,
+			   uint32_t blocks);
+
+void sha1_process(sha1_context *ctx, const unsigned char *data,
+		  unsigned int blocks)
+{
+	uint32_t state[5];
+	int i;
+
+	if (!blocks)
+		return;
+
+	/* sha1_context holds the state in unsigned longs */
+	for (i = 0; i < 5; i++)
+		state[i] = ctx->state[i];
+	sha1_armv8_ce_process(state, data, blocks);
+	for (i = 0; i < 5; i++)
+		ctx->state[i] = state[i];
+}
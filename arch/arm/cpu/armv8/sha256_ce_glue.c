@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * SHA-256 block function using the ARMv8 Crypto Extensions
+ */
+
+#include <common.h>
+#include <u-boot/sha256.h>
+
+void sha256_armv8_ce_process(uint32_t state[8], const uint8_t *src,
+			     uint32_t blocks);
+
+void sha256_process(sha256_context *ctx, const uint8_t *data,
+		    unsigned int blocks)
+{
+	if (blocks)
+		sha256_armv8_ce_process(ctx->state, data, blocks);
+}
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * CRC-32 using the ARMv8 CRC32 instructions
+ */
+
+#ifndef _ASM_ARMV8_CRC32_H_
+#define _ASM_ARMV8_CRC32_H_
+
+#include <linux/types.h>
+
+#define CRC32_INSN(insn)	".arch_extension crc\n\t" insn
+
+/**
+ * crc32_armv8_no_comp() - Update a CRC-32 without the ones complement
+ *
+ * This works out the same as the table-driven crc32_no_comp(), eight bytes
+ * at a time. It is always inlined so that it can be part of crc32_no_comp()
+ * in the EFI runtime.
+ *
+ * @crc: CRC so far
+ * @p: Data to add
+ * @len: Number of bytes at @p
+ * @return the updated CRC
+ */
+static __always_inline u32 crc32_armv8_no_comp(u32 crc, const u8 *p,
+					       size_t len)
+{
+	/* Keep the wider loads aligned, in case the MMU is off */
+	for (; len && ((ulong)p & 7); len--)
+		asm(CRC32_INSN("crc32b %w0, %w0, %w1")
+		    : "+r" (crc) : "r" ((u32)*p++));
+	for (; len >= 8; len -= 8, p += 8)
+		asm(CRC32_INSN("crc32x %w0, %w0, %x1")
+		    : "+r" (crc) : "r" (*(const u64 *)p));
+	if (len & 4) {
+		asm(CRC32_INSN("crc32w %w0, %w0, %w1")
+		    : "+r" (crc) : "r" (*(const u32 *)p));
+		p += 4;
+	}
+	if (len & 2) {
+		asm(CRC32_INSN("crc32h %w0, %w0, %w1")
+		    : "+r" (crc) : "r" ((u32)*(const u16 *)p));
+		p += 2;
+	}
+	if (len & 1)
+		asm(CRC32_INSN("crc32b %w0, %w0, %w1")
+		    : "+r" (crc) : "r" ((u32)*p));
+
+	return crc;
+}
+
+#endif /* _ASM_ARMV8_CRC32_H_ */
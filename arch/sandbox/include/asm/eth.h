@@ -78,6 +78,9 @@ typedef int sandbox_eth_tx_hand_f(struct udevice *dev, void *pkt,
  * recv_packet_buffer - buffers of the packet returned as received
  * recv_packet_length - lengths of the packet returned as received
  * recv_packets - number of packets returned
+ * recv_batch - number of packets handed out by the last recv_batch() call
+ * recv_freed - number of packets of that batch freed so far
+ * hwaddr_writes - number of times the MAC address was written to the device
  * tx_handler - function to generate responses to sent packets
  * priv - a pointer to some structure a test may want to keep track of
  */
@@ -88,6 +91,9 @@ struct eth_sandbox_priv {
 	uchar * recv_packet_buffer[PKTBUFSRX];
 	int recv_packet_length[PKTBUFSRX];
 	int recv_packets;
+	int recv_batch;
+	int recv_freed;
+	int hwaddr_writes;
 	sandbox_eth_tx_hand_f *tx_handler;
 	void *priv;
 };
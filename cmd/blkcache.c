@@ -13,15 +13,31 @@ static int blkc_show(cmd_tbl_t *cmdtp, int flag,
 		     int argc, char * const argv[])
 {
 	struct block_cache_stats stats;
+	struct block_cache_dev_stats *dev;
+	int i;
+
 	blkcache_stats(&stats);
 
 	printf("hits: %u\n"
 	       "misses: %u\n"
 	       "entries: %u\n"
 	       "max blocks/entry: %u\n"
-	       "max cache entries: %u\n",
+	       "max cache entries: %u\n"
+	       "ways: %u\n"
+	       "line size: %u\n"
+	       "readahead: %u\n",
 	       stats.hits, stats.misses, stats.entries,
-	       stats.max_blocks_per_entry, stats.max_entries);
+	       stats.max_blocks_per_entry, stats.max_entries,
+	       stats.ways, stats.line_size, stats.readahead);
+
+	for (i = 0; i < stats.ndevs; i++) {
+		dev = &stats.devs[i];
+		if (!dev->hits && !dev->misses)
+			continue;
+		printf("%s %d: hits %u, misses %u, bytes %llu, readahead %u\n",
+		       blk_get_if_type_name(dev->iftype), dev->devnum,
+		       dev->hits, dev->misses, dev->bytes, dev->readahead);
+	}
 	return 0;
 }
 
@@ -40,9 +56,23 @@ static int blkc_configure(cmd_tbl_t *cmdtp, int flag,
 	return 0;
 }
 
+static int blkc_size(cmd_tbl_t *cmdtp, int flag,
+		     int argc, char * const argv[])
+{
+	unsigned size_kb;
+	if (argc != 2)
+		return CMD_RET_USAGE;
+
+	size_kb = simple_strtoul(argv[1], 0, 0);
+	blkcache_configure_size(size_kb);
+	printf("changed to %u KiB\n", size_kb);
+	return 0;
+}
+
 static cmd_tbl_t cmd_blkc_sub[] = {
 	U_BOOT_CMD_MKENT(show, 0, 0, blkc_show, "", ""),
 	U_BOOT_CMD_MKENT(configure, 3, 0, blkc_configure, "", ""),
+	U_BOOT_CMD_MKENT(size, 2, 0, blkc_size, "", ""),
 };
 
 static __maybe_unused void blkc_reloc(void)
@@ -83,4 +113,5 @@ U_BOOT_CMD(
 	"block cache diagnostics and control",
 	"show - show and reset statistics\n"
 	"blkcache configure blocks entries\n"
+	"blkcache size kb - resize the cache, 0 to disable it\n"
 );
@@ -27,6 +27,13 @@ static int do_hash(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 		argc--;
 		argv++;
 	}
+#endif
+#ifdef CONFIG_HASH_BENCH
+	if (argc > 2 && !strcmp(argv[1], "-b")) {
+		flags |= HASH_FLAG_BENCH;
+		argc--;
+		argv++;
+	}
 #endif
 	/* Move forward to 'algorithm' parameter */
 	argc--;
@@ -36,7 +43,7 @@ static int do_hash(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	return hash_command(*argv, flags, cmdtp, flag, argc - 1, argv + 1);
 }
 
-#ifdef CONFIG_HASH_VERIFY
+#if defined(CONFIG_HASH_VERIFY) || defined(CONFIG_HASH_BENCH)
 #define HARGS 6
 #else
 #define HARGS 5
@@ -52,4 +59,8 @@ U_BOOT_CMD(
 		"    - verify message digest of memory area to immediate value, \n"
 		"      env var or *address"
 #endif
+#ifdef CONFIG_HASH_BENCH
+	"\nhash -b algorithm address count\n"
+		"    - compute message digest and show how long it took"
+#endif
 );
@@ -114,6 +114,19 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_WGET)
+static int do_wget(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	return netboot_common(WGET, cmdtp, argc, argv);
+}
+
+U_BOOT_CMD(
+	wget,	3,	1,	do_wget,
+	"boot image via network using HTTP protocol",
+	"[loadAddress] [[hostIPaddr:]path]"
+);
+#endif
+
 static void netboot_update_env(void)
 {
 	char tmp[22];
@@ -297,6 +310,22 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_NETSTAT)
+static int do_netstat(cmd_tbl_t *cmdtp, int flag, int argc,
+		      char * const argv[])
+{
+	net_print_stats();
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	netstat,	1,	1,	do_netstat,
+	"show packet counters of the last network command",
+	""
+);
+#endif
+
 #if defined(CONFIG_CMD_CDP)
 
 static void cdp_update_env(void)
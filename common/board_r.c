@@ -304,6 +304,10 @@ static int initr_dm(void)
 	gd->dm_root = NULL;
 #ifdef CONFIG_TIMER
 	gd->timer = NULL;
+#endif
+#ifdef CONFIG_DM_COMPAT_INDEX
+	/* The index may be in the pre-relocation heap */
+	gd->dm_compat_index = NULL;
 #endif
 	bootstage_start(BOOTSTATE_ID_ACCUM_DM_R, "dm_r");
 	ret = dm_init_and_scan(false);
@@ -12,6 +12,7 @@
 #ifndef USE_HOSTCC
 #include <common.h>
 #include <command.h>
+#include <div64.h>
 #include <env.h>
 #include <malloc.h>
 #include <mapmem.h>
@@ -443,6 +444,14 @@ static void hash_show(struct hash_algo *algo, ulong addr, ulong len, uint8_t *ou
 		printf("%02x", output[i]);
 }
 
+static void hash_show_speed(ulong len, ulong us)
+{
+	/* Avoid dividing by zero on a fast CPU with a coarse timer */
+	us = max(us, 1UL);
+	printf(" in %lu us, %llu KiB/s", us,
+	       lldiv((u64)len * 1000000 / 1024, us));
+}
+
 int hash_command(const char *algo_name, int flags, cmd_tbl_t *cmdtp, int flag,
 		 int argc, char * const argv[])
 {
@@ -458,6 +467,7 @@ int hash_command(const char *algo_name, int flags, cmd_tbl_t *cmdtp, int flag,
 		struct hash_algo *algo;
 		u8 *output;
 		uint8_t vsum[HASH_MAX_DIGEST_SIZE];
+		ulong start, us;
 		void *buf;
 
 		if (hash_lookup_algo(algo_name, &algo)) {
@@ -475,7 +485,9 @@ int hash_command(const char *algo_name, int flags, cmd_tbl_t *cmdtp, int flag,
 				  sizeof(uint32_t) * HASH_MAX_DIGEST_SIZE);
 
 		buf = map_sysmem(addr, len);
+		start = timer_get_us();
 		algo->hash_func_ws(buf, len, output, algo->chunk_size);
+		us = timer_get_us() - start;
 		unmap_sysmem(buf);
 
 		/* Try to avoid code bloat when verify is not needed */
@@ -503,6 +515,9 @@ int hash_command(const char *algo_name, int flags, cmd_tbl_t *cmdtp, int flag,
 			}
 		} else {
 			hash_show(algo, addr, len, output);
+			if (IS_ENABLED(CONFIG_HASH_BENCH) &&
+			    (flags & HASH_FLAG_BENCH))
+				hash_show_speed(len, us);
 			printf("\n");
 
 			if (argc) {
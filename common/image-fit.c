@@ -20,6 +20,7 @@
 #include <mapmem.h>
 #include <asm/io.h>
 #include <malloc.h>
+#include <parallel.h>
 DECLARE_GLOBAL_DATA_PTR;
 #endif /* !USE_HOSTCC*/
 
@@ -1160,8 +1161,30 @@ int calculate_hash(const void *data, int data_len, const char *algo,
 	return 0;
 }
 
+/* Whether a hash node is in the hashes already checked, for the same data */
+static bool fit_hash_is_checked(const struct fit_checked_hashes *checked,
+				const void *fit, int noffset, const void *data,
+				size_t size)
+{
+	ulong start = map_to_sysmem((void *)data);
+	int i;
+
+	if (!checked || checked->fit != fit)
+		return false;
+	for (i = 0; i < checked->count; i++) {
+		if (checked->node[i].noffset == noffset &&
+		    checked->node[i].start == start &&
+		    checked->node[i].end == start + size)
+			return true;
+	}
+
+	return false;
+}
+
 static int fit_image_check_hash(const void *fit, int noffset, const void *data,
-				size_t size, char **err_msgp)
+				size_t size,
+				const struct fit_checked_hashes *checked,
+				char **err_msgp)
 {
 	uint8_t value[FIT_MAX_HASH_LEN];
 	int value_len;
@@ -1169,6 +1192,7 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 	uint8_t *fit_value;
 	int fit_value_len;
 	int ignore;
+	int ret;
 
 	*err_msgp = NULL;
 
@@ -1192,7 +1216,14 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 		return -1;
 	}
 
-	if (calculate_hash(data, size, algo, value, &value_len)) {
+	if (IMAGE_ENABLE_PARALLEL_HASH &&
+	    fit_hash_is_checked(checked, fit, noffset, data, size))
+		return 0;
+
+	bootstage_start(BOOTSTAGE_ID_ACCUM_FIT_HASH, "fit_hash");
+	ret = calculate_hash(data, size, algo, value, &value_len);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_FIT_HASH);
+	if (ret) {
 		*err_msgp = "Unsupported hash algorithm";
 		return -1;
 	}
@@ -1208,8 +1239,9 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 	return 0;
 }
 
-int fit_image_verify_with_data(const void *fit, int image_noffset,
-			       const void *data, size_t size)
+static int fit_image_verify_data(const void *fit, int image_noffset,
+				 const void *data, size_t size,
+				 const struct fit_checked_hashes *checked)
 {
 	int		noffset = 0;
 	char		*err_msg = "";
@@ -1236,7 +1268,7 @@ int fit_image_verify_with_data(const void *fit, int image_noffset,
 		if (!strncmp(name, FIT_HASH_NODENAME,
 			     strlen(FIT_HASH_NODENAME))) {
 			if (fit_image_check_hash(fit, noffset, data, size,
-						 &err_msg))
+						 checked, &err_msg))
 				goto error;
 			puts("+ ");
 		} else if (IMAGE_ENABLE_VERIFY && verify_all &&
@@ -1272,20 +1304,14 @@ error:
 	return 0;
 }
 
-/**
- * fit_image_verify - verify data integrity
- * @fit: pointer to the FIT format image header
- * @image_noffset: component image node offset
- *
- * fit_image_verify() goes over component image hash nodes,
- * re-calculates each data hash and compares with the value stored in hash
- * node.
- *
- * returns:
- *     1, if all hashes are valid
- *     0, otherwise (or on error)
- */
-int fit_image_verify(const void *fit, int image_noffset)
+int fit_image_verify_with_data(const void *fit, int image_noffset,
+			       const void *data, size_t size)
+{
+	return fit_image_verify_data(fit, image_noffset, data, size, NULL);
+}
+
+static int fit_image_verify_checked(const void *fit, int image_noffset,
+				    const struct fit_checked_hashes *checked)
 {
 	const void	*data;
 	size_t		size;
@@ -1301,7 +1327,25 @@ int fit_image_verify(const void *fit, int image_noffset)
 		return 0;
 	}
 
-	return fit_image_verify_with_data(fit, image_noffset, data, size);
+	return fit_image_verify_data(fit, image_noffset, data, size, checked);
+}
+
+/**
+ * fit_image_verify - verify data integrity
+ * @fit: pointer to the FIT format image header
+ * @image_noffset: component image node offset
+ *
+ * fit_image_verify() goes over component image hash nodes,
+ * re-calculates each data hash and compares with the value stored in hash
+ * node.
+ *
+ * returns:
+ *     1, if all hashes are valid
+ *     0, otherwise (or on error)
+ */
+int fit_image_verify(const void *fit, int image_noffset)
+{
+	return fit_image_verify_checked(fit, image_noffset, NULL);
 }
 
 /**
@@ -1729,13 +1773,204 @@ int fit_conf_get_prop_node(const void *fit, int noffset,
 	return fit_conf_get_prop_node_index(fit, noffset, prop_name, 0);
 }
 
-static int fit_image_select(const void *fit, int rd_noffset, int verify)
+#ifndef USE_HOSTCC
+struct fit_hash_job {
+	int noffset;			/* hash node */
+	const void *data;
+	size_t size;
+	const char *algo;
+	const uint8_t *fit_value;
+	int fit_value_len;
+	bool ok;			/* the hash matched */
+};
+
+/*
+ * calculate_hash() for the secondary CPUs, which must leave the watchdog to
+ * the boot CPU
+ */
+static int fit_hash_calc_nowd(const void *data, size_t size, const char *algo,
+			      uint8_t *value, int *value_len)
 {
+	sha256_context ctx;
+
+	if (IMAGE_ENABLE_CRC32 && !strcmp(algo, "crc32")) {
+		*(uint32_t *)value = cpu_to_uimage(crc32(0, data, size));
+		*value_len = 4;
+	} else if (IMAGE_ENABLE_SHA1 && !strcmp(algo, "sha1")) {
+		sha1_csum(data, size, value);
+		*value_len = 20;
+	} else if (IMAGE_ENABLE_SHA256 && !strcmp(algo, "sha256")) {
+		sha256_starts(&ctx);
+		sha256_update(&ctx, data, size);
+		sha256_finish(&ctx, value);
+		*value_len = SHA256_SUM_LEN;
+	} else if (IMAGE_ENABLE_MD5 && !strcmp(algo, "md5")) {
+		md5((unsigned char *)data, size, value);
+		*value_len = 16;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int fit_hash_job_run(void *arg, int worker, int item)
+{
+	struct fit_hash_job *job = (struct fit_hash_job *)arg + item;
+	uint8_t value[FIT_MAX_HASH_LEN];
+	int value_len, ret;
+
+	if (worker)
+		ret = fit_hash_calc_nowd(job->data, job->size, job->algo,
+					 value, &value_len);
+	else
+		ret = calculate_hash(job->data, job->size, job->algo, value,
+				     &value_len);
+	job->ok = !ret && value_len == job->fit_value_len &&
+		!memcmp(value, job->fit_value, value_len);
+
+	/* A mismatch is reported when the image is loaded */
+	return 0;
+}
+
+/* Add the hashes of an image to check, returning the new number of jobs */
+static int fit_hash_add_jobs(const void *fit, int image_noffset,
+			     struct fit_hash_job *jobs, int count)
+{
+	struct fit_hash_job *job;
+	const void *data;
+	size_t size;
+	int noffset;
+	int ignore;
+
+	if (fit_image_get_data_and_size(fit, image_noffset, &data, &size))
+		return count;
+
+	fdt_for_each_subnode(noffset, fit, image_noffset) {
+		if (count == FIT_CHECKED_HASHES_MAX)
+			break;
+		if (strncmp(fit_get_name(fit, noffset, NULL),
+			    FIT_HASH_NODENAME, strlen(FIT_HASH_NODENAME)))
+			continue;
+		fit_image_hash_get_ignore(fit, noffset, &ignore);
+		if (ignore)
+			continue;
+
+		job = &jobs[count];
+		if (fit_image_hash_get_algo(fit, noffset, (char **)&job->algo) ||
+		    fit_image_hash_get_value(fit, noffset,
+					     (uint8_t **)&job->fit_value,
+					     &job->fit_value_len))
+			continue;
+		job->noffset = noffset;
+		job->data = data;
+		job->size = size;
+		job->ok = false;
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * fit_config_check_hashes() - check the hashes of the images bootm loads
+ *
+ * These are the images of the config which bootm_find_os() and
+ * bootm_find_images() go on to load; firmware and standalone images are
+ * left alone. The hashes are checked in parallel where the CPU allows it.
+ * The ones which match are recorded in @images, so that fit_image_load()
+ * does not hash the images again. Any other problem is left for
+ * fit_image_load() to report.
+ *
+ * @images: bootm state to record the hashes in
+ * @fit: FIT to check
+ * @cfg_noffset: configuration node
+ */
+static void fit_config_check_hashes(bootm_headers_t *images, const void *fit,
+				    int cfg_noffset)
+{
+	static const struct {
+		const char *name;
+		bool all;		/* all images listed, not the first */
+	} props[] = {
+		{ FIT_KERNEL_PROP },
+		{ FIT_RAMDISK_PROP },
+		{ FIT_FDT_PROP, IS_ENABLED(CONFIG_OF_LIBFDT_OVERLAY) },
+		{ FIT_LOADABLE_PROP, true },
+#ifdef CONFIG_FPGA
+		{ FIT_FPGA_PROP },
+#endif
+#ifdef CONFIG_X86
+		{ FIT_SETUP_PROP },
+#endif
+	};
+	struct fit_checked_hashes *checked = &images->fit_hashes;
+	struct fit_hash_job jobs[FIT_CHECKED_HASHES_MAX];
+	int count = 0;
+	int noffset;
+	int i, j;
+
+	if (checked->fit == fit && checked->cfg_noffset == cfg_noffset)
+		return;
+	checked->fit = fit;
+	checked->cfg_noffset = cfg_noffset;
+	checked->count = 0;
+
+	for (i = 0; i < ARRAY_SIZE(props); i++) {
+		for (j = 0; !j || props[i].all; j++) {
+			noffset = fit_conf_get_prop_node_index(fit, cfg_noffset,
+							       props[i].name, j);
+			if (noffset < 0)
+				break;
+			count = fit_hash_add_jobs(fit, noffset, jobs, count);
+		}
+	}
+
+	bootstage_start(BOOTSTAGE_ID_ACCUM_FIT_HASH_PAR, "fit_hash_parallel");
+	parallel_run(fit_hash_job_run, jobs, count);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_FIT_HASH_PAR);
+
+	for (i = 0; i < count; i++) {
+		if (!jobs[i].ok)
+			continue;
+		checked->node[checked->count].noffset = jobs[i].noffset;
+		checked->node[checked->count].start =
+			map_to_sysmem(jobs[i].data);
+		checked->node[checked->count].end =
+			checked->node[checked->count].start + jobs[i].size;
+		checked->count++;
+	}
+	debug("%s: %d of %d hashes checked\n", __func__, checked->count,
+	      count);
+}
+
+/* Forget the hashes checked for any image data which was written over */
+static void fit_forget_hashes(bootm_headers_t *images, ulong start, ulong end)
+{
+	struct fit_checked_hashes *checked = &images->fit_hashes;
+	int i, upto;
+
+	for (i = 0, upto = 0; i < checked->count; i++) {
+		if (checked->node[i].start < end && checked->node[i].end > start)
+			continue;
+		checked->node[upto++] = checked->node[i];
+	}
+	checked->count = upto;
+}
+#endif /* !USE_HOSTCC */
+
+static int fit_image_select(bootm_headers_t *images, const void *fit,
+			    int rd_noffset)
+{
+	const struct fit_checked_hashes *checked = NULL;
+
 	fit_image_print(fit, rd_noffset, "   ");
 
-	if (verify) {
+	if (IMAGE_ENABLE_PARALLEL_HASH)
+		checked = &images->fit_hashes;
+	if (images->verify) {
 		puts("   Verifying Hash Integrity ... ");
-		if (!fit_image_verify(fit, rd_noffset)) {
+		if (!fit_image_verify_checked(fit, rd_noffset, checked)) {
 			puts("Bad Data Hash\n");
 			return -EACCES;
 		}
@@ -1882,6 +2117,11 @@ int fit_image_load(bootm_headers_t *images, ulong addr,
 			puts("OK\n");
 		}
 
+#ifndef USE_HOSTCC
+		if (IMAGE_ENABLE_PARALLEL_HASH && images->verify)
+			fit_config_check_hashes(images, fit, cfg_noffset);
+#endif
+
 		bootstage_mark(BOOTSTAGE_ID_FIT_CONFIG);
 
 		noffset = fit_conf_get_prop_node(fit, cfg_noffset,
@@ -1896,7 +2136,7 @@ int fit_image_load(bootm_headers_t *images, ulong addr,
 
 	printf("   Trying '%s' %s subimage\n", fit_uname, prop_name);
 
-	ret = fit_image_select(fit, noffset, images->verify);
+	ret = fit_image_select(images, fit, noffset);
 	if (ret) {
 		bootstage_error(bootstage_id + BOOTSTAGE_SUB_HASH);
 		return ret;
@@ -2023,6 +2263,11 @@ int fit_image_load(bootm_headers_t *images, ulong addr,
 		memcpy(loadbuf, buf, len);
 	}
 
+#ifndef USE_HOSTCC
+	if (IMAGE_ENABLE_PARALLEL_HASH && load != data)
+		fit_forget_hashes(images, load, load + len);
+#endif
+
 	if (image_type == IH_TYPE_RAMDISK && comp != IH_COMP_NONE)
 		puts("WARNING: 'compression' nodes for ramdisks are deprecated,"
 		     " please fix your .its file!\n");
@@ -11,6 +11,7 @@
 #include <cpu_func.h>
 #include <env.h>
 #include <u-boot/crc.h>
+#include <u-boot/zstd_seek.h>
 #include <watchdog.h>
 
 #ifdef CONFIG_SHOW_BOOT_PROGRESS
@@ -191,6 +192,7 @@ static const table_entry_t uimage_comp[] = {
 	{	IH_COMP_LZMA,	"lzma",		"lzma compressed",	},
 	{	IH_COMP_LZO,	"lzo",		"lzo compressed",	},
 	{	IH_COMP_LZ4,	"lz4",		"lz4 compressed",	},
+	{	IH_COMP_ZSTD,	"zstd",		"zstd compressed",	},
 	{	-1,		"",		"",			},
 };
 
@@ -478,6 +480,16 @@ int image_decomp(int comp, ulong load, ulong image_start, int type,
 		break;
 	}
 #endif /* CONFIG_LZ4 */
+#if defined(CONFIG_ZSTD) && !defined(CONFIG_SPL_BUILD)
+	case IH_COMP_ZSTD: {
+		size_t size;
+
+		ret = zstd_seek_decompress(image_buf, image_len, load_buf,
+					   unc_len, &size);
+		image_len = size;
+		break;
+	}
+#endif /* CONFIG_ZSTD */
 	default:
 		printf("Unimplemented compression type %d\n", comp);
 		return -ENOSYS;
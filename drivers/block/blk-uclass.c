@@ -431,7 +431,9 @@ unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 {
 	struct udevice *dev = block_dev->bdev;
 	const struct blk_ops *ops = blk_get_ops(dev);
+	lbaint_t rastart, racnt;
 	ulong blks_read;
+	char *rabuf;
 
 	if (!ops->read)
 		return -ENOSYS;
@@ -439,6 +441,16 @@ unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 	if (blkcache_read(block_dev->if_type, block_dev->devnum,
 			  start, blkcnt, block_dev->blksz, buffer))
 		return blkcnt;
+	rabuf = blkcache_readahead(block_dev->if_type, block_dev->devnum,
+				   start, blkcnt, block_dev->blksz,
+				   block_dev->lba, &rastart, &racnt);
+	if (rabuf && ops->read(dev, rastart, racnt, rabuf) == racnt) {
+		blkcache_fill(block_dev->if_type, block_dev->devnum,
+			      rastart, racnt, block_dev->blksz, rabuf);
+		memcpy(buffer, rabuf + (start - rastart) * block_dev->blksz,
+		       blkcnt * block_dev->blksz);
+		return blkcnt;
+	}
 	blks_read = ops->read(dev, start, blkcnt, buffer);
 	if (blks_read == blkcnt)
 		blkcache_fill(block_dev->if_type, block_dev->devnum,
@@ -447,6 +459,151 @@ unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 	return blks_read;
 }
 
+/**
+ * struct blk_queue - requests in flight on a block device
+ *
+ * @reqs:	Requests submitted to the driver and not yet completed
+ * @count:	Number of entries in @reqs
+ * @depth:	Maximum value of @count
+ */
+struct blk_queue {
+	struct list_head reqs;
+	int count;
+	int depth;
+};
+
+/* Check whether a write still in flight covers any block of @req */
+static bool blk_write_pending(struct blk_queue *queue, struct blk_req *req)
+{
+	struct blk_req *other;
+
+	list_for_each_entry(other, &queue->reqs, node) {
+		if (other->write && other->start < req->start + req->blkcnt &&
+		    req->start < other->start + other->blkcnt)
+			return true;
+	}
+
+	return false;
+}
+
+void blk_req_done(struct udevice *dev, struct blk_req *req, long result)
+{
+	struct blk_desc *block_dev = dev_get_uclass_platdata(dev);
+	struct blk_queue *queue = dev_get_uclass_priv(dev);
+
+	list_del(&req->node);
+	queue->count--;
+	req->result = result;
+	req->done = true;
+	if (req->write) {
+		/* reads completed since the submit may have cached old data */
+		blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	} else if (result == req->blkcnt && !blk_write_pending(queue, req)) {
+		blkcache_fill(block_dev->if_type, block_dev->devnum,
+			      req->start, req->blkcnt, block_dev->blksz,
+			      req->buffer);
+	}
+}
+
+static int blk_poll(struct udevice *dev)
+{
+	const struct blk_ops *ops = blk_get_ops(dev);
+
+	return ops->poll(dev);
+}
+
+int blk_submit(struct blk_desc *block_dev, struct blk_req *req)
+{
+	struct udevice *dev = block_dev->bdev;
+	const struct blk_ops *ops = blk_get_ops(dev);
+	struct blk_queue *queue = dev_get_uclass_priv(dev);
+	int ret;
+
+	req->done = false;
+	req->result = 0;
+	if (!ops->submit || !ops->poll) {
+		if (req->write)
+			req->result = blk_dwrite(block_dev, req->start,
+						 req->blkcnt, req->buffer);
+		else
+			req->result = blk_dread(block_dev, req->start,
+						req->blkcnt, req->buffer);
+		req->done = true;
+		return 0;
+	}
+
+	if (req->write) {
+		blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	} else if (blkcache_read(block_dev->if_type, block_dev->devnum,
+				 req->start, req->blkcnt, block_dev->blksz,
+				 req->buffer)) {
+		req->result = req->blkcnt;
+		req->done = true;
+		return 0;
+	}
+
+	while (1) {
+		while (queue->count >= queue->depth) {
+			ret = blk_poll(dev);
+			if (ret < 0)
+				return ret;
+		}
+
+		/* the driver may complete the request before returning */
+		list_add_tail(&req->node, &queue->reqs);
+		queue->count++;
+		ret = ops->submit(dev, req);
+		if (!ret)
+			return 0;
+		list_del(&req->node);
+		queue->count--;
+		if (ret != -EBUSY)
+			return ret;
+
+		/* the hardware queue is shallower than ours */
+		if (!queue->count)
+			return ret;
+		ret = blk_poll(dev);
+		if (ret < 0)
+			return ret;
+	}
+}
+
+long blk_wait(struct blk_desc *block_dev, struct blk_req *req)
+{
+	int ret;
+
+	while (!req->done) {
+		ret = blk_poll(block_dev->bdev);
+		if (ret < 0)
+			return ret;
+	}
+
+	return req->result;
+}
+
+int blk_wait_all(struct blk_desc *block_dev)
+{
+	struct udevice *dev = block_dev->bdev;
+	struct blk_queue *queue = dev_get_uclass_priv(dev);
+	int ret;
+
+	while (queue->count) {
+		ret = blk_poll(dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+void blk_set_queue_depth(struct udevice *dev, int depth)
+{
+	struct blk_queue *queue = dev_get_uclass_priv(dev);
+
+	queue->depth = max(depth, 1);
+}
+
 unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt, const void *buffer)
 {
@@ -638,6 +795,25 @@ int blk_unbind_all(int if_type)
 	return 0;
 }
 
+static int blk_pre_remove(struct udevice *dev)
+{
+	struct blk_desc *desc = dev_get_uclass_platdata(dev);
+
+	blkcache_release(desc->if_type, desc->devnum);
+
+	return 0;
+}
+
+static int blk_pre_probe(struct udevice *dev)
+{
+	struct blk_queue *queue = dev_get_uclass_priv(dev);
+
+	INIT_LIST_HEAD(&queue->reqs);
+	queue->depth = CONFIG_BLK_QUEUE_DEPTH;
+
+	return 0;
+}
+
 static int blk_post_probe(struct udevice *dev)
 {
 #if defined(CONFIG_PARTITIONS) && defined(CONFIG_HAVE_BLOCK_DEVICE)
@@ -652,6 +828,9 @@ static int blk_post_probe(struct udevice *dev)
 UCLASS_DRIVER(blk) = {
 	.id		= UCLASS_BLK,
 	.name		= "blk",
+	.pre_probe	= blk_pre_probe,
 	.post_probe	= blk_post_probe,
+	.pre_remove	= blk_pre_remove,
+	.per_device_auto_alloc_size = sizeof(struct blk_queue),
 	.per_device_platdata_auto_alloc_size = sizeof(struct blk_desc),
 };
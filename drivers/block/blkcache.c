@@ -7,166 +7,408 @@
 #include <config.h>
 #include <common.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 #include <linux/ctype.h>
-#include <linux/list.h>
-
-struct block_cache_node {
-	struct list_head lh;
-	int iftype;
-	int devnum;
-	lbaint_t start;
-	lbaint_t blkcnt;
+#include <linux/log2.h>
+#include <linux/sizes.h>
+
+/*
+ * The cache is a preallocated arena of fixed-size lines, organised as a
+ * set-associative cache. A line holds the naturally aligned run of blocks
+ * that fits in BLKCACHE_LINE_SIZE bytes, with a mask of the blocks that are
+ * valid, so that reads of any size up to the limit can be cached without
+ * allocating. A line is found by hashing the device and the line number to
+ * a set, and replaced least-recently-used within its set.
+ */
+#define BLKCACHE_LINE_SIZE	4096
+#define BLKCACHE_MAX_LINE_BLKS	32	/* bits in blkcache_line.valid */
+#define BLKCACHE_STAGE_EXTRA	SZ_64K
+
+struct blkcache_line {
+	lbaint_t start;		/* first block of the line */
+	u32 valid;		/* blocks holding data, 0 if the line is free */
+	u32 stamp;		/* last use, for LRU replacement */
+	int dev;		/* index in blkcache_devs */
+};
+
+struct blkcache_dev {
 	unsigned long blksz;
-	char *cache;
+	lbaint_t next;		/* block following the last read */
+	struct block_cache_dev_stats stats;
 };
 
-static LIST_HEAD(block_cache);
+static struct blkcache_dev blkcache_devs[BLOCK_CACHE_MAX_DEVS];
+static struct blkcache_line *blkcache_lines;
+static char *blkcache_arena;
+static char *blkcache_stage;
+static unsigned int blkcache_set_bits;
+static u32 blkcache_clock;
+static bool blkcache_failed;
 
 static struct block_cache_stats _stats = {
-	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.max_blocks_per_entry = 32,
+	.max_entries = CONFIG_BLOCK_CACHE_SIZE_KB * SZ_1K / BLKCACHE_LINE_SIZE,
+	.ways = CONFIG_BLOCK_CACHE_WAYS,
+	.line_size = BLKCACHE_LINE_SIZE,
+	.readahead = CONFIG_BLOCK_CACHE_READAHEAD * SZ_1K,
 };
 
-static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
-{
-	struct block_cache_node *node;
-
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
-			}
-			return node;
+static void blkcache_free(void)
+{
+	free(blkcache_lines);
+	free(blkcache_arena);
+	free(blkcache_stage);
+	blkcache_lines = NULL;
+	blkcache_arena = NULL;
+	blkcache_stage = NULL;
+	blkcache_failed = false;
+	_stats.entries = 0;
+}
+
+/* Allocate the arena on first use, so boards that never read pay nothing */
+static bool blkcache_ready(void)
+{
+	unsigned int ways = _stats.ways;
+	unsigned long sets;
+
+	if (blkcache_lines)
+		return true;
+	if (blkcache_failed || !_stats.max_entries || !ways)
+		return false;
+
+	if (ways > _stats.max_entries)
+		ways = _stats.max_entries;
+	sets = rounddown_pow_of_two(_stats.max_entries / ways);
+	blkcache_set_bits = ilog2(sets);
+	_stats.ways = ways;
+	_stats.max_entries = sets * ways;
+
+	blkcache_lines = calloc(_stats.max_entries, sizeof(*blkcache_lines));
+	blkcache_arena = malloc(_stats.max_entries * BLKCACHE_LINE_SIZE);
+	blkcache_stage = malloc_cache_aligned(_stats.readahead +
+					      BLKCACHE_STAGE_EXTRA);
+	if (!blkcache_lines || !blkcache_arena || !blkcache_stage) {
+		debug("blkcache: cannot allocate %u lines\n",
+		      _stats.max_entries);
+		blkcache_free();
+		blkcache_failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+static int blkcache_get_dev(int iftype, int devnum, unsigned long blksz)
+{
+	struct blkcache_dev *d;
+	int i, slot = -1;
+
+	for (i = 0; i < BLOCK_CACHE_MAX_DEVS; i++) {
+		d = &blkcache_devs[i];
+		if (!d->blksz) {
+			if (slot < 0)
+				slot = i;
+			continue;
 		}
-	return 0;
+		if (d->stats.iftype == iftype && d->stats.devnum == devnum)
+			break;
+	}
+	if (i == BLOCK_CACHE_MAX_DEVS) {
+		if (slot < 0)
+			return -ENOSPC;
+		i = slot;
+		d = &blkcache_devs[i];
+		memset(d, 0, sizeof(*d));
+		d->stats.iftype = iftype;
+		d->stats.devnum = devnum;
+		d->blksz = blksz;
+		if (i >= _stats.ndevs)
+			_stats.ndevs = i + 1;
+	}
+
+	if (d->blksz != blksz) {
+		blkcache_invalidate(iftype, devnum);
+		d->blksz = blksz;
+	}
+
+	return i;
+}
+
+/* Number of blocks per line as a shift, or -1 if the size is not cacheable */
+static int blkcache_line_shift(unsigned long blksz)
+{
+	if (!is_power_of_2(blksz) || blksz > BLKCACHE_LINE_SIZE ||
+	    BLKCACHE_LINE_SIZE / blksz > BLKCACHE_MAX_LINE_BLKS)
+		return -1;
+
+	return ilog2(BLKCACHE_LINE_SIZE / blksz);
+}
+
+static struct blkcache_line *blkcache_set(int dev, lbaint_t start, int shift)
+{
+	u64 line = (u64)start >> shift;
+	u32 hash;
+
+	hash = ((u32)line ^ (u32)(line >> 32) ^ ((u32)dev << 24)) * 0x9e3779b1;
+	if (!blkcache_set_bits)
+		return blkcache_lines;
+
+	return &blkcache_lines[(hash >> (32 - blkcache_set_bits)) *
+			       _stats.ways];
+}
+
+static struct blkcache_line *blkcache_lookup(int dev, lbaint_t start,
+					     int shift, bool alloc)
+{
+	struct blkcache_line *set = blkcache_set(dev, start, shift);
+	struct blkcache_line *line, *victim = set;
+	unsigned int i;
+
+	for (i = 0; i < _stats.ways; i++) {
+		line = &set[i];
+		if (line->valid && line->dev == dev && line->start == start)
+			return line;
+		if (victim->valid && (!line->valid ||
+				      (s32)(line->stamp - victim->stamp) < 0))
+			victim = line;
+	}
+	if (!alloc)
+		return NULL;
+
+	if (victim->valid)
+		debug("drop: start " LBAF "\n", victim->start);
+	else
+		_stats.entries++;
+	victim->start = start;
+	victim->dev = dev;
+	victim->valid = 0;
+
+	return victim;
+}
+
+static char *blkcache_data(struct blkcache_line *line)
+{
+	return blkcache_arena + (line - blkcache_lines) * BLKCACHE_LINE_SIZE;
 }
 
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
-		debug("hit: start " LBAF ", count " LBAFU "\n",
-		      start, blkcnt);
-		++_stats.hits;
-		return 1;
+	struct blkcache_dev *d = NULL;
+	struct blkcache_line *line;
+	lbaint_t blk, count, end = start + blkcnt;
+	int dev, shift, per, first;
+	u32 mask;
+
+	shift = blkcache_line_shift(blksz);
+	if (!blkcache_ready() || shift < 0)
+		goto miss;
+	dev = blkcache_get_dev(iftype, devnum, blksz);
+	if (dev < 0)
+		goto miss;
+	d = &blkcache_devs[dev];
+	if (blkcnt > _stats.max_blocks_per_entry)
+		goto miss;
+
+	per = 1 << shift;
+	for (blk = start; blk < end; blk += count) {
+		first = blk & (per - 1);
+		count = min_t(lbaint_t, per - first, end - blk);
+
+		line = blkcache_lookup(dev, blk - first, shift, false);
+		mask = GENMASK(first + count - 1, first);
+		if (!line || (line->valid & mask) != mask)
+			goto miss;
+		memcpy(buffer, blkcache_data(line) + first * blksz,
+		       count * blksz);
+		line->stamp = ++blkcache_clock;
+		buffer += count * blksz;
 	}
 
+	debug("hit: start " LBAF ", count " LBAFU "\n",
+	      start, blkcnt);
+	++_stats.hits;
+	d->stats.hits++;
+	d->stats.bytes += blkcnt * blksz;
+	d->next = end;
+	return 1;
+
+miss:
 	debug("miss: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 	++_stats.misses;
+	if (d)
+		d->stats.misses++;
 	return 0;
 }
 
+void *blkcache_readahead(int iftype, int devnum,
+			 lbaint_t start, lbaint_t blkcnt,
+			 unsigned long blksz, lbaint_t lba,
+			 lbaint_t *rastart, lbaint_t *racnt)
+{
+	struct blkcache_dev *d;
+	lbaint_t first, end;
+	bool sequential;
+	int dev, shift, per;
+
+	shift = blkcache_line_shift(blksz);
+	if (!blkcache_ready() || shift < 0)
+		return NULL;
+	dev = blkcache_get_dev(iftype, devnum, blksz);
+	if (dev < 0)
+		return NULL;
+	d = &blkcache_devs[dev];
+	sequential = start == d->next;
+	d->next = start + blkcnt;
+	if (blkcnt > _stats.max_blocks_per_entry || !lba)
+		return NULL;
+
+	/* Read whole lines, and keep going if the reads are sequential */
+	per = 1 << shift;
+	first = start & ~(lbaint_t)(per - 1);
+	end = start + blkcnt;
+	if (sequential)
+		end += _stats.readahead / blksz;
+	end = (end + per - 1) & ~(lbaint_t)(per - 1);
+	if (end > lba)
+		end = lba;
+	if (end - first > (_stats.readahead + BLKCACHE_STAGE_EXTRA) / blksz)
+		end = first + (_stats.readahead + BLKCACHE_STAGE_EXTRA) / blksz;
+	if (end < start + blkcnt || (first == start && end == start + blkcnt))
+		return NULL;
+
+	debug("readahead: start " LBAF ", count " LBAFU "\n",
+	      first, end - first);
+	d->stats.readahead += end - first - blkcnt;
+	*rastart = first;
+	*racnt = end - first;
+
+	return blkcache_stage;
+}
+
 void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
-	struct block_cache_node *node;
+	struct blkcache_line *line;
+	lbaint_t blk, count, end = start + blkcnt;
+	int dev, shift, per, first;
 
-	/* don't cache big stuff */
-	if (blkcnt > _stats.max_blocks_per_entry)
+	/* don't cache big stuff, unless it was read ahead for the cache */
+	if (blkcnt > _stats.max_blocks_per_entry && buffer != blkcache_stage)
 		return;
 
-	if (_stats.max_entries == 0)
+	shift = blkcache_line_shift(blksz);
+	if (!blkcache_ready() || shift < 0)
+		return;
+	dev = blkcache_get_dev(iftype, devnum, blksz);
+	if (dev < 0)
 		return;
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
-			return;
-		node->cache = 0;
-	}
+	debug("fill: start " LBAF ", count " LBAFU "\n",
+	      start, blkcnt);
 
-	if (!node->cache) {
-		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
-			return;
-		}
+	per = 1 << shift;
+	for (blk = start; blk < end; blk += count) {
+		first = blk & (per - 1);
+		count = min_t(lbaint_t, per - first, end - blk);
+
+		line = blkcache_lookup(dev, blk - first, shift, true);
+		memcpy(blkcache_data(line) + first * blksz, buffer,
+		       count * blksz);
+		line->valid |= GENMASK(first + count - 1, first);
+		line->stamp = ++blkcache_clock;
+		buffer += count * blksz;
 	}
+}
 
-	debug("fill: start " LBAF ", count " LBAFU "\n",
-	      start, blkcnt);
+static int blkcache_find_dev(int iftype, int devnum)
+{
+	int dev;
+
+	for (dev = 0; dev < BLOCK_CACHE_MAX_DEVS; dev++) {
+		if (blkcache_devs[dev].blksz &&
+		    blkcache_devs[dev].stats.iftype == iftype &&
+		    blkcache_devs[dev].stats.devnum == devnum)
+			return dev;
+	}
 
-	node->iftype = iftype;
-	node->devnum = devnum;
-	node->start = start;
-	node->blkcnt = blkcnt;
-	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+	return -ENOENT;
 }
 
-void blkcache_invalidate(int iftype, int devnum)
+static void blkcache_drop_lines(int dev)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
+	struct blkcache_line *line;
+
+	if (!blkcache_lines)
+		return;
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
+	for (line = blkcache_lines;
+	     line < blkcache_lines + _stats.max_entries; line++) {
+		if (line->valid && line->dev == dev) {
+			line->valid = 0;
 			--_stats.entries;
 		}
 	}
 }
 
+void blkcache_invalidate(int iftype, int devnum)
+{
+	int dev = blkcache_find_dev(iftype, devnum);
+
+	if (dev >= 0)
+		blkcache_drop_lines(dev);
+}
+
+void blkcache_release(int iftype, int devnum)
+{
+	int dev = blkcache_find_dev(iftype, devnum);
+
+	if (dev < 0)
+		return;
+
+	blkcache_drop_lines(dev);
+	memset(&blkcache_devs[dev], 0, sizeof(blkcache_devs[dev]));
+	while (_stats.ndevs && !blkcache_devs[_stats.ndevs - 1].blksz)
+		_stats.ndevs--;
+}
+
 void blkcache_configure(unsigned blocks, unsigned entries)
 {
-	struct block_cache_node *node;
-	if ((blocks != _stats.max_blocks_per_entry) ||
-	    (entries != _stats.max_entries)) {
-		/* invalidate cache */
-		while (!list_empty(&block_cache)) {
-			node = (struct block_cache_node *)block_cache.next;
-			list_del(&node->lh);
-			free(node->cache);
-			free(node);
-		}
-		_stats.entries = 0;
-	}
+	if (entries != _stats.max_entries)
+		blkcache_free();
 
 	_stats.max_blocks_per_entry = blocks;
 	_stats.max_entries = entries;
+	_stats.ways = CONFIG_BLOCK_CACHE_WAYS;
 
 	_stats.hits = 0;
 	_stats.misses = 0;
 }
 
+void blkcache_configure_size(unsigned size_kb)
+{
+	blkcache_configure(_stats.max_blocks_per_entry,
+			   size_kb * SZ_1K / BLKCACHE_LINE_SIZE);
+}
+
 void blkcache_stats(struct block_cache_stats *stats)
 {
+	int i;
+
+	for (i = 0; i < _stats.ndevs; i++)
+		_stats.devs[i] = blkcache_devs[i].stats;
 	memcpy(stats, &_stats, sizeof(*stats));
+
 	_stats.hits = 0;
 	_stats.misses = 0;
+	for (i = 0; i < _stats.ndevs; i++) {
+		blkcache_devs[i].stats.hits = 0;
+		blkcache_devs[i].stats.misses = 0;
+		blkcache_devs[i].stats.bytes = 0;
+		blkcache_devs[i].stats.readahead = 0;
+	}
 }
@@ -218,9 +218,48 @@ int host_get_dev_err(int devnum, struct blk_desc **blk_devp)
 }
 
 #ifdef CONFIG_BLK
+static int host_block_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct host_block_dev *host_dev = dev_get_platdata(dev);
+
+	if (host_dev->queued == HOST_BLK_QUEUE_DEPTH)
+		return -EBUSY;
+	host_dev->queue[host_dev->queued++] = req;
+
+	return 0;
+}
+
+/*
+ * Complete everything queued, newest first, so that callers cannot come to
+ * rely on requests completing in the order they were submitted.
+ */
+static int host_block_poll(struct udevice *dev)
+{
+	struct host_block_dev *host_dev = dev_get_platdata(dev);
+	struct blk_req *req;
+	unsigned long blks;
+	int count = 0;
+
+	while (host_dev->queued) {
+		req = host_dev->queue[--host_dev->queued];
+		if (req->write)
+			blks = host_block_write(dev, req->start, req->blkcnt,
+						req->buffer);
+		else
+			blks = host_block_read(dev, req->start, req->blkcnt,
+					       req->buffer);
+		blk_req_done(dev, req, blks == req->blkcnt ? blks : -EIO);
+		count++;
+	}
+
+	return count;
+}
+
 static const struct blk_ops sandbox_host_blk_ops = {
 	.read	= host_block_read,
 	.write	= host_block_write,
+	.submit	= host_block_submit,
+	.poll	= host_block_poll,
 };
 
 U_BOOT_DRIVER(sandbox_host_blk) = {
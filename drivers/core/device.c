@@ -311,9 +311,65 @@ static void *alloc_priv(int size, uint flags)
 	return priv;
 }
 
-int device_probe(struct udevice *dev)
+#if CONFIG_IS_ENABLED(DM_PROBE_TIME)
+/* Get the time for measuring a probe, or 0 if the timer is not ready */
+static ulong device_probe_now(void)
+{
+#if CONFIG_IS_ENABLED(TIMER) && !defined(CONFIG_TIMER_EARLY)
+	/* Reading the timer would probe it */
+	if (!gd->timer)
+		return 0;
+#endif
+	return timer_get_us();
+}
+
+static void device_probe_time(struct udevice *dev, ulong start, bool resumed)
+{
+	if (!resumed)
+		dev->probe_time = 0;
+	if (start)
+		dev->probe_time += device_probe_now() - start;
+}
+#else
+static inline ulong device_probe_now(void)
+{
+	return 0;
+}
+
+static inline void device_probe_time(struct udevice *dev, ulong start,
+				     bool resumed)
+{
+}
+#endif
+
+int device_probe_wait(struct udevice *dev, ulong us)
+{
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+	dev->probe_wait = timer_get_us() + us;
+#else
+	udelay(us);
+#endif
+	dev->flags |= DM_FLAG_PROBE_WAIT;
+
+	return -EINPROGRESS;
+}
+
+/* Wait for whatever is left of the time a probe method asked for */
+static void device_probe_wait_done(struct udevice *dev)
+{
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+	long left = dev->probe_wait - timer_get_us();
+
+	if (left > 0)
+		udelay(left);
+#endif
+}
+
+int device_probe_step(struct udevice *dev)
 {
 	const struct driver *drv;
+	bool resumed = false;
+	ulong start;
 	int size = 0;
 	int ret;
 	int seq;
@@ -327,6 +383,15 @@ int device_probe(struct udevice *dev)
 	drv = dev->driver;
 	assert(drv);
 
+	if (dev->flags & DM_FLAG_PROBE_WAIT) {
+		start = device_probe_now();
+		resumed = true;
+		dev->flags &= ~DM_FLAG_PROBE_WAIT;
+		dev->flags |= DM_FLAG_ACTIVATED;
+		device_probe_wait_done(dev);
+		goto probe;
+	}
+
 	/* Allocate private data if requested and not reentered */
 	if (drv->priv_auto_alloc_size && !dev->priv) {
 		dev->priv = alloc_priv(drv->priv_auto_alloc_size, drv->flags);
@@ -375,12 +440,13 @@ int device_probe(struct udevice *dev)
 			return 0;
 	}
 
+	start = device_probe_now();
 	seq = uclass_resolve_seq(dev);
 	if (seq < 0) {
 		ret = seq;
 		goto fail;
 	}
-	dev->seq = seq;
+	uclass_set_seq(dev, seq);
 
 	dev->flags |= DM_FLAG_ACTIVATED;
 
@@ -429,8 +495,14 @@ int device_probe(struct udevice *dev)
 			goto fail;
 	}
 
+probe:
 	if (drv->probe) {
 		ret = drv->probe(dev);
+		if (ret == -EINPROGRESS && (dev->flags & DM_FLAG_PROBE_WAIT)) {
+			dev->flags &= ~DM_FLAG_ACTIVATED;
+			device_probe_time(dev, start, resumed);
+			return ret;
+		}
 		if (ret) {
 			dev->flags &= ~DM_FLAG_ACTIVATED;
 			goto fail;
@@ -443,6 +515,7 @@ int device_probe(struct udevice *dev)
 
 	if (dev->parent && device_get_uclass_id(dev) == UCLASS_PINCTRL)
 		pinctrl_select_state(dev, "default");
+	device_probe_time(dev, start, resumed);
 
 	return 0;
 fail_uclass:
@@ -451,14 +524,25 @@ fail_uclass:
 			__func__, dev->name);
 	}
 fail:
-	dev->flags &= ~DM_FLAG_ACTIVATED;
+	dev->flags &= ~(DM_FLAG_ACTIVATED | DM_FLAG_PROBE_WAIT);
 
-	dev->seq = -1;
+	uclass_set_seq(dev, -1);
 	device_free(dev);
 
 	return ret;
 }
 
+int device_probe(struct udevice *dev)
+{
+	int ret;
+
+	do {
+		ret = device_probe_step(dev);
+	} while (ret == -EINPROGRESS && (dev->flags & DM_FLAG_PROBE_WAIT));
+
+	return ret;
+}
+
 void *dev_get_platdata(const struct udevice *dev)
 {
 	if (!dev) {
@@ -838,6 +922,13 @@ int device_set_name(struct udevice *dev, const char *name)
 	return 0;
 }
 
+void dev_set_ofnode(struct udevice *dev, ofnode node)
+{
+	uclass_index_remove(dev);
+	dev->node = node;
+	uclass_index_add(dev);
+}
+
 #if CONFIG_IS_ENABLED(OF_CONTROL) && !CONFIG_IS_ENABLED(OF_PLATDATA)
 bool device_is_compatible(struct udevice *dev, const char *compat)
 {
@@ -10,6 +10,7 @@
 
 #include <common.h>
 #include <errno.h>
+#include <malloc.h>
 #include <dm/device.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
@@ -18,6 +19,10 @@
 #include <dm/util.h>
 #include <fdtdec.h>
 #include <linux/compiler.h>
+#include <linux/err.h>
+#include <linux/log2.h>
+
+DECLARE_GLOBAL_DATA_PTR;
 
 struct driver *lists_driver_lookup_name(const char *name)
 {
@@ -124,11 +129,142 @@ static int driver_check_compatible(const struct udevice_id *of_match,
 	return -ENOENT;
 }
 
-int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
-		   bool pre_reloc_only)
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+/**
+ * struct dm_compat_index - drivers indexed by compatible string
+ *
+ * This is a hash table with linear probing, holding each compatible string
+ * of each driver once, for the first driver in the linker list which has
+ * it. Drivers are recorded by their position in the linker list, which
+ * keeps the table small.
+ *
+ * @driver: start of the driver linker list
+ * @mask: number of slots - 1, the number of slots being a power of two
+ * @slot: driver (index + 1, or 0 if the slot is empty) and its of_match
+ *	entry for the compatible string
+ */
+struct dm_compat_index {
+	struct driver *driver;
+	uint mask;
+	struct {
+		u16 drv;
+		u16 id;
+	} slot[];
+};
+
+/* Get the driver and of_match entry in a slot which is not empty */
+static const struct udevice_id *compat_index_get(struct dm_compat_index *idx,
+						 uint i, struct driver **drvp)
+{
+	struct driver *drv = idx->driver + idx->slot[i].drv - 1;
+
+	*drvp = drv;
+
+	return drv->of_match + idx->slot[i].id;
+}
+
+/* FNV-1a */
+static uint compat_hash(const char *str)
+{
+	uint hash = 2166136261U;
+
+	while (*str)
+		hash = (hash ^ (u8)*str++) * 16777619;
+
+	return hash;
+}
+
+static struct dm_compat_index *compat_index_build(void)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *id;
+	struct dm_compat_index *idx;
+	struct driver *entry, *drv;
+	uint count = 0, size, i;
+
+	if (n_ents >= U16_MAX)
+		return ERR_PTR(-E2BIG);
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (id = entry->of_match; id && id->compatible; id++)
+			count++;
+		if (entry->of_match && id - entry->of_match > U16_MAX)
+			return ERR_PTR(-E2BIG);
+	}
+
+	/* Keep the table at most two thirds full */
+	size = roundup_pow_of_two(count + count / 2 + 1);
+	idx = calloc(1, sizeof(*idx) + size * sizeof(idx->slot[0]));
+	if (!idx)
+		return ERR_PTR(-ENOMEM);
+	idx->driver = driver;
+	idx->mask = size - 1;
+
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (id = entry->of_match; id && id->compatible; id++) {
+			for (i = compat_hash(id->compatible) & idx->mask;
+			     idx->slot[i].drv; i = (i + 1) & idx->mask) {
+				if (!strcmp(compat_index_get(idx, i, &drv)->compatible,
+					    id->compatible))
+					break;
+			}
+			if (idx->slot[i].drv)
+				continue;
+			idx->slot[i].drv = entry - driver + 1;
+			idx->slot[i].id = id - entry->of_match;
+		}
+	}
+	log_debug("%u compatible strings in %u slots\n", count, size);
+
+	return idx;
+}
+
+static struct driver *compat_index_lookup(struct dm_compat_index *idx,
+					  const char *compat,
+					  const struct udevice_id **of_idp)
+{
+	const struct udevice_id *id;
+	struct driver *drv;
+	uint i;
+
+	for (i = compat_hash(compat) & idx->mask; idx->slot[i].drv;
+	     i = (i + 1) & idx->mask) {
+		id = compat_index_get(idx, i, &drv);
+		if (!strcmp(id->compatible, compat)) {
+			*of_idp = id;
+			return drv;
+		}
+	}
+
+	return NULL;
+}
+#endif
+
+struct driver *lists_driver_lookup_compat(const char *compat,
+					  const struct udevice_id **of_idp)
 {
 	struct driver *driver = ll_entry_start(struct driver, driver);
 	const int n_ents = ll_entry_count(struct driver, driver);
+	struct driver *entry;
+
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	/* An error is kept, so that the index is not tried again */
+	if (!gd->dm_compat_index)
+		gd->dm_compat_index = compat_index_build();
+	if (!IS_ERR(gd->dm_compat_index))
+		return compat_index_lookup(gd->dm_compat_index, compat, of_idp);
+#endif
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		if (!driver_check_compatible(entry->of_match, of_idp, compat))
+			return entry;
+	}
+
+	return NULL;
+}
+
+int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
+		   bool pre_reloc_only)
+{
 	const struct udevice_id *id;
 	struct driver *entry;
 	struct udevice *dev;
@@ -165,14 +301,11 @@ int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 		log_debug("   - attempt to match compatible string '%s'\n",
 			  compat);
 
-		for (entry = driver; entry != driver + n_ents; entry++) {
-			ret = driver_check_compatible(entry->of_match, &id,
-						      compat);
-			if (!ret)
-				break;
-		}
-		if (entry == driver + n_ents)
+		entry = lists_driver_lookup_compat(compat, &id);
+		if (!entry) {
+			ret = -ENOENT;
 			continue;
+		}
 
 		if (pre_reloc_only) {
 			if (!dm_ofnode_pre_reloc(node) &&
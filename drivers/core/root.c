@@ -7,6 +7,7 @@
  */
 
 #include <common.h>
+#include <bootstage.h>
 #include <errno.h>
 #include <fdtdec.h>
 #include <malloc.h>
@@ -19,9 +20,11 @@
 #include <dm/platdata.h>
 #include <dm/read.h>
 #include <dm/root.h>
+#include <dm/snapshot.h>
 #include <dm/uclass.h>
 #include <dm/util.h>
 #include <linux/list.h>
+#include <u-boot/crc.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -151,10 +154,10 @@ int dm_init(bool of_live)
 #if CONFIG_IS_ENABLED(OF_CONTROL)
 # if CONFIG_IS_ENABLED(OF_LIVE)
 	if (of_live)
-		DM_ROOT_NON_CONST->node = np_to_ofnode(gd->of_root);
+		dev_set_ofnode(DM_ROOT_NON_CONST, np_to_ofnode(gd->of_root));
 	else
 #endif
-		DM_ROOT_NON_CONST->node = offset_to_ofnode(0);
+		dev_set_ofnode(DM_ROOT_NON_CONST, offset_to_ofnode(0));
 #endif
 	ret = device_probe(DM_ROOT_NON_CONST);
 	if (ret)
@@ -223,6 +226,80 @@ static int dm_scan_fdt_live(struct udevice *parent,
 }
 #endif /* CONFIG_IS_ENABLED(OF_LIVE) */
 
+#if CONFIG_IS_ENABLED(DM_SNAPSHOT)
+const struct dm_snapshot *dm_snapshot_check(const struct dm_snapshot *snap,
+					    const void *blob)
+{
+	if (fdt_totalsize(blob) != snap->fdt_size ||
+	    crc32(0, blob, snap->fdt_size) != snap->fdt_crc32)
+		return NULL;
+
+	return snap;
+}
+
+int dm_snapshot_get_children(const struct dm_snapshot *snap, int offset,
+			     const s32 **childrenp)
+{
+	const struct dm_snapshot_node *node;
+	int lo = 0, hi = snap->node_count;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		node = &snap->nodes[mid];
+		if (node->offset == offset) {
+			*childrenp = snap->children + node->first;
+			return node->count;
+		}
+		if (node->offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return 0;
+}
+
+/**
+ * dm_scan_snapshot() - Bind drivers for the children of a node in a snapshot
+ *
+ * This binds the same devices as dm_scan_fdt_node(), without walking the
+ * device tree.
+ *
+ * @parent: Parent device for the devices that will be created
+ * @snap: Snapshot of the device tree
+ * @offset: Offset of node to scan
+ * @pre_reloc_only: If true, bind only drivers with the DM_FLAG_PRE_RELOC
+ * flag. If false bind all drivers.
+ * @return 0 if OK, -ve on error
+ */
+static int dm_scan_snapshot(struct udevice *parent,
+			    const struct dm_snapshot *snap, int offset,
+			    bool pre_reloc_only)
+{
+	const s32 *children;
+	int ret = 0, err;
+	int count, i;
+
+	count = dm_snapshot_get_children(snap, offset, &children);
+	for (i = 0; i < count; i++) {
+		err = lists_bind_fdt(parent, offset_to_ofnode(children[i]),
+				     NULL, pre_reloc_only);
+		if (err && !ret) {
+			ret = err;
+			debug("%s: ret=%d\n", fdt_get_name(gd->fdt_blob,
+							   children[i], NULL),
+			      ret);
+		}
+	}
+
+	if (ret)
+		dm_warn("Some drivers failed to bind\n");
+
+	return ret;
+}
+#endif
+
 #if CONFIG_IS_ENABLED(OF_CONTROL) && !CONFIG_IS_ENABLED(OF_PLATDATA)
 /**
  * dm_scan_fdt_node() - Scan the device tree and bind drivers for a node
@@ -242,6 +319,11 @@ static int dm_scan_fdt_node(struct udevice *parent, const void *blob,
 {
 	int ret = 0, err;
 
+#if CONFIG_IS_ENABLED(DM_SNAPSHOT)
+	if (gd->dm_snapshot && blob == gd->fdt_blob)
+		return dm_scan_snapshot(parent, gd->dm_snapshot, offset,
+					pre_reloc_only);
+#endif
 	for (offset = fdt_first_subnode(blob, offset);
 	     offset > 0;
 	     offset = fdt_next_subnode(blob, offset)) {
@@ -358,7 +440,18 @@ int dm_init_and_scan(bool pre_reloc_only)
 	}
 
 	if (CONFIG_IS_ENABLED(OF_CONTROL) && !CONFIG_IS_ENABLED(OF_PLATDATA)) {
+		enum bootstage_id id = gd->flags & GD_FLG_RELOC ?
+			BOOTSTAGE_ID_ACCUM_DM_BIND_R :
+			BOOTSTAGE_ID_ACCUM_DM_BIND_F;
+
+		bootstage_start(id, id == BOOTSTAGE_ID_ACCUM_DM_BIND_R ?
+				"dm_bind_r" : "dm_bind_f");
+#if CONFIG_IS_ENABLED(DM_SNAPSHOT)
+		gd->dm_snapshot = of_live_active() ? NULL :
+			dm_snapshot_check(&dm_snapshot, gd->fdt_blob);
+#endif
 		ret = dm_extended_scan_fdt(gd->fdt_blob, pre_reloc_only);
+		bootstage_accum(id);
 		if (ret) {
 			debug("dm_extended_scan_dt() failed: %d\n", ret);
 			return ret;
@@ -18,6 +18,7 @@
 #include <dm/uclass.h>
 #include <dm/uclass-internal.h>
 #include <dm/util.h>
+#include <linux/log2.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -103,6 +104,262 @@ fail_mem:
 	return ret;
 }
 
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+/* Sequence numbers from here on are not in the index, to keep it small */
+#define UCLASS_SEQ_INDEX_MAX	256
+
+/* Slots of a uclass_hash which do not hold a single device */
+#define UCLASS_HASH_GONE	((struct udevice *)1)	/* device removed */
+#define UCLASS_HASH_DUP		((struct udevice *)2)	/* several devices */
+
+/* Get the key of a device in a hash table, returning false if it has none */
+typedef bool (*uclass_key_t)(struct udevice *dev, ulong *keyp);
+
+static bool uclass_node_key(struct udevice *dev, ulong *keyp)
+{
+	if (!dev_has_of_node(dev))
+		return false;
+	*keyp = dev_ofnode(dev).of_offset;
+
+	return true;
+}
+
+static bool uclass_phandle_key(struct udevice *dev, ulong *keyp)
+{
+#if CONFIG_IS_ENABLED(OF_CONTROL) && !CONFIG_IS_ENABLED(OF_PLATDATA)
+	if (dev_has_of_node(dev)) {
+		*keyp = (uint)dev_read_phandle(dev);
+		return *keyp != 0;
+	}
+#endif
+
+	return false;
+}
+
+static uint uclass_hash_first(struct uclass_hash *hash, ulong key)
+{
+	return ((u64)key * 0x9e3779b97f4a7c15ULL) >> 40 & hash->mask;
+}
+
+static void uclass_hash_insert(struct uclass_hash *hash, ulong key,
+			       struct udevice *dev)
+{
+	struct uclass_hash_slot *slot, *gone = NULL;
+	uint i;
+
+	for (i = uclass_hash_first(hash, key); hash->slot[i].dev;
+	     i = (i + 1) & hash->mask) {
+		slot = &hash->slot[i];
+		if (slot->dev == UCLASS_HASH_GONE) {
+			if (!gone)
+				gone = slot;
+		} else if (slot->key == key) {
+			/* Which device comes first is up to the list */
+			slot->dev = UCLASS_HASH_DUP;
+			return;
+		}
+	}
+	if (!gone) {
+		gone = &hash->slot[i];
+		hash->used++;
+	}
+	gone->key = key;
+	gone->dev = dev;
+}
+
+static int uclass_hash_build(struct uclass *uc, struct uclass_hash *hash,
+			     uclass_key_t get_key)
+{
+	struct udevice *dev;
+	uint count = 0;
+	ulong key;
+
+	uclass_foreach_dev(dev, uc)
+		count++;
+	free(hash->slot);
+	hash->mask = max(8UL, roundup_pow_of_two(count * 2 + 1)) - 1;
+	hash->used = 0;
+	hash->slot = calloc(hash->mask + 1, sizeof(*hash->slot));
+	if (!hash->slot) {
+		hash->mask = 0;
+		return -ENOMEM;
+	}
+	uclass_foreach_dev(dev, uc) {
+		if (get_key(dev, &key))
+			uclass_hash_insert(hash, key, dev);
+	}
+
+	return 0;
+}
+
+static void uclass_hash_add(struct uclass *uc, struct uclass_hash *hash,
+			    uclass_key_t get_key, struct udevice *dev)
+{
+	ulong key;
+
+	if (!hash->mask)
+		return;
+	/* Keep the table at most two thirds full; dev is in the list */
+	if ((hash->used + 1) * 3 > (hash->mask + 1) * 2)
+		uclass_hash_build(uc, hash, get_key);
+	else if (get_key(dev, &key))
+		uclass_hash_insert(hash, key, dev);
+}
+
+static void uclass_hash_remove(struct uclass_hash *hash, uclass_key_t get_key,
+			       struct udevice *dev)
+{
+	ulong key;
+	uint i;
+
+	if (!hash->mask || !get_key(dev, &key))
+		return;
+	for (i = uclass_hash_first(hash, key); hash->slot[i].dev;
+	     i = (i + 1) & hash->mask) {
+		if (hash->slot[i].dev == dev) {
+			hash->slot[i].dev = UCLASS_HASH_GONE;
+			return;
+		}
+	}
+}
+
+/*
+ * The early malloc() pool never frees, so building and growing the tables
+ * before relocation would only use it up. Leave them until full malloc() is
+ * ready.
+ */
+static bool uclass_index_can_build(void)
+{
+	return gd->flags & GD_FLG_FULL_MALLOC_INIT;
+}
+
+/*
+ * Find a device by key, building the table if needed. This returns false if
+ * the table cannot tell, in which case the caller must search the list.
+ */
+static bool uclass_hash_find(struct uclass *uc, struct uclass_hash *hash,
+			     uclass_key_t get_key, ulong key,
+			     struct udevice **devp)
+{
+	struct uclass_hash_slot *slot;
+	uint i;
+
+	if (!hash->mask &&
+	    (!uclass_index_can_build() || uclass_hash_build(uc, hash, get_key)))
+		return false;
+	*devp = NULL;
+	for (i = uclass_hash_first(hash, key); hash->slot[i].dev;
+	     i = (i + 1) & hash->mask) {
+		slot = &hash->slot[i];
+		if (slot->dev == UCLASS_HASH_GONE || slot->key != key)
+			continue;
+		if (slot->dev == UCLASS_HASH_DUP)
+			return false;
+		*devp = slot->dev;
+		break;
+	}
+
+	return true;
+}
+
+static int uclass_seq_index_resize(struct uclass *uc, int count)
+{
+	struct udevice **devs;
+
+	devs = calloc(count, sizeof(*devs));
+	if (devs && uc->seq_devs)
+		memcpy(devs, uc->seq_devs, uc->seq_count * sizeof(*devs));
+	free(uc->seq_devs);
+	uc->seq_devs = devs;
+	uc->seq_count = devs ? count : 0;
+
+	return devs ? 0 : -ENOMEM;
+}
+
+static int uclass_seq_index_build(struct uclass *uc)
+{
+	struct udevice *dev;
+	int count = 8;
+
+	uclass_foreach_dev(dev, uc) {
+		if (dev->seq >= count && dev->seq < UCLASS_SEQ_INDEX_MAX)
+			count = roundup_pow_of_two(dev->seq + 1);
+	}
+	if (uclass_seq_index_resize(uc, count))
+		return -ENOMEM;
+	uclass_foreach_dev(dev, uc) {
+		if (dev->seq >= 0 && dev->seq < count)
+			uc->seq_devs[dev->seq] = dev;
+	}
+
+	return 0;
+}
+
+/* As uclass_hash_find(), for a sequence number */
+static bool uclass_seq_index_find(struct uclass *uc, int seq,
+				  struct udevice **devp)
+{
+	if (seq < 0 || seq >= UCLASS_SEQ_INDEX_MAX)
+		return false;
+	if (!uc->seq_devs &&
+	    (!uclass_index_can_build() || uclass_seq_index_build(uc)))
+		return false;
+	*devp = seq < uc->seq_count ? uc->seq_devs[seq] : NULL;
+
+	return true;
+}
+
+void uclass_index_add(struct udevice *dev)
+{
+	struct uclass *uc = dev->uclass;
+
+	if (!uc || list_empty(&dev->uclass_node))
+		return;
+	uclass_hash_add(uc, &uc->node_hash, uclass_node_key, dev);
+	uclass_hash_add(uc, &uc->phandle_hash, uclass_phandle_key, dev);
+}
+
+void uclass_index_remove(struct udevice *dev)
+{
+	struct uclass *uc = dev->uclass;
+
+	if (!uc || list_empty(&dev->uclass_node))
+		return;
+	uclass_hash_remove(&uc->node_hash, uclass_node_key, dev);
+	uclass_hash_remove(&uc->phandle_hash, uclass_phandle_key, dev);
+	if (uc->seq_devs && dev->seq >= 0 && dev->seq < uc->seq_count &&
+	    uc->seq_devs[dev->seq] == dev)
+		uc->seq_devs[dev->seq] = NULL;
+}
+
+static void uclass_index_free(struct uclass *uc)
+{
+	free(uc->seq_devs);
+	free(uc->node_hash.slot);
+	free(uc->phandle_hash.slot);
+}
+#else
+static inline void uclass_index_free(struct uclass *uc) {}
+#endif
+
+void uclass_set_seq(struct udevice *dev, int seq)
+{
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	struct uclass *uc = dev->uclass;
+
+	if (uc->seq_devs) {
+		if (dev->seq >= 0 && dev->seq < uc->seq_count &&
+		    uc->seq_devs[dev->seq] == dev)
+			uc->seq_devs[dev->seq] = NULL;
+		if (seq >= uc->seq_count && seq < UCLASS_SEQ_INDEX_MAX)
+			uclass_seq_index_resize(uc, roundup_pow_of_two(seq + 1));
+		if (seq >= 0 && seq < uc->seq_count)
+			uc->seq_devs[seq] = dev;
+	}
+#endif
+	dev->seq = seq;
+}
+
 int uclass_destroy(struct uclass *uc)
 {
 	struct uclass_driver *uc_drv;
@@ -132,6 +389,7 @@ int uclass_destroy(struct uclass *uc)
 	list_del(&uc->sibling_node);
 	if (uc_drv->priv_auto_alloc_size)
 		free(uc->priv);
+	uclass_index_free(uc);
 	free(uc);
 
 	return 0;
@@ -312,6 +570,12 @@ int uclass_find_device_by_seq(enum uclass_id id, int seq_or_req_seq,
 	if (ret)
 		return ret;
 
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	if (!find_req_seq && uclass_seq_index_find(uc, seq_or_req_seq, devp)) {
+		log_debug("   - %s\n", *devp ? "found" : "not found");
+		return *devp ? 0 : -ENODEV;
+	}
+#endif
 	uclass_foreach_dev(dev, uc) {
 		log_debug("   - %d %d '%s'\n",
 			  dev->req_seq, dev->seq, dev->name);
@@ -366,6 +630,13 @@ int uclass_find_device_by_ofnode(enum uclass_id id, ofnode node,
 	if (ret)
 		return ret;
 
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	if (uclass_hash_find(uc, &uc->node_hash, uclass_node_key,
+			     node.of_offset, devp)) {
+		ret = *devp ? 0 : -ENODEV;
+		goto done;
+	}
+#endif
 	uclass_foreach_dev(dev, uc) {
 		log(LOGC_DM, LOGL_DEBUG_CONTENT, "      - checking %s\n",
 		    dev->name);
@@ -399,6 +670,11 @@ int uclass_find_device_by_phandle(enum uclass_id id, struct udevice *parent,
 	if (ret)
 		return ret;
 
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	if (uclass_hash_find(uc, &uc->phandle_hash, uclass_phandle_key,
+			     find_phandle, devp))
+		return *devp ? 0 : -ENODEV;
+#endif
 	uclass_foreach_dev(dev, uc) {
 		uint phandle;
 
@@ -526,6 +802,16 @@ int uclass_get_device_by_phandle_id(enum uclass_id id, uint phandle_id,
 	if (ret)
 		return ret;
 
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	if (phandle_id && uclass_hash_find(uc, &uc->phandle_hash,
+					   uclass_phandle_key, phandle_id,
+					   &dev)) {
+		if (!dev)
+			return -ENODEV;
+		*devp = dev;
+		return uclass_get_device_tail(dev, ret, devp);
+	}
+#endif
 	uclass_foreach_dev(dev, uc) {
 		uint phandle;
 
@@ -629,6 +915,53 @@ int uclass_next_device_check(struct udevice **devp)
 	return device_probe(*devp);
 }
 
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+/* Find the device whose wait for the hardware ends first */
+static struct udevice *uclass_next_waiting(struct uclass *uc)
+{
+	struct udevice *dev, *next = NULL;
+
+	uclass_foreach_dev(dev, uc) {
+		if (!(dev->flags & DM_FLAG_PROBE_WAIT))
+			continue;
+		if (!next || (long)(dev->probe_wait - next->probe_wait) < 0)
+			next = dev;
+	}
+
+	return next;
+}
+#endif
+
+int uclass_probe_all(enum uclass_id id)
+{
+	struct udevice *dev;
+	struct uclass *uc;
+	int ret, err = 0;
+
+	ret = uclass_get(id, &uc);
+	if (ret)
+		return ret;
+
+	uclass_foreach_dev(dev, uc) {
+		if (CONFIG_IS_ENABLED(DM_PROBE_ASYNC))
+			ret = device_probe_step(dev);
+		else
+			ret = device_probe(dev);
+		if (ret && !(dev->flags & DM_FLAG_PROBE_WAIT) && !err)
+			err = ret;
+	}
+
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+	while ((dev = uclass_next_waiting(uc))) {
+		ret = device_probe_step(dev);
+		if (ret && !(dev->flags & DM_FLAG_PROBE_WAIT) && !err)
+			err = ret;
+	}
+#endif
+
+	return err;
+}
+
 int uclass_bind_device(struct udevice *dev)
 {
 	struct uclass *uc;
@@ -636,6 +969,7 @@ int uclass_bind_device(struct udevice *dev)
 
 	uc = dev->uclass;
 	list_add_tail(&dev->uclass_node, &uc->dev_head);
+	uclass_index_add(dev);
 
 	if (dev->parent) {
 		struct uclass_driver *uc_drv = dev->parent->uclass->uc_drv;
@@ -650,6 +984,7 @@ int uclass_bind_device(struct udevice *dev)
 	return 0;
 err:
 	/* There is no need to undo the parent's post_bind call */
+	uclass_index_remove(dev);
 	list_del(&dev->uclass_node);
 
 	return ret;
@@ -668,6 +1003,7 @@ int uclass_unbind_device(struct udevice *dev)
 			return ret;
 	}
 
+	uclass_index_remove(dev);
 	list_del(&dev->uclass_node);
 	return 0;
 }
@@ -0,0 +1,238 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * OctopOS storage mailbox driver
+ *
+ * The storage domain streams the boot image through a Xilinx AXI mailbox
+ * (data queue) whose ownership is arbitrated by an OctopOS control register.
+ * Register definitions are adapted from
+ * https://github.com/Xilinx/embeddedsw/blob/master/XilinxProcessorIPLib/drivers/mbox/src/xmbox_hw.h
+ *
+ * Copyright (c) 2021 - 2023, The OctopOS Authors, All rights reserved.
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <errno.h>
+#include <mailbox-uclass.h>
+#include <octopos_mbox.h>
+#include <time.h>
+#include <asm/io.h>
+
+#define XMB_READ_REG_OFFSET	0x08	/* Mbox read register */
+#define XMB_STATUS_REG_OFFSET	0x10	/* Mbox status register */
+#define XMB_RIT_REG_OFFSET	0x1C	/* Receive interrupt threshold */
+#define XMB_IS_REG_OFFSET	0x20	/* Interrupt status register */
+#define XMB_IE_REG_OFFSET	0x24	/* Interrupt enable register */
+
+#define XMB_STATUS_FIFO_EMPTY	BIT(0)	/* Receive FIFO is empty */
+#define XMB_STATUS_RTA		BIT(3)	/* Receive FIFO above threshold */
+#define XMB_IX_RTA		BIT(1)	/* Receive threshold interrupt */
+
+#define OCTOPOS_CTRL_INTR_OFFSET	4
+#define OCTOPOS_CTRL_RELEASE		0xff000000
+#define OCTOPOS_CTRL_QUOTA(val)		(((val) >> 12) & 0xfff)
+
+#define OCTOPOS_MBOX_MSG_WORDS		(OCTOPOS_MBOX_MSG_SIZE / sizeof(u32))
+#define OCTOPOS_MBOX_DEFAULT_BURST	8
+
+struct octopos_mbox {
+	void __iomem *data;
+	void __iomem *ctrl;
+	uint burst;
+	struct octopos_mbox_stats stats;
+};
+
+/*
+ * Read one message from the data FIFO. Whenever the receive threshold status
+ * is set the FIFO holds at least a full burst, so the burst is drained with
+ * back-to-back reads instead of polling the status register for every word.
+ */
+static int octopos_mbox_read_msg(struct octopos_mbox *mbox, u32 *buf,
+				 bool block)
+{
+	void __iomem *status = mbox->data + XMB_STATUS_REG_OFFSET;
+	void __iomem *fifo = mbox->data + XMB_READ_REG_OFFSET;
+	uint left = OCTOPOS_MBOX_MSG_WORDS;
+	uint i;
+	u32 st;
+
+	while (left) {
+		st = readl(status);
+		if (left >= mbox->burst && (st & XMB_STATUS_RTA)) {
+			for (i = 0; i < mbox->burst; i++)
+				*buf++ = readl(fifo);
+			left -= mbox->burst;
+			mbox->stats.bursts++;
+			continue;
+		}
+		if (st & XMB_STATUS_FIFO_EMPTY) {
+			/* A message is never abandoned once started */
+			if (!block && left == OCTOPOS_MBOX_MSG_WORDS)
+				return -ENODATA;
+			continue;
+		}
+		*buf++ = readl(fifo);
+		left--;
+	}
+	mbox->stats.words += OCTOPOS_MBOX_MSG_WORDS;
+	mbox->stats.msgs++;
+
+	return 0;
+}
+
+int octopos_mbox_recv_msgs(struct mbox_chan *chan, void *buf, ulong count)
+{
+	struct octopos_mbox *mbox = dev_get_priv(chan->dev);
+	struct octopos_mbox_stats *stats = &mbox->stats;
+	ulong start, now, lat;
+	u32 *dst = buf;
+	ulong i;
+	int ret;
+
+	start = timer_get_us();
+	for (i = 0; i < count; i++) {
+		now = timer_get_us();
+		while (readl(mbox->data + XMB_STATUS_REG_OFFSET) &
+		       XMB_STATUS_FIFO_EMPTY)
+			;
+		lat = timer_get_us() - now;
+		if (lat < stats->lat_min_us)
+			stats->lat_min_us = lat;
+		if (lat > stats->lat_max_us)
+			stats->lat_max_us = lat;
+
+		ret = octopos_mbox_read_msg(mbox, dst, true);
+		if (ret)
+			return ret;
+		dst += OCTOPOS_MBOX_MSG_WORDS;
+	}
+	/* Acknowledge the threshold interrupt raised while draining */
+	writel(XMB_IX_RTA, mbox->data + XMB_IS_REG_OFFSET);
+	stats->total_us += timer_get_us() - start;
+
+	return 0;
+}
+
+int octopos_mbox_wait_delegation(struct mbox_chan *chan, ulong timeout_us)
+{
+	struct octopos_mbox *mbox = dev_get_priv(chan->dev);
+	ulong start = timer_get_us();
+	u32 val;
+
+	while ((val = readl(mbox->ctrl)) == OCTOPOS_MBOX_NOT_DELEGATED) {
+		if (timeout_us && timer_get_us() - start >= timeout_us)
+			return -ETIMEDOUT;
+	}
+
+	/* Clear the OctopOS control interrupt */
+	writel(1, mbox->ctrl + OCTOPOS_CTRL_INTR_OFFSET);
+
+	return OCTOPOS_CTRL_QUOTA(val);
+}
+
+void octopos_mbox_release(struct mbox_chan *chan)
+{
+	struct octopos_mbox *mbox = dev_get_priv(chan->dev);
+
+	writel(OCTOPOS_CTRL_RELEASE, mbox->ctrl);
+}
+
+struct octopos_mbox_stats *octopos_mbox_get_stats(struct mbox_chan *chan)
+{
+	struct octopos_mbox *mbox = dev_get_priv(chan->dev);
+
+	return &mbox->stats;
+}
+
+int octopos_mbox_get(struct mbox_chan *chan)
+{
+	struct udevice *dev;
+	int ret;
+
+	ret = uclass_get_device_by_driver(UCLASS_MAILBOX,
+					  DM_GET_DRIVER(octopos_mbox), &dev);
+	if (ret)
+		return ret;
+
+	chan->dev = dev;
+	chan->id = 0;
+
+	return 0;
+}
+
+static int octopos_mbox_request(struct mbox_chan *chan)
+{
+	if (chan->id)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int octopos_mbox_send(struct mbox_chan *chan, const void *data)
+{
+	/* The storage data queue is receive-only */
+	return -ENOSYS;
+}
+
+static int octopos_mbox_recv(struct mbox_chan *chan, void *data)
+{
+	struct octopos_mbox *mbox = dev_get_priv(chan->dev);
+
+	return octopos_mbox_read_msg(mbox, data, false);
+}
+
+static int octopos_mbox_probe(struct udevice *dev)
+{
+	struct octopos_mbox *mbox = dev_get_priv(dev);
+
+	mbox->data = dev_remap_addr_name(dev, "data");
+	if (!mbox->data) {
+		dev_err(dev, "No reg property for data queue\n");
+		return -EINVAL;
+	}
+
+	mbox->ctrl = dev_remap_addr_name(dev, "control");
+	if (!mbox->ctrl) {
+		dev_err(dev, "No reg property for control queue\n");
+		return -EINVAL;
+	}
+
+	mbox->burst = dev_read_u32_default(dev, "octopos,rx-burst-words",
+					   OCTOPOS_MBOX_DEFAULT_BURST);
+	if (!mbox->burst || mbox->burst > OCTOPOS_MBOX_MSG_WORDS) {
+		dev_err(dev, "Invalid burst size %u\n", mbox->burst);
+		return -EINVAL;
+	}
+
+	/*
+	 * RTA is set while the FIFO holds more than RIT words; the interrupt
+	 * output stays masked since the status bit is sampled directly.
+	 */
+	writel(mbox->burst - 1, mbox->data + XMB_RIT_REG_OFFSET);
+	writel(0, mbox->data + XMB_IE_REG_OFFSET);
+	writel(XMB_IX_RTA, mbox->data + XMB_IS_REG_OFFSET);
+
+	mbox->stats.lat_min_us = ~0UL;
+
+	return 0;
+}
+
+static const struct udevice_id octopos_mbox_ids[] = {
+	{ .compatible = "octopos,storage-mailbox" },
+	{ }
+};
+
+struct mbox_ops octopos_mbox_ops = {
+	.request = octopos_mbox_request,
+	.send = octopos_mbox_send,
+	.recv = octopos_mbox_recv,
+};
+
+U_BOOT_DRIVER(octopos_mbox) = {
+	.name = "octopos-mbox",
+	.id = UCLASS_MAILBOX,
+	.of_match = octopos_mbox_ids,
+	.probe = octopos_mbox_probe,
+	.priv_auto_alloc_size = sizeof(struct octopos_mbox),
+	.ops = &octopos_mbox_ops,
+};
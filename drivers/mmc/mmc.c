@@ -11,6 +11,7 @@
 #include <command.h>
 #include <dm.h>
 #include <dm/device-internal.h>
+#include <dm/uclass-internal.h>
 #include <errno.h>
 #include <mmc.h>
 #include <part.h>
@@ -2998,6 +2999,21 @@ static int mmc_probe(bd_t *bis)
 
 	return 0;
 }
+
+#if CONFIG_IS_ENABLED(DM_PROBE_DEFER)
+/* List the devices without probing them, see CONFIG_DM_PROBE_DEFER */
+static void mmc_show_unprobed(void)
+{
+	struct udevice *dev;
+	bool first = true;
+
+	for (uclass_find_first_device(UCLASS_MMC, &dev);
+	     dev;
+	     uclass_find_next_device(&dev), first = false)
+		printf("%s%s", first ? "" : ", ", dev->name);
+	printf("\n");
+}
+#endif
 #else
 static int mmc_probe(bd_t *bis)
 {
@@ -3020,6 +3036,13 @@ int mmc_initialize(bd_t *bis)
 #if !CONFIG_IS_ENABLED(MMC_TINY)
 	mmc_list_init();
 #endif
+#endif
+#if CONFIG_IS_ENABLED(DM_MMC) && CONFIG_IS_ENABLED(DM_PROBE_DEFER)
+	/* Each device is probed when it is first used */
+	mmc_show_unprobed();
+	/* still start those which board code has probed already */
+	mmc_do_preinit();
+	return 0;
 #endif
 	ret = mmc_probe(bis);
 	if (ret)
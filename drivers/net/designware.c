@@ -632,6 +632,45 @@ int designware_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 	return _dw_eth_recv(priv, packetp);
 }
 
+/*
+ * Hand up every frame the DMA has completed, starting at the current
+ * descriptor. The descriptor ring is invalidated once for the whole batch;
+ * _dw_free_pkt() then returns the descriptors in order.
+ */
+int designware_eth_recv_batch(struct udevice *dev, int flags,
+			      uchar **packets, int *lengths, int count)
+{
+	struct dw_eth_dev *priv = dev_get_priv(dev);
+	u32 status, desc_num = priv->rx_currdescnum;
+	ulong table = (ulong)priv->rx_mac_descrtable;
+	struct dmamacdescr *desc_p;
+	ulong data_start;
+	int length, n;
+
+	invalidate_dcache_range(table,
+				table + sizeof(priv->rx_mac_descrtable));
+
+	for (n = 0; n < count; n++) {
+		desc_p = &priv->rx_mac_descrtable[desc_num];
+		status = desc_p->txrx_status;
+		if (status & DESC_RXSTS_OWNBYDMA)
+			break;
+
+		length = (status & DESC_RXSTS_FRMLENMSK) >>
+			 DESC_RXSTS_FRMLENSHFT;
+		data_start = desc_p->dmamac_addr;
+		invalidate_dcache_range(data_start, data_start +
+					roundup(length, ARCH_DMA_MINALIGN));
+		packets[n] = (uchar *)data_start;
+		lengths[n] = length;
+
+		if (++desc_num >= CONFIG_RX_DESCR_NUM)
+			desc_num = 0;
+	}
+
+	return n ? n : -EAGAIN;
+}
+
 int designware_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 {
 	struct dw_eth_dev *priv = dev_get_priv(dev);
@@ -800,6 +839,7 @@ const struct eth_ops designware_eth_ops = {
 	.send			= designware_eth_send,
 	.recv			= designware_eth_recv,
 	.free_pkt		= designware_eth_free_pkt,
+	.recv_batch		= designware_eth_recv_batch,
 	.stop			= designware_eth_stop,
 	.write_hwaddr		= designware_eth_write_hwaddr,
 };
@@ -325,6 +325,7 @@ static int sb_eth_start(struct udevice *dev)
 	debug("eth_sandbox: Start\n");
 
 	priv->recv_packets = 0;
+	priv->recv_batch = 0;
 	for (int i = 0; i < PKTBUFSRX; i++) {
 		priv->recv_packet_buffer[i] = net_rx_packets[i];
 		priv->recv_packet_length[i] = 0;
@@ -365,22 +366,68 @@ static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 	return 0;
 }
 
-static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
+/*
+ * Drop the first 'count' packets of the queue. Packets queued by a tx_handler
+ * while they were processed are moved up.
+ */
+static void sb_eth_drop_packets(struct eth_sandbox_priv *priv, int count)
+{
+	int i;
+
+	count = min(count, priv->recv_packets);
+	priv->recv_packets -= count;
+	for (i = 0; i < priv->recv_packets; i++) {
+		priv->recv_packet_length[i] =
+			priv->recv_packet_length[i + count];
+		memcpy(priv->recv_packet_buffer[i],
+		       priv->recv_packet_buffer[i + count],
+		       priv->recv_packet_length[i + count]);
+	}
+	for (i = priv->recv_packets; i < priv->recv_packets + count; i++)
+		priv->recv_packet_length[i] = 0;
+}
+
+static int sb_eth_recv_batch(struct udevice *dev, int flags, uchar **packets,
+			     int *lengths, int count)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
 	int i;
 
+	if (skip_timeout) {
+		timer_test_add_offset(11000UL);
+		skip_timeout = false;
+	}
+
+	count = min(count, priv->recv_packets);
+	for (i = 0; i < count; i++) {
+		packets[i] = priv->recv_packet_buffer[i];
+		lengths[i] = priv->recv_packet_length[i];
+	}
+	debug("eth_sandbox: received %d packets, %d waiting\n", count,
+	      priv->recv_packets - count);
+
+	/* Buffers stay in place until the whole batch has been freed */
+	priv->recv_batch = count;
+	priv->recv_freed = 0;
+
+	return count;
+}
+
+static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
 	if (!priv->recv_packets)
 		return 0;
 
-	--priv->recv_packets;
-	for (i = 0; i < priv->recv_packets; i++) {
-		priv->recv_packet_length[i] = priv->recv_packet_length[i + 1];
-		memcpy(priv->recv_packet_buffer[i],
-		       priv->recv_packet_buffer[i + 1],
-		       priv->recv_packet_length[i + 1]);
+	if (priv->recv_batch) {
+		if (++priv->recv_freed < priv->recv_batch)
+			return 0;
+		sb_eth_drop_packets(priv, priv->recv_batch);
+		priv->recv_batch = 0;
+	} else {
+		sb_eth_drop_packets(priv, 1);
 	}
-	priv->recv_packet_length[priv->recv_packets] = 0;
 
 	return 0;
 }
@@ -393,7 +440,9 @@ static void sb_eth_stop(struct udevice *dev)
 static int sb_eth_write_hwaddr(struct udevice *dev)
 {
 	struct eth_pdata *pdata = dev_get_platdata(dev);
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
 
+	priv->hwaddr_writes++;
 	debug("eth_sandbox %s: Write HW ADDR - %pM\n", dev->name,
 	      pdata->enetaddr);
 	return 0;
@@ -404,6 +453,7 @@ static const struct eth_ops sb_eth_ops = {
 	.send			= sb_eth_send,
 	.recv			= sb_eth_recv,
 	.free_pkt		= sb_eth_free_pkt,
+	.recv_batch		= sb_eth_recv_batch,
 	.stop			= sb_eth_stop,
 	.write_hwaddr		= sb_eth_write_hwaddr,
 };
@@ -573,6 +573,73 @@ static int zynq_gem_recv(struct udevice *dev, int flags, uchar **packetp)
 	return frame_len;
 }
 
+/*
+ * Hand up all complete single-buffer frames starting at the current buffer
+ * descriptor. The receive buffers of neighbouring descriptors are adjacent,
+ * so the data cache is invalidated once per contiguous run of buffers rather
+ * than once per frame.
+ */
+static int zynq_gem_recv_batch(struct udevice *dev, int flags,
+			       uchar **packets, int *lengths, int count)
+{
+	struct zynq_gem_priv *priv = dev_get_priv(dev);
+	u32 idx = priv->rxbd_current;
+	ulong run_start = 0, run_end = 0;
+	struct emac_bd *bd;
+	dma_addr_t addr;
+	int frame_len;
+	int n;
+
+	for (n = 0; n < count; n++) {
+		bd = &priv->rx_bd[idx];
+		if (!(bd->addr & ZYNQ_GEM_RXBUF_NEW_MASK))
+			break;
+		if ((bd->status & (ZYNQ_GEM_RXBUF_SOF_MASK |
+				   ZYNQ_GEM_RXBUF_EOF_MASK)) !=
+		    (ZYNQ_GEM_RXBUF_SOF_MASK | ZYNQ_GEM_RXBUF_EOF_MASK))
+			break;
+		frame_len = bd->status & ZYNQ_GEM_RXBUF_LEN_MASK;
+		if (!frame_len)
+			break;
+
+#if defined(CONFIG_PHYS_64BIT)
+		addr = (dma_addr_t)((bd->addr & ZYNQ_GEM_RXBUF_ADD_MASK)
+			      | ((dma_addr_t)bd->addr_hi << 32));
+#else
+		addr = bd->addr & ZYNQ_GEM_RXBUF_ADD_MASK;
+#endif
+		addr &= ~(ARCH_DMA_MINALIGN - 1);
+
+		if (addr != run_end) {
+			if (run_end)
+				invalidate_dcache_range(run_start, run_end);
+			run_start = addr;
+		}
+		run_end = addr + roundup(PKTSIZE_ALIGN, ARCH_DMA_MINALIGN);
+
+		packets[n] = (uchar *)(uintptr_t)addr;
+		lengths[n] = frame_len;
+
+		if (++idx >= RX_BUF)
+			idx = 0;
+	}
+
+	if (run_end)
+		invalidate_dcache_range(run_start, run_end);
+	barrier();
+
+	/* Leave anything unusual, like split frames, to zynq_gem_recv() */
+	if (!n) {
+		frame_len = zynq_gem_recv(dev, flags, packets);
+		if (frame_len < 0)
+			return -EAGAIN;
+		lengths[0] = frame_len;
+		return 1;
+	}
+
+	return n;
+}
+
 static int zynq_gem_free_pkt(struct udevice *dev, uchar *packet, int length)
 {
 	struct zynq_gem_priv *priv = dev_get_priv(dev);
@@ -729,6 +796,7 @@ static const struct eth_ops zynq_gem_ops = {
 	.send			= zynq_gem_send,
 	.recv			= zynq_gem_recv,
 	.free_pkt		= zynq_gem_free_pkt,
+	.recv_batch		= zynq_gem_recv_batch,
 	.stop			= zynq_gem_halt,
 	.write_hwaddr		= zynq_gem_setup_mac,
 	.read_rom_hwaddr	= zynq_gem_read_rom_mac,
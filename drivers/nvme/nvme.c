@@ -14,13 +14,12 @@
 #include <dm/device-internal.h>
 #include "nvme.h"
 
-#define NVME_Q_DEPTH		2
+#define NVME_Q_DEPTH		CONFIG_NVME_IO_QUEUE_DEPTH
 #define NVME_AQ_DEPTH		2
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
 #define ADMIN_TIMEOUT		60
 #define IO_TIMEOUT		30
-#define MAX_PRP_POOL		512
 
 enum nvme_queue_id {
 	NVME_ADMIN_Q,
@@ -49,6 +48,20 @@ struct nvme_queue {
 	unsigned long cmdid_data[];
 };
 
+/*
+ * An I/O command slot. Slots are indexed by command id, so that a completion
+ * finds its command without searching, and each one owns a PRP list taken
+ * from a pool allocated once at probe time.
+ */
+struct nvme_io_cmd {
+	struct blk_req *req;	/* request the command is part of, or NULL */
+	struct udevice *blk;	/* block device that issued it */
+	u64 *prp_list;
+	void *buf;
+	u32 len;
+	bool async;		/* complete @req with blk_req_done() */
+};
+
 static int nvme_wait_ready(struct nvme_dev *dev, bool enabled)
 {
 	u32 bit = enabled ? NVME_CSTS_RDY : 0;
@@ -67,16 +80,15 @@ static int nvme_wait_ready(struct nvme_dev *dev, bool enabled)
 	return -ETIME;
 }
 
-static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
+static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp_list, u64 *prp2,
 			   int total_len, u64 dma_addr)
 {
 	u32 page_size = dev->page_size;
 	int offset = dma_addr & (page_size - 1);
-	u64 *prp_pool;
+	u64 *prp_page;
 	int length = total_len;
-	int i, nprps;
+	int i, nprps, used;
 	u32 prps_per_page = (page_size >> 3) - 1;
-	u32 num_pages;
 
 	length -= (page_size - offset);
 
@@ -94,39 +106,28 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 	}
 
 	nprps = DIV_ROUND_UP(length, page_size);
-	num_pages = DIV_ROUND_UP(nprps, prps_per_page);
-
-	if (nprps > dev->prp_entry_num) {
-		free(dev->prp_pool);
-		/*
-		 * Always increase in increments of pages.  It doesn't waste
-		 * much memory and reduces the number of allocations.
-		 */
-		dev->prp_pool = memalign(page_size, num_pages * page_size);
-		if (!dev->prp_pool) {
-			printf("Error: malloc prp_pool fail\n");
-			return -ENOMEM;
-		}
-		dev->prp_entry_num = prps_per_page * num_pages;
+	used = DIV_ROUND_UP(nprps, prps_per_page) * page_size;
+	if (used > dev->prp_list_size) {
+		printf("Error: PRP list of %d entries too long\n", nprps);
+		return -EINVAL;
 	}
 
-	prp_pool = dev->prp_pool;
+	prp_page = prp_list;
 	i = 0;
 	while (nprps) {
-		if (i == ((page_size >> 3) - 1)) {
-			*(prp_pool + i) = cpu_to_le64((ulong)prp_pool +
+		if (i == prps_per_page) {
+			*(prp_page + i) = cpu_to_le64((ulong)prp_page +
 					page_size);
 			i = 0;
-			prp_pool += page_size;
+			prp_page += page_size >> 3;
 		}
-		*(prp_pool + i++) = cpu_to_le64(dma_addr);
+		*(prp_page + i++) = cpu_to_le64(dma_addr);
 		dma_addr += page_size;
 		nprps--;
 	}
-	*prp2 = (ulong)dev->prp_pool;
+	*prp2 = (ulong)prp_list;
 
-	flush_dcache_range((ulong)dev->prp_pool, (ulong)dev->prp_pool +
-			   dev->prp_entry_num * sizeof(u64));
+	flush_dcache_range((ulong)prp_list, (ulong)prp_list + used);
 
 	return 0;
 }
@@ -149,12 +150,12 @@ static u16 nvme_read_completion_status(struct nvme_queue *nvmeq, u16 index)
 }
 
 /**
- * nvme_submit_cmd() - copy a command into a queue and ring the doorbell
+ * nvme_queue_cmd() - copy a command into a queue without ringing the doorbell
  *
  * @nvmeq:	The queue to use
  * @cmd:	The command to send
  */
-static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
+static void nvme_queue_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
 {
 	u16 tail = nvmeq->sq_tail;
 
@@ -164,10 +165,21 @@ static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
 
 	if (++tail == nvmeq->q_depth)
 		tail = 0;
-	writel(tail, nvmeq->q_db);
 	nvmeq->sq_tail = tail;
 }
 
+/**
+ * nvme_submit_cmd() - copy a command into a queue and ring the doorbell
+ *
+ * @nvmeq:	The queue to use
+ * @cmd:	The command to send
+ */
+static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
+{
+	nvme_queue_cmd(nvmeq, cmd);
+	writel(nvmeq->sq_tail, nvmeq->q_db);
+}
+
 static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 				struct nvme_command *cmd,
 				u32 *result, unsigned timeout)
@@ -701,69 +713,301 @@ static int nvme_blk_probe(struct udevice *udev)
 	sprintf(desc->vendor, "0x%.4x", pplat->vendor);
 	memcpy(desc->product, ndev->serial, sizeof(ndev->serial));
 	memcpy(desc->revision, ndev->firmware_rev, sizeof(ndev->firmware_rev));
+	blk_set_queue_depth(udev, ndev->q_depth - 1);
 
 	free(id);
 	return 0;
 }
 
-static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
-			 lbaint_t blkcnt, void *buffer, bool read)
+static int nvme_alloc_io_cmds(struct nvme_dev *dev)
+{
+	u32 page_size = dev->page_size;
+	int ncmds = dev->q_depth - 1;
+	int nprps, i;
+
+	/* the largest transfer, starting part way into a page */
+	nprps = (1 << dev->max_transfer_shift) / page_size + 1;
+	dev->prp_list_size = DIV_ROUND_UP(nprps, (page_size >> 3) - 1) *
+			     page_size;
+
+	dev->prp_pool = memalign(page_size, ncmds * dev->prp_list_size);
+	dev->io_cmds = calloc(ncmds, sizeof(*dev->io_cmds));
+	if (!dev->prp_pool || !dev->io_cmds) {
+		free(dev->prp_pool);
+		free(dev->io_cmds);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ncmds; i++)
+		dev->io_cmds[i].prp_list = (void *)dev->prp_pool +
+					   i * dev->prp_list_size;
+	dev->io_free = ncmds;
+
+	return 0;
+}
+
+static u32 nvme_max_lbas(struct nvme_ns *ns)
+{
+	/* the command length field counts at most 64Ki blocks */
+	return 1 << min(ns->dev->max_transfer_shift - ns->lba_shift, 16U);
+}
+
+/**
+ * nvme_post_rw() - queue one read or write command of a request
+ *
+ * The command is copied into the I/O submission queue; the doorbell is rung
+ * by the caller once it has queued all it can.
+ *
+ * @udev:	Block device issuing the command
+ * @req:	Request the command is part of
+ * @async:	true to complete @req through blk_req_done()
+ * @slba:	First block of the command
+ * @lbas:	Number of blocks, at most nvme_max_lbas()
+ * @buf:	Data buffer of the command
+ * @return 0 if OK, -EBUSY if no command slot is free, other -ve error
+ */
+static int nvme_post_rw(struct udevice *udev, struct blk_req *req, bool async,
+			u64 slba, u32 lbas, void *buf)
 {
 	struct nvme_ns *ns = dev_get_priv(udev);
 	struct nvme_dev *dev = ns->dev;
+	struct nvme_io_cmd *cmd;
 	struct nvme_command c;
-	struct blk_desc *desc = dev_get_uclass_platdata(udev);
-	int status;
+	u32 len = lbas << ns->lba_shift;
 	u64 prp2;
-	u64 total_len = blkcnt << desc->log2blksz;
-	u64 temp_len = total_len;
+	u16 cid;
 
-	u64 slba = blknr;
-	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
-	u64 total_lbas = blkcnt;
+	if (dev->io_dead)
+		return -EIO;
+	if (!dev->io_free)
+		return -EBUSY;
+	/* the timeout runs from here when the queue was idle */
+	if (dev->io_free == dev->q_depth - 1)
+		dev->io_stamp = timer_get_us();
+
+	cid = dev->io_next;
+	while (dev->io_cmds[cid].req) {
+		if (++cid == dev->q_depth - 1)
+			cid = 0;
+	}
+	cmd = &dev->io_cmds[cid];
 
-	flush_dcache_range((unsigned long)buffer,
-			   (unsigned long)buffer + total_len);
+	if (nvme_setup_prps(dev, cmd->prp_list, &prp2, len, (ulong)buf))
+		return -EIO;
 
-	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
-	c.rw.flags = 0;
+	memset(&c, 0, sizeof(c));
+	c.rw.opcode = req->write ? nvme_cmd_write : nvme_cmd_read;
+	c.rw.command_id = cpu_to_le16(cid);
 	c.rw.nsid = cpu_to_le32(ns->ns_id);
-	c.rw.control = 0;
-	c.rw.dsmgmt = 0;
-	c.rw.reftag = 0;
-	c.rw.apptag = 0;
-	c.rw.appmask = 0;
-	c.rw.metadata = 0;
-
-	while (total_lbas) {
-		if (total_lbas < lbas) {
-			lbas = (u16)total_lbas;
-			total_lbas = 0;
-		} else {
-			total_lbas -= lbas;
-		}
+	c.rw.slba = cpu_to_le64(slba);
+	c.rw.length = cpu_to_le16(lbas - 1);
+	c.rw.prp1 = cpu_to_le64((ulong)buf);
+	c.rw.prp2 = cpu_to_le64(prp2);
+
+	flush_dcache_range((ulong)buf, (ulong)buf + len);
+
+	cmd->req = req;
+	cmd->blk = udev;
+	cmd->buf = buf;
+	cmd->len = len;
+	cmd->async = async;
+	req->priv = (void *)((uintptr_t)req->priv + 1);
+	dev->io_free--;
+	dev->io_next = cid + 1 == dev->q_depth - 1 ? 0 : cid + 1;
+
+	nvme_queue_cmd(dev->queues[NVME_IO_Q], &c);
+
+	return 0;
+}
+
+static void nvme_complete_io(struct nvme_dev *dev, struct nvme_io_cmd *cmd,
+			     u16 status)
+{
+	struct blk_req *req = cmd->req;
+	uintptr_t left = (uintptr_t)req->priv - 1;
+
+	if (status) {
+		printf("ERROR: status = %x, cid = %d\n", status,
+		       (int)(cmd - dev->io_cmds));
+		req->result = -EIO;
+	} else if (!req->write) {
+		invalidate_dcache_range((ulong)cmd->buf,
+					(ulong)cmd->buf + cmd->len);
+	}
+
+	cmd->req = NULL;
+	dev->io_free++;
+	req->priv = (void *)left;
+	if (!left && cmd->async)
+		blk_req_done(cmd->blk, req,
+			     req->result < 0 ? req->result : req->blkcnt);
+}
+
+/**
+ * nvme_reap_io() - complete all I/O commands the controller has finished
+ *
+ * Walks the completion queue up to the first entry not yet posted and moves
+ * the head doorbell once for the whole batch.
+ *
+ * @dev:	NVMe controller
+ * @return number of commands completed
+ */
+static int nvme_reap_io(struct nvme_dev *dev)
+{
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	u16 head = nvmeq->cq_head;
+	u16 phase = nvmeq->cq_phase;
+	u16 status, cid;
+	int count = 0;
 
-		if (nvme_setup_prps(dev, &prp2,
-				    lbas << ns->lba_shift, (ulong)buffer))
-			return -EIO;
-		c.rw.slba = cpu_to_le64(slba);
-		slba += lbas;
-		c.rw.length = cpu_to_le16(lbas - 1);
-		c.rw.prp1 = cpu_to_le64((ulong)buffer);
-		c.rw.prp2 = cpu_to_le64(prp2);
-		status = nvme_submit_sync_cmd(dev->queues[NVME_IO_Q],
-				&c, NULL, IO_TIMEOUT);
-		if (status)
+	for (;;) {
+		status = nvme_read_completion_status(nvmeq, head);
+		if ((status & 0x01) != phase)
 			break;
-		temp_len -= (u32)lbas << ns->lba_shift;
-		buffer += lbas << ns->lba_shift;
+		cid = le16_to_cpu(readw(&nvmeq->cqes[head].command_id));
+
+		if (++head == nvmeq->q_depth) {
+			head = 0;
+			phase = !phase;
+		}
+		count++;
+
+		if (cid >= dev->q_depth - 1 || !dev->io_cmds[cid].req) {
+			printf("ERROR: unexpected completion, cid = %d\n", cid);
+			continue;
+		}
+		nvme_complete_io(dev, &dev->io_cmds[cid], status >> 1);
 	}
 
-	if (read)
-		invalidate_dcache_range((unsigned long)buffer,
-					(unsigned long)buffer + total_len);
+	if (count) {
+		writel(head, nvmeq->q_db + dev->db_stride);
+		nvmeq->cq_head = head;
+		nvmeq->cq_phase = phase;
+		dev->io_stamp = timer_get_us();
+	}
+
+	return count;
+}
+
+/**
+ * nvme_reset_io_queue() - take back the I/O commands the controller owns
+ *
+ * Deleting the submission queue makes the controller abort the commands in
+ * it, after which it no longer touches their buffers or PRP lists, so their
+ * slots can be reused. The queues are then created again and every command
+ * still outstanding fails with -ETIMEDOUT. If that cannot be done, the
+ * controller is disabled instead and all later I/O fails.
+ *
+ * @dev:	NVMe controller
+ * @return number of commands failed, or -ve on error
+ */
+static int nvme_reset_io_queue(struct nvme_dev *dev)
+{
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	struct nvme_io_cmd *cmd;
+	int count = 0;
+	int ret, i;
+
+	dev->online_queues--;
+	ret = nvme_delete_sq(dev, NVME_IO_Q);
+	if (!ret)
+		ret = nvme_delete_cq(dev, NVME_IO_Q);
+	if (!ret)
+		ret = nvme_create_queue(nvmeq, NVME_IO_Q);
+	if (ret) {
+		printf("ERROR: cannot reset I/O queue, disabling controller\n");
+		nvme_disable_ctrl(dev);
+		dev->io_dead = true;
+	}
+
+	for (i = 0; i < dev->q_depth - 1; i++) {
+		cmd = &dev->io_cmds[i];
+		if (!cmd->req)
+			continue;
+		cmd->req->result = -ETIMEDOUT;
+		nvme_complete_io(dev, cmd, 0);
+		count++;
+	}
+
+	return ret ? ret : count;
+}
 
-	return (total_len - temp_len) >> desc->log2blksz;
+/**
+ * nvme_reap_io_timeout() - complete I/O commands, resetting a stuck queue
+ *
+ * As nvme_reap_io(), but if commands are outstanding and none has completed
+ * for IO_TIMEOUT, the I/O queue is reset and they fail.
+ *
+ * @dev:	NVMe controller
+ * @return number of commands completed, or -ve on error
+ */
+static int nvme_reap_io_timeout(struct nvme_dev *dev)
+{
+	ulong timeout_us = IO_TIMEOUT * 100000;
+	int count;
+
+	count = nvme_reap_io(dev);
+	if (count || dev->io_free == dev->q_depth - 1 ||
+	    timer_get_us() - dev->io_stamp < timeout_us)
+		return count;
+
+	printf("ERROR: I/O timeout, %d commands outstanding\n",
+	       dev->q_depth - 1 - dev->io_free);
+
+	return nvme_reset_io_queue(dev);
+}
+
+/*
+ * Keep as many commands of the transfer in flight as the I/O queue allows,
+ * posting more as completions free up command slots.
+ */
+static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
+			 lbaint_t blkcnt, void *buffer, bool read)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	struct blk_req req = {
+		.start = blknr,
+		.blkcnt = blkcnt,
+		.buffer = buffer,
+		.write = !read,
+	};
+	u32 max_lbas = nvme_max_lbas(ns);
+	lbaint_t posted = 0;
+	bool queued;
+	u32 lbas;
+	int ret;
+
+	for (;;) {
+		queued = false;
+		/* stop posting once a command has failed */
+		while (posted < blkcnt && !req.result) {
+			lbas = min_t(lbaint_t, max_lbas, blkcnt - posted);
+			ret = nvme_post_rw(udev, &req, false, blknr + posted,
+					   lbas, buffer +
+					   (posted << ns->lba_shift));
+			if (ret == -EBUSY)
+				break;
+			if (ret) {
+				req.result = ret;
+				break;
+			}
+			posted += lbas;
+			queued = true;
+		}
+		if (queued)
+			writel(nvmeq->sq_tail, nvmeq->q_db);
+
+		if (!req.priv && (posted == blkcnt || req.result))
+			break;
+
+		/* a reset fails the commands still in flight */
+		if (nvme_reap_io_timeout(dev) < 0)
+			return 0;
+	}
+
+	return req.result ? 0 : blkcnt;
 }
 
 static ulong nvme_blk_read(struct udevice *udev, lbaint_t blknr,
@@ -778,9 +1022,63 @@ static ulong nvme_blk_write(struct udevice *udev, lbaint_t blknr,
 	return nvme_blk_rw(udev, blknr, blkcnt, (void *)buffer, false);
 }
 
+static int nvme_blk_submit(struct udevice *udev, struct blk_req *req)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	u32 max_lbas = nvme_max_lbas(ns);
+	lbaint_t cmds = DIV_ROUND_UP(req->blkcnt, max_lbas);
+	lbaint_t posted = 0;
+	ulong blks;
+	u32 lbas;
+	int ret;
+
+	/* larger than the whole queue: stream it through synchronously */
+	if (cmds > dev->q_depth - 1) {
+		blks = nvme_blk_rw(udev, req->start, req->blkcnt, req->buffer,
+				   !req->write);
+		blk_req_done(udev, req, blks == req->blkcnt ? blks : -EIO);
+		return 0;
+	}
+	/* the queue is shared with other namespaces and synchronous I/O */
+	while (cmds > dev->io_free) {
+		ret = nvme_reap_io_timeout(dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	req->priv = NULL;
+	while (posted < req->blkcnt) {
+		lbas = min_t(lbaint_t, max_lbas, req->blkcnt - posted);
+		ret = nvme_post_rw(udev, req, true, req->start + posted, lbas,
+				   req->buffer + (posted << ns->lba_shift));
+		if (ret) {
+			if (!posted)
+				return ret;
+			/* reported when the posted commands complete */
+			req->result = ret;
+			break;
+		}
+		posted += lbas;
+	}
+	writel(nvmeq->sq_tail, nvmeq->q_db);
+
+	return 0;
+}
+
+static int nvme_blk_poll(struct udevice *udev)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+
+	return nvme_reap_io_timeout(ns->dev);
+}
+
 static const struct blk_ops nvme_blk_ops = {
 	.read	= nvme_blk_read,
 	.write	= nvme_blk_write,
+	.submit	= nvme_blk_submit,
+	.poll	= nvme_blk_poll,
 };
 
 U_BOOT_DRIVER(nvme_blk) = {
@@ -834,21 +1132,19 @@ static int nvme_probe(struct udevice *udev)
 	if (ret)
 		goto free_queue;
 
-	/* Allocate after the page size is known */
-	ndev->prp_pool = memalign(ndev->page_size, MAX_PRP_POOL);
-	if (!ndev->prp_pool) {
-		ret = -ENOMEM;
-		printf("Error: %s: Out of memory!\n", udev->name);
-		goto free_nvme;
-	}
-	ndev->prp_entry_num = MAX_PRP_POOL >> 3;
-
 	ret = nvme_setup_io_queues(ndev);
 	if (ret)
 		goto free_queue;
 
 	nvme_get_info_from_identify(ndev);
 
+	/* Allocate once the page and maximum transfer sizes are known */
+	ret = nvme_alloc_io_cmds(ndev);
+	if (ret) {
+		printf("Error: %s: Out of memory!\n", udev->name);
+		goto free_queue;
+	}
+
 	return 0;
 
 free_queue:
@@ -602,6 +602,8 @@ enum {
 	NVME_CSTS_SHST_MASK	= 3 << 2,
 };
 
+struct nvme_io_cmd;
+
 /* Represents an NVM Express device. Each nvme_dev is a PCI function. */
 struct nvme_dev {
 	struct list_head node;
@@ -625,7 +627,12 @@ struct nvme_dev {
 	u32 page_size;
 	u8 vwc;
 	u64 *prp_pool;
-	u32 prp_entry_num;
+	u32 prp_list_size;
+	struct nvme_io_cmd *io_cmds;
+	u16 io_free;
+	u16 io_next;
+	ulong io_stamp;		/* timer_get_us() of the last I/O progress */
+	bool io_dead;		/* I/O queue could not be reset, fail all I/O */
 	u32 nn;
 };
 
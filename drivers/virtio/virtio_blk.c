@@ -7,65 +7,268 @@
 #include <common.h>
 #include <blk.h>
 #include <dm.h>
+#include <malloc.h>
 #include <virtio_types.h>
 #include <virtio.h>
 #include <virtio_ring.h>
 #include "virtio_blk.h"
 
+/* Largest data segment when the device does not give VIRTIO_BLK_F_SIZE_MAX */
+#define VIRTIO_BLK_SEG_SIZE	(64 << 10)
+/* Largest number of data segments in one request */
+#define VIRTIO_BLK_MAX_SEGS	32
+/* Requests of the largest size that fit in a ring without indirect tables */
+#define VIRTIO_BLK_MIN_REQS	4
+
+/**
+ * struct virtio_blk_slot - a request in flight on the virtqueue
+ *
+ * @hdr:	request header, also the token given back by virtqueue_get_buf()
+ * @status:	status byte written by the device
+ * @req:	block request this is part of, NULL if the slot is free
+ * @async:	true to complete @req through blk_req_done()
+ */
+struct virtio_blk_slot {
+	struct virtio_blk_outhdr hdr;
+	u8 status;
+	struct blk_req *req;
+	bool async;
+};
+
+/**
+ * struct virtio_blk_priv - private data of a virtio block device
+ *
+ * @vq:		the request virtqueue
+ * @slots:	request slots, one per ring entry
+ * @num_slots:	number of entries in @slots
+ * @num_free:	number of free entries in @slots
+ * @next:	slot to try first for the next request
+ * @seg_size:	largest data segment, in bytes
+ * @max_blks:	largest number of blocks in one request
+ */
 struct virtio_blk_priv {
 	struct virtqueue *vq;
+	struct virtio_blk_slot *slots;
+	uint num_slots;
+	uint num_free;
+	uint next;
+	u32 seg_size;
+	lbaint_t max_blks;
+};
+
+static const u32 feature[] = {
+	VIRTIO_BLK_F_SIZE_MAX,
+	VIRTIO_BLK_F_SEG_MAX,
+	VIRTIO_RING_F_INDIRECT_DESC,
 };
 
-static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
-			       lbaint_t blkcnt, void *buffer, u32 type)
+/**
+ * virtio_blk_post() - add one request of a transfer to the virtqueue
+ *
+ * The data is split into segments of at most seg_size bytes. The device is
+ * not notified; the caller kicks the virtqueue once it has added all it can.
+ *
+ * @dev:	Block device issuing the request
+ * @req:	Transfer the request is part of
+ * @async:	true to complete @req through blk_req_done()
+ * @sector:	First sector of the request
+ * @blkcnt:	Number of sectors, at most max_blks
+ * @buffer:	Data buffer of the request
+ * @return 0 if OK, -EBUSY if the virtqueue is full, other -ve error
+ */
+static int virtio_blk_post(struct udevice *dev, struct blk_req *req,
+			   bool async, u64 sector, lbaint_t blkcnt, void *buffer)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
-	unsigned int num_out = 0, num_in = 0;
-	struct virtio_sg *sgs[3];
-	u8 status;
+	struct virtio_sg sg[VIRTIO_BLK_MAX_SEGS + 2];
+	struct virtio_sg *sgs[VIRTIO_BLK_MAX_SEGS + 2];
+	struct virtio_blk_slot *slot;
+	size_t len = blkcnt * 512;
+	unsigned int num_out, n = 0;
+	uint i;
 	int ret;
 
-	struct virtio_blk_outhdr out_hdr = {
-		.type = cpu_to_virtio32(dev, type),
-		.sector = cpu_to_virtio64(dev, sector),
-	};
-	struct virtio_sg hdr_sg = { &out_hdr, sizeof(out_hdr) };
-	struct virtio_sg data_sg = { buffer, blkcnt * 512 };
-	struct virtio_sg status_sg = { &status, sizeof(status) };
+	if (!priv->num_free)
+		return -EBUSY;
 
-	sgs[num_out++] = &hdr_sg;
+	i = priv->next;
+	while (priv->slots[i].req)
+		i = (i + 1) % priv->num_slots;
+	slot = &priv->slots[i];
 
-	if (type & VIRTIO_BLK_T_OUT)
-		sgs[num_out++] = &data_sg;
-	else
-		sgs[num_out + num_in++] = &data_sg;
+	slot->hdr.type = cpu_to_virtio32(dev, req->write ? VIRTIO_BLK_T_OUT :
+					  VIRTIO_BLK_T_IN);
+	slot->hdr.ioprio = 0;
+	slot->hdr.sector = cpu_to_virtio64(dev, sector);
+	sg[n].addr = &slot->hdr;
+	sg[n++].length = sizeof(slot->hdr);
+
+	while (len) {
+		sg[n].addr = buffer;
+		sg[n].length = min_t(size_t, len, priv->seg_size);
+		buffer += sg[n].length;
+		len -= sg[n++].length;
+	}
+	num_out = req->write ? n : 1;
 
-	sgs[num_out + num_in++] = &status_sg;
+	sg[n].addr = &slot->status;
+	sg[n++].length = sizeof(slot->status);
 
-	ret = virtqueue_add(priv->vq, sgs, num_out, num_in);
+	for (i = 0; i < n; i++)
+		sgs[i] = &sg[i];
+	ret = virtqueue_add(priv->vq, sgs, num_out, n - num_out);
 	if (ret)
-		return ret;
+		return ret == -ENOSPC ? -EBUSY : ret;
 
-	virtqueue_kick(priv->vq);
+	slot->req = req;
+	slot->async = async;
+	priv->num_free--;
+	priv->next = (slot - priv->slots + 1) % priv->num_slots;
+	req->priv = (void *)((uintptr_t)req->priv + 1);
+
+	return 0;
+}
+
+static void virtio_blk_complete(struct udevice *dev,
+				struct virtio_blk_slot *slot)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct blk_req *req = slot->req;
+	uintptr_t left = (uintptr_t)req->priv - 1;
+
+	if (slot->status != VIRTIO_BLK_S_OK)
+		req->result = -EIO;
+
+	slot->req = NULL;
+	priv->num_free++;
+	req->priv = (void *)left;
+	if (!left && slot->async)
+		blk_req_done(dev, req,
+			     req->result < 0 ? req->result : req->blkcnt);
+}
+
+/**
+ * virtio_blk_reap() - complete all requests the device has finished
+ *
+ * @dev:	Block device
+ * @return number of requests completed
+ */
+static int virtio_blk_reap(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct virtio_blk_outhdr *hdr;
+	int count = 0;
+
+	while ((hdr = virtqueue_get_buf(priv->vq, NULL))) {
+		virtio_blk_complete(dev, container_of(hdr,
+						      struct virtio_blk_slot,
+						      hdr));
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Keep as many requests of the transfer in flight as the virtqueue holds,
+ * adding more as completions free up room.
+ */
+static ulong virtio_blk_rw(struct udevice *dev, lbaint_t start,
+			   lbaint_t blkcnt, void *buffer, bool write)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct blk_req req = {
+		.start = start,
+		.blkcnt = blkcnt,
+		.buffer = buffer,
+		.write = write,
+	};
+	lbaint_t posted = 0, cnt;
+	bool queued;
+	int ret;
+
+	for (;;) {
+		queued = false;
+		/* stop adding once a request has failed */
+		while (posted < blkcnt && !req.result) {
+			cnt = min(priv->max_blks, blkcnt - posted);
+			ret = virtio_blk_post(dev, &req, false, start + posted,
+					      cnt, buffer + posted * 512);
+			if (ret == -EBUSY)
+				break;
+			if (ret) {
+				req.result = ret;
+				break;
+			}
+			posted += cnt;
+			queued = true;
+		}
+		if (queued)
+			virtqueue_kick(priv->vq);
 
-	while (!virtqueue_get_buf(priv->vq, NULL))
-		;
+		if (!req.priv && (posted == blkcnt || req.result))
+			break;
 
-	return status == VIRTIO_BLK_S_OK ? blkcnt : -EIO;
+		virtio_blk_reap(dev);
+	}
+
+	return req.result ? req.result : blkcnt;
 }
 
 static ulong virtio_blk_read(struct udevice *dev, lbaint_t start,
 			     lbaint_t blkcnt, void *buffer)
 {
-	return virtio_blk_do_req(dev, start, blkcnt, buffer,
-				 VIRTIO_BLK_T_IN);
+	return virtio_blk_rw(dev, start, blkcnt, buffer, false);
 }
 
 static ulong virtio_blk_write(struct udevice *dev, lbaint_t start,
 			      lbaint_t blkcnt, const void *buffer)
 {
-	return virtio_blk_do_req(dev, start, blkcnt, (void *)buffer,
-				 VIRTIO_BLK_T_OUT);
+	return virtio_blk_rw(dev, start, blkcnt, (void *)buffer, true);
+}
+
+static int virtio_blk_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	lbaint_t posted = 0, cnt;
+	uintptr_t left;
+	int ret;
+
+	/* held until everything is added, so @req cannot complete early */
+	req->priv = (void *)1;
+	while (posted < req->blkcnt) {
+		cnt = min(priv->max_blks, req->blkcnt - posted);
+		ret = virtio_blk_post(dev, req, true, req->start + posted, cnt,
+				      req->buffer + posted * 512);
+		if (ret == -EBUSY && posted) {
+			/* the rest goes in as the device makes room */
+			virtqueue_kick(priv->vq);
+			virtio_blk_reap(dev);
+			continue;
+		}
+		if (ret) {
+			if (!posted)
+				return ret;
+			/* reported when the added requests complete */
+			req->result = ret;
+			break;
+		}
+		posted += cnt;
+	}
+	virtqueue_kick(priv->vq);
+
+	left = (uintptr_t)req->priv - 1;
+	req->priv = (void *)left;
+	if (!left)
+		blk_req_done(dev, req,
+			     req->result < 0 ? req->result : req->blkcnt);
+
+	return 0;
+}
+
+static int virtio_blk_poll(struct udevice *dev)
+{
+	return virtio_blk_reap(dev);
 }
 
 static int virtio_blk_bind(struct udevice *dev)
@@ -97,7 +300,8 @@ static int virtio_blk_bind(struct udevice *dev)
 	desc->bdev = dev;
 
 	/* Indicate what driver features we support */
-	virtio_driver_features_init(uc_priv, NULL, 0, NULL, 0);
+	virtio_driver_features_init(uc_priv, feature, ARRAY_SIZE(feature),
+				    NULL, 0);
 
 	return 0;
 }
@@ -106,6 +310,8 @@ static int virtio_blk_probe(struct udevice *dev)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
 	struct blk_desc *desc = dev_get_uclass_platdata(dev);
+	u32 size_max, seg_max;
+	uint num, segs;
 	u64 cap;
 	int ret;
 
@@ -117,12 +323,64 @@ static int virtio_blk_probe(struct udevice *dev)
 	virtio_cread(dev, struct virtio_blk_config, capacity, &cap);
 	desc->lba = cap;
 
+	if (virtio_cread_feature(dev, VIRTIO_BLK_F_SIZE_MAX,
+				 struct virtio_blk_config, size_max,
+				 &size_max) || size_max < 512)
+		size_max = VIRTIO_BLK_SEG_SIZE;
+	priv->seg_size = size_max & ~511;
+
+	segs = VIRTIO_BLK_MAX_SEGS;
+	if (!virtio_cread_feature(dev, VIRTIO_BLK_F_SEG_MAX,
+				  struct virtio_blk_config, seg_max,
+				  &seg_max) && seg_max)
+		segs = min_t(uint, segs, seg_max);
+
+	/*
+	 * With indirect descriptors every request takes one ring entry, so
+	 * the ring is filled with requests of up to a full table of segments.
+	 * Otherwise requests are kept small enough for a few to fit at once.
+	 */
+	num = virtqueue_get_vring_size(priv->vq);
+	if (priv->vq->indir)
+		segs = min_t(uint, segs, VIRTQUEUE_INDIRECT_MAX - 2);
+	else if (num / VIRTIO_BLK_MIN_REQS > 2)
+		segs = min(segs, num / VIRTIO_BLK_MIN_REQS - 2);
+	else
+		segs = 1;
+	priv->max_blks = (lbaint_t)segs * priv->seg_size / 512;
+
+	priv->slots = calloc(num, sizeof(*priv->slots));
+	if (!priv->slots)
+		return -ENOMEM;
+	priv->num_slots = num;
+	priv->num_free = num;
+	blk_set_queue_depth(dev, num);
+
+	debug("%s: %u slots, %u segments of %u bytes, %sindirect\n",
+	      dev->name, num, segs, priv->seg_size,
+	      priv->vq->indir ? "" : "no ");
+
 	return 0;
 }
 
+static int virtio_blk_remove(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	int ret;
+
+	ret = virtio_reset(dev);
+	/* A device can be removed without ever having been probed */
+	if (priv)
+		free(priv->slots);
+
+	return ret;
+}
+
 static const struct blk_ops virtio_blk_ops = {
 	.read	= virtio_blk_read,
 	.write	= virtio_blk_write,
+	.submit	= virtio_blk_submit,
+	.poll	= virtio_blk_poll,
 };
 
 U_BOOT_DRIVER(virtio_blk) = {
@@ -131,7 +389,7 @@ U_BOOT_DRIVER(virtio_blk) = {
 	.ops	= &virtio_blk_ops,
 	.bind	= virtio_blk_bind,
 	.probe	= virtio_blk_probe,
-	.remove	= virtio_reset,
+	.remove	= virtio_blk_remove,
 	.priv_auto_alloc_size = sizeof(struct virtio_blk_priv),
 	.flags	= DM_FLAG_ACTIVE_DMA,
 };
@@ -19,15 +19,25 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 	struct vring_desc *desc;
 	unsigned int total_sg = out_sgs + in_sgs;
 	unsigned int i, n, avail, descs_used, uninitialized_var(prev);
+	bool indirect;
 	int head;
 
 	WARN_ON(total_sg == 0);
 
 	head = vq->free_head;
 
-	desc = vq->vring.desc;
-	i = head;
-	descs_used = total_sg;
+	/* Each ring entry owns a table, so the chain is already linked */
+	indirect = vq->indir && total_sg > 1 &&
+		   total_sg <= VIRTQUEUE_INDIRECT_MAX;
+	if (indirect) {
+		desc = vq->indir + head * VIRTQUEUE_INDIRECT_MAX;
+		i = 0;
+		descs_used = 1;
+	} else {
+		desc = vq->vring.desc;
+		i = head;
+		descs_used = total_sg;
+	}
 
 	if (vq->num_free < descs_used) {
 		debug("Can't add buf len %i - avail = %i\n",
@@ -67,6 +77,17 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 	/* Last one doesn't continue */
 	desc[prev].flags &= cpu_to_virtio16(vq->vdev, ~VRING_DESC_F_NEXT);
 
+	if (indirect) {
+		struct vring_desc *table = desc;
+
+		desc = &vq->vring.desc[head];
+		desc->flags = cpu_to_virtio16(vq->vdev, VRING_DESC_F_INDIRECT);
+		desc->addr = cpu_to_virtio64(vq->vdev, (u64)(uintptr_t)table);
+		desc->len = cpu_to_virtio32(vq->vdev,
+					    total_sg * sizeof(struct vring_desc));
+		i = virtio16_to_cpu(vq->vdev, desc->next);
+	}
+
 	/* We're using some buffers from the free list. */
 	vq->num_free -= descs_used;
 
@@ -159,6 +180,7 @@ static inline bool more_used(const struct virtqueue *vq)
 
 void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 {
+	struct vring_desc *desc;
 	unsigned int i;
 	u16 last_used;
 
@@ -186,6 +208,11 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 		return NULL;
 	}
 
+	/* Hand back the first buffer of the chain, as for a direct one */
+	desc = &vq->vring.desc[i];
+	if (desc->flags & cpu_to_virtio16(vq->vdev, VRING_DESC_F_INDIRECT))
+		desc = vq->indir + i * VIRTQUEUE_INDIRECT_MAX;
+
 	detach_buf(vq, i);
 	vq->last_used_idx++;
 	/*
@@ -197,15 +224,14 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 		virtio_store_mb(&vring_used_event(&vq->vring),
 				cpu_to_virtio16(vq->vdev, vq->last_used_idx));
 
-	return (void *)(uintptr_t)virtio64_to_cpu(vq->vdev,
-						  vq->vring.desc[i].addr);
+	return (void *)(uintptr_t)virtio64_to_cpu(vq->vdev, desc->addr);
 }
 
 static struct virtqueue *__vring_new_virtqueue(unsigned int index,
 					       struct vring vring,
 					       struct udevice *udev)
 {
-	unsigned int i;
+	unsigned int i, n;
 	struct virtqueue *vq;
 	struct virtio_dev_priv *uc_priv = dev_get_uclass_priv(udev);
 	struct udevice *vdev = uc_priv->vdev;
@@ -237,6 +263,20 @@ static struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	for (i = 0; i < vring.num - 1; i++)
 		vq->vring.desc[i].next = cpu_to_virtio16(vdev, i + 1);
 
+	/*
+	 * Indirect tables are optional: without one a buffer simply uses a
+	 * chain of ring entries. The links within each table never change.
+	 */
+	vq->indir = NULL;
+	if (virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC)) {
+		n = vring.num * VIRTQUEUE_INDIRECT_MAX;
+		vq->indir = memalign(VRING_DESC_ALIGN_SIZE,
+				     n * sizeof(struct vring_desc));
+		for (i = 0; vq->indir && i < n; i++)
+			vq->indir[i].next = cpu_to_virtio16(vdev, (i + 1) %
+						VIRTQUEUE_INDIRECT_MAX);
+	}
+
 	return vq;
 }
 
@@ -288,6 +328,7 @@ struct virtqueue *vring_create_virtqueue(unsigned int index, unsigned int num,
 void vring_del_virtqueue(struct virtqueue *vq)
 {
 	free(vq->vring.desc);
+	free(vq->indir);
 	list_del(&vq->list);
 	free(vq);
 }
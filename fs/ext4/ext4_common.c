@@ -1992,6 +1992,219 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 	return blknr;
 }
 
+/*
+ * Extent maps: the leaves of an inode's extent tree flattened into one sorted
+ * array of runs, so that a file is mapped with a single walk of the tree
+ * instead of one walk per block. A few maps are kept per mount, keyed by
+ * inode number, so a directory or file read several times is only walked once.
+ */
+#define EXT4_EXTENT_MAP_CACHE_SIZE	4
+#define EXT4_EXTENT_MAP_INC		64
+#define EXT4_EXTENT_MAX_DEPTH		5
+
+struct ext4_map_run {
+	uint32_t block;			/* first logical block */
+	uint32_t len;			/* number of blocks */
+	unsigned long long start;	/* first physical block */
+};
+
+struct ext4_extent_map {
+	int ino;			/* 0 if the slot is unused */
+	struct ext4_map_run *runs;
+	int count;
+	int alloc;
+	int cursor;			/* run of the last lookup */
+};
+
+static struct ext4_extent_map ext4fs_maps[EXT4_EXTENT_MAP_CACHE_SIZE];
+static int ext4fs_map_victim;
+
+static void ext4fs_extent_map_free(struct ext4_extent_map *map)
+{
+	free(map->runs);
+	memset(map, 0, sizeof(*map));
+}
+
+void ext4fs_extent_map_invalidate(void)
+{
+	int i;
+
+	for (i = 0; i < EXT4_EXTENT_MAP_CACHE_SIZE; i++)
+		ext4fs_extent_map_free(&ext4fs_maps[i]);
+	ext4fs_map_victim = 0;
+}
+
+static int ext4fs_extent_map_add(struct ext4_extent_map *map,
+				 struct ext4_extent *extent)
+{
+	uint32_t block = le32_to_cpu(extent->ee_block);
+	uint32_t len = le16_to_cpu(extent->ee_len);
+	unsigned long long start;
+	struct ext4_map_run *run;
+
+	start = le16_to_cpu(extent->ee_start_hi);
+	start = (start << 32) + le32_to_cpu(extent->ee_start_lo);
+	if (!len)
+		return 0;
+
+	if (map->count) {
+		run = &map->runs[map->count - 1];
+		/* The lookup relies on the leaves being sorted */
+		if (block < run->block + run->len)
+			return -EINVAL;
+		if (block == run->block + run->len &&
+		    start == run->start + run->len) {
+			run->len += len;
+			return 0;
+		}
+	}
+
+	if (map->count == map->alloc) {
+		run = realloc(map->runs, (map->alloc + EXT4_EXTENT_MAP_INC) *
+			      sizeof(*run));
+		if (!run)
+			return -ENOMEM;
+		map->runs = run;
+		map->alloc += EXT4_EXTENT_MAP_INC;
+	}
+	run = &map->runs[map->count++];
+	run->block = block;
+	run->len = len;
+	run->start = start;
+
+	return 0;
+}
+
+static int ext4fs_extent_map_walk(struct ext4_extent_map *map,
+				  struct ext4_extent_header *ext_block,
+				  int level)
+{
+	int entries = le16_to_cpu(ext_block->eh_entries);
+	int blksz = EXT2_BLOCK_SIZE(ext4fs_root);
+	int log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root) -
+			 get_fs()->dev_desc->log2blksz;
+	struct ext4_extent_idx *index;
+	unsigned long long block;
+	char *buf;
+	int i, ret = 0;
+
+	if (le16_to_cpu(ext_block->eh_magic) != EXT4_EXT_MAGIC ||
+	    level > EXT4_EXTENT_MAX_DEPTH)
+		return -EINVAL;
+
+	if (!le16_to_cpu(ext_block->eh_depth)) {
+		struct ext4_extent *extent;
+
+		extent = (struct ext4_extent *)(ext_block + 1);
+		for (i = 0; i < entries && !ret; i++)
+			ret = ext4fs_extent_map_add(map, &extent[i]);
+		return ret;
+	}
+
+	buf = zalloc(blksz);
+	if (!buf)
+		return -ENOMEM;
+
+	index = (struct ext4_extent_idx *)(ext_block + 1);
+	for (i = 0; i < entries && !ret; i++) {
+		block = le16_to_cpu(index[i].ei_leaf_hi);
+		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
+		if (!ext4fs_devread((lbaint_t)block << log2_blksz, 0, blksz,
+				    buf)) {
+			ret = -EIO;
+			break;
+		}
+		ret = ext4fs_extent_map_walk(map,
+					     (struct ext4_extent_header *)buf,
+					     level + 1);
+	}
+	free(buf);
+
+	return ret;
+}
+
+static struct ext4_extent_map *ext4fs_get_extent_map(struct ext2fs_node *node)
+{
+	struct ext4_extent_map *map;
+	int i;
+
+	for (i = 0; i < EXT4_EXTENT_MAP_CACHE_SIZE; i++) {
+		if (ext4fs_maps[i].ino == node->ino)
+			return &ext4fs_maps[i];
+	}
+
+	map = &ext4fs_maps[ext4fs_map_victim];
+	ext4fs_map_victim = (ext4fs_map_victim + 1) %
+			    EXT4_EXTENT_MAP_CACHE_SIZE;
+	ext4fs_extent_map_free(map);
+
+	if (ext4fs_extent_map_walk(map, (struct ext4_extent_header *)
+				   node->inode.b.blocks.dir_blocks, 0)) {
+		ext4fs_extent_map_free(map);
+		return NULL;
+	}
+	map->ino = node->ino;
+
+	return map;
+}
+
+long int ext4fs_map_block(struct ext2fs_node *node, int fileblock,
+			  struct ext_block_cache *cache, lbaint_t *run)
+{
+	struct ext4_extent_map *map = NULL;
+	struct ext4_map_run *r;
+	uint32_t block = fileblock;
+	int lo, hi, mid;
+
+	/*
+	 * Indirect-mapped files keep using their own block caches, and the
+	 * extent trees may change under the map while a write is in progress.
+	 */
+	if ((le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL) &&
+	    !get_fs()->inode_bmaps && node->ino)
+		map = ext4fs_get_extent_map(node);
+	if (!map) {
+		*run = 1;
+		return read_allocated_block(&node->inode, fileblock, cache);
+	}
+
+	/* Sequential reads hit the current run or the one after it */
+	lo = map->cursor;
+	if (lo + 1 < map->count && map->runs[lo + 1].block <= block)
+		lo++;
+	if (lo >= map->count || map->runs[lo].block > block ||
+	    (lo + 1 < map->count && map->runs[lo + 1].block <= block)) {
+		/* Find the last run starting at or before the block */
+		lo = -1;
+		hi = map->count - 1;
+		while (lo < hi) {
+			mid = (lo + hi + 1) / 2;
+			if (map->runs[mid].block <= block)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+	}
+
+	if (lo < 0) {
+		/* Sparse file, before the first extent */
+		*run = map->count ? map->runs[0].block - block : (lbaint_t)-1;
+		return 0;
+	}
+
+	map->cursor = lo;
+	r = &map->runs[lo];
+	if (block < r->block + r->len) {
+		*run = r->block + r->len - block;
+		return r->start + (block - r->block);
+	}
+
+	/* Sparse file, up to the next extent */
+	*run = lo + 1 < map->count ? map->runs[lo + 1].block - block :
+				     (lbaint_t)-1;
+	return 0;
+}
+
 /**
  * ext4fs_reinit_global() - Reinitialize values of ext4 write implementation's
  *			    global pointers
@@ -2006,6 +2219,7 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
  */
 void ext4fs_reinit_global(void)
 {
+	ext4fs_extent_map_invalidate();
 	if (ext4fs_indir1_block != NULL) {
 		free(ext4fs_indir1_block);
 		ext4fs_indir1_block = NULL;
@@ -2338,7 +2552,11 @@ int ext4fs_open(const char *filename, loff_t *len)
 	if (ext4fs_root == NULL)
 		return -1;
 
-	ext4fs_file = NULL;
+	/* release the previous file when several are opened in one mount */
+	if (ext4fs_file) {
+		ext4fs_free_node(ext4fs_file, &ext4fs_root->diropen);
+		ext4fs_file = NULL;
+	}
 	status = ext4fs_find_file(filename, &ext4fs_root->diropen, &fdiro,
 				  FILETYPE_REG);
 	if (status == 0)
@@ -56,6 +56,24 @@ int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 			struct ext2fs_node **fnode, int *ftype);
 
+/**
+ * ext4fs_map_block() - resolve a file block through the inode's extent map
+ *
+ * Like read_allocated_block(), but extent-mapped inodes are looked up in a
+ * flattened copy of their extent tree that is kept until the filesystem is
+ * closed, so reading a file walks its tree only once.
+ *
+ * @node:	file or directory being read
+ * @fileblock:	logical block in the file
+ * @cache:	block cache used for indirect-mapped inodes
+ * @run:	returns the number of blocks from @fileblock on that are
+ *		physically contiguous, or holes, and may be handled together
+ * Return:	physical block, 0 for a hole, or negative on error
+ */
+long int ext4fs_map_block(struct ext2fs_node *node, int fileblock,
+			  struct ext_block_cache *cache, lbaint_t *run);
+void ext4fs_extent_map_invalidate(void);
+
 #if defined(CONFIG_EXT4_WRITE)
 uint32_t ext4fs_div_roundup(uint32_t size, uint32_t n);
 uint16_t ext4fs_checksum_update(unsigned int i);
@@ -754,6 +754,9 @@ void ext4fs_deinit(void)
 	fs->first_pass_bbmap = 0;
 	fs->curr_inode_no = 0;
 	fs->curr_blkno = 0;
+
+	/* extent trees may have changed under maps built before the write */
+	ext4fs_extent_map_invalidate();
 }
 
 /*
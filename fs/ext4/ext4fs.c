@@ -24,6 +24,7 @@
 #include <ext_common.h>
 #include <ext4fs.h>
 #include "ext4_common.h"
+#include <fs.h>
 #include <div64.h>
 
 int ext4fs_symlinknest;
@@ -49,11 +50,13 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		loff_t len, char *buf, loff_t *actread)
 {
 	struct ext_filesystem *fs = get_fs();
-	int i;
+	lbaint_t i, n, first;
 	lbaint_t blockcnt;
 	int log2blksz = fs->dev_desc->log2blksz;
 	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data) - log2blksz;
 	int blocksize = (1 << (log2_fs_blocksize + log2blksz));
+	/* ext4fs_devread() takes an int length */
+	lbaint_t maxspan = INT_MAX >> (log2_fs_blocksize + log2blksz);
 	unsigned int filesize = le32_to_cpu(node->inode.size);
 	lbaint_t previous_block_number = -1;
 	lbaint_t delayed_start = 0;
@@ -61,7 +64,6 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 	lbaint_t delayed_skipfirst = 0;
 	lbaint_t delayed_next = 0;
 	char *delayed_buf = NULL;
-	char *start_buf = buf;
 	short status;
 	struct ext_block_cache cache;
 
@@ -77,42 +79,51 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 	}
 
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
-
-	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
+	first = lldiv(pos, blocksize);
+
+	/*
+	 * Each step handles a run of blocks that the extent map reports as
+	 * physically contiguous (or as a hole), so a contiguous file is read
+	 * with as few device reads as its layout allows.
+	 */
+	for (i = first; i < blockcnt; i += n) {
 		long int blknr;
-		int blockoff = pos - (blocksize * i);
-		int blockend = blocksize;
+		loff_t blockend;
 		int skipfirst = 0;
-		blknr = read_allocated_block(&node->inode, i, &cache);
+
+		blknr = ext4fs_map_block(node, i, &cache, &n);
 		if (blknr < 0) {
 			ext_cache_fini(&cache);
 			return -1;
 		}
+		if (n > blockcnt - i)
+			n = blockcnt - i;
+		if (n > maxspan)
+			n = maxspan;
 
 		blknr = blknr << log2_fs_blocksize;
+		blockend = (loff_t)n * blocksize;
 
 		/* Last block.  */
-		if (i == blockcnt - 1) {
-			blockend = (len + pos) - (blocksize * i);
-
-			/* The last portion is exactly blocksize. */
-			if (!blockend)
-				blockend = blocksize;
-		}
+		if (i + n == blockcnt)
+			blockend -= (loff_t)blockcnt * blocksize - (len + pos);
 
 		/* First block. */
-		if (i == lldiv(pos, blocksize)) {
-			skipfirst = blockoff;
+		if (i == first) {
+			skipfirst = pos - (loff_t)blocksize * i;
 			blockend -= skipfirst;
 		}
 		if (blknr) {
 			int status;
 
-			if (previous_block_number != -1) {
-				if (delayed_next == blknr) {
-					delayed_extent += blockend;
-					delayed_next += blockend >> log2blksz;
-				} else {	/* spill */
+			if (previous_block_number != -1 &&
+			    delayed_next == blknr &&
+			    delayed_extent + blockend <= INT_MAX) {
+				delayed_extent += blockend;
+				delayed_next += n << log2_fs_blocksize;
+			} else {
+				if (previous_block_number != -1) {
+					/* spill */
 					status = ext4fs_devread(delayed_start,
 							delayed_skipfirst,
 							delayed_extent,
@@ -121,26 +132,15 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 						ext_cache_fini(&cache);
 						return -1;
 					}
-					previous_block_number = blknr;
-					delayed_start = blknr;
-					delayed_extent = blockend;
-					delayed_skipfirst = skipfirst;
-					delayed_buf = buf;
-					delayed_next = blknr +
-						(blockend >> log2blksz);
 				}
-			} else {
 				previous_block_number = blknr;
 				delayed_start = blknr;
 				delayed_extent = blockend;
 				delayed_skipfirst = skipfirst;
 				delayed_buf = buf;
-				delayed_next = blknr +
-					(blockend >> log2blksz);
+				delayed_next = blknr + (n << log2_fs_blocksize);
 			}
 		} else {
-			int n;
-			int n_left;
 			if (previous_block_number != -1) {
 				/* spill */
 				status = ext4fs_devread(delayed_start,
@@ -153,14 +153,9 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 				}
 				previous_block_number = -1;
 			}
-			/* Zero no more than `len' bytes. */
-			n = blocksize - skipfirst;
-			n_left = len - ( buf - start_buf );
-			if (n > n_left)
-				n = n_left;
-			memset(buf, 0, n);
+			memset(buf, 0, blockend);
 		}
-		buf += blocksize - skipfirst;
+		buf += blockend;
 	}
 	if (previous_block_number != -1) {
 		/* spill */
@@ -255,6 +250,72 @@ int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 	return ext4fs_read(buf, offset, len, len_read);
 }
 
+/**
+ * ext4fs_map_file() - map a file to runs of contiguous sectors
+ *
+ * Resolve every logical block of 'filename' and coalesce physically adjacent
+ * blocks (and adjacent holes) into extents, so that the file can be read with
+ * one device read per extent. The last extent covers whole filesystem blocks
+ * and may extend past EOF.
+ *
+ * @filename:	name of the file
+ * @exts:	array receiving the extents, in file order
+ * @max:	number of entries in 'exts'
+ * @size:	returns the size of the file
+ * Return:	number of extents, -E2BIG if 'exts' is too small, or another
+ *		negative error code
+ */
+int ext4fs_map_file(const char *filename, struct fs_extent *exts, int max,
+		    loff_t *size)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext_block_cache cache;
+	struct fs_extent *last = NULL;
+	int log2_fs_blocksize;
+	lbaint_t blockcnt, i, n;
+	lbaint_t start;
+	long int blknr;
+	int count = 0;
+	int ret = 0;
+
+	if (ext4fs_open(filename, size) < 0)
+		return -ENOENT;
+
+	log2_fs_blocksize = LOG2_BLOCK_SIZE(ext4fs_root) -
+			    fs->dev_desc->log2blksz;
+	blockcnt = lldiv(*size + EXT2_BLOCK_SIZE(ext4fs_root) - 1,
+			 EXT2_BLOCK_SIZE(ext4fs_root));
+
+	ext_cache_init(&cache);
+	for (i = 0; i < blockcnt; i += n) {
+		blknr = ext4fs_map_block(ext4fs_file, i, &cache, &n);
+		if (blknr < 0) {
+			ret = -EIO;
+			break;
+		}
+		if (n > blockcnt - i)
+			n = blockcnt - i;
+		start = (lbaint_t)blknr << log2_fs_blocksize;
+
+		if (last && ((!start && !last->start) ||
+			     (start && last->start &&
+			      last->start + last->count == start))) {
+			last->count += n << log2_fs_blocksize;
+			continue;
+		}
+		if (count == max) {
+			ret = -E2BIG;
+			break;
+		}
+		last = &exts[count++];
+		last->start = start;
+		last->count = n << log2_fs_blocksize;
+	}
+	ext_cache_fini(&cache);
+
+	return ret ? ret : count;
+}
+
 int ext4fs_uuid(char *uuid_str)
 {
 	if (ext4fs_root == NULL)
@@ -18,6 +18,7 @@
 #include <part.h>
 #include <malloc.h>
 #include <memalign.h>
+#include <div64.h>
 #include <linux/compiler.h>
 #include <linux/ctype.h>
 
@@ -37,6 +38,14 @@ static void downcase(char *str, size_t len)
 static struct blk_desc *cur_dev;
 static disk_partition_t cur_part_info;
 
+/* Start of the boot sector of the volume the chain cache belongs to */
+#define FAT_CHAIN_BOOT_BYTES	0x60
+static struct blk_desc *chain_dev;
+static lbaint_t chain_part_start;
+static unsigned char chain_boot[FAT_CHAIN_BOOT_BYTES];
+
+static void fat_chain_invalidate(void);
+
 #define DOS_BOOT_MAGIC_OFFSET	0x1fe
 #define DOS_FS_TYPE_OFFSET	0x36
 #define DOS_FS32_TYPE_OFFSET	0x52
@@ -76,13 +85,22 @@ int fat_set_blk_dev(struct blk_desc *dev_desc, disk_partition_t *info)
 	}
 
 	/* Check for FAT12/FAT16/FAT32 filesystem */
-	if (!memcmp(buffer + DOS_FS_TYPE_OFFSET, "FAT", 3))
-		return 0;
-	if (!memcmp(buffer + DOS_FS32_TYPE_OFFSET, "FAT32", 5))
-		return 0;
+	if (memcmp(buffer + DOS_FS_TYPE_OFFSET, "FAT", 3) &&
+	    memcmp(buffer + DOS_FS32_TYPE_OFFSET, "FAT32", 5)) {
+		cur_dev = NULL;
+		return -1;
+	}
 
-	cur_dev = NULL;
-	return -1;
+	/* Drop decoded chains if the volume is not the one they came from */
+	if (chain_dev != dev_desc || chain_part_start != info->start ||
+	    memcmp(chain_boot, buffer, FAT_CHAIN_BOOT_BYTES)) {
+		fat_chain_invalidate();
+		chain_dev = dev_desc;
+		chain_part_start = info->start;
+		memcpy(chain_boot, buffer, FAT_CHAIN_BOOT_BYTES);
+	}
+
+	return 0;
 }
 
 int fat_register_device(struct blk_desc *dev_desc, int part_no)
@@ -240,24 +258,15 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 }
 
 /*
- * Read at most 'size' bytes from the specified cluster into 'buffer'.
- * Return 0 on success, -1 otherwise.
+ * Read at most 'size' bytes from the sectors starting at 'startsect' into
+ * 'buffer'. Return 0 on success, -1 otherwise.
  */
 static int
-get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
+read_sectors(fsdata *mydata, __u32 startsect, __u8 *buffer, unsigned long size)
 {
 	__u32 idx = 0;
-	__u32 startsect;
 	int ret;
 
-	if (clustnum > 0) {
-		startsect = clust_to_sect(mydata, clustnum);
-	} else {
-		startsect = mydata->rootdir_sect;
-	}
-
-	debug("gc - clustnum: %d, startsect: %d\n", clustnum, startsect);
-
 	if ((unsigned long)buffer & (ARCH_DMA_MINALIGN - 1)) {
 		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
 
@@ -301,6 +310,196 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/* Number of FAT sectors read at once when decoding a cluster chain */
+#define FAT_CHAIN_BLOCKS	64
+/* Number of decoded cluster chains kept */
+#define FAT_CHAIN_CACHE_SIZE	4
+/* Granularity in which the extent array of a chain grows */
+#define FAT_CHAIN_EXTS_INC	64
+
+/*
+ * Cluster chain of a file, decoded once into runs of contiguous sectors.
+ * Chains are keyed by device, partition, first cluster and file size and
+ * are dropped whenever the filesystem is written or another one is set.
+ */
+struct fat_chain {
+	struct blk_desc *dev;
+	lbaint_t part_start;
+	__u32 start;
+	__u32 size;
+	int count;
+	struct fs_extent *exts;
+};
+
+static struct fat_chain fat_chains[FAT_CHAIN_CACHE_SIZE];
+static int fat_chain_victim;
+
+static void fat_chain_invalidate(void)
+{
+	int i;
+
+	for (i = 0; i < FAT_CHAIN_CACHE_SIZE; i++) {
+		free(fat_chains[i].exts);
+		memset(&fat_chains[i], '\0', sizeof(fat_chains[i]));
+	}
+}
+
+/*
+ * Get the FAT entry at index 'entry' while decoding a chain. FAT16/32
+ * entries are taken from a window of FAT_CHAIN_BLOCKS sectors, so that a
+ * whole chain is decoded with a few large reads. FAT12 entries, which may
+ * straddle sectors, and a FAT with pending writes go through get_fatent().
+ */
+static __u32 get_chain_fatent(fsdata *mydata, __u32 entry, __u8 *win,
+			      __u32 *winstart, __u32 *winlen)
+{
+	__u32 entsz = mydata->fatsize / 8;
+	__u32 sect, off;
+
+	if (mydata->fatsize == 12 || mydata->fat_dirty)
+		return get_fatent(mydata, entry);
+
+	if (CHECK_CLUST(entry, mydata->fatsize)) {
+		printf("Error: Invalid FAT entry: 0x%08x\n", entry);
+		return 0;
+	}
+
+	sect = entry * entsz / mydata->sect_size;
+	if (sect < *winstart || sect >= *winstart + *winlen) {
+		*winstart = sect - sect % FAT_CHAIN_BLOCKS;
+		*winlen = min((__u32)FAT_CHAIN_BLOCKS,
+			      mydata->fatlength - *winstart);
+		if (disk_read(mydata->fat_sect + *winstart, *winlen, win) < 0) {
+			debug("Error reading FAT blocks\n");
+			*winlen = 0;
+			return 0;
+		}
+	}
+
+	off = entry * entsz - *winstart * mydata->sect_size;
+	if (mydata->fatsize == 32)
+		return FAT2CPU32(*(__u32 *)(win + off));
+
+	return FAT2CPU16(*(__u16 *)(win + off));
+}
+
+/*
+ * Decode the cluster chain of a file starting at cluster 'start' with
+ * 'size' bytes, or return it from the cache. Return NULL on error.
+ */
+static struct fat_chain *fat_get_chain(fsdata *mydata, __u32 start,
+				       __u32 size)
+{
+	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
+	__u32 winstart = 0, winlen = 0;
+	struct fat_chain *chain;
+	struct fs_extent *exts;
+	__u32 clust = start;
+	__u32 sect;
+	loff_t left;
+	__u8 *win;
+	int i;
+
+	for (i = 0; i < FAT_CHAIN_CACHE_SIZE; i++) {
+		chain = &fat_chains[i];
+		if (chain->exts && chain->dev == cur_dev &&
+		    chain->part_start == cur_part_info.start &&
+		    chain->start == start && chain->size == size)
+			return chain;
+	}
+
+	chain = &fat_chains[fat_chain_victim];
+	fat_chain_victim = (fat_chain_victim + 1) % FAT_CHAIN_CACHE_SIZE;
+	free(chain->exts);
+	memset(chain, '\0', sizeof(*chain));
+
+	win = malloc_cache_aligned(FAT_CHAIN_BLOCKS * mydata->sect_size);
+	if (!win)
+		return NULL;
+
+	for (left = size; left > 0; left -= bytesperclust) {
+		if (CHECK_CLUST(clust, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", clust);
+			printf("Invalid FAT entry\n");
+			goto err;
+		}
+
+		sect = clust_to_sect(mydata, clust);
+		if (chain->count && chain->exts[chain->count - 1].start +
+				    chain->exts[chain->count - 1].count == sect) {
+			chain->exts[chain->count - 1].count += mydata->clust_size;
+		} else {
+			if (!(chain->count % FAT_CHAIN_EXTS_INC)) {
+				exts = realloc(chain->exts,
+					       (chain->count + FAT_CHAIN_EXTS_INC) *
+					       sizeof(*exts));
+				if (!exts)
+					goto err;
+				chain->exts = exts;
+			}
+			chain->exts[chain->count].start = sect;
+			chain->exts[chain->count].count = mydata->clust_size;
+			chain->count++;
+		}
+
+		if (left > bytesperclust)
+			clust = get_chain_fatent(mydata, clust, win, &winstart,
+						 &winlen);
+	}
+	free(win);
+
+	chain->dev = cur_dev;
+	chain->part_start = cur_part_info.start;
+	chain->start = start;
+	chain->size = size;
+	/* keep empty files cacheable */
+	if (!chain->exts)
+		chain->exts = malloc(sizeof(*chain->exts));
+	if (!chain->exts)
+		return NULL;
+
+	return chain;
+
+err:
+	free(win);
+	free(chain->exts);
+	memset(chain, '\0', sizeof(*chain));
+	return NULL;
+}
+
+/*
+ * Read 'size' bytes starting 'offset' bytes into the run of sectors at
+ * 'startsect'. A partial first sector goes through a bounce buffer, the rest
+ * is read in one go. Return 0 on success, -1 otherwise.
+ */
+static int get_sectors(fsdata *mydata, __u32 startsect, loff_t offset,
+		       __u8 *buffer, loff_t size)
+{
+	u64 sect = offset;
+	__u32 skip;
+	loff_t n;
+
+	skip = do_div(sect, mydata->sect_size);
+	startsect += sect;
+	if (skip) {
+		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
+
+		if (disk_read(startsect, 1, tmpbuf) != 1) {
+			debug("Error reading data\n");
+			return -1;
+		}
+		n = min(size, (loff_t)(mydata->sect_size - skip));
+		memcpy(buffer, tmpbuf + skip, n);
+		buffer += n;
+		size -= n;
+		startsect++;
+	}
+	if (!size)
+		return 0;
+
+	return read_sectors(mydata, startsect, buffer, size);
+}
+
 /**
  * get_contents() - read from file
  *
@@ -320,10 +519,10 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 			__u8 *buffer, loff_t maxsize, loff_t *gotsize)
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
-	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
-	loff_t actsize;
+	struct fat_chain *chain;
+	loff_t extstart = 0;
+	loff_t extlen, n;
+	int i;
 
 	*gotsize = 0;
 	debug("Filesize: %llu bytes\n", filesize);
@@ -338,101 +537,28 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
-	actsize = bytesperclust;
-
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize += bytesperclust;
-	}
-
-	/* actsize > pos */
-	actsize -= bytesperclust;
-	filesize -= actsize;
-	pos -= actsize;
-
-	/* align to beginning of next cluster if any */
-	if (pos) {
-		__u8 *tmp_buffer;
-
-		actsize = min(filesize, (loff_t)bytesperclust);
-		tmp_buffer = malloc_cache_aligned(actsize);
-		if (!tmp_buffer) {
-			debug("Error: allocating buffer\n");
-			return -1;
-		}
-
-		if (get_cluster(mydata, curclust, tmp_buffer, actsize) != 0) {
-			printf("Error reading cluster\n");
-			free(tmp_buffer);
-			return -1;
-		}
-		filesize -= actsize;
-		actsize -= pos;
-		memcpy(buffer, tmp_buffer + pos, actsize);
-		free(tmp_buffer);
-		*gotsize += actsize;
-		if (!filesize)
-			return 0;
-		buffer += actsize;
-
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-	}
+	chain = fat_get_chain(mydata, START(dentptr), FAT2CPU32(dentptr->size));
+	if (!chain)
+		return -1;
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				printf("Invalid FAT entry\n");
+	/* one read per run of contiguous clusters */
+	for (i = 0; i < chain->count && pos < filesize; i++) {
+		extlen = (loff_t)chain->exts[i].count * mydata->sect_size;
+		if (pos < extstart + extlen) {
+			n = min(filesize, extstart + extlen) - pos;
+			if (get_sectors(mydata, chain->exts[i].start,
+					pos - extstart, buffer, n)) {
+				printf("Error reading cluster\n");
 				return -1;
 			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
-
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
+			buffer += n;
+			pos += n;
+			*gotsize += n;
 		}
-		*gotsize += (int)actsize;
-		filesize -= actsize;
-		buffer += actsize;
+		extstart += extlen;
+	}
 
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
@@ -1248,6 +1374,57 @@ int fat_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 	return ret;
 }
 
+/**
+ * fat_map_file() - map a file to runs of contiguous sectors
+ *
+ * Walk the cluster chain of 'filename' and coalesce physically adjacent
+ * clusters into extents, so that the file can be read with one disk read per
+ * extent. The last extent covers whole clusters and may extend past EOF.
+ *
+ * @filename:	name of the file
+ * @exts:	array receiving the extents, in file order
+ * @max:	number of entries in 'exts'
+ * @size:	returns the size of the file
+ * Return:	number of extents, -E2BIG if 'exts' is too small, or another
+ *		negative error code
+ */
+int fat_map_file(const char *filename, struct fs_extent *exts, int max,
+		 loff_t *size)
+{
+	fsdata fsdata, *mydata = &fsdata;
+	struct fat_chain *chain;
+	fat_itr *itr;
+	int ret;
+
+	itr = malloc_cache_aligned(sizeof(fat_itr));
+	if (!itr)
+		return -ENOMEM;
+	ret = fat_itr_root(itr, &fsdata);
+	if (ret)
+		goto out_free_itr;
+
+	ret = fat_itr_resolve(itr, filename, TYPE_FILE);
+	if (ret)
+		goto out_free_both;
+
+	*size = FAT2CPU32(itr->dent->size);
+	chain = fat_get_chain(mydata, START(itr->dent), *size);
+	if (!chain) {
+		ret = -EIO;
+	} else if (chain->count > max) {
+		ret = -E2BIG;
+	} else {
+		memcpy(exts, chain->exts, chain->count * sizeof(*exts));
+		ret = chain->count;
+	}
+
+out_free_both:
+	free(fsdata.fatbuf);
+out_free_itr:
+	free(itr);
+	return ret;
+}
+
 typedef struct {
 	struct fs_dir_stream parent;
 	struct fs_dirent dirent;
@@ -1082,6 +1082,9 @@ int file_fat_write_at(const char *filename, loff_t pos, void *buffer,
 
 	debug("writing %s\n", filename);
 
+	/* cluster chains may change */
+	fat_chain_invalidate();
+
 	filename_copy = strdup(filename);
 	if (!filename_copy)
 		return -ENOMEM;
@@ -1287,6 +1290,8 @@ int fat_unlink(const char *filename)
 	int n_entries, ret;
 	char *filename_copy, *dirname, *basename;
 
+	fat_chain_invalidate();
+
 	filename_copy = strdup(filename);
 	if (!filename_copy) {
 		printf("Error: allocating memory\n");
@@ -1364,6 +1369,8 @@ int fat_mkdir(const char *new_dirname)
 	unsigned int bytesperclust;
 	dir_entry *dotdent = NULL;
 
+	fat_chain_invalidate();
+
 	dirname_copy = strdup(new_dirname);
 	if (!dirname_copy)
 		goto exit;
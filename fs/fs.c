@@ -17,13 +17,17 @@
 #include <config.h>
 #include <errno.h>
 #include <common.h>
+#include <cpu_func.h>
 #include <env.h>
+#include <malloc.h>
 #include <mapmem.h>
+#include <memalign.h>
 #include <part.h>
 #include <ext4fs.h>
 #include <fat.h>
 #include <fs.h>
 #include <sandboxfs.h>
+#include <sort.h>
 #include <ubifs_uboot.h>
 #include <btrfs.h>
 #include <asm/io.h>
@@ -31,6 +35,10 @@
 #include <linux/math64.h>
 #include <efi_loader.h>
 #include <linux/delay.h>
+#include <dm/ofnode.h>
+#include <lmb.h>
+#include <octopos_mbox.h>
+#include <hash.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -174,6 +182,12 @@ struct fstype_info {
 	int (*unlink)(const char *filename);
 	int (*mkdir)(const char *dirname);
 	int (*ln)(const char *filename, const char *target);
+	/*
+	 * Map a file to the extents holding its data, see struct fs_extent.
+	 * Returns the number of extents or -errno. Optional.
+	 */
+	int (*map)(const char *filename, struct fs_extent *exts, int max,
+		   loff_t *size);
 };
 
 static struct fstype_info fstypes[] = {
@@ -202,6 +216,7 @@ static struct fstype_info fstypes[] = {
 		.readdir = fat_readdir,
 		.closedir = fat_closedir,
 		.ln = fs_ln_unsupported,
+		.map = fat_map_file,
 	},
 #endif
 
@@ -227,6 +242,7 @@ static struct fstype_info fstypes[] = {
 		.opendir = fs_opendir_unsupported,
 		.unlink = fs_unlink_unsupported,
 		.mkdir = fs_mkdir_unsupported,
+		.map = ext4fs_map_file,
 	},
 #endif
 #ifdef CONFIG_SANDBOX
@@ -541,6 +557,318 @@ int fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 	return _fs_read(filename, addr, offset, len, 0, actread);
 }
 
+/*
+ * Find the files of a batch with a single scan of their directory. Files
+ * that are found are numbered in directory order in @order, missing files
+ * get -1. Returns -ENOSYS if the filesystem has no directory streams.
+ */
+static int fs_read_multi_scan(struct fstype_info *info, const char *dirname,
+			      struct fs_read_req *reqs, int count, int *order)
+{
+	struct fs_dir_stream *dirs;
+	struct fs_dirent *dent;
+	int pos = 0;
+	int ret, i;
+
+	ret = info->opendir(dirname, &dirs);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < count; i++)
+		order[i] = -1;
+
+	while (!info->readdir(dirs, &dent)) {
+		if (dent->type != FS_DT_REG || !dent->size)
+			continue;
+		for (i = 0; i < count; i++) {
+			if (!strcmp(dent->name, reqs[i].name)) {
+				reqs[i].size = dent->size;
+				order[i] = pos++;
+			}
+		}
+	}
+	info->closedir(dirs);
+
+	return 0;
+}
+
+/* Flush a written range, widened to whole cache lines */
+static void fs_flush_range(ulong addr, loff_t len)
+{
+	ulong start = rounddown(addr, ARCH_DMA_MINALIGN);
+	ulong end = roundup(addr + len, ARCH_DMA_MINALIGN);
+
+	flush_cache(start, end - start);
+}
+
+/* Maximum number of extents of a file read with FS_READ_DIRECT */
+#define FS_MAX_EXTENTS	1024
+
+/* A file of a batch, with its extents if the filesystem could map it */
+struct fs_read_item {
+	struct fs_read_req *req;
+	int pos;
+	lbaint_t first;
+	struct fs_extent *exts;
+	int nexts;
+	loff_t size;
+};
+
+/*
+ * Map a file of a batch to its extents, keeping them for the read. The first
+ * block holding data decides when the file is read.
+ */
+static void fs_read_multi_map(struct fstype_info *info, const char *path,
+			      struct fs_extent *scratch,
+			      struct fs_read_item *item)
+{
+	int count, i;
+
+	count = info->map(path, scratch, FS_MAX_EXTENTS, &item->size);
+	if (count <= 0)
+		return;
+
+	item->exts = malloc(count * sizeof(*item->exts));
+	if (!item->exts)
+		return;
+	memcpy(item->exts, scratch, count * sizeof(*item->exts));
+	item->nexts = count;
+
+	for (i = 0; i < count && !item->first; i++)
+		item->first = item->exts[i].start;
+}
+
+/*
+ * Mapped files go first, by the first block holding their data, so that the
+ * device sees the reads in ascending order. The rest keep directory order.
+ */
+static int fs_read_item_cmp(const void *a, const void *b)
+{
+	const struct fs_read_item *x = a, *y = b;
+
+	if (x->first != y->first) {
+		if (!x->first || !y->first)
+			return x->first ? -1 : 1;
+		return x->first < y->first ? -1 : 1;
+	}
+
+	return x->pos - y->pos;
+}
+
+/*
+ * Read a whole file straight into place from its extents, one block read per
+ * extent. Returns -ENOSYS if the file cannot be read this way and the regular
+ * read path must be used instead.
+ */
+static int fs_read_extents(struct fs_read_req *req, struct fs_read_item *item)
+{
+	int log2blksz = fs_dev_desc->log2blksz;
+	struct fs_extent *exts = item->exts;
+	struct blk_req *ios, *io;
+	loff_t left, n;
+	lbaint_t blks;
+	char *base, *buf, *bounce;
+	char *tail = NULL;
+	loff_t tail_len = 0;
+	int i, nio = 0;
+	int ret = 0;
+
+	if (!exts || !IS_ALIGNED(req->addr, ARCH_DMA_MINALIGN))
+		return -ENOSYS;
+
+	/* one request per extent, plus the partial last block */
+	bounce = malloc_cache_aligned(fs_dev_desc->blksz);
+	ios = calloc(item->nexts + 1, sizeof(*ios));
+	if (!bounce || !ios) {
+		ret = -ENOSYS;
+		goto out;
+	}
+
+	left = req->len && req->len < item->size ? req->len : item->size;
+	req->actread = left;
+	req->direct = 0;
+	base = map_sysmem(req->addr, left);
+	buf = base;
+
+	/*
+	 * Keep the extents in flight together, so that devices which queue
+	 * requests can work on several of them at once.
+	 */
+	for (i = 0; i < item->nexts && left; i++) {
+		n = min(left, (loff_t)exts[i].count << log2blksz);
+		blks = n >> log2blksz;
+
+		if (!exts[i].start) {
+			memset(buf, '\0', n);
+		} else {
+			if (blks) {
+				io = &ios[nio++];
+				io->start = fs_partition.start + exts[i].start;
+				io->blkcnt = blks;
+				io->buffer = buf;
+				ret = blk_submit(fs_dev_desc, io);
+				if (ret)
+					break;
+			}
+			req->direct += blks << log2blksz;
+
+			/* partial last block through the bounce buffer */
+			if (n > (blks << log2blksz)) {
+				io = &ios[nio++];
+				io->start = fs_partition.start +
+					    exts[i].start + blks;
+				io->blkcnt = 1;
+				io->buffer = bounce;
+				ret = blk_submit(fs_dev_desc, io);
+				if (ret)
+					break;
+				tail = buf + (blks << log2blksz);
+				tail_len = n - (blks << log2blksz);
+			}
+		}
+		buf += n;
+		left -= n;
+	}
+	/* the buffers must not be released while requests are in flight */
+	if (blk_wait_all(fs_dev_desc) && !ret)
+		ret = -EIO;
+	for (i = 0; i < nio && !ret; i++) {
+		if (!ios[i].done || ios[i].result != ios[i].blkcnt)
+			ret = -EIO;
+	}
+	if (!ret && tail)
+		memcpy(tail, bounce, tail_len);
+	/* anything not covered by an extent reads as a hole */
+	if (!ret && left)
+		memset(buf, '\0', left);
+	unmap_sysmem(base);
+
+out:
+	free(ios);
+	free(bounce);
+	return ret;
+}
+
+int fs_read_multi(const char *dirname, struct fs_read_req *reqs, int count,
+		  int (*place)(struct fs_read_req *reqs, int count, void *priv),
+		  void *priv)
+{
+	struct fstype_info *info = fs_get_info(fs_type);
+	struct fs_extent *scratch = NULL;
+	struct fs_read_item *items, *item;
+	struct fs_read_req *req;
+	char path[256];
+	int *order;
+	int nread = 0, nitems = 0;
+	loff_t start;
+	int ret = 0;
+	int i;
+	void *buf;
+
+	order = calloc(count, sizeof(*order));
+	items = calloc(count, sizeof(*items));
+	if (!order || !items) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < count; i++) {
+		reqs[i].ret = -ENOENT;
+		reqs[i].size = 0;
+		reqs[i].actread = 0;
+		reqs[i].direct = 0;
+	}
+
+	if (fs_read_multi_scan(info, dirname, reqs, count, order)) {
+		/* no directory streams, look each file up instead */
+		for (i = 0; i < count; i++) {
+			snprintf(path, sizeof(path), "%s/%s", dirname,
+				 reqs[i].name);
+			if (info->size(path, &reqs[i].size) || !reqs[i].size) {
+				reqs[i].size = 0;
+				order[i] = -1;
+			} else {
+				order[i] = i;
+			}
+		}
+	}
+
+	if (place) {
+		ret = place(reqs, count, priv);
+		if (ret)
+			goto out;
+	}
+
+	if (info->map)
+		scratch = malloc(FS_MAX_EXTENTS * sizeof(*scratch));
+	for (i = 0; i < count; i++) {
+		if (order[i] < 0)
+			continue;
+		item = &items[nitems++];
+		item->req = &reqs[i];
+		item->pos = order[i];
+		if (scratch) {
+			snprintf(path, sizeof(path), "%s/%s", dirname,
+				 reqs[i].name);
+			fs_read_multi_map(info, path, scratch, item);
+		}
+	}
+	free(scratch);
+
+	/* issue the reads in block order if known, mounted once */
+	qsort(items, nitems, sizeof(*items), fs_read_item_cmp);
+	for (i = 0; i < nitems; i++) {
+		item = &items[i];
+		req = item->req;
+
+		snprintf(path, sizeof(path), "%s/%s", dirname, req->name);
+		req->ret = -ENOSYS;
+		if (req->flags & FS_READ_DIRECT)
+			req->ret = fs_read_extents(req, item);
+		if (req->ret == -ENOSYS) {
+			buf = map_sysmem(req->addr, req->len);
+			req->ret = info->read(path, buf, 0, req->len,
+					      &req->actread);
+			unmap_sysmem(buf);
+			req->direct = 0;
+		}
+		debug("%s: %s -> %08lx (%d %lld %lld)\n", __func__, path,
+		      req->addr, req->ret, req->actread, req->direct);
+		if (!req->ret && req->actread) {
+			nread++;
+			if (req->flags & FS_READ_FLUSH)
+				fs_flush_range(req->addr, req->actread);
+		}
+	}
+
+	/* zero-fill what the reads left of each range once they are done */
+	for (i = 0; i < count; i++) {
+		req = &reqs[i];
+		if (!req->ret && !req->actread)
+			req->ret = -ENOENT;
+		if (req->ret)
+			req->actread = 0;
+		start = req->actread;
+		if (req->fill <= start)
+			continue;
+		buf = map_sysmem(req->addr + start, req->fill - start);
+		memset(buf, '\0', req->fill - start);
+		unmap_sysmem(buf);
+		if (req->flags & FS_READ_FLUSH)
+			fs_flush_range(req->addr + start, req->fill - start);
+	}
+	ret = nread;
+
+out:
+	for (i = 0; items && i < nitems; i++)
+		free(items[i].exts);
+	free(items);
+	free(order);
+	fs_close();
+
+	return ret;
+}
+
 int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 	     loff_t *actwrite)
 {
@@ -758,6 +1086,174 @@ void octopos_mailbox_deduct_and_set_owner(u32 base, u8 owner)
 	Xil_Out32(base, 0xFF000000);
 }
 
+/* Number of mailbox messages in the untrusted domain boot image */
+#define OCTOPOS_BOOT_IMAGE_MSGS 12623
+
+/* Progressive hash of the image, updated as each message lands */
+struct octopos_hash {
+	struct hash_algo *algo;
+	void *ctx;
+	int err;
+};
+
+static int octopos_hash_start(struct octopos_hash *h)
+{
+	const char *name;
+	int ret;
+
+	h->algo = NULL;
+	h->err = 0;
+	if (!IS_ENABLED(CONFIG_FS_OCTOPOS_HASH))
+		return 0;
+
+	name = env_get("octopos_hash_algo");
+	if (!name)
+		name = "sha256";
+	ret = hash_progressive_lookup_algo(name, &h->algo);
+	if (ret) {
+		printf("** Unknown hash algorithm %s **\n", name);
+		return ret;
+	}
+
+	if (h->algo->hash_init(h->algo, &h->ctx)) {
+		h->algo = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int octopos_hash_update(struct octopos_hash *h, const void *buf,
+			       unsigned int size)
+{
+	int ret;
+
+	if (!h->algo)
+		return h->err;
+
+	ret = h->algo->hash_update(h->algo, h->ctx, buf, size, 0);
+	if (ret) {
+		/* keep the error so that the load fails rather than unchecked */
+		printf("** %s update failed **\n", h->algo->name);
+		free(h->ctx);
+		h->algo = NULL;
+		h->err = ret;
+	}
+
+	return ret;
+}
+
+static int octopos_hash_finish(struct octopos_hash *h)
+{
+	struct hash_algo *algo = h->algo;
+	uint8_t sum[HASH_MAX_DIGEST_SIZE];
+	uint8_t vsum[HASH_MAX_DIGEST_SIZE];
+	char str[HASH_MAX_DIGEST_SIZE * 2 + 1];
+	const char *expected;
+	int i;
+
+	if (!algo)
+		return h->err;
+
+	/* hash_finish() frees the context */
+	h->algo = NULL;
+	if (algo->hash_finish(algo, h->ctx, sum, sizeof(sum)))
+		return -EINVAL;
+
+	for (i = 0; i < algo->digest_size; i++)
+		sprintf(str + i * 2, "%02x", sum[i]);
+	env_set("octopos_hash", str);
+	printf("%s: %s\n", algo->name, str);
+
+	expected = env_get("octopos_hash_expected");
+	if (!expected)
+		return 0;
+
+	if (strlen(expected) != algo->digest_size * 2 ||
+	    hash_parse_string(algo->name, expected, vsum) ||
+	    memcmp(sum, vsum, algo->digest_size)) {
+		printf("** %s mismatch, expected %s **\n", algo->name,
+		       expected);
+		return -EACCES;
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_OCTOPOS_MBOX
+static void octopos_hash_abort(struct octopos_hash *h)
+{
+	if (h->algo)
+		free(h->ctx);
+	h->algo = NULL;
+}
+
+static void octopos_mbox_report(struct octopos_mbox_stats *stats)
+{
+	u64 bytes = (u64)stats->msgs * OCTOPOS_MBOX_MSG_SIZE;
+
+	printf("mailbox: %lu msgs (%lu bursts) in %lu us, latency %lu-%lu us",
+	       stats->msgs, stats->bursts, stats->total_us,
+	       stats->msgs ? stats->lat_min_us : 0, stats->lat_max_us);
+	if (stats->total_us) {
+		puts(" (");
+		print_size(div_u64(bytes * 1000000, stats->total_us), "/s");
+		puts(")");
+	}
+	puts("\n");
+}
+
+static int do_load_octopos_mbox(struct mbox_chan *chan, void *buf,
+				struct octopos_hash *hash, loff_t *actread)
+{
+	struct octopos_mbox_stats *stats = octopos_mbox_get_stats(chan);
+	ulong total = 0;
+	ulong count, i;
+	void *msg;
+	int quota;
+	int ret = 0;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->lat_min_us = ~0UL;
+
+	do {
+		/* wait for os to delegate data queue access */
+		quota = octopos_mbox_wait_delegation(chan, 0);
+		if (quota < 0)
+			return quota;
+#ifdef FINITE_DELEGATION
+		count = quota / 128;
+#else
+		count = OCTOPOS_BOOT_IMAGE_MSGS;
+#endif
+		/* hash each message while it is still in the cache */
+		for (i = 0; i < count; i++) {
+			msg = buf + (total + i) * OCTOPOS_MBOX_MSG_SIZE;
+			ret = octopos_mbox_recv_msgs(chan, msg, 1);
+			if (!ret)
+				ret = octopos_hash_update(hash, msg,
+							  OCTOPOS_MBOX_MSG_SIZE);
+			if (ret)
+				break;
+		}
+		octopos_mbox_release(chan);
+		if (ret)
+			return ret;
+		total += count;
+#ifdef FINITE_DELEGATION
+	/* repeat until OS stops delegating the queue */
+	} while (quota / 128 == OCTOPOS_MBOX_MAX_LIMIT / 128);
+#else
+	} while (0);
+#endif
+
+	*actread = total * OCTOPOS_MBOX_MSG_SIZE;
+	octopos_mbox_report(stats);
+
+	return 0;
+}
+#endif
+
 int do_load_octopos(ulong addr, loff_t offset, loff_t len, loff_t *actread)
 {
 	/* FIXME: hard coded address */
@@ -767,9 +1263,32 @@ int do_load_octopos(ulong addr, loff_t offset, loff_t len, loff_t *actread)
 	int need_repeat = 0;
 	int total = 0;
 	void* buf;
+	void *msg;
+	struct octopos_hash hash;
+	int ret;
+#ifdef CONFIG_OCTOPOS_MBOX
+	struct mbox_chan chan;
+#endif
+
+	ret = octopos_hash_start(&hash);
+	if (ret)
+		return ret;
 
 	buf = map_sysmem(addr, len);
 
+#ifdef CONFIG_OCTOPOS_MBOX
+	/* prefer the mailbox driver, fall back to polling fixed addresses */
+	if (!octopos_mbox_get(&chan)) {
+		ret = do_load_octopos_mbox(&chan, buf, &hash, actread);
+		if (!ret)
+			ret = octopos_hash_finish(&hash);
+		else
+			octopos_hash_abort(&hash);
+		unmap_sysmem(buf);
+		return ret;
+	}
+#endif
+
 repeat:
 	/* wait for os to delegate data queue access */
 	while (0xdeadbeef == Xil_In32(q_storage_control));
@@ -794,13 +1313,18 @@ repeat:
 #ifdef FINITE_DELEGATION
 	for (int i = 0; i < (int) count; i++) {
 #else
-	int block_size = 12623;
+	int block_size = OCTOPOS_BOOT_IMAGE_MSGS;
 	for (int i = 0; i < block_size; i++) {	
 #endif
+		msg = buf + (total + i) * MAILBOX_QUEUE_MSG_SIZE_LARGE;
 		XMbox_ReadBlocking(
 			q_storage_data_out,
-			(u8*) (buf + (total + i) * MAILBOX_QUEUE_MSG_SIZE_LARGE),
+			(u32 *)msg,
 			MAILBOX_QUEUE_MSG_SIZE_LARGE);
+		/* keep draining the queue, the load fails below */
+		if (!ret)
+			ret = octopos_hash_update(&hash, msg,
+						  MAILBOX_QUEUE_MSG_SIZE_LARGE);
 	}
 
 #ifdef FINITE_DELEGATION
@@ -818,10 +1342,12 @@ repeat:
 
 	*actread = total * MAILBOX_QUEUE_MSG_SIZE_LARGE;
 
+	if (!ret)
+		ret = octopos_hash_finish(&hash);
 
 	unmap_sysmem(buf);
 
-	return CMD_RET_SUCCESS;
+	return ret ? ret : CMD_RET_SUCCESS;
 }
 
 /* FIXME: this comes from octopos/storage.h and storage/storage.c */
@@ -833,24 +1359,234 @@ repeat:
 #define STORAGE_UNTRUSTED_ROOT_FS_PARTITION_SIZE	300000
 #define RAM_ROOT_PARTITION_METADATA_BASE 0x25000000
 #define RAM_ROOT_PARTITION_BASE 0x30000000
-#define RAM_UNTRUSTED_PARTITION_BASE (RAM_ROOT_PARTITION_BASE + STORAGE_BOOT_PARTITION_SIZE * STORAGE_BLOCK_SIZE)
-#define RAM_ENCLAVE_PARTITION_1_BASE (RAM_UNTRUSTED_PARTITION_BASE + STORAGE_UNTRUSTED_ROOT_FS_PARTITION_SIZE * STORAGE_BLOCK_SIZE)
-#define RAM_ENCLAVE_PARTITION_2_BASE (RAM_ENCLAVE_PARTITION_1_BASE + 100 * STORAGE_BLOCK_SIZE)
-#define RAM_ENCLAVE_PARTITION_3_BASE (RAM_ENCLAVE_PARTITION_2_BASE + 100 * STORAGE_BLOCK_SIZE)
-#define RAM_ENCLAVE_PARTITION_4_BASE (RAM_ENCLAVE_PARTITION_3_BASE + 100 * STORAGE_BLOCK_SIZE)
+#define RAM_PARTITION_REGION_SIZE 0x10000000
 
+/* default layout, used when the device tree does not describe one */
 uint32_t partition_sizes[NUM_PARTITIONS] = {STORAGE_BOOT_PARTITION_SIZE,
 	STORAGE_UNTRUSTED_ROOT_FS_PARTITION_SIZE, 100, 100, 100, 100};
 
-uint32_t partition_base[NUM_PARTITIONS] = {
-	RAM_ROOT_PARTITION_BASE,
-	RAM_UNTRUSTED_PARTITION_BASE,
-	RAM_ENCLAVE_PARTITION_1_BASE,
-	RAM_ENCLAVE_PARTITION_2_BASE,
-	RAM_ENCLAVE_PARTITION_3_BASE,
-	RAM_ENCLAVE_PARTITION_4_BASE
+/* Maximum number of partitions a device tree layout may describe */
+#define OCTOPOS_MAX_PARTITIONS	16
+
+/**
+ * struct octopos_layout - RAM layout of the preloaded storage partitions
+ *
+ * @count:	Number of partitions to preload
+ * @meta_base:	Address of the metadata of partition 0
+ * @data_base:	Start of the region the partitions are placed in
+ * @data_size:	Size of the region the partitions are placed in
+ * @packed:	true to place each partition at the size of its file, false
+ *		to reserve the full partition size for each of them
+ * @blocks:	Size of each partition in storage blocks
+ */
+struct octopos_layout {
+	int count;
+	ulong meta_base;
+	ulong data_base;
+	ulong data_size;
+	bool packed;
+	u32 blocks[OCTOPOS_MAX_PARTITIONS];
 };
 
+/*
+ * Read the layout from the "octopos,storage-layout" node, falling back to
+ * the compile-time partition table.
+ */
+static void octopos_get_layout(struct octopos_layout *layout)
+{
+	ofnode node;
+	int size;
+	u32 val;
+	int i;
+
+	layout->count = NUM_PARTITIONS;
+	layout->meta_base = RAM_ROOT_PARTITION_METADATA_BASE;
+	layout->data_base = RAM_ROOT_PARTITION_BASE;
+	layout->data_size = RAM_PARTITION_REGION_SIZE;
+	layout->packed = false;
+	for (i = 0; i < NUM_PARTITIONS; i++)
+		layout->blocks[i] = partition_sizes[i];
+
+	if (!CONFIG_IS_ENABLED(OF_CONTROL))
+		return;
+
+	node = ofnode_by_compatible(ofnode_null(), "octopos,storage-layout");
+	if (!ofnode_valid(node))
+		return;
+
+	size = ofnode_read_size(node, "partition-blocks");
+	if (size <= 0 || size % sizeof(u32) ||
+	    size > sizeof(layout->blocks) ||
+	    ofnode_read_u32_array(node, "partition-blocks", layout->blocks,
+				  size / sizeof(u32))) {
+		printf("** Invalid OctopOS storage layout, using default **\n");
+		for (i = 0; i < NUM_PARTITIONS; i++)
+			layout->blocks[i] = partition_sizes[i];
+		return;
+	}
+	layout->count = size / sizeof(u32);
+
+	if (!ofnode_read_u32(node, "metadata-base", &val))
+		layout->meta_base = val;
+	if (!ofnode_read_u32(node, "data-base", &val))
+		layout->data_base = val;
+	if (!ofnode_read_u32(node, "data-size", &val))
+		layout->data_size = val;
+	layout->packed = ofnode_read_bool(node, "octopos,packed");
+}
+
+/*
+ * Place the data file of each partition once their sizes are known. The
+ * partitions are laid out back to back from the start of the data region,
+ * each range being allocated from lmb so that reserved memory is never
+ * overwritten. The result is exported as octopos_partition_<n>_{base,size}.
+ * The metadata is cleared here too, once it is known not to be reserved.
+ */
+static int octopos_place_partitions(struct fs_read_req *reqs, int count,
+				    void *priv)
+{
+	struct octopos_layout *layout = priv;
+	ulong end = layout->data_base + layout->data_size;
+	ulong addr = layout->data_base;
+	ulong meta_size = layout->count * STORAGE_METADATA_SIZE;
+	struct fs_read_req *data;
+	char name[32];
+	loff_t size, max;
+	void *meta;
+	int i;
+#ifdef CONFIG_LMB
+	struct lmb lmb;
+
+	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
+	if (lmb_alloc_addr(&lmb, layout->meta_base, meta_size) !=
+	    layout->meta_base) {
+		printf("** OctopOS metadata overlaps reserved memory **\n");
+		return -ENOSPC;
+	}
+#endif
+	/* the creation tags are read into it once this returns */
+	meta = map_sysmem(layout->meta_base, meta_size);
+	memset(meta, 0, meta_size);
+	unmap_sysmem(meta);
+
+	for (i = 0; i < layout->count; i++) {
+		data = &reqs[i * 2];
+		max = (loff_t)layout->blocks[i] * STORAGE_BLOCK_SIZE;
+		if (data->size > max) {
+			printf("** %s truncated to %lld bytes **\n", data->name,
+			       max);
+			data->len = max;
+		}
+
+		if (layout->packed)
+			size = roundup(min(data->size, max),
+				       (loff_t)STORAGE_BLOCK_SIZE);
+		else
+			size = max;
+		/* whatever the file does not cover reads as zeroes */
+		data->fill = size;
+
+		if (addr + size > end) {
+			printf("** Partition %d does not fit the data region **\n",
+			       i);
+			return -ENOSPC;
+		}
+#ifdef CONFIG_LMB
+		if (size && lmb_alloc_addr(&lmb, addr, size) != addr) {
+			printf("** Partition %d overlaps reserved memory **\n",
+			       i);
+			return -ENOSPC;
+		}
+#endif
+		data->addr = addr;
+
+		snprintf(name, sizeof(name), "octopos_partition_%d_base", i);
+		env_set_hex(name, addr);
+		snprintf(name, sizeof(name), "octopos_partition_%d_size", i);
+		env_set_hex(name, size);
+
+		addr += size;
+	}
+
+	return 0;
+}
+
+/*
+ * Load the data and creation tag of every partition from the device set by
+ * fs_set_blk_dev(), in a single mount of the filesystem.
+ */
+static int octopos_preload_partitions(void)
+{
+	struct fs_read_req reqs[OCTOPOS_MAX_PARTITIONS * 2];
+	char names[OCTOPOS_MAX_PARTITIONS * 2][32];
+	struct fs_read_req *data, *create;
+	struct octopos_layout layout;
+	loff_t total = 0, direct = 0;
+	int loaded = 0;
+	ulong metabase;
+	void *meta;
+	int ret;
+	int i;
+
+	octopos_get_layout(&layout);
+
+	for (i = 0; i < layout.count; i++) {
+		metabase = layout.meta_base + i * STORAGE_METADATA_SIZE;
+
+		data = &reqs[i * 2];
+		sprintf(names[i * 2], "octopos_partition_%d_data", i);
+		data->name = names[i * 2];
+		data->len = 0;
+		data->flags = FS_READ_FLUSH | FS_READ_DIRECT;
+
+		create = &reqs[i * 2 + 1];
+		sprintf(names[i * 2 + 1], "octopos_partition_%d_create", i);
+		create->name = names[i * 2 + 1];
+		create->addr = metabase;
+		create->len = 4;
+		create->fill = 0;
+		create->flags = 0;
+	}
+
+	ret = fs_read_multi("/", reqs, layout.count * 2,
+			    octopos_place_partitions, &layout);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < layout.count; i++) {
+		data = &reqs[i * 2];
+		create = &reqs[i * 2 + 1];
+		total += data->actread;
+		direct += data->direct;
+		if (!data->ret)
+			loaded++;
+		else
+			debug("%s: partition %d data does not exist\n",
+			      __func__, i);
+		if (create->ret) {
+			debug("%s: partition %d create does not exist\n",
+			      __func__, i);
+			continue;
+		}
+
+		meta = map_sysmem(create->addr, STORAGE_METADATA_SIZE);
+		if (*(uint32_t *)meta != 1) {
+			printf("%s: bad create tag(%u)\r\n", __func__,
+			       *(uint32_t *)meta);
+			memset(meta, 0, STORAGE_METADATA_SIZE);
+		}
+		unmap_sysmem(meta);
+	}
+
+	printf("octopos: %d partitions, %lld bytes (%lld by block reads, %lld copied)\n",
+	       loaded, total, direct, total - direct);
+
+	/* data ranges were flushed as they were read, flush the metadata */
+	fs_flush_range(layout.meta_base, layout.count * STORAGE_METADATA_SIZE);
+
+	return ret;
+}
+
 int do_load(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[],
 		int fstype)
 {
@@ -860,15 +1596,9 @@ int do_load(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[],
 	loff_t bytes;
 	loff_t pos;
 	loff_t len_read;
-	loff_t len_read_bootimg;
-	int ret, ret_bootimg;
+	int ret;
 	unsigned long time;
 	char *ep;
-	uint32_t size, base, metabase;
-	uint32_t creation_tag;
-	char data_name[256];
-	char create_name[256];
-	char keys_name[256];
 
 	if (argc < 2)
 		return CMD_RET_USAGE;
@@ -916,60 +1646,14 @@ int do_load(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[],
 	if (strcmp(filename, "/boot.scr") == 0) {
 		ret = fs_read(filename, addr, pos, bytes, &len_read);
 		/* at time of loading boot.scr, load all sec_hw images */
-		for (uint32_t i = 0; i < NUM_PARTITIONS; i++) {
-			size = partition_sizes[i];
-			base = partition_base[i];
-			metabase = RAM_ROOT_PARTITION_METADATA_BASE + i * STORAGE_METADATA_SIZE;
-
-			memset(data_name, 0x0, 256);
-			sprintf(data_name, "/octopos_partition_%d_data", i);
-
-			memset(create_name, 0x0, 256);
-			sprintf(create_name, "/octopos_partition_%d_create", i);
-
-			memset(keys_name, 0x0, 256);
-			sprintf(keys_name, "/octopos_partition_%d_keys", i);
-
-			if (fs_set_blk_dev(argv[1], (argc >= 3) ? argv[2] : NULL, fstype)) {
-				printf("FATAL: fs_set_blk_dev failure\r\n");
-				return 1;
-			}
-
-			ret_bootimg = fs_read(data_name, base, 0, 0, &len_read_bootimg);
-			printf("%s: %d data(%d %d)\r\n", __FUNCTION__, i, ret_bootimg, len_read_bootimg);
-			if (ret_bootimg != 0 || len_read_bootimg == 0) {
-				/* no file by data_name */
-				memset(base, 0, size);
-				printf("%s: partition %d data does not exist\r\n", __FUNCTION__, i);
-			}
-			
-			if (fs_set_blk_dev(argv[1], (argc >= 3) ? argv[2] : NULL, fstype)) {
-				printf("FATAL: fs_set_blk_dev failure\r\n");
-				return 1;
-			}
-
-			printf("[1] %08x\r\n", metabase);
-			memset(metabase, 0, STORAGE_METADATA_SIZE);
-			printf("[2] %08x\r\n", metabase);
-			ret_bootimg = fs_read(create_name, metabase, 0, 4, &len_read_bootimg);
-			printf("%s: %d create(%08x %d %d)\r\n", __FUNCTION__, i, 
-					metabase, ret_bootimg, len_read_bootimg);
-			if (ret_bootimg != 0 || len_read_bootimg == 0) {
-				/* no file by create_name */
-				memset(metabase, 0, STORAGE_METADATA_SIZE);
-				printf("%s: partition %d create does not exist\r\n", __FUNCTION__, i);
-			} else {
-				if (*((uint32_t*) metabase) != 1) {
-					memset(metabase, 0, STORAGE_METADATA_SIZE);
-					printf("%s: bad create tag(%u)\r\n", 
-							__FUNCTION__, 
-							*((uint32_t*) metabase));
-				}	
-			}
-
+		if (fs_set_blk_dev(argv[1], (argc >= 3) ? argv[2] : NULL, fstype)) {
+			printf("FATAL: fs_set_blk_dev failure\r\n");
+			return 1;
+		}
+		if (octopos_preload_partitions() < 0) {
+			printf("FATAL: partition preload failure\r\n");
+			return 1;
 		}
-		flush_cache(0x30000000, 0xfffffff);
-		flush_cache(RAM_ROOT_PARTITION_METADATA_BASE, 0xffffff);
 	} else {
 		ret = do_load_octopos(addr, pos, bytes, &len_read);
 	}
@@ -68,6 +68,14 @@ typedef struct global_data {
 	struct udevice	*dm_root_f;	/* Pre-relocation root instance */
 	struct list_head uclass_root;	/* Head of core tree */
 #endif
+#ifdef CONFIG_DM_COMPAT_INDEX
+	/* Drivers by compatible string */
+	struct dm_compat_index *dm_compat_index;
+#endif
+#ifdef CONFIG_DM_SNAPSHOT
+	/* Table of the nodes to bind, if it matches fdt_blob */
+	const struct dm_snapshot *dm_snapshot;
+#endif
 #ifdef CONFIG_TIMER
 	struct udevice	*timer;		/* Timer instance for Driver Model */
 #endif
@@ -8,6 +8,7 @@
 #define BLK_H
 
 #include <efi.h>
+#include <linux/list.h>
 
 #ifdef CONFIG_SYS_64BIT_LBA
 typedef uint64_t lbaint_t;
@@ -145,6 +146,30 @@ void blkcache_fill(int iftype, int dev,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer);
 
+/**
+ * blkcache_readahead() - decide what to read from the device on a cache miss
+ *
+ * Small reads that miss are widened to whole cache lines, and extended by the
+ * configured read-ahead when they follow on from the previous read of the
+ * device. The widened range is read into a buffer owned by the cache, to be
+ * passed to blkcache_fill() before the requested blocks are copied out.
+ *
+ * @param iftype - IF_TYPE_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number of the request
+ * @param blkcnt - number of blocks requested
+ * @param blksz - size in bytes of each block
+ * @param lba - number of blocks of the device
+ * @param rastart - returns the first block to read
+ * @param racnt - returns the number of blocks to read
+ *
+ * @return - buffer to read into, or NULL to read only the requested blocks
+ */
+void *blkcache_readahead(int iftype, int dev,
+			 lbaint_t start, lbaint_t blkcnt,
+			 unsigned long blksz, lbaint_t lba,
+			 lbaint_t *rastart, lbaint_t *racnt);
+
 /**
  * blkcache_invalidate() - discard the cache for a set of blocks
  * because of a write or device (re)initialization.
@@ -154,23 +179,61 @@ void blkcache_fill(int iftype, int dev,
  */
 void blkcache_invalidate(int iftype, int dev);
 
+/**
+ * blkcache_release() - forget a device which is going away
+ *
+ * This discards the cache for the device and frees its statistics slot
+ * for use by another device.
+ *
+ * @param iftype - IF_TYPE_x for type of device
+ * @param dev - device index of particular type
+ */
+void blkcache_release(int iftype, int dev);
+
 /**
  * blkcache_configure() - configure block cache
  *
- * @param blocks - maximum blocks per entry
- * @param entries - maximum entries in cache
+ * @param blocks - maximum blocks per read that is cached
+ * @param entries - number of cache lines
  */
 void blkcache_configure(unsigned blocks, unsigned entries);
 
+/**
+ * blkcache_configure_size() - resize the block cache
+ *
+ * @param size_kb - size of the cache arena in KiB, 0 to disable the cache
+ */
+void blkcache_configure_size(unsigned size_kb);
+
+/* number of devices with their own statistics */
+#define BLOCK_CACHE_MAX_DEVS	8
+
+/*
+ * statistics of one device using the block cache
+ */
+struct block_cache_dev_stats {
+	int iftype;
+	int devnum;
+	unsigned hits;
+	unsigned misses;
+	unsigned long long bytes; /* bytes returned from the cache */
+	unsigned readahead; /* blocks read beyond the requests */
+};
+
 /*
  * statistics of the block cache
  */
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
-	unsigned entries; /* current entry count */
-	unsigned max_blocks_per_entry;
-	unsigned max_entries;
+	unsigned entries; /* current count of lines holding data */
+	unsigned max_blocks_per_entry; /* largest read that is cached */
+	unsigned max_entries; /* number of lines */
+	unsigned ways; /* lines per set */
+	unsigned line_size; /* bytes per line */
+	unsigned readahead; /* bytes read ahead on sequential misses */
+	unsigned ndevs;
+	struct block_cache_dev_stats devs[BLOCK_CACHE_MAX_DEVS];
 };
 
 /**
@@ -193,10 +256,46 @@ static inline void blkcache_fill(int iftype, int dev,
 				 lbaint_t start, lbaint_t blkcnt,
 				 unsigned long blksz, void const *buffer) {}
 
+static inline void *blkcache_readahead(int iftype, int dev,
+				       lbaint_t start, lbaint_t blkcnt,
+				       unsigned long blksz, lbaint_t lba,
+				       lbaint_t *rastart, lbaint_t *racnt)
+{
+	return NULL;
+}
+
 static inline void blkcache_invalidate(int iftype, int dev) {}
 
+static inline void blkcache_release(int iftype, int dev) {}
+
 #endif
 
+/**
+ * struct blk_req - an asynchronous block request
+ *
+ * Filled in by the caller of blk_submit(), which owns the request (and must
+ * keep it in place) until blk_wait() or blk_wait_all() has returned for it.
+ *
+ * @start:	Start block number (0=first)
+ * @blkcnt:	Number of blocks to transfer
+ * @buffer:	Data buffer
+ * @write:	true to write @buffer to the device, false to read into it
+ * @result:	Number of blocks transferred, or -ve error, once @done is set
+ * @done:	Set when the request has completed
+ * @node:	Entry in the device's queue, private to the uclass
+ * @priv:	Private data of the driver handling the request
+ */
+struct blk_req {
+	lbaint_t start;
+	lbaint_t blkcnt;
+	void *buffer;
+	bool write;
+	long result;
+	bool done;
+	struct list_head node;
+	void *priv;
+};
+
 #if CONFIG_IS_ENABLED(BLK)
 struct udevice;
 
@@ -258,6 +357,30 @@ struct blk_ops {
 	 * @return 0 if OK, -ve on error
 	 */
 	int (*select_hwpart)(struct udevice *dev, int hwpart);
+
+	/**
+	 * submit() - start a request without waiting for it to complete
+	 *
+	 * Optional. The driver must call blk_req_done() once the request has
+	 * completed, which may be from within submit() or poll().
+	 *
+	 * @dev:	Device to queue the request on
+	 * @req:	Request to start
+	 * @return 0 if started, -EBUSY if the device cannot take another
+	 * request until some have completed, other -ve error
+	 */
+	int (*submit)(struct udevice *dev, struct blk_req *req);
+
+	/**
+	 * poll() - complete requests that have finished
+	 *
+	 * Required if submit() is provided. Calls blk_req_done() for each
+	 * request found complete, without waiting for any.
+	 *
+	 * @dev:	Device to poll
+	 * @return number of requests completed, or -ve error
+	 */
+	int (*poll)(struct udevice *dev);
 };
 
 #define blk_get_ops(dev)	((struct blk_ops *)(dev)->driver->ops)
@@ -275,6 +398,61 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt);
 
+/**
+ * blk_submit() - queue a block request
+ *
+ * Starts @req on the device and returns without waiting for it, so that
+ * several requests can be in flight at once. Up to the queue depth of the
+ * device are kept outstanding; beyond that this polls the device until one
+ * completes. Reads served by the block cache, and all requests on devices
+ * without asynchronous support, complete before this returns.
+ *
+ * @block_dev:	Block device descriptor
+ * @req:	Request, with @start, @blkcnt, @buffer and @write set
+ * @return 0 if the request was queued or completed (see @req->result), or
+ * -ve error if it could not be started
+ */
+int blk_submit(struct blk_desc *block_dev, struct blk_req *req);
+
+/**
+ * blk_wait() - wait for a block request to complete
+ *
+ * @block_dev:	Block device descriptor
+ * @req:	Request previously passed to blk_submit()
+ * @return @req->result, or -ve error if polling the device failed
+ */
+long blk_wait(struct blk_desc *block_dev, struct blk_req *req);
+
+/**
+ * blk_wait_all() - wait for all block requests of a device to complete
+ *
+ * @block_dev:	Block device descriptor
+ * @return 0 if OK, or -ve error if polling the device failed
+ */
+int blk_wait_all(struct blk_desc *block_dev);
+
+/**
+ * blk_req_done() - report the completion of a request
+ *
+ * Called by drivers implementing the submit() operation.
+ *
+ * @dev:	Block device which handled the request
+ * @req:	Completed request
+ * @result:	Number of blocks transferred, or -ve error
+ */
+void blk_req_done(struct udevice *dev, struct blk_req *req, long result);
+
+/**
+ * blk_set_queue_depth() - set how many requests a device keeps in flight
+ *
+ * The default is CONFIG_BLK_QUEUE_DEPTH. Drivers with deeper hardware
+ * queues may raise it when probing.
+ *
+ * @dev:	Block device
+ * @depth:	Maximum number of outstanding requests, at least 1
+ */
+void blk_set_queue_depth(struct udevice *dev, int depth);
+
 /**
  * blk_find_device() - Find a block device
  *
@@ -460,6 +638,30 @@ static inline ulong blk_derase(struct blk_desc *block_dev, lbaint_t start,
 	return block_dev->block_erase(block_dev, start, blkcnt);
 }
 
+/* Legacy block drivers are synchronous: requests complete when submitted */
+static inline int blk_submit(struct blk_desc *block_dev, struct blk_req *req)
+{
+	if (req->write)
+		req->result = blk_dwrite(block_dev, req->start, req->blkcnt,
+					 req->buffer);
+	else
+		req->result = blk_dread(block_dev, req->start, req->blkcnt,
+					req->buffer);
+	req->done = true;
+
+	return 0;
+}
+
+static inline long blk_wait(struct blk_desc *block_dev, struct blk_req *req)
+{
+	return req->result;
+}
+
+static inline int blk_wait_all(struct blk_desc *block_dev)
+{
+	return 0;
+}
+
 /**
  * struct blk_driver - Driver for block interface types
  *
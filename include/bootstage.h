@@ -202,6 +202,10 @@ enum bootstage_id {
 	BOOTSTATE_ID_ACCUM_DM_SPL,
 	BOOTSTATE_ID_ACCUM_DM_F,
 	BOOTSTATE_ID_ACCUM_DM_R,
+	BOOTSTAGE_ID_ACCUM_FIT_HASH,
+	BOOTSTAGE_ID_ACCUM_FIT_HASH_PAR,
+	BOOTSTAGE_ID_ACCUM_DM_BIND_F,
+	BOOTSTAGE_ID_ACCUM_DM_BIND_R,
 
 	/* a few spare for the user, from here */
 	BOOTSTAGE_ID_USER,
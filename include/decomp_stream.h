@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Streaming decompression into a memory buffer
+ */
+
+#ifndef __DECOMP_STREAM_H
+#define __DECOMP_STREAM_H
+
+#include <linux/types.h>
+
+/* Pick the compression from the magic number at the start of the data */
+#define DECOMP_STREAM_AUTO	-1
+
+/**
+ * struct decomp_stream - state of a streaming decompression
+ *
+ * @comp: compression in use (IH_COMP_...)
+ * @dst: output buffer
+ * @dst_len: size of @dst
+ * @out: number of bytes written to @dst so far
+ * @in: number of compressed bytes accepted so far
+ * @done: true once the end of the compressed data has been seen
+ * @err: first error seen, returned again by later calls
+ * @magic: first bytes of the data, held back while @comp is still
+ *	DECOMP_STREAM_AUTO
+ * @magic_len: number of bytes in @magic
+ * @priv: private state of the decompressor
+ */
+struct decomp_stream {
+	int comp;
+	u8 *dst;
+	size_t dst_len;
+	size_t out;
+	size_t in;
+	bool done;
+	int err;
+	u8 magic[4];
+	int magic_len;
+	void *priv;
+};
+
+/**
+ * decomp_stream_init() - start a streaming decompression
+ *
+ * The output buffer must hold the whole uncompressed data: it is also used
+ * as the history window of the decompressor, which avoids a copy of the
+ * output. Supported are IH_COMP_NONE, and IH_COMP_GZIP, IH_COMP_LZ4,
+ * IH_COMP_LZMA and IH_COMP_ZSTD when the decompressor is enabled. With
+ * DECOMP_STREAM_AUTO, gzip, lz4 and zstd data is recognised by its magic
+ * number and anything else is copied unchanged.
+ *
+ * @ds: stream to set up
+ * @comp: compression of the data (IH_COMP_...) or DECOMP_STREAM_AUTO
+ * @dst: output buffer
+ * @dst_len: size of @dst
+ * @return 0 if OK, -EPROTONOSUPPORT if @comp is not supported, -ENOMEM if
+ *	out of memory
+ */
+int decomp_stream_init(struct decomp_stream *ds, int comp, void *dst,
+		       size_t dst_len);
+
+/**
+ * decomp_stream_write() - decompress the next piece of data
+ *
+ * Pieces may be of any size and need not line up with anything in the
+ * compressed format. Data following the end of a gzip, lz4 or lzma stream is
+ * ignored, while zstd data may consist of several frames.
+ *
+ * @ds: stream to write to
+ * @src: compressed data
+ * @len: length of @src
+ * @return 0 if OK, -ENOSPC if the output buffer is full, -EPROTONOSUPPORT
+ *	if the detected compression is not supported, -EINVAL if the data is
+ *	corrupt, -ENOMEM if out of memory
+ */
+int decomp_stream_write(struct decomp_stream *ds, const void *src,
+			size_t len);
+
+/**
+ * decomp_stream_finish() - end a streaming decompression
+ *
+ * This frees the state of the decompressor and must be called even when a
+ * previous call failed.
+ *
+ * @ds: stream to finish
+ * @out_len: returns the number of bytes written to the output buffer
+ * @return 0 if the compressed data was complete, -EINVAL if it was
+ *	truncated, or the error of an earlier call
+ */
+int decomp_stream_finish(struct decomp_stream *ds, size_t *out_len);
+
+#endif
@@ -94,6 +94,20 @@ int device_bind_by_name(struct udevice *parent, bool pre_reloc_only,
  */
 int device_probe(struct udevice *dev);
 
+/**
+ * device_probe_step() - Probe a device, up to its next wait for the hardware
+ *
+ * This is device_probe() for callers with other devices to probe in the
+ * meantime. If the probe method asks to wait (see device_probe_wait()), this
+ * returns -EINPROGRESS with DM_FLAG_PROBE_WAIT set on the device, which is
+ * not active yet. Calling this again carries on with the probe, after
+ * waiting for whatever is left of the time asked for.
+ *
+ * @dev: Pointer to device to probe
+ * @return 0 if OK, -EINPROGRESS if waiting, other -ve on error
+ */
+int device_probe_step(struct udevice *dev);
+
 /**
  * device_remove() - Remove a device, de-activating it
  *
@@ -64,6 +64,9 @@ struct driver_info;
 /* DM does not enable/disable the power domains corresponding to this device */
 #define DM_FLAG_DEFAULT_PD_CTRL_OFF	(1 << 11)
 
+/* The probe method is waiting for the hardware, see device_probe_wait() */
+#define DM_FLAG_PROBE_WAIT		(1 << 12)
+
 /*
  * One or multiple of these flags are passed to device_remove() so that
  * a selective device removal as specified by the remove-stage and the
@@ -126,6 +129,10 @@ enum {
  *		When CONFIG_DEVRES is enabled, devm_kmalloc() and friends will
  *		add to this list. Memory so-allocated will be freed
  *		automatically when the device is removed / unbound
+ * @probe_time: Time taken to probe this device in microseconds, see
+ *		CONFIG_DM_PROBE_TIME
+ * @probe_wait: Value of timer_get_us() at which the probe method waiting
+ *		for the hardware can carry on, see device_probe_wait()
  */
 struct udevice {
 	const struct driver *driver;
@@ -149,6 +156,12 @@ struct udevice {
 #ifdef CONFIG_DEVRES
 	struct list_head devres_head;
 #endif
+#if CONFIG_IS_ENABLED(DM_PROBE_TIME)
+	ulong probe_time;
+#endif
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+	ulong probe_wait;
+#endif
 };
 
 /* Maximum sequence number supported */
@@ -165,9 +178,20 @@ static inline int dev_of_offset(const struct udevice *dev)
 	return ofnode_to_offset(dev->node);
 }
 
+/**
+ * dev_set_ofnode() - Set the device tree node of a device
+ *
+ * Use this rather than setting dev->node, so that the device can still be
+ * found by its node, see uclass_find_device_by_ofnode().
+ *
+ * @dev: Device to update
+ * @node: New node for the device
+ */
+void dev_set_ofnode(struct udevice *dev, ofnode node);
+
 static inline void dev_set_of_offset(struct udevice *dev, int of_offset)
 {
-	dev->node = offset_to_ofnode(of_offset);
+	dev_set_ofnode(dev, offset_to_ofnode(of_offset));
 }
 
 static inline bool dev_has_of_node(struct udevice *dev)
@@ -641,6 +665,23 @@ void device_set_name_alloced(struct udevice *dev);
  */
 bool device_is_compatible(struct udevice *dev, const char *compat);
 
+/**
+ * device_probe_wait() - wait for the hardware before going on with a probe
+ *
+ * A probe method which has to wait, e.g. for a PHY to come out of reset,
+ * can return this instead of sleeping. The probe method is then called
+ * again once @us microseconds have passed, and must carry on from where it
+ * left off, keeping track of that in the device's private data.
+ *
+ * With CONFIG_DM_PROBE_ASYNC, uclass_probe_all() probes other devices in
+ * the meantime. Otherwise this simply waits.
+ *
+ * @dev:	Device being probed
+ * @us:		Time to wait in microseconds
+ * @return -EINPROGRESS, to be returned by the probe method
+ */
+int device_probe_wait(struct udevice *dev, ulong us);
+
 /**
  * of_machine_is_compatible() - check if the machine is compatible with
  *				the compat
@@ -12,6 +12,8 @@
 #include <dm/ofnode.h>
 #include <dm/uclass-id.h>
 
+struct udevice_id;
+
 /**
  * lists_driver_lookup_name() - Return u_boot_driver corresponding to name
  *
@@ -32,6 +34,20 @@ struct driver *lists_driver_lookup_name(const char *name);
  */
 struct uclass_driver *lists_uclass_lookup(enum uclass_id id);
 
+/**
+ * lists_driver_lookup_compat() - Return the driver for a compatible string
+ *
+ * This finds the first driver in the linker list with @compat in its
+ * of_match table. With CONFIG_DM_COMPAT_INDEX this uses a hash table of
+ * the compatible strings, built on first use.
+ *
+ * @compat: Compatible string to look up
+ * @of_idp: Returns the of_match entry of the driver which has @compat
+ * @return pointer to driver, or NULL if not found
+ */
+struct driver *lists_driver_lookup_compat(const char *compat,
+					  const struct udevice_id **of_idp);
+
 /**
  * lists_bind_drivers() - search for and bind all drivers to parent
  *
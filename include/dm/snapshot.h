@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Table of the device tree nodes which driver model binds devices for,
+ * generated by dtoc when U-Boot is built
+ */
+
+#ifndef _DM_SNAPSHOT_H_
+#define _DM_SNAPSHOT_H_
+
+#include <linux/types.h>
+
+/**
+ * struct dm_snapshot_node - a device tree node with children to bind
+ *
+ * @offset: Offset of the node in the device tree
+ * @first: Index in the children table of the node's first child
+ * @count: Number of children
+ */
+struct dm_snapshot_node {
+	s32 offset;
+	u16 first;
+	u16 count;
+};
+
+/**
+ * struct dm_snapshot - the nodes which dm_scan_fdt_node() binds
+ *
+ * This lists, for each node, the subnodes which are enabled and have a
+ * compatible string, in device tree order. Those are the nodes that scanning
+ * the device tree passes to lists_bind_fdt(). Nodes which have no such
+ * subnodes are left out.
+ *
+ * @fdt_size: fdt_totalsize() of the device tree the table was made from
+ * @fdt_crc32: CRC32 of that device tree
+ * @node_count: Number of entries in @nodes
+ * @nodes: Nodes with children to bind, in order of offset
+ * @children: Offsets of the children of all the nodes
+ */
+struct dm_snapshot {
+	u32 fdt_size;
+	u32 fdt_crc32;
+	int node_count;
+	const struct dm_snapshot_node *nodes;
+	const s32 *children;
+};
+
+/* Snapshot of the U-Boot device tree, in dts/dm-snapshot.c */
+extern const struct dm_snapshot dm_snapshot;
+
+/**
+ * dm_snapshot_check() - Check that a snapshot was made from a device tree
+ *
+ * @snap: Snapshot to check
+ * @blob: Device tree blob
+ * @return @snap if its size and CRC32 match @blob, else NULL
+ */
+const struct dm_snapshot *dm_snapshot_check(const struct dm_snapshot *snap,
+					    const void *blob);
+
+/**
+ * dm_snapshot_get_children() - Find the children of a node to bind
+ *
+ * @snap: Snapshot to search
+ * @offset: Offset of the node
+ * @childrenp: Returns a pointer to the offsets of the children
+ * @return number of children, 0 if the node has none
+ */
+int dm_snapshot_get_children(const struct dm_snapshot *snap, int offset,
+			     const s32 **childrenp);
+
+#endif
@@ -61,6 +61,23 @@ enum {
 /* The number added to the ping total on each probe */
 #define DM_TEST_START_TOTAL	5
 
+/* Number of times test_wait_drv waits while probing, and for how long */
+#define DM_TEST_WAIT_STEPS	2
+#define DM_TEST_WAIT_US		1000
+
+/**
+ * struct dm_test_wait_priv - private data for test_wait_drv
+ *
+ * @steps: Number of times the probe method has been called
+ * @first: Value of dm_testdrv_op_count[DM_TEST_OP_PROBE] on the first call
+ * @last: Value of dm_testdrv_op_count[DM_TEST_OP_PROBE] on the last call
+ */
+struct dm_test_wait_priv {
+	int steps;
+	int first;
+	int last;
+};
+
 /**
  * struct dm_test_priv - private data for the test devices
  */
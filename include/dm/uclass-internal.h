@@ -196,6 +196,46 @@ int uclass_unbind_device(struct udevice *dev);
 static inline int uclass_unbind_device(struct udevice *dev) { return 0; }
 #endif
 
+/**
+ * uclass_set_seq() - Set the sequence number of a device
+ *
+ * Driver model sets dev->seq only through this, so that the uclass can keep
+ * an index of its devices by sequence number.
+ *
+ * @dev:	Pointer to the device
+ * @seq:	New sequence number, or -1 for none
+ */
+void uclass_set_seq(struct udevice *dev, int seq);
+
+/**
+ * uclass_index_add() - Add a device to the indexes of its uclass
+ *
+ * With CONFIG_DM_UCLASS_INDEX, add the device to the indexes by device tree
+ * node and phandle. This does nothing if the device is not in its uclass's
+ * list of devices yet.
+ *
+ * @dev:	Pointer to the device
+ */
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+void uclass_index_add(struct udevice *dev);
+#else
+static inline void uclass_index_add(struct udevice *dev) {}
+#endif
+
+/**
+ * uclass_index_remove() - Remove a device from the indexes of its uclass
+ *
+ * This undoes uclass_index_add(), and takes the device out of the index by
+ * sequence number.
+ *
+ * @dev:	Pointer to the device
+ */
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+void uclass_index_remove(struct udevice *dev);
+#else
+static inline void uclass_index_remove(struct udevice *dev) {}
+#endif
+
 /**
  * uclass_pre_probe_device() - Deal with a device that is about to be probed
  *
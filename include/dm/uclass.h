@@ -14,6 +14,26 @@
 #include <linker_lists.h>
 #include <linux/list.h>
 
+/**
+ * struct uclass_hash - hash table of the devices in a uclass
+ *
+ * This is used with CONFIG_DM_UCLASS_INDEX to find a device by its device
+ * tree node or phandle, see uclass_find_device_by_ofnode(). Each slot holds
+ * a key and the device with that key, with linear probing.
+ *
+ * @slot: Slots of the table
+ * @mask: Number of slots - 1, or 0 if the table is not built yet
+ * @used: Number of slots in use, including those of removed devices
+ */
+struct uclass_hash {
+	struct uclass_hash_slot {
+		ulong key;
+		struct udevice *dev;
+	} *slot;
+	uint mask;
+	uint used;
+};
+
 /**
  * struct uclass - a U-Boot drive class, collecting together similar drivers
  *
@@ -30,12 +50,22 @@
  * @dev_head: List of devices in this uclass (devices are attached to their
  * uclass when their bind method is called)
  * @sibling_node: Next uclass in the linked list of uclasses
+ * @seq_devs: Devices by sequence number (dev->seq), or NULL if not built yet
+ * @seq_count: Number of entries in @seq_devs
+ * @node_hash: Devices by device tree node
+ * @phandle_hash: Devices by phandle
  */
 struct uclass {
 	void *priv;
 	struct uclass_driver *uc_drv;
 	struct list_head dev_head;
 	struct list_head sibling_node;
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	struct udevice **seq_devs;
+	int seq_count;
+	struct uclass_hash node_hash;
+	struct uclass_hash phandle_hash;
+#endif
 };
 
 struct driver;
@@ -350,6 +380,19 @@ int uclass_first_device_check(enum uclass_id id, struct udevice **devp);
  */
 int uclass_next_device_check(struct udevice **devp);
 
+/**
+ * uclass_probe_all() - Probe all devices in a uclass
+ *
+ * The devices are probed in the order of the uclass list. With
+ * CONFIG_DM_PROBE_ASYNC, a device whose probe method waits for the hardware
+ * (see device_probe_wait()) is finished once the others have been started,
+ * so that the waits overlap.
+ *
+ * @id: Uclass ID to probe
+ * @return 0 if OK, else the first error. The other devices are probed anyway
+ */
+int uclass_probe_all(enum uclass_id id);
+
 /**
  * uclass_resolve_seq() - Resolve a device's sequence number
  *
@@ -109,6 +109,85 @@ int fs_size(const char *filename, loff_t *size);
 int fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 	    loff_t *actread);
 
+/**
+ * struct fs_extent - a run of device blocks holding part of a file
+ *
+ * @start:	first block, relative to the start of the partition, or 0 for a
+ *		hole that reads as zeroes
+ * @count:	number of blocks
+ */
+struct fs_extent {
+	lbaint_t start;
+	lbaint_t count;
+};
+
+/**
+ * struct fs_read_req - one file of a batched fs_read_multi() load
+ *
+ * @name:	name of the file, relative to the directory being loaded
+ * @addr:	address of the buffer to write to
+ * @len:	the number of bytes to read. Use 0 to read entire file.
+ * @fill:	number of bytes at @addr that read as zeroes past the data read,
+ *		or all of them if the file is missing or empty
+ * @flags:	FS_READ_... flags
+ * @size:	returns the size of the file, 0 if it is missing
+ * @actread:	returns the actual number of bytes read
+ * @direct:	returns the number of bytes of @actread read by the block device
+ *		straight into @addr, without going through a buffer
+ * @ret:	returns 0 if the file was read, negative on error
+ */
+struct fs_read_req {
+	const char *name;
+	ulong addr;
+	loff_t len;
+	loff_t fill;
+	unsigned int flags;
+	loff_t size;
+	loff_t actread;
+	loff_t direct;
+	int ret;
+};
+
+/* Flush the range written for this file from the data cache */
+#define FS_READ_FLUSH	(1 << 0)
+/* Read the file's extents straight into place if the filesystem maps them */
+#define FS_READ_DIRECT	(1 << 1)
+
+/**
+ * fs_read_multi() - read several files from one directory in a single mount
+ *
+ * Reads all files of @reqs from the partition previously set by
+ * fs_set_blk_dev(), keeping the filesystem mounted between the reads. If the
+ * filesystem supports directory streams, @dirname is scanned once to find
+ * which files exist; otherwise each file is looked up on its own. If the
+ * filesystem can map files to extents, the reads are issued in the order of
+ * the first block of each file, else in directory order. Zero-filling of
+ * what the reads leave of each @fill range is done after all reads have been
+ * issued.
+ *
+ * Files flagged FS_READ_FLUSH have exactly the range that was written (read
+ * data or zero fill) flushed from the data cache, each right after it was
+ * produced.
+ *
+ * Files flagged FS_READ_DIRECT are read, if the filesystem can map them to
+ * extents and @addr is cache aligned, with one block read per extent straight
+ * into @addr. Only a partial last block goes through a bounce buffer.
+ *
+ * If @place is given it is called once all files have been looked up, with
+ * the size of each file set, and may update @addr, @len and @fill of any
+ * request before the reads are issued. A non-zero return aborts the load.
+ *
+ * @dirname:	directory containing the files
+ * @reqs:	files to read, with per-file results
+ * @count:	number of entries in @reqs
+ * @place:	optional callback deciding where the files are loaded
+ * @priv:	private data passed to @place
+ * Return:	number of files read, negative on error
+ */
+int fs_read_multi(const char *dirname, struct fs_read_req *reqs, int count,
+		  int (*place)(struct fs_read_req *reqs, int count, void *priv),
+		  void *priv);
+
 /**
  * fs_write() - write file to the partition previously set by fs_set_blk_dev()
  *
@@ -36,6 +36,7 @@ struct fdt_region;
 #define CONFIG_SHA256
 
 #define IMAGE_ENABLE_IGNORE	0
+#define IMAGE_ENABLE_PARALLEL_HASH	0
 #define IMAGE_INDENT_STRING	""
 
 #else
@@ -46,6 +47,8 @@ struct fdt_region;
 
 /* Take notice of the 'ignore' property for hashes */
 #define IMAGE_ENABLE_IGNORE	1
+/* Check the hashes of all images of a configuration at once */
+#define IMAGE_ENABLE_PARALLEL_HASH	CONFIG_IS_ENABLED(FIT_PARALLEL_HASH)
 #define IMAGE_INDENT_STRING	"   "
 
 #define IMAGE_ENABLE_FIT	CONFIG_IS_ENABLED(FIT)
@@ -303,6 +306,7 @@ enum {
 	IH_COMP_LZMA,			/* lzma  Compression Used	*/
 	IH_COMP_LZO,			/* lzo   Compression Used	*/
 	IH_COMP_LZ4,			/* lz4   Compression Used	*/
+	IH_COMP_ZSTD,			/* zstd  Compression Used	*/
 
 	IH_COMP_COUNT,
 };
@@ -341,6 +345,32 @@ typedef struct image_info {
 	uint8_t		arch;			/* CPU architecture */
 } image_info_t;
 
+#define FIT_CHECKED_HASHES_MAX	16
+
+/**
+ * struct fit_checked_hashes - image hashes checked ahead of loading
+ *
+ * With CONFIG_FIT_PARALLEL_HASH fit_image_load() checks the hashes of all
+ * images of a configuration at once, and records the ones that matched
+ * here. Each image is still verified when it is loaded, but without
+ * hashing its data again, unless loading another image wrote over it.
+ *
+ * @fit: FIT the hashes are in, or NULL if none were checked
+ * @cfg_noffset: configuration the images are from
+ * @count: number of hash nodes in @node
+ * @node: hash nodes which matched, with the image data they cover
+ */
+struct fit_checked_hashes {
+	const void *fit;
+	int cfg_noffset;
+	int count;
+	struct {
+		int noffset;
+		ulong start;
+		ulong end;
+	} node[FIT_CHECKED_HASHES_MAX];
+};
+
 /*
  * Legacy and FIT format headers used by do_bootm() and do_bootm_<os>()
  * routines.
@@ -373,6 +403,8 @@ typedef struct bootm_headers {
 	void		*fit_hdr_setup;	/* x86 setup FIT image header */
 	const char	*fit_uname_setup; /* x86 setup subimage node name */
 	int		fit_noffset_setup;/* x86 setup subimage node offset */
+
+	struct fit_checked_hashes fit_hashes;	/* hashes already checked */
 #endif
 
 #ifndef USE_HOSTCC
@@ -21,4 +21,36 @@
  */
 int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn);
 
+/**
+ * ulz4_block() - Decompress a single LZ4 block
+ *
+ * This decodes the contents of one independent block of an LZ4 frame, without
+ * any frame or block header.
+ *
+ * @src: Compressed block
+ * @srcn: Length of the compressed block
+ * @dst: Destination for uncompressed data
+ * @dstn: Space available at @dst; returns length of uncompressed data
+ * @return 0 if OK, -EPROTO if the compressed data causes an error in the
+ *	decompression algorithm, including an overrun of the destination
+ */
+int ulz4_block(const void *src, size_t srcn, void *dst, size_t *dstn);
+
+/**
+ * ulz4_block_ref() - Decompress a single LZ4 block with the reference decoder
+ *
+ * This gives the same results as ulz4_block(), but decodes the whole block
+ * with the reference decoder, which checks every step and copies 8 bytes at
+ * a time, instead of only finishing the block with it. It is there to check
+ * and measure ulz4_block() against.
+ *
+ * @src: Compressed block
+ * @srcn: Length of the compressed block
+ * @dst: Destination for uncompressed data
+ * @dstn: Space available at @dst; returns length of uncompressed data
+ * @return 0 if OK, -EPROTO if the compressed data causes an error in the
+ *	decompression algorithm, including an overrun of the destination
+ */
+int ulz4_block_ref(const void *src, size_t srcn, void *dst, size_t *dstn);
+
 #endif
@@ -31,6 +31,8 @@
 
 #ifdef CONFIG_SYS_RX_ETH_BUFFER
 # define PKTBUFSRX	CONFIG_SYS_RX_ETH_BUFFER
+#elif defined(CONFIG_NET_RX_BUFFERS)
+# define PKTBUFSRX	CONFIG_NET_RX_BUFFERS
 #else
 # define PKTBUFSRX	4
 #endif
@@ -125,6 +127,13 @@ enum eth_recv_flags {
  * free_pkt: Give the driver an opportunity to manage its packet buffer memory
  *	     when the network stack is finished processing it. This will only be
  *	     called when no error was returned from recv - optional
+ * recv_batch: Like recv, but hand up to "count" received packets at once,
+ *	       filling in "packets" and "lengths". Returns the number of
+ *	       packets, 0 or -EAGAIN if there are none, or another error. The
+ *	       network stack processes them in order and calls free_pkt for
+ *	       each one before the next call to recv or recv_batch. Lets the
+ *	       driver check its ring and do cache maintenance once per poll
+ *	       rather than once per packet - optional
  * stop: Stop the hardware from looking for packets - may be called even if
  *	 state == PASSIVE
  * mcast: Join or leave a multicast group (for TFTP) - optional
@@ -143,6 +152,8 @@ struct eth_ops {
 	int (*send)(struct udevice *dev, void *packet, int length);
 	int (*recv)(struct udevice *dev, int flags, uchar **packetp);
 	int (*free_pkt)(struct udevice *dev, uchar *packet, int length);
+	int (*recv_batch)(struct udevice *dev, int flags, uchar **packets,
+			  int *lengths, int count);
 	void (*stop)(struct udevice *dev);
 	int (*mcast)(struct udevice *dev, const u8 *enetaddr, int join);
 	int (*write_hwaddr)(struct udevice *dev);
@@ -347,6 +358,7 @@ struct vlan_ethernet_hdr {
 #define PROT_PPP_SES	0x8864		/* PPPoE session messages	*/
 
 #define IPPROTO_ICMP	 1	/* Internet Control Message Protocol	*/
+#define IPPROTO_TCP	 6	/* Transmission Control Protocol	*/
 #define IPPROTO_UDP	17	/* User Datagram Protocol		*/
 
 /*
@@ -532,7 +544,7 @@ extern int		net_restart_wrap;	/* Tried all network devices */
 
 enum proto_t {
 	BOOTP, RARP, ARP, TFTPGET, DHCP, PING, DNS, NFS, CDP, NETCONS, SNTP,
-	TFTPSRV, TFTPPUT, LINKLOCAL, FASTBOOT, WOL
+	TFTPSRV, TFTPPUT, LINKLOCAL, FASTBOOT, WOL, WGET
 };
 
 extern char	net_boot_file_name[1024];/* Boot File name */
@@ -655,22 +667,57 @@ static inline void net_set_state(enum net_loop_state state)
  */
 uchar * net_get_async_tx_pkt_buf(void);
 
+/**
+ * struct net_stats - packet counters of the last net_loop()
+ *
+ * @rx_packets: frames handed to the network stack
+ * @rx_batches: driver polls that returned at least one frame
+ * @rx_arp: ARP and RARP packets
+ * @rx_icmp: ICMP packets
+ * @rx_udp: UDP packets
+ * @rx_tcp: TCP segments
+ * @rx_other: frames of any other protocol
+ * @rx_errors: truncated frames and IP headers with a bad checksum
+ * @tx_packets: frames sent
+ */
+struct net_stats {
+	ulong rx_packets;
+	ulong rx_batches;
+	ulong rx_arp;
+	ulong rx_icmp;
+	ulong rx_udp;
+	ulong rx_tcp;
+	ulong rx_other;
+	ulong rx_errors;
+	ulong tx_packets;
+};
+
+extern struct net_stats net_stats;
+
+/* Print the counters in net_stats */
+void net_print_stats(void);
+
 /* Transmit a packet */
 static inline void net_send_packet(uchar *pkt, int len)
 {
+	net_stats.tx_packets++;
 	/* Currently no way to return errors from eth_send() */
 	(void) eth_send(pkt, len);
 }
 
 /*
- * Transmit "net_tx_packet" as UDP packet, performing ARP request if needed
- *  (ether will be populated)
+ * Transmit "net_tx_packet" as UDP or TCP packet, performing ARP request if
+ *  needed (ether will be populated)
  *
  * @param ether Raw packet buffer
  * @param dest IP address to send the datagram to
- * @param dport Destination UDP port
- * @param sport Source UDP port
- * @param payload_len Length of data after the UDP header
+ * @param dport Destination UDP/TCP port
+ * @param sport Source UDP/TCP port
+ * @param payload_len Length of data after the UDP/TCP header
+ * @param proto IPPROTO_UDP or IPPROTO_TCP
+ * @param action TCP flags (TCP only)
+ * @param tcp_seq_num TCP sequence number (TCP only)
+ * @param tcp_ack_num TCP acknowledgment number (TCP only)
  */
 int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		       int payload_len, int proto, u8 action, u32 tcp_seq_num,
@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Minimal TCP client
+ *
+ * A single active-open connection with in-order delivery straight to the
+ * protocol handler. There is no selective acknowledgment and no reassembly
+ * queue: out-of-order segments are dropped and answered with a duplicate ACK,
+ * so the sender retransmits from the first hole.
+ */
+
+#ifndef __TCP_H__
+#define __TCP_H__
+
+/*
+ *	Internet Protocol (IP) + TCP header.
+ */
+struct ip_tcp_hdr {
+	u8		ip_hl_v;	/* header length and version	*/
+	u8		ip_tos;		/* type of service		*/
+	u16		ip_len;		/* total length			*/
+	u16		ip_id;		/* identification		*/
+	u16		ip_off;		/* fragment offset field	*/
+	u8		ip_ttl;		/* time to live			*/
+	u8		ip_p;		/* protocol			*/
+	u16		ip_sum;		/* checksum			*/
+	struct in_addr	ip_src;		/* Source IP address		*/
+	struct in_addr	ip_dst;		/* Destination IP address	*/
+	u16		tcp_src;	/* TCP source port		*/
+	u16		tcp_dst;	/* TCP destination port		*/
+	u32		tcp_seq;	/* Sequence number		*/
+	u32		tcp_ack;	/* Acknowledgment number	*/
+	u8		tcp_hlen;	/* Data offset in 32-bit words	*/
+	u8		tcp_flags;	/* Control flags		*/
+	u16		tcp_win;	/* Receive window		*/
+	u16		tcp_xsum;	/* Checksum			*/
+	u16		tcp_urg;	/* Urgent pointer		*/
+} __attribute__((packed));
+
+#define IP_TCP_HDR_SIZE		(sizeof(struct ip_tcp_hdr))
+#define TCP_HDR_SIZE		(IP_TCP_HDR_SIZE - IP_HDR_SIZE)
+
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PSH		0x08
+#define TCP_ACK		0x10
+
+/* Largest segment payload that fits an untagged Ethernet frame */
+#define TCP_MSS		1460
+
+enum tcp_event {
+	TCP_EV_CONNECTED,	/* Handshake complete, tcp_send() may be used */
+	TCP_EV_DATA,		/* In-order payload received */
+	TCP_EV_CLOSED,		/* The peer closed the connection */
+	TCP_EV_ERROR,		/* Connection reset or timed out */
+};
+
+/**
+ * tcp_handler_f - connection event handler
+ *
+ * @event: what happened
+ * @data: received payload for TCP_EV_DATA, NULL otherwise
+ * @len: length of @data
+ */
+typedef void tcp_handler_f(enum tcp_event event, const uchar *data,
+			   unsigned int len);
+
+/**
+ * tcp_connect() - open a connection
+ *
+ * Sends the SYN and installs the retransmission timer. The handler is called
+ * from net_loop() context once the connection is established. Any previous
+ * connection is forgotten.
+ *
+ * @dest: server IP address
+ * @dport: server port
+ * @handler: event handler
+ */
+void tcp_connect(struct in_addr dest, int dport, tcp_handler_f *handler);
+
+/**
+ * tcp_send() - send data on the established connection
+ *
+ * Only one buffer can be outstanding at a time; it is kept until it has been
+ * acknowledged so that it can be retransmitted.
+ *
+ * @data: data to send, copied
+ * @len: length of @data, at most TCP_MSS
+ * @return 0 if OK, -EBUSY if earlier data is not acknowledged yet, -ENOTCONN
+ * if there is no established connection, -E2BIG if @len is too large
+ */
+int tcp_send(const void *data, unsigned int len);
+
+/**
+ * tcp_close() - close the connection gracefully by sending a FIN
+ */
+void tcp_close(void);
+
+/**
+ * tcp_abort() - reset the connection
+ */
+void tcp_abort(void);
+
+/**
+ * tcp_set_tcp_header() - fill in the IP and TCP headers of a segment
+ *
+ * The payload must already be at IP_TCP_HDR_SIZE from @pkt. SYN segments carry
+ * an MSS option, which is accounted for in the returned header size.
+ *
+ * @pkt: start of the IP header
+ * @dest: destination IP address
+ * @dport: destination port
+ * @sport: source port
+ * @payload_len: length of the payload
+ * @action: TCP_... flags
+ * @seq: sequence number
+ * @ack: acknowledgment number
+ * @return size of the IP and TCP headers
+ */
+int tcp_set_tcp_header(uchar *pkt, struct in_addr dest, int dport, int sport,
+		       int payload_len, u8 action, u32 seq, u32 ack);
+
+/**
+ * tcp_receive() - process a received TCP segment
+ *
+ * @ip: IP header of the segment
+ * @len: IP total length
+ */
+void tcp_receive(struct ip_tcp_hdr *ip, int len);
+
+#endif /* __TCP_H__ */
@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * OctopOS storage mailbox driver
+ *
+ * Copyright (c) 2021 - 2023, The OctopOS Authors, All rights reserved.
+ */
+
+#ifndef _OCTOPOS_MBOX_H_
+#define _OCTOPOS_MBOX_H_
+
+#include <mailbox.h>
+
+/* Size of one message on the storage data queue */
+#define OCTOPOS_MBOX_MSG_SIZE		512
+
+/* Control register value while the OS has not delegated the queue */
+#define OCTOPOS_MBOX_NOT_DELEGATED	0xdeadbeef
+
+/* Quota limit reported when the OS delegates the maximum number of words */
+#define OCTOPOS_MBOX_MAX_LIMIT		0xffe
+
+/**
+ * struct octopos_mbox_stats - Receive statistics of the storage data queue
+ *
+ * @msgs:	Number of complete messages received
+ * @bursts:	Number of threshold-sized burst reads issued
+ * @words:	Number of 32-bit words read from the FIFO
+ * @total_us:	Time spent inside octopos_mbox_recv_msgs()
+ * @lat_min_us:	Shortest wait for a message to become available
+ * @lat_max_us:	Longest wait for a message to become available
+ */
+struct octopos_mbox_stats {
+	ulong msgs;
+	ulong bursts;
+	ulong words;
+	ulong total_us;
+	ulong lat_min_us;
+	ulong lat_max_us;
+};
+
+/**
+ * octopos_mbox_get() - Get the storage data channel of the first mailbox
+ *
+ * @chan:	Returns the channel, ready to be used with mbox_recv()
+ * @return 0 if OK, or a negative error code
+ */
+int octopos_mbox_get(struct mbox_chan *chan);
+
+/**
+ * octopos_mbox_wait_delegation() - Wait for the OS to delegate the queue
+ *
+ * Blocks until the OctopOS control queue reports that the storage data queue
+ * has been delegated to U-Boot, then acknowledges the control interrupt.
+ *
+ * @chan:	Channel returned by octopos_mbox_get()
+ * @timeout_us:	Time to wait for the delegation, or 0 to wait forever
+ * @return the delegated quota in words (>= 0), or -ETIMEDOUT
+ */
+int octopos_mbox_wait_delegation(struct mbox_chan *chan, ulong timeout_us);
+
+/**
+ * octopos_mbox_release() - Hand the storage data queue back to its owner
+ *
+ * @chan:	Channel returned by octopos_mbox_get()
+ */
+void octopos_mbox_release(struct mbox_chan *chan);
+
+/**
+ * octopos_mbox_recv_msgs() - Drain a run of messages into memory
+ *
+ * Reads @count messages of OCTOPOS_MBOX_MSG_SIZE bytes back to back. This
+ * avoids the per-message mbox_recv() overhead and keeps the FIFO drained at
+ * the rate the storage domain fills it.
+ *
+ * @chan:	Channel returned by octopos_mbox_get()
+ * @buf:	Destination, at least @count * OCTOPOS_MBOX_MSG_SIZE bytes
+ * @count:	Number of messages to receive
+ * @return 0 if OK, or a negative error code
+ */
+int octopos_mbox_recv_msgs(struct mbox_chan *chan, void *buf, ulong count);
+
+/**
+ * octopos_mbox_get_stats() - Get the receive statistics of a channel
+ *
+ * @chan:	Channel returned by octopos_mbox_get()
+ * @return pointer to the statistics, which may be reset by the caller
+ */
+struct octopos_mbox_stats *octopos_mbox_get_stats(struct mbox_chan *chan);
+
+#endif /* _OCTOPOS_MBOX_H_ */
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Spreading independent pieces of work over several CPUs
+ */
+
+#ifndef __PARALLEL_H
+#define __PARALLEL_H
+
+#if CONFIG_IS_ENABLED(PARALLEL)
+/**
+ * parallel_workers() - get the number of CPUs parallel_run() would use
+ *
+ * This is meant for sizing per-worker state, e.g. a decompressor workspace
+ * for each CPU.
+ *
+ * @count: number of items to process
+ * @return number of workers, from 1 (the calling CPU alone) to @count
+ */
+int parallel_workers(int count);
+
+/**
+ * parallel_run() - call a function for each of a number of items
+ *
+ * The items are handed out in order to the secondary CPUs the architecture
+ * can start and to the calling CPU, each worker taking the next item once it
+ * is done with the previous one. Without secondary CPUs the items are simply
+ * processed one after the other.
+ *
+ * On a secondary CPU @fn runs with the MMU and caches set up as on the
+ * calling CPU, but with a small stack and nothing else: it must not call
+ * malloc(), print, use driver model or anything else that is not safe to
+ * run on two CPUs at once.
+ *
+ * @fn: function to call with @arg, the number of the worker (0 to
+ *	parallel_workers(@count) - 1, 0 being the calling CPU) and the item
+ * @arg: argument for @fn
+ * @count: number of items
+ * @return 0 if OK, else the first error returned by @fn, in which case the
+ *	items not started yet are skipped
+ */
+int parallel_run(int (*fn)(void *arg, int worker, int item), void *arg,
+		 int count);
+#else
+static inline int parallel_workers(int count)
+{
+	return 1;
+}
+
+static inline int parallel_run(int (*fn)(void *arg, int worker, int item),
+			       void *arg, int count)
+{
+	int item, ret;
+
+	for (item = 0; item < count; item++) {
+		ret = fn(arg, 0, item);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+#endif
+
+/**
+ * cpu_parallel_count() - get the number of secondary CPUs for parallel_run()
+ *
+ * This is provided by the architecture. The default has none.
+ *
+ * @return number of CPUs that cpu_parallel_start() can start
+ */
+int cpu_parallel_count(void);
+
+/**
+ * cpu_parallel_start() - run a function on a secondary CPU
+ *
+ * This is provided by the architecture. @func is called once on the CPU,
+ * which is stopped again when it returns.
+ *
+ * @cpu: CPU to start, 0 to cpu_parallel_count() - 1
+ * @func: function to call
+ * @arg: argument for @func
+ * @return 0 if OK, -ve on error, in which case @func is not called
+ */
+int cpu_parallel_start(int cpu, void (*func)(void *arg), void *arg);
+
+#endif
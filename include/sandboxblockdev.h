@@ -6,9 +6,15 @@
 #ifndef __SANDBOX_BLOCK_DEV__
 #define __SANDBOX_BLOCK_DEV__
 
+/* Requests the host device accepts before reporting it is busy */
+#define HOST_BLK_QUEUE_DEPTH	4
+
 struct host_block_dev {
 #ifndef CONFIG_BLK
 	struct blk_desc blk_dev;
+#else
+	struct blk_req *queue[HOST_BLK_QUEUE_DEPTH];
+	int queued;
 #endif
 	char *filename;
 	int fd;
@@ -52,6 +52,17 @@ void sha1_starts( sha1_context *ctx );
 void sha1_update(sha1_context *ctx, const unsigned char *input,
 		 unsigned int ilen);
 
+/**
+ * \brief	   SHA-1 compression of whole 64-byte blocks, weak so that
+ *		   architectures can provide a faster version
+ *
+ * \param ctx	   SHA-1 context
+ * \param data	   buffer holding the blocks
+ * \param blocks   number of blocks
+ */
+void sha1_process(sha1_context *ctx, const unsigned char *data,
+		  unsigned int blocks);
+
 /**
  * \brief	   SHA-1 final digest
  *
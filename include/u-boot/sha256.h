@@ -19,6 +19,19 @@ void sha256_starts(sha256_context * ctx);
 void sha256_update(sha256_context *ctx, const uint8_t *input, uint32_t length);
 void sha256_finish(sha256_context * ctx, uint8_t digest[SHA256_SUM_LEN]);
 
+/**
+ * sha256_process() - Run the SHA-256 compression function over whole blocks
+ *
+ * This is the part of sha256_update() that does the work. The generic
+ * version is weak so that an architecture can provide a faster one.
+ *
+ * @ctx: SHA-256 context
+ * @data: Data to hash
+ * @blocks: Number of 64-byte blocks in @data
+ */
+void sha256_process(sha256_context *ctx, const uint8_t *data,
+		    unsigned int blocks);
+
 void sha256_csum_wd(const unsigned char *input, unsigned int ilen,
 		unsigned char *output, unsigned int chunk_sz);
 
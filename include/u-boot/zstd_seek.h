@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Seek table for zstd data made of several frames
+ *
+ * This is the seek table of the zstd seekable format: a skippable frame at
+ * the end of the data which lists the compressed and uncompressed size of
+ * each frame. It lets the frames be decompressed independently of each
+ * other, while the data stays a valid zstd stream for any decompressor.
+ */
+
+#ifndef _UBOOT_ZSTD_SEEK_H
+#define _UBOOT_ZSTD_SEEK_H
+
+#include <compiler.h>
+
+#define ZSTD_FRAME_MAGIC		0xfd2fb528
+#define ZSTD_SKIPPABLE_MAGIC		0x184d2a50
+#define ZSTD_SKIPPABLE_MASK		0xfffffff0
+
+#define ZSTD_SEEK_SKIPPABLE_MAGIC	0x184d2a5e
+#define ZSTD_SEEK_MAGIC			0x8f92eab1
+#define ZSTD_SEEK_FOOTER_SIZE		9
+#define ZSTD_SEEK_CHECKSUM_FLAG		0x80
+
+/* Content size of a frame which does not record it */
+#define ZSTD_SEEK_UNKNOWN_SIZE		((uint64_t)-1)
+
+/**
+ * struct zstd_seek_table - a seek table found at the end of zstd data
+ *
+ * @entries: first entry of the table
+ * @count: number of entries, i.e. frames
+ * @entry_size: size of each entry: 8, or 12 with a checksum
+ * @data_len: length of the frames in front of the table
+ */
+struct zstd_seek_table {
+	const uint8_t *entries;
+	int count;
+	int entry_size;
+	size_t data_len;
+};
+
+/**
+ * struct zstd_seek_entry - a frame as listed in a seek table
+ *
+ * @csize: compressed size
+ * @dsize: uncompressed size
+ * @checksum: low 32 bits of the xxh64 of the uncompressed frame, if
+ *	@has_checksum
+ * @has_checksum: the table has checksums
+ */
+struct zstd_seek_entry {
+	uint32_t csize;
+	uint32_t dsize;
+	uint32_t checksum;
+	bool has_checksum;
+};
+
+/**
+ * zstd_seek_table_find() - find the seek table at the end of zstd data
+ *
+ * The table is checked against the length of the data, not against the
+ * frames themselves.
+ *
+ * @buf: zstd data
+ * @len: length of @buf
+ * @tbl: returns the table
+ * @return 0 if OK, -ENOENT if there is no seek table, -EINVAL if it is
+ *	corrupt
+ */
+int zstd_seek_table_find(const void *buf, size_t len,
+			 struct zstd_seek_table *tbl);
+
+/**
+ * zstd_seek_table_get() - get an entry of a seek table
+ *
+ * @tbl: table from zstd_seek_table_find()
+ * @index: entry to get, 0 to @tbl->count - 1
+ * @entry: returns the entry
+ */
+void zstd_seek_table_get(const struct zstd_seek_table *tbl, int index,
+			 struct zstd_seek_entry *entry);
+
+/**
+ * zstd_frame_info() - get the sizes of the frame at the start of some data
+ *
+ * This walks the block headers of the frame, which is much quicker than
+ * decompressing it.
+ *
+ * @buf: data starting with a zstd frame or a skippable frame
+ * @len: length of @buf
+ * @csize: returns the size of the frame
+ * @dsize: returns the uncompressed size, 0 for a skippable frame, or
+ *	ZSTD_SEEK_UNKNOWN_SIZE if the frame header does not have it
+ * @return 0 if OK, -EINVAL if this is not a valid frame
+ */
+int zstd_frame_info(const void *buf, size_t len, size_t *csize,
+		    uint64_t *dsize);
+
+/**
+ * zstd_seek_table_create() - create a seek table for zstd data
+ *
+ * Each zstd frame becomes an entry, together with any skippable frames in
+ * front of it. The table has no checksums and is meant to be appended to
+ * the data.
+ *
+ * @buf: zstd data, which must not have a seek table yet
+ * @len: length of @buf
+ * @table: buffer for the table, or NULL to only get its size
+ * @table_len: size of @table; returns the size of the table
+ * @return number of frames if OK, -EINVAL if the data is not valid zstd,
+ *	-EFBIG if a frame does not record its uncompressed size or is too
+ *	large for the table, -ENOSPC if @table is too small
+ */
+int zstd_seek_table_create(const void *buf, size_t len, void *table,
+			   size_t *table_len);
+
+/**
+ * zstd_seek_decompress() - decompress zstd data, using its seek table
+ *
+ * If the data has a seek table, the frames are decompressed in parallel
+ * (see parallel_run()), each straight to its place in @dst. Otherwise the
+ * data is decompressed in one go.
+ *
+ * @src: zstd data
+ * @src_len: length of @src
+ * @dst: output buffer
+ * @dst_len: size of @dst
+ * @out_len: returns the number of bytes written to @dst
+ * @return 0 if OK, -ENOSPC if @dst is too small, -EINVAL if the data is
+ *	corrupt, -ENOMEM if out of memory
+ */
+int zstd_seek_decompress(const void *src, size_t src_len, void *dst,
+			 size_t dst_len, size_t *out_len);
+
+#endif
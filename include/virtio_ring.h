@@ -34,6 +34,9 @@
 /* We support indirect buffer descriptors */
 #define VIRTIO_RING_F_INDIRECT_DESC	28
 
+/* Maximum number of entries in one indirect descriptor table */
+#define VIRTQUEUE_INDIRECT_MAX		16
+
 /*
  * The Guest publishes the used index for which it expects an interrupt
  * at the end of the avail ring. Host should ignore the avail->flags field.
@@ -95,6 +98,8 @@ struct vring {
  * @last_used_idx: last used index we've seen
  * @avail_flags_shadow: last written value to avail->flags
  * @avail_idx_shadow: last written value to avail->idx in guest byte order
+ * @indir: indirect descriptor tables, VIRTQUEUE_INDIRECT_MAX entries for
+ *	each ring entry, or NULL if VIRTIO_RING_F_INDIRECT_DESC is not used
  */
 struct virtqueue {
 	struct list_head list;
@@ -108,6 +113,7 @@ struct virtqueue {
 	u16 last_used_idx;
 	u16 avail_flags_shadow;
 	u16 avail_idx_shadow;
+	struct vring_desc *indir;
 };
 
 /*
@@ -170,6 +176,10 @@ struct virtio_sg;
  * @in_sgs:	the number of scatterlists which are writable
  *		(after readable ones)
  *
+ * If indirect descriptors were negotiated, a buffer of more than one and at
+ * most VIRTQUEUE_INDIRECT_MAX scatter-gather entries only takes a single
+ * entry of the ring.
+ *
  * Caller must ensure we don't call this with other virtqueue operations
  * at the same time (except where noted).
  *
@@ -22,12 +22,23 @@
 #include <watchdog.h>
 #endif
 #include "u-boot/zlib.h"
+#if defined(CONFIG_ARMV8_CRC32) && !defined(USE_HOSTCC)
+#include <asm/armv8/crc32.h>
+#define CRC32_ARMV8
+#endif
 
 #ifdef USE_HOSTCC
 #define __efi_runtime
 #define __efi_runtime_data
 #endif
 
+#ifdef CRC32_ARMV8
+/* No ones complement version, using the CRC32 instructions */
+uint32_t __efi_runtime crc32_no_comp(uint32_t crc, const Bytef *buf, uInt len)
+{
+	return crc32_armv8_no_comp(crc, buf, len);
+}
+#else
 #define tole(x) cpu_to_le32(x)
 
 #ifdef CONFIG_DYNAMIC_CRC_TABLE
@@ -222,6 +233,7 @@ uint32_t __efi_runtime crc32_no_comp(uint32_t crc, const Bytef *buf, uInt len)
     return le32_to_cpu(crc);
 }
 #undef DO_CRC
+#endif /* CRC32_ARMV8 */
 
 uint32_t __efi_runtime crc32(uint32_t crc, const Bytef *p, uInt len)
 {
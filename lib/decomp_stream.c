@@ -0,0 +1,675 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Streaming decompression into a memory buffer
+ *
+ * Compressed data is pushed in pieces as it is read, e.g. one network packet
+ * at a time, and decompressed straight to its final location, so neither a
+ * second copy of the compressed image nor a pass over it after loading is
+ * needed. The output buffer is contiguous and therefore doubles as the
+ * history window of the decompressors.
+ */
+
+#include <common.h>
+#include <decomp_stream.h>
+#include <image.h>
+#include <lz4.h>
+#include <malloc.h>
+#include <asm/unaligned.h>
+#include <linux/sizes.h>
+#include <linux/zstd.h>
+#include <u-boot/zlib.h>
+
+#include <lzma/LzmaTypes.h>
+#include <lzma/LzmaDec.h>
+
+/**
+ * gather() - collect the next @need bytes of input in one piece
+ *
+ * If nothing is buffered yet and the input holds enough bytes, they are used
+ * in place; otherwise they are copied to @stage until complete.
+ *
+ * @stage: buffer of at least @need bytes
+ * @have: number of bytes in @stage, updated
+ * @need: number of bytes wanted
+ * @src: input, advanced past the bytes used
+ * @len: length of @src, reduced by the bytes used
+ * @return pointer to the @need bytes, or NULL if more input is needed
+ */
+static const u8 *gather(u8 *stage, size_t *have, size_t need, const u8 **src,
+			size_t *len)
+{
+	const u8 *p;
+	size_t n;
+
+	if (!*have && *len >= need) {
+		p = *src;
+		*src += need;
+		*len -= need;
+		return p;
+	}
+
+	n = min(need - *have, *len);
+	memcpy(stage + *have, *src, n);
+	*have += n;
+	*src += n;
+	*len -= n;
+	if (*have < need)
+		return NULL;
+	*have = 0;
+
+	return stage;
+}
+
+#if CONFIG_IS_ENABLED(GZIP)
+static int gzip_init(struct decomp_stream *ds)
+{
+	z_stream *s;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return -ENOMEM;
+
+	/* Let inflate() handle the gzip header and check the trailer */
+	if (inflateInit2(s, 16 + MAX_WBITS) != Z_OK) {
+		free(s);
+		return -ENOMEM;
+	}
+	s->next_out = ds->dst;
+	s->avail_out = ds->dst_len;
+	ds->priv = s;
+
+	return 0;
+}
+
+static int gzip_write(struct decomp_stream *ds, const u8 *src, size_t len)
+{
+	z_stream *s = ds->priv;
+	int r;
+
+	if (ds->done)
+		return 0;
+	s->next_in = (u8 *)src;
+	s->avail_in = len;
+	do {
+		r = inflate(s, Z_NO_FLUSH);
+	} while (r == Z_OK && s->avail_in && s->avail_out);
+	ds->out = s->next_out - ds->dst;
+
+	if (r == Z_STREAM_END)
+		ds->done = true;
+	else if (s->avail_in && !s->avail_out)
+		return -ENOSPC;
+	else if (r != Z_OK && r != Z_BUF_ERROR)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void gzip_end(struct decomp_stream *ds)
+{
+	inflateEnd(ds->priv);
+	free(ds->priv);
+}
+#endif
+
+#if CONFIG_IS_ENABLED(LZ4)
+enum {
+	LZ4_FRAME,		/* magic, FLG and BD */
+	LZ4_FRAME_REST,		/* optional content size, header checksum */
+	LZ4_BLOCK_HDR,
+	LZ4_BLOCK,		/* block data and optional block checksum */
+	LZ4_TRAILER,		/* content checksum */
+	LZ4_DONE,
+};
+
+#define LZ4_MAGIC		0x184d2204
+#define LZ4_FLG_VERSION_MASK	0xc0
+#define LZ4_FLG_VERSION		0x40
+#define LZ4_FLG_INDEPENDENT	0x20
+#define LZ4_FLG_BLOCK_CSUM	0x10
+#define LZ4_FLG_CONTENT_SIZE	0x08
+#define LZ4_FLG_CONTENT_CSUM	0x04
+#define LZ4_BLOCK_UNCOMPRESSED	BIT(31)
+
+struct lz4_stream {
+	int state;
+	u8 flags;
+	u8 hdr[16];
+	u8 *buf;		/* a block that straddles two writes */
+	size_t block_max;
+	size_t have;
+	size_t need;
+	u32 block;		/* header of the current block */
+};
+
+static int lz4_init(struct decomp_stream *ds)
+{
+	struct lz4_stream *lz;
+
+	lz = calloc(1, sizeof(*lz));
+	if (!lz)
+		return -ENOMEM;
+	lz->state = LZ4_FRAME;
+	lz->need = 6;
+	ds->priv = lz;
+
+	return 0;
+}
+
+static int lz4_frame(struct lz4_stream *lz, const u8 *p)
+{
+	if (get_unaligned_le32(p) != LZ4_MAGIC)
+		return -EINVAL;
+	lz->flags = p[4];
+	if ((lz->flags & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION)
+		return -EPROTONOSUPPORT;
+	/* As with ulz4fn(), blocks must not refer to earlier ones */
+	if (!(lz->flags & LZ4_FLG_INDEPENDENT))
+		return -EPROTONOSUPPORT;
+	if ((lz->flags & 0x03) || (p[5] & 0x8f))
+		return -EINVAL;
+	lz->block_max = 1 << (8 + 2 * ((p[5] >> 4) & 7));
+	if (lz->block_max < SZ_64K)
+		return -EINVAL;
+	lz->buf = malloc(lz->block_max + sizeof(u32));
+	if (!lz->buf)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int lz4_write(struct decomp_stream *ds, const u8 *src, size_t len)
+{
+	struct lz4_stream *lz = ds->priv;
+	u8 *stage;
+	const u8 *p;
+	int ret;
+
+	while (len && lz->state != LZ4_DONE) {
+		stage = lz->state == LZ4_BLOCK ? lz->buf : lz->hdr;
+		p = gather(stage, &lz->have, lz->need, &src, &len);
+		if (!p)
+			break;
+
+		switch (lz->state) {
+		case LZ4_FRAME:
+			ret = lz4_frame(lz, p);
+			if (ret)
+				return ret;
+			lz->state = LZ4_FRAME_REST;
+			lz->need = 1;
+			if (lz->flags & LZ4_FLG_CONTENT_SIZE)
+				lz->need += sizeof(u64);
+			break;
+		case LZ4_FRAME_REST:
+			lz->state = LZ4_BLOCK_HDR;
+			lz->need = sizeof(u32);
+			break;
+		case LZ4_BLOCK_HDR:
+			lz->block = get_unaligned_le32(p);
+			lz->need = lz->block & ~LZ4_BLOCK_UNCOMPRESSED;
+			if (!lz->need) {
+				lz->state = LZ4_TRAILER;
+				lz->need = sizeof(u32);
+				if (!(lz->flags & LZ4_FLG_CONTENT_CSUM))
+					lz->state = LZ4_DONE;
+				break;
+			}
+			if (lz->need > lz->block_max)
+				return -EINVAL;
+			if (lz->flags & LZ4_FLG_BLOCK_CSUM)
+				lz->need += sizeof(u32);
+			lz->state = LZ4_BLOCK;
+			break;
+		case LZ4_BLOCK: {
+			size_t size = lz->block & ~LZ4_BLOCK_UNCOMPRESSED;
+			size_t space = min(ds->dst_len - ds->out,
+					   lz->block_max);
+
+			if (lz->block & LZ4_BLOCK_UNCOMPRESSED) {
+				if (size > space)
+					return -ENOSPC;
+				memcpy(ds->dst + ds->out, p, size);
+			} else if (ulz4_block(p, size, ds->dst + ds->out,
+					      &space)) {
+				/* Overrunning the output looks the same */
+				return space < lz->block_max ? -ENOSPC :
+					-EINVAL;
+			} else {
+				size = space;
+			}
+			ds->out += size;
+			lz->state = LZ4_BLOCK_HDR;
+			lz->need = sizeof(u32);
+			break;
+		}
+		case LZ4_TRAILER:
+			lz->state = LZ4_DONE;
+			break;
+		}
+	}
+	ds->done = lz->state == LZ4_DONE;
+
+	return 0;
+}
+
+static void lz4_end(struct decomp_stream *ds)
+{
+	struct lz4_stream *lz = ds->priv;
+
+	free(lz->buf);
+	free(lz);
+}
+#endif
+
+#ifdef CONFIG_LZMA
+/* Properties, then the uncompressed size as a 64-bit little-endian value */
+#define LZMA_HDR_SIZE	(LZMA_PROPS_SIZE + sizeof(u64))
+
+struct lzma_stream {
+	CLzmaDec dec;
+	ISzAlloc alloc;
+	u8 hdr[LZMA_HDR_SIZE];
+	size_t have;
+	bool started;
+	bool sized;		/* the header gives the uncompressed size */
+	SizeT limit;
+};
+
+static void *lzma_alloc(void *p, size_t size)
+{
+	return malloc(size);
+}
+
+static void lzma_free(void *p, void *address)
+{
+	free(address);
+}
+
+static int lzma_init(struct decomp_stream *ds)
+{
+	struct lzma_stream *lz;
+
+	lz = calloc(1, sizeof(*lz));
+	if (!lz)
+		return -ENOMEM;
+	LzmaDec_Construct(&lz->dec);
+	lz->alloc.Alloc = lzma_alloc;
+	lz->alloc.Free = lzma_free;
+	ds->priv = lz;
+
+	return 0;
+}
+
+static int lzma_start(struct decomp_stream *ds, struct lzma_stream *lz,
+		      const u8 *p)
+{
+	u64 size = get_unaligned_le64(p + LZMA_PROPS_SIZE);
+
+	lz->sized = size != (u64)-1;
+	if (lz->sized && size > ds->dst_len)
+		return -ENOSPC;
+	lz->limit = min_t(u64, size, ds->dst_len);
+
+	/* Only the probabilities; the dictionary is the output buffer */
+	if (LzmaDec_AllocateProbs(&lz->dec, p, LZMA_PROPS_SIZE, &lz->alloc))
+		return -EINVAL;
+	lz->dec.dic = ds->dst;
+	lz->dec.dicBufSize = ds->dst_len;
+	LzmaDec_Init(&lz->dec);
+	lz->started = true;
+
+	return 0;
+}
+
+static int lzma_write(struct decomp_stream *ds, const u8 *src, size_t len)
+{
+	struct lzma_stream *lz = ds->priv;
+	ELzmaFinishMode mode;
+	ELzmaStatus status;
+	const u8 *p;
+	SizeT in;
+	int ret;
+
+	if (ds->done)
+		return 0;
+	if (!lz->started) {
+		p = gather(lz->hdr, &lz->have, LZMA_HDR_SIZE, &src, &len);
+		if (!p)
+			return 0;
+		ret = lzma_start(ds, lz, p);
+		if (ret)
+			return ret;
+	}
+
+	/*
+	 * Without a size in the header the data ends with a marker. Once the
+	 * output buffer is full, only that marker may follow: LZMA_FINISH_END
+	 * checks for it and fails on anything else.
+	 */
+	do {
+		mode = !lz->sized && lz->dec.dicPos == lz->limit ?
+			LZMA_FINISH_END : LZMA_FINISH_ANY;
+		in = len;
+		ret = LzmaDec_DecodeToDic(&lz->dec, lz->limit, src, &in, mode,
+					  &status);
+		ds->out = lz->dec.dicPos;
+		if (ret != SZ_OK)
+			return ds->out == ds->dst_len ? -ENOSPC : -EINVAL;
+		src += in;
+		len -= in;
+	} while (len && mode == LZMA_FINISH_ANY && ds->out == lz->limit &&
+		 status != LZMA_STATUS_FINISHED_WITH_MARK);
+
+	if (status == LZMA_STATUS_FINISHED_WITH_MARK ||
+	    (lz->sized && ds->out == lz->limit))
+		ds->done = true;
+
+	return 0;
+}
+
+static void lzma_end(struct decomp_stream *ds)
+{
+	struct lzma_stream *lz = ds->priv;
+
+	LzmaDec_FreeProbs(&lz->dec, &lz->alloc);
+	free(lz);
+}
+#endif
+
+#if CONFIG_IS_ENABLED(ZSTD)
+struct zstd_stream {
+	ZSTD_DCtx *dctx;
+	void *workspace;
+	u8 *buf;		/* an input item that straddles two writes */
+	size_t have;
+	bool skipping;		/* in the content of a skippable frame */
+};
+
+static int zstd_init(struct decomp_stream *ds)
+{
+	struct zstd_stream *zs;
+	size_t wsize;
+
+	zs = calloc(1, sizeof(*zs));
+	if (!zs)
+		return -ENOMEM;
+	ds->priv = zs;
+
+	wsize = ZSTD_DCtxWorkspaceBound();
+	zs->workspace = malloc(wsize);
+	zs->buf = malloc(ZSTD_BLOCKSIZE_ABSOLUTEMAX);
+	if (!zs->workspace || !zs->buf)
+		return -ENOMEM;
+	zs->dctx = ZSTD_initDCtx(zs->workspace, wsize);
+	if (!zs->dctx)
+		return -ENOMEM;
+	ZSTD_decompressBegin(zs->dctx);
+
+	return 0;
+}
+
+/*
+ * This uses the buffer-less API, which decodes straight into the output
+ * buffer and takes the previous output as its window, rather than keeping a
+ * window of its own like ZSTD_decompressStream() does.
+ */
+static int zstd_write(struct decomp_stream *ds, const u8 *src, size_t len)
+{
+	struct zstd_stream *zs = ds->priv;
+	ZSTD_nextInputType_e type;
+	const u8 *p;
+	size_t need;
+	size_t ret;
+
+	while (len) {
+		need = ZSTD_nextSrcSizeToDecompress(zs->dctx);
+		if (!need) {
+			/* Another frame follows */
+			ZSTD_decompressBegin(zs->dctx);
+			zs->skipping = false;
+			continue;
+		}
+		ds->done = false;
+
+		if (zs->skipping) {
+			/* Skippable frames may be larger than a block */
+			ret = min(need - zs->have, len);
+			zs->have += ret;
+			src += ret;
+			len -= ret;
+			if (zs->have < need)
+				break;
+			zs->have = 0;
+			zs->skipping = false;
+			ZSTD_decompressBegin(zs->dctx);
+			ds->done = true;
+			continue;
+		}
+
+		if (need > ZSTD_BLOCKSIZE_ABSOLUTEMAX)
+			return -EINVAL;
+		type = ZSTD_nextInputType(zs->dctx);
+		p = gather(zs->buf, &zs->have, need, &src, &len);
+		if (!p)
+			break;
+		ret = ZSTD_decompressContinue(zs->dctx, ds->dst + ds->out,
+					      ds->dst_len - ds->out, p, need);
+		if (ZSTD_isError(ret)) {
+			if (ZSTD_getErrorCode(ret) == ZSTD_error_dstSize_tooSmall)
+				return -ENOSPC;
+			return -EINVAL;
+		}
+		ds->out += ret;
+
+		/* The header of a skippable frame gives its size */
+		if (type == ZSTDnit_skippableFrame)
+			zs->skipping = true;
+		else if (!ZSTD_nextSrcSizeToDecompress(zs->dctx))
+			ds->done = true;
+	}
+
+	return 0;
+}
+
+static void zstd_end(struct decomp_stream *ds)
+{
+	struct zstd_stream *zs = ds->priv;
+
+	free(zs->buf);
+	free(zs->workspace);
+	free(zs);
+}
+#endif
+
+static int none_write(struct decomp_stream *ds, const u8 *src, size_t len)
+{
+	if (len > ds->dst_len - ds->out)
+		return -ENOSPC;
+	memcpy(ds->dst + ds->out, src, len);
+	ds->out += len;
+
+	return 0;
+}
+
+static int decomp_detect(const u8 *magic, int len)
+{
+	static const struct {
+		int comp;
+		u8 magic[4];
+		int len;
+	} magics[] = {
+		{ IH_COMP_GZIP, { 0x1f, 0x8b }, 2 },
+		{ IH_COMP_LZ4, { 0x04, 0x22, 0x4d, 0x18 }, 4 },
+		{ IH_COMP_ZSTD, { 0x28, 0xb5, 0x2f, 0xfd }, 4 },
+	};
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(magics); i++) {
+		if (len >= magics[i].len &&
+		    !memcmp(magic, magics[i].magic, magics[i].len))
+			return magics[i].comp;
+	}
+
+	return IH_COMP_NONE;
+}
+
+static int decomp_start(struct decomp_stream *ds)
+{
+	switch (ds->comp) {
+	case IH_COMP_NONE:
+		return 0;
+#if CONFIG_IS_ENABLED(GZIP)
+	case IH_COMP_GZIP:
+		return gzip_init(ds);
+#endif
+#if CONFIG_IS_ENABLED(LZ4)
+	case IH_COMP_LZ4:
+		return lz4_init(ds);
+#endif
+#ifdef CONFIG_LZMA
+	case IH_COMP_LZMA:
+		return lzma_init(ds);
+#endif
+#if CONFIG_IS_ENABLED(ZSTD)
+	case IH_COMP_ZSTD:
+		return zstd_init(ds);
+#endif
+	default:
+		return -EPROTONOSUPPORT;
+	}
+}
+
+static int decomp_write(struct decomp_stream *ds, const u8 *src, size_t len)
+{
+	switch (ds->comp) {
+	case IH_COMP_NONE:
+		return none_write(ds, src, len);
+#if CONFIG_IS_ENABLED(GZIP)
+	case IH_COMP_GZIP:
+		return gzip_write(ds, src, len);
+#endif
+#if CONFIG_IS_ENABLED(LZ4)
+	case IH_COMP_LZ4:
+		return lz4_write(ds, src, len);
+#endif
+#ifdef CONFIG_LZMA
+	case IH_COMP_LZMA:
+		return lzma_write(ds, src, len);
+#endif
+#if CONFIG_IS_ENABLED(ZSTD)
+	case IH_COMP_ZSTD:
+		return zstd_write(ds, src, len);
+#endif
+	default:
+		return -EPROTONOSUPPORT;
+	}
+}
+
+static void decomp_end(struct decomp_stream *ds)
+{
+	if (!ds->priv)
+		return;
+
+	switch (ds->comp) {
+#if CONFIG_IS_ENABLED(GZIP)
+	case IH_COMP_GZIP:
+		gzip_end(ds);
+		break;
+#endif
+#if CONFIG_IS_ENABLED(LZ4)
+	case IH_COMP_LZ4:
+		lz4_end(ds);
+		break;
+#endif
+#ifdef CONFIG_LZMA
+	case IH_COMP_LZMA:
+		lzma_end(ds);
+		break;
+#endif
+#if CONFIG_IS_ENABLED(ZSTD)
+	case IH_COMP_ZSTD:
+		zstd_end(ds);
+		break;
+#endif
+	}
+	ds->priv = NULL;
+}
+
+/* Pick the compression once enough of the data is there, then catch up */
+static int decomp_auto(struct decomp_stream *ds, const u8 **src, size_t *len,
+		       bool flush)
+{
+	int n;
+	int ret;
+
+	n = min_t(size_t, sizeof(ds->magic) - ds->magic_len, *len);
+	memcpy(ds->magic + ds->magic_len, *src, n);
+	ds->magic_len += n;
+	*src += n;
+	*len -= n;
+	if (ds->magic_len < (int)sizeof(ds->magic) && !flush)
+		return 0;
+
+	ds->comp = decomp_detect(ds->magic, ds->magic_len);
+	ret = decomp_start(ds);
+	if (ret)
+		return ret;
+
+	return decomp_write(ds, ds->magic, ds->magic_len);
+}
+
+int decomp_stream_init(struct decomp_stream *ds, int comp, void *dst,
+		       size_t dst_len)
+{
+	int ret;
+
+	memset(ds, '\0', sizeof(*ds));
+	ds->comp = comp;
+	ds->dst = dst;
+	ds->dst_len = dst_len;
+	if (comp == DECOMP_STREAM_AUTO)
+		return 0;
+
+	ret = decomp_start(ds);
+	if (ret)
+		decomp_end(ds);
+
+	return ret;
+}
+
+int decomp_stream_write(struct decomp_stream *ds, const void *src,
+			size_t len)
+{
+	const u8 *p = src;
+
+	if (ds->err)
+		return ds->err;
+	ds->in += len;
+
+	if (ds->comp == DECOMP_STREAM_AUTO) {
+		ds->err = decomp_auto(ds, &p, &len, false);
+		if (ds->err || ds->comp == DECOMP_STREAM_AUTO)
+			return ds->err;
+	}
+	if (len)
+		ds->err = decomp_write(ds, p, len);
+
+	return ds->err;
+}
+
+int decomp_stream_finish(struct decomp_stream *ds, size_t *out_len)
+{
+	const u8 *p = NULL;
+	size_t len = 0;
+
+	if (!ds->err && ds->comp == DECOMP_STREAM_AUTO)
+		ds->err = decomp_auto(ds, &p, &len, true);
+	if (!ds->err && !ds->done && ds->comp != IH_COMP_NONE)
+		ds->err = -EINVAL;
+
+	decomp_end(ds);
+	*out_len = ds->out;
+
+	return ds->err;
+}
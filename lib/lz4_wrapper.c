@@ -14,6 +14,38 @@ static u16 LZ4_readLE16(const void *src) { return le16_to_cpu(*(u16 *)src); }
 static void LZ4_copy4(void *dst, const void *src) { *(u32 *)dst = *(u32 *)src; }
 static void LZ4_copy8(void *dst, const void *src) { *(u64 *)dst = *(u64 *)src; }
 
+/*
+ * 16-byte copies for the fast path: NEON on arm64, where ld1/st1 of bytes
+ * need no alignment even with -mstrict-align, and SSE2 on x86_64 through a
+ * GCC vector type, since the intrinsics headers need a C library.
+ */
+#if defined(__aarch64__)
+typedef u8 lz4_vec16 __attribute__((vector_size(16)));
+
+static void LZ4_copy16(void *dst, const void *src)
+{
+	lz4_vec16 v;
+
+	asm ("ld1 {%0.16b}, [%1]"
+	     : "=w" (v) : "r" (src), "m" (*(const u8 (*)[16])src));
+	asm ("st1 {%1.16b}, [%2]"
+	     : "=m" (*(u8 (*)[16])dst) : "w" (v), "r" (dst));
+}
+#elif defined(__x86_64__)
+typedef u8 lz4_vec16 __attribute__((vector_size(16), aligned(1), may_alias));
+
+static void LZ4_copy16(void *dst, const void *src)
+{
+	*(lz4_vec16 *)dst = *(const lz4_vec16 *)src;
+}
+#else
+static void LZ4_copy16(void *dst, const void *src)
+{
+	LZ4_copy8(dst, src);
+	LZ4_copy8(dst + 8, src + 8);
+}
+#endif
+
 typedef  uint8_t BYTE;
 typedef uint16_t U16;
 typedef uint32_t U32;
@@ -25,6 +57,131 @@ typedef uint64_t U64;
 /* Unaltered (except removing unrelated code) from github.com/Cyan4973/lz4. */
 #include "lz4.c"	/* #include for inlining, do not link! */
 
+/*
+ * Room the fast path keeps at the end of both buffers, for its 16-byte
+ * copies to run over and to leave the last sequence, which has no match,
+ * to LZ4_decompress_generic().
+ */
+#define LZ4_FAST_MARGIN	32
+
+/* Like LZ4_wildCopy(), but may write up to 15 bytes beyond dstEnd */
+static void LZ4_wildCopy16(BYTE *d, const BYTE *s, BYTE *e)
+{
+	do {
+		LZ4_copy16(d, s);
+		d += 16;
+		s += 16;
+	} while (d < e);
+}
+
+/*
+ * Decode an independent block. While both buffers have LZ4_FAST_MARGIN bytes
+ * to spare, each sequence is decoded with wide copies and a few checks. The
+ * rest, from the first sequence which gets too close to either end, is left
+ * to LZ4_decompress_generic() and all of its checks.
+ *
+ * Returns the number of bytes decoded, or a negative value on error.
+ */
+static int LZ4_decompress_fast_path(const BYTE *src, BYTE *dst, int srcn,
+				    int dstn)
+{
+	const size_t dec32table[] = {4, 1, 2, 1, 4, 4, 4, 4};
+	const size_t dec64table[] = {0, 0, 0, (size_t)-1, 0, 1, 2, 3};
+	const BYTE *const iend = src + srcn;
+	BYTE *const oend = dst + dstn;
+	const BYTE *ip = src;
+	BYTE *op = dst;
+	const BYTE *seq, *match;
+	BYTE *seq_op, *cpy;
+	size_t length, offset;
+	unsigned int token, s;
+	int ret;
+
+	while (1) {
+		/* Where the generic code takes over if this sequence does not fit */
+		seq = ip;
+		seq_op = op;
+		if (iend - ip <= LZ4_FAST_MARGIN || oend - op <= LZ4_FAST_MARGIN)
+			break;
+
+		token = *ip++;
+		length = token >> ML_BITS;
+		if (length == RUN_MASK) {
+			do {
+				s = *ip++;
+				length += s;
+			} while (s == 255 && ip < iend - LZ4_FAST_MARGIN);
+			if (s == 255)
+				break;
+		}
+		if (length > (size_t)(iend - ip) - LZ4_FAST_MARGIN ||
+		    length > (size_t)(oend - op) - LZ4_FAST_MARGIN)
+			break;
+
+		/* Most literal runs take a single copy */
+		if (length <= 16)
+			LZ4_copy16(op, ip);
+		else
+			LZ4_wildCopy16(op, ip, op + length);
+		ip += length;
+		op += length;
+
+		offset = LZ4_readLE16(ip);
+		ip += 2;
+		match = op - offset;
+		if (unlikely(match < dst))
+			return -1;	/* offset outside destination buffer */
+
+		length = token & ML_MASK;
+		if (length == ML_MASK) {
+			do {
+				s = *ip++;
+				length += s;
+			} while (s == 255 && ip < iend - LZ4_FAST_MARGIN);
+			if (s == 255)
+				break;
+		}
+		length += MINMATCH;
+		if (length > (size_t)(oend - op) - LZ4_FAST_MARGIN)
+			break;
+
+		/*
+		 * A match closer than a copy overlaps itself, so spread out the
+		 * first bytes until it is 8 bytes away, as the generic code does
+		 */
+		cpy = op + length;
+		if (offset >= 16) {
+			LZ4_wildCopy16(op, match, cpy);
+		} else {
+			if (offset < 8) {
+				op[0] = match[0];
+				op[1] = match[1];
+				op[2] = match[2];
+				op[3] = match[3];
+				match += dec32table[offset];
+				LZ4_copy4(op + 4, match);
+				match -= dec64table[offset];
+			} else {
+				LZ4_copy8(op, match);
+				match += 8;
+			}
+			op += 8;
+			LZ4_wildCopy(op, match, cpy);
+		}
+		op = cpy;
+	}
+
+
+	/* constant folding essential, do not touch params! */
+	ret = LZ4_decompress_generic((const char *)seq, (char *)seq_op,
+				     iend - seq, oend - seq_op, endOnInputSize,
+				     full, 0, noDict, dst, NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	return seq_op - dst + ret;
+}
+
 struct lz4_frame_header {
 	u32 magic;
 	union {
@@ -117,10 +274,8 @@ int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
 				break;
 			}
 		} else {
-			/* constant folding essential, do not touch params! */
-			ret = LZ4_decompress_generic(in, out, b.size,
-					end - out, endOnInputSize,
-					full, 0, noDict, out, NULL, 0);
+			ret = LZ4_decompress_fast_path(in, out, b.size,
+						       end - out);
 			if (ret < 0) {
 				ret = -EPROTO;	/* decompression error */
 				break;
@@ -136,3 +291,29 @@ int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
 	*dstn = out - dst;
 	return ret;
 }
+
+int ulz4_block(const void *src, size_t srcn, void *dst, size_t *dstn)
+{
+	int ret;
+
+	ret = LZ4_decompress_fast_path(src, dst, srcn, *dstn);
+	if (ret < 0)
+		return -EPROTO;
+
+	*dstn = ret;
+	return 0;
+}
+
+int ulz4_block_ref(const void *src, size_t srcn, void *dst, size_t *dstn)
+{
+	int ret;
+
+	/* constant folding essential, do not touch params! */
+	ret = LZ4_decompress_generic(src, dst, srcn, *dstn, endOnInputSize,
+				     full, 0, noDict, dst, NULL, 0);
+	if (ret < 0)
+		return -EPROTO;
+
+	*dstn = ret;
+	return 0;
+}
@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Spreading independent pieces of work over several CPUs
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <parallel.h>
+#include <watchdog.h>
+
+/*
+ * The secondary CPUs share nothing but this structure with the calling CPU,
+ * so it is only ever accessed with atomic operations.
+ */
+struct parallel_work {
+	int (*fn)(void *arg, int worker, int item);
+	void *arg;
+	int count;
+	int next;		/* next item to hand out */
+	int err;		/* first error from fn */
+	int running;		/* secondary CPUs still busy */
+};
+
+struct parallel_worker {
+	struct parallel_work *work;
+	int id;
+};
+
+__weak int cpu_parallel_count(void)
+{
+	return 0;
+}
+
+__weak int cpu_parallel_start(int cpu, void (*func)(void *arg), void *arg)
+{
+	return -ENOSYS;
+}
+
+static void parallel_do(struct parallel_work *work, int id)
+{
+	int item, ret, none;
+
+	while (!__atomic_load_n(&work->err, __ATOMIC_RELAXED)) {
+		item = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+		if (item >= work->count)
+			break;
+		ret = work->fn(work->arg, id, item);
+		if (ret) {
+			none = 0;
+			__atomic_compare_exchange_n(&work->err, &none, ret,
+						    false, __ATOMIC_RELAXED,
+						    __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/* Entry point on the secondary CPUs */
+static void parallel_secondary(void *arg)
+{
+	struct parallel_worker *worker = arg;
+	struct parallel_work *work = worker->work;
+
+	parallel_do(work, worker->id);
+	/* Publishes everything fn() wrote before the CPU goes away */
+	__atomic_fetch_sub(&work->running, 1, __ATOMIC_RELEASE);
+}
+
+int parallel_workers(int count)
+{
+	return max(1, min(count, cpu_parallel_count() + 1));
+}
+
+int parallel_run(int (*fn)(void *arg, int worker, int item), void *arg,
+		 int count)
+{
+	struct parallel_work work = {
+		.fn = fn,
+		.arg = arg,
+		.count = count,
+	};
+	struct parallel_worker *workers = NULL;
+	int nworkers = parallel_workers(count);
+	int i;
+
+	if (nworkers > 1)
+		workers = calloc(nworkers, sizeof(*workers));
+	for (i = 1; workers && i < nworkers; i++) {
+		workers[i].work = &work;
+		workers[i].id = i;
+		__atomic_fetch_add(&work.running, 1, __ATOMIC_RELAXED);
+		if (cpu_parallel_start(i - 1, parallel_secondary,
+				       &workers[i])) {
+			/* Leave the rest to the CPUs already started */
+			__atomic_fetch_sub(&work.running, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+
+	parallel_do(&work, 0);
+	while (__atomic_load_n(&work.running, __ATOMIC_ACQUIRE))
+		WATCHDOG_RESET();
+	free(workers);
+
+	return work.err;
+}
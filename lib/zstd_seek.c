@@ -0,0 +1,339 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Seek table for zstd data made of several frames
+ *
+ * The format is that of the zstd seekable format, see
+ * https://github.com/facebook/zstd/blob/dev/contrib/seekable_format/zstd_seekable_compression_format.md
+ */
+
+#ifdef USE_HOSTCC
+#include "mkimage.h"
+#else
+#include <common.h>
+#include <malloc.h>
+#include <parallel.h>
+#include <linux/xxhash.h>
+#include <linux/zstd.h>
+#endif
+#include <u-boot/zstd_seek.h>
+
+static uint32_t zstd_le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void zstd_put_le32(uint8_t *p, uint32_t val)
+{
+	p[0] = val;
+	p[1] = val >> 8;
+	p[2] = val >> 16;
+	p[3] = val >> 24;
+}
+
+int zstd_seek_table_find(const void *buf, size_t len,
+			 struct zstd_seek_table *tbl)
+{
+	const uint8_t *footer, *frame;
+	struct zstd_seek_entry entry;
+	uint64_t size, total = 0;
+	uint8_t desc;
+	int i;
+
+	if (len < ZSTD_SEEK_FOOTER_SIZE)
+		return -ENOENT;
+	footer = buf + len - ZSTD_SEEK_FOOTER_SIZE;
+	if (zstd_le32(footer + 5) != ZSTD_SEEK_MAGIC)
+		return -ENOENT;
+
+	/* Bits 2 to 6 of the descriptor are reserved */
+	desc = footer[4];
+	if (desc & 0x7c)
+		return -EINVAL;
+	tbl->count = zstd_le32(footer);
+	tbl->entry_size = desc & ZSTD_SEEK_CHECKSUM_FLAG ? 12 : 8;
+	if (tbl->count < 0)
+		return -EINVAL;
+	size = 8 + (uint64_t)tbl->count * tbl->entry_size +
+		ZSTD_SEEK_FOOTER_SIZE;
+	if (size > len)
+		return -EINVAL;
+
+	frame = buf + len - size;
+	if (zstd_le32(frame) != ZSTD_SEEK_SKIPPABLE_MAGIC ||
+	    zstd_le32(frame + 4) != size - 8)
+		return -EINVAL;
+	tbl->entries = frame + 8;
+	tbl->data_len = len - size;
+
+	for (i = 0; i < tbl->count; i++) {
+		zstd_seek_table_get(tbl, i, &entry);
+		total += entry.csize;
+	}
+	if (total != tbl->data_len)
+		return -EINVAL;
+
+	return 0;
+}
+
+void zstd_seek_table_get(const struct zstd_seek_table *tbl, int index,
+			 struct zstd_seek_entry *entry)
+{
+	const uint8_t *p = tbl->entries + index * tbl->entry_size;
+
+	entry->csize = zstd_le32(p);
+	entry->dsize = zstd_le32(p + 4);
+	entry->has_checksum = tbl->entry_size == 12;
+	entry->checksum = entry->has_checksum ? zstd_le32(p + 8) : 0;
+}
+
+int zstd_frame_info(const void *buf, size_t len, size_t *csize,
+		    uint64_t *dsize)
+{
+	static const uint8_t dict_id_size[] = { 0, 1, 2, 4 };
+	const uint8_t *p = buf;
+	uint32_t magic, hdr;
+	size_t pos, size;
+	int fcs_size, i;
+	uint8_t desc;
+	bool last;
+
+	if (len < 8)
+		return -EINVAL;
+	magic = zstd_le32(p);
+	if ((magic & ZSTD_SKIPPABLE_MASK) == ZSTD_SKIPPABLE_MAGIC) {
+		size = zstd_le32(p + 4);
+		if (size > len - 8)
+			return -EINVAL;
+		*csize = 8 + size;
+		*dsize = 0;
+		return 0;
+	}
+	if (magic != ZSTD_FRAME_MAGIC)
+		return -EINVAL;
+
+	/* Frame header: descriptor, window, dictionary ID, content size */
+	desc = p[4];
+	if (desc & 0x08)
+		return -EINVAL;
+	pos = 5;
+	if (!(desc & 0x20))
+		pos++;
+	pos += dict_id_size[desc & 3];
+	fcs_size = desc >> 6 ? 1 << (desc >> 6) : desc & 0x20 ? 1 : 0;
+	if (pos + fcs_size > len)
+		return -EINVAL;
+	*dsize = fcs_size ? 0 : ZSTD_SEEK_UNKNOWN_SIZE;
+	for (i = 0; i < fcs_size; i++)
+		*dsize |= (uint64_t)p[pos + i] << (i * 8);
+	if (fcs_size == 2)
+		*dsize += 256;
+	pos += fcs_size;
+
+	/* Blocks, the last one marked as such */
+	do {
+		if (pos + 3 > len)
+			return -EINVAL;
+		hdr = p[pos] | p[pos + 1] << 8 | p[pos + 2] << 16;
+		pos += 3;
+		last = hdr & 1;
+		switch ((hdr >> 1) & 3) {
+		case 1:		/* RLE: a single byte */
+			size = 1;
+			break;
+		case 3:		/* reserved */
+			return -EINVAL;
+		default:
+			size = hdr >> 3;
+			break;
+		}
+		if (size > len - pos)
+			return -EINVAL;
+		pos += size;
+	} while (!last);
+
+	/* Content checksum */
+	if (desc & 0x04)
+		pos += 4;
+	if (pos > len)
+		return -EINVAL;
+	*csize = pos;
+
+	return 0;
+}
+
+int zstd_seek_table_create(const void *buf, size_t len, void *table,
+			   size_t *table_len)
+{
+	const uint8_t *p = buf;
+	size_t pos, start, csize, size;
+	uint8_t *entry = NULL;
+	uint64_t dsize;
+	int count, ret;
+
+	/* Count the zstd frames first, to size the table */
+	for (count = 0, pos = 0; pos < len; pos += csize) {
+		ret = zstd_frame_info(p + pos, len - pos, &csize, &dsize);
+		if (ret)
+			return ret;
+		if (zstd_le32(p + pos) == ZSTD_FRAME_MAGIC)
+			count++;
+	}
+	if (!count)
+		return -EINVAL;
+
+	size = 8 + count * 8 + ZSTD_SEEK_FOOTER_SIZE;
+	if (table) {
+		if (*table_len < size)
+			return -ENOSPC;
+		entry = table + 8;
+		zstd_put_le32(table, ZSTD_SEEK_SKIPPABLE_MAGIC);
+		zstd_put_le32(table + 4, size - 8);
+		zstd_put_le32(table + size - 9, count);
+		((uint8_t *)table)[size - 5] = 0;
+		zstd_put_le32(table + size - 4, ZSTD_SEEK_MAGIC);
+	}
+	*table_len = size;
+
+	/*
+	 * Skippable frames go with the zstd frame after them, or with the
+	 * last one at the end of the data.
+	 */
+	for (start = 0, pos = 0, count = 0; pos < len; pos += csize) {
+		zstd_frame_info(p + pos, len - pos, &csize, &dsize);
+		if (zstd_le32(p + pos) != ZSTD_FRAME_MAGIC)
+			continue;
+		if (dsize > UINT32_MAX || pos + csize - start > UINT32_MAX)
+			return -EFBIG;
+		if (entry) {
+			zstd_put_le32(entry, pos + csize - start);
+			zstd_put_le32(entry + 4, dsize);
+			entry += 8;
+		}
+		start = pos + csize;
+		count++;
+	}
+	if (entry && start < len)
+		zstd_put_le32(entry - 8, zstd_le32(entry - 8) + len - start);
+
+	return count;
+}
+
+#ifndef USE_HOSTCC
+struct zstd_seek_job {
+	struct zstd_seek_table tbl;
+	const u8 *src;
+	u8 *dst;
+	size_t *src_off;	/* where each frame starts in src */
+	size_t *dst_off;	/* and in dst */
+	ZSTD_DCtx **dctx;	/* one for each worker */
+};
+
+static int zstd_seek_frame(void *arg, int worker, int item)
+{
+	struct zstd_seek_job *job = arg;
+	struct zstd_seek_entry entry;
+	u8 *dst = job->dst + job->dst_off[item];
+	size_t ret;
+
+	zstd_seek_table_get(&job->tbl, item, &entry);
+	ret = ZSTD_decompressDCtx(job->dctx[worker], dst, entry.dsize,
+				  job->src + job->src_off[item], entry.csize);
+	if (ZSTD_isError(ret) || ret != entry.dsize)
+		return -EINVAL;
+	if (entry.has_checksum &&
+	    (u32)xxh64(dst, entry.dsize, 0) != entry.checksum)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int zstd_seek_run(struct zstd_seek_job *job, size_t dst_len,
+			 size_t *out_len)
+{
+	struct zstd_seek_entry entry;
+	size_t src_pos = 0, dst_pos = 0;
+	size_t wsize = ZSTD_DCtxWorkspaceBound();
+	void **workspace;
+	int count = job->tbl.count;
+	int workers, i, ret;
+
+	for (i = 0; i < count; i++) {
+		zstd_seek_table_get(&job->tbl, i, &entry);
+		job->src_off[i] = src_pos;
+		job->dst_off[i] = dst_pos;
+		src_pos += entry.csize;
+		dst_pos += entry.dsize;
+	}
+	if (dst_pos > dst_len)
+		return -ENOSPC;
+
+	/* The workers must not allocate, so give each its own context */
+	workers = parallel_workers(count);
+	workspace = calloc(workers, sizeof(*workspace));
+	job->dctx = calloc(workers, sizeof(*job->dctx));
+	ret = workspace && job->dctx ? 0 : -ENOMEM;
+	for (i = 0; !ret && i < workers; i++) {
+		workspace[i] = malloc(wsize);
+		if (workspace[i])
+			job->dctx[i] = ZSTD_initDCtx(workspace[i], wsize);
+		if (!job->dctx[i])
+			ret = -ENOMEM;
+	}
+
+	if (!ret)
+		ret = parallel_run(zstd_seek_frame, job, count);
+	if (!ret)
+		*out_len = dst_pos;
+
+	for (i = 0; workspace && i < workers; i++)
+		free(workspace[i]);
+	free(workspace);
+	free(job->dctx);
+
+	return ret;
+}
+
+int zstd_seek_decompress(const void *src, size_t src_len, void *dst,
+			 size_t dst_len, size_t *out_len)
+{
+	struct zstd_seek_job job = {
+		.src = src,
+		.dst = dst,
+	};
+	size_t wsize, ret;
+	ZSTD_DCtx *dctx;
+	void *workspace;
+	int err;
+
+	*out_len = 0;
+	err = zstd_seek_table_find(src, src_len, &job.tbl);
+	if (!err) {
+		job.src_off = calloc(job.tbl.count, sizeof(*job.src_off));
+		job.dst_off = calloc(job.tbl.count, sizeof(*job.dst_off));
+		if (job.src_off && job.dst_off)
+			err = zstd_seek_run(&job, dst_len, out_len);
+		else
+			err = -ENOMEM;
+		free(job.src_off);
+		free(job.dst_off);
+		return err;
+	} else if (err != -ENOENT) {
+		return err;
+	}
+
+	/* No seek table: all frames one after the other */
+	wsize = ZSTD_DCtxWorkspaceBound();
+	workspace = malloc(wsize);
+	if (!workspace)
+		return -ENOMEM;
+	dctx = ZSTD_initDCtx(workspace, wsize);
+	ret = ZSTD_decompressDCtx(dctx, dst, dst_len, src, src_len);
+	free(workspace);
+	if (ZSTD_isError(ret))
+		return ZSTD_getErrorCode(ret) == ZSTD_error_dstSize_tooSmall ?
+			-ENOSPC : -EINVAL;
+	*out_len = ret;
+
+	return 0;
+}
+#endif
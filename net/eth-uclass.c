@@ -110,6 +110,17 @@ struct udevice *eth_get_dev_by_name(const char *devname)
 	}
 
 	uclass_get(UCLASS_ETH, &uc);
+	/*
+	 * A name or an alias matches without probing the devices before it,
+	 * which CONFIG_DM_PROBE_DEFER relies on to leave them unprobed
+	 */
+	uclass_foreach_dev(it, uc) {
+		if ((!strcmp(it->name, devname) ||
+		     (endp > startp && it->req_seq == seq)) &&
+		    !device_probe(it))
+			return it;
+	}
+
 	uclass_foreach_dev(it, uc) {
 		/*
 		 * We need the seq to be valid, so try to probe it.
@@ -352,6 +363,41 @@ int eth_send(void *packet, int length)
 	return ret;
 }
 
+/* Maximum number of packets processed by one eth_rx() call */
+#define ETH_RX_BUDGET	32
+/* Maximum number of packets fetched by one recv_batch() call */
+#define ETH_RX_BATCH	8
+
+static int eth_rx_batch(struct udevice *current)
+{
+	const struct eth_ops *ops = eth_get_ops(current);
+	uchar *packets[ETH_RX_BATCH];
+	int lengths[ETH_RX_BATCH];
+	int done, count, flags;
+	int ret, i;
+
+	flags = ETH_RECV_CHECK_DEVICE;
+	for (done = 0; done < ETH_RX_BUDGET; done += ret) {
+		count = min(ETH_RX_BATCH, ETH_RX_BUDGET - done);
+		ret = ops->recv_batch(current, flags, packets, lengths, count);
+		flags = 0;
+		if (ret <= 0)
+			return ret;
+
+		net_stats.rx_batches++;
+		for (i = 0; i < ret; i++) {
+			net_process_received_packet(packets[i], lengths[i]);
+			if (ops->free_pkt)
+				ops->free_pkt(current, packets[i], lengths[i]);
+		}
+		/* A short batch means the driver has nothing more for now */
+		if (ret < count)
+			break;
+	}
+
+	return 0;
+}
+
 int eth_rx(void)
 {
 	struct udevice *current;
@@ -367,17 +413,25 @@ int eth_rx(void)
 	if (!eth_is_active(current))
 		return -EINVAL;
 
-	/* Process up to 32 packets at one time */
-	flags = ETH_RECV_CHECK_DEVICE;
-	for (i = 0; i < 32; i++) {
-		ret = eth_get_ops(current)->recv(current, flags, &packet);
-		flags = 0;
-		if (ret > 0)
-			net_process_received_packet(packet, ret);
-		if (ret >= 0 && eth_get_ops(current)->free_pkt)
-			eth_get_ops(current)->free_pkt(current, packet, ret);
-		if (ret <= 0)
-			break;
+	if (eth_get_ops(current)->recv_batch) {
+		ret = eth_rx_batch(current);
+	} else {
+		/* Process up to ETH_RX_BUDGET packets at one time */
+		flags = ETH_RECV_CHECK_DEVICE;
+		for (i = 0; i < ETH_RX_BUDGET; i++) {
+			ret = eth_get_ops(current)->recv(current, flags,
+							 &packet);
+			flags = 0;
+			if (ret > 0) {
+				net_stats.rx_batches++;
+				net_process_received_packet(packet, ret);
+			}
+			if (ret >= 0 && eth_get_ops(current)->free_pkt)
+				eth_get_ops(current)->free_pkt(current, packet,
+							       ret);
+			if (ret <= 0)
+				break;
+		}
 	}
 	if (ret == -EAGAIN)
 		ret = 0;
@@ -388,6 +442,47 @@ int eth_rx(void)
 	return ret;
 }
 
+/* List the devices without probing them, see CONFIG_DM_PROBE_DEFER */
+static int eth_show_unprobed(void)
+{
+	int num_devices = 0;
+	struct udevice *dev;
+
+	for (uclass_find_first_device(UCLASS_ETH, &dev);
+	     dev;
+	     uclass_find_next_device(&dev))
+		printf("%s%s", num_devices++ ? ", " : "", dev->name);
+
+	if (!num_devices)
+		printf("No ethernet found.");
+	putc('\n');
+
+	return num_devices;
+}
+
+/*
+ * Step to the first or next device, probing it. With DM_PROBE_ASYNC all of
+ * them have been probed by uclass_probe_all() already, so skip those which
+ * failed rather than probing them a second time.
+ */
+static void eth_next_probed(struct udevice **devp, bool first)
+{
+	if (!CONFIG_IS_ENABLED(DM_PROBE_ASYNC)) {
+		if (first)
+			uclass_first_device_check(UCLASS_ETH, devp);
+		else
+			uclass_next_device_check(devp);
+		return;
+	}
+
+	if (first)
+		uclass_find_first_device(UCLASS_ETH, devp);
+	else
+		uclass_find_next_device(devp);
+	while (*devp && !device_active(*devp))
+		uclass_find_next_device(devp);
+}
+
 int eth_initialize(void)
 {
 	int num_devices = 0;
@@ -395,13 +490,25 @@ int eth_initialize(void)
 
 	eth_common_init();
 
+	/*
+	 * eth_post_probe() writes the hwaddr of each device as it is first
+	 * used and eth_set_current() picks ethprime then, see
+	 * CONFIG_DM_PROBE_DEFER for what this leaves out
+	 */
+	if (CONFIG_IS_ENABLED(DM_PROBE_DEFER))
+		return eth_show_unprobed();
+
+	/* Probe them together, so that any waits for their PHYs overlap */
+	if (CONFIG_IS_ENABLED(DM_PROBE_ASYNC))
+		uclass_probe_all(UCLASS_ETH);
+
 	/*
 	 * Devices need to write the hwaddr even if not started so that Linux
 	 * will have access to the hwaddr that u-boot stored for the device.
 	 * This is accomplished by attempting to probe each device and calling
 	 * their write_hwaddr() operation.
 	 */
-	uclass_first_device_check(UCLASS_ETH, &dev);
+	eth_next_probed(&dev, true);
 	if (!dev) {
 		printf("No ethernet found.\n");
 		bootstage_error(BOOTSTAGE_ID_NET_ETH_START);
@@ -434,7 +541,7 @@ int eth_initialize(void)
 
 			if (dev->seq != -1)
 				num_devices++;
-			uclass_next_device_check(&dev);
+			eth_next_probed(&dev, false);
 		} while (dev);
 
 		if (!num_devices)
@@ -505,6 +612,8 @@ static int eth_post_probe(struct udevice *dev)
 			ops->recv += gd->reloc_off;
 		if (ops->free_pkt)
 			ops->free_pkt += gd->reloc_off;
+		if (ops->recv_batch)
+			ops->recv_batch += gd->reloc_off;
 		if (ops->stop)
 			ops->stop += gd->reloc_off;
 		if (ops->mcast)
@@ -95,7 +95,11 @@
 #include <errno.h>
 #include <net.h>
 #include <net/fastboot.h>
+#include <net/tcp.h>
 #include <net/tftp.h>
+#if defined(CONFIG_CMD_WGET)
+#include <net/wget.h>
+#endif
 #if defined(CONFIG_CMD_PCAP)
 #include <net/pcap.h>
 #endif
@@ -191,6 +195,8 @@ int		net_ntp_time_offset;
 static uchar net_pkt_buf[(PKTBUFSRX+1) * PKTSIZE_ALIGN + PKTALIGN];
 /* Receive packets */
 uchar *net_rx_packets[PKTBUFSRX];
+/* Packet counters of the last net_loop() */
+struct net_stats net_stats;
 /* Current UDP RX packet handler */
 static rxhand_f *udp_packet_handler;
 /* Current ARP RX packet handler */
@@ -412,6 +418,7 @@ int net_loop(enum proto_t protocol)
 	debug_cond(DEBUG_INT_STATE, "--- net_loop Entry\n");
 
 	bootstage_mark_name(BOOTSTAGE_ID_ETH_START, "eth_start");
+	memset(&net_stats, '\0', sizeof(net_stats));
 	net_init();
 	if (eth_is_on_demand_init() || protocol != NETCONS) {
 		eth_halt();
@@ -501,6 +508,11 @@ restart:
 			nfs_start();
 			break;
 #endif
+#if defined(CONFIG_CMD_WGET)
+		case WGET:
+			wget_start();
+			break;
+#endif
 #if defined(CONFIG_CMD_CDP)
 		case CDP:
 			cdp_start();
@@ -848,6 +860,14 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 				   payload_len);
 		pkt_hdr_size = eth_hdr_size + IP_UDP_HDR_SIZE;
 		break;
+#if defined(CONFIG_PROT_TCP)
+	case IPPROTO_TCP:
+		pkt_hdr_size = eth_hdr_size +
+			tcp_set_tcp_header(pkt + eth_hdr_size, dest, dport,
+					   sport, payload_len, action,
+					   tcp_seq_num, tcp_ack_num);
+		break;
+#endif
 	default:
 		return -EINVAL;
 	}
@@ -1095,10 +1115,13 @@ void net_process_received_packet(uchar *in_packet, int len)
 	net_rx_packet = in_packet;
 	net_rx_packet_len = len;
 	et = (struct ethernet_hdr *)in_packet;
+	net_stats.rx_packets++;
 
 	/* too small packet? */
-	if (len < ETHER_HDR_SIZE)
+	if (len < ETHER_HDR_SIZE) {
+		net_stats.rx_errors++;
 		return;
+	}
 
 #if defined(CONFIG_API) || defined(CONFIG_EFI_LOADER)
 	if (push_packet) {
@@ -1143,8 +1166,10 @@ void net_process_received_packet(uchar *in_packet, int len)
 		debug_cond(DEBUG_NET_PKT, "VLAN packet received\n");
 
 		/* too small packet? */
-		if (len < VLAN_ETHER_HDR_SIZE)
+		if (len < VLAN_ETHER_HDR_SIZE) {
+			net_stats.rx_errors++;
 			return;
+		}
 
 		/* if no VLAN active */
 		if ((ntohs(net_our_vlan) & VLAN_IDMASK) == VLAN_NONE
@@ -1181,11 +1206,13 @@ void net_process_received_packet(uchar *in_packet, int len)
 
 	switch (eth_proto) {
 	case PROT_ARP:
+		net_stats.rx_arp++;
 		arp_receive(et, ip, len);
 		break;
 
 #ifdef CONFIG_CMD_RARP
 	case PROT_RARP:
+		net_stats.rx_arp++;
 		rarp_receive(ip, len);
 		break;
 #endif
@@ -1195,11 +1222,13 @@ void net_process_received_packet(uchar *in_packet, int len)
 		if (len < IP_UDP_HDR_SIZE) {
 			debug("len bad %d < %lu\n", len,
 			      (ulong)IP_UDP_HDR_SIZE);
+			net_stats.rx_errors++;
 			return;
 		}
 		/* Check the packet length */
 		if (len < ntohs(ip->ip_len)) {
 			debug("len bad %d < %d\n", len, ntohs(ip->ip_len));
+			net_stats.rx_errors++;
 			return;
 		}
 		len = ntohs(ip->ip_len);
@@ -1215,6 +1244,7 @@ void net_process_received_packet(uchar *in_packet, int len)
 		/* Check the Checksum of the header */
 		if (!ip_checksum_ok((uchar *)ip, IP_HDR_SIZE)) {
 			debug("checksum bad\n");
+			net_stats.rx_errors++;
 			return;
 		}
 		/* If it is not for us, ignore it */
@@ -1255,11 +1285,20 @@ void net_process_received_packet(uchar *in_packet, int len)
 		 * there is no server at the other end.
 		 */
 		if (ip->ip_p == IPPROTO_ICMP) {
+			net_stats.rx_icmp++;
 			receive_icmp(ip, len, src_ip, et);
 			return;
+#if defined(CONFIG_PROT_TCP)
+		} else if (ip->ip_p == IPPROTO_TCP) {
+			net_stats.rx_tcp++;
+			tcp_receive((struct ip_tcp_hdr *)ip, len);
+			return;
+#endif
 		} else if (ip->ip_p != IPPROTO_UDP) {	/* Only UDP packets */
+			net_stats.rx_other++;
 			return;
 		}
+		net_stats.rx_udp++;
 
 		if (ntohs(ip->udp_len) < UDP_HDR_SIZE || ntohs(ip->udp_len) > ntohs(ip->ip_len))
 			return;
@@ -1325,9 +1364,25 @@ void net_process_received_packet(uchar *in_packet, int len)
 		wol_receive(ip, len);
 		break;
 #endif
+	default:
+		net_stats.rx_other++;
+		break;
 	}
 }
 
+void net_print_stats(void)
+{
+	printf("RX: %lu packets, %lu errors", net_stats.rx_packets,
+	       net_stats.rx_errors);
+	/* Legacy drivers hand packets to the stack themselves */
+	if (net_stats.rx_batches)
+		printf(", %lu driver polls", net_stats.rx_batches);
+	printf("\n    ARP %lu, ICMP %lu, UDP %lu, TCP %lu, other %lu\n",
+	       net_stats.rx_arp, net_stats.rx_icmp, net_stats.rx_udp,
+	       net_stats.rx_tcp, net_stats.rx_other);
+	printf("TX: %lu packets\n", net_stats.tx_packets);
+}
+
 /**********************************************************************/
 
 static int net_check_prereq(enum proto_t protocol)
@@ -1360,6 +1415,9 @@ static int net_check_prereq(enum proto_t protocol)
 #endif
 #if defined(CONFIG_CMD_NFS)
 	case NFS:
+#endif
+#if defined(CONFIG_CMD_WGET)
+	case WGET:
 #endif
 		/* Fall through */
 	case TFTPGET:
@@ -43,15 +43,65 @@
 # define NFS_TIMEOUT CONFIG_NFS_TIMEOUT
 #endif
 
+#ifdef CONFIG_NFS_READ_WINDOW
+# define NFS_READ_WINDOW CONFIG_NFS_READ_WINDOW
+#else
+# define NFS_READ_WINDOW 1
+#endif
+
+/* Bounds of the READ retransmission timeout, in ms */
+#define NFS_RTO_MIN	100UL
+#define NFS_RTO_MAX	(4 * NFS_TIMEOUT)
+
+/* Bytes of the reply header copied out of the packet by nfs_read_reply() */
+#define NFS_READ_HDR_SIZE	(sizeof(((struct rpc_t *)0)->u.reply) - \
+				 NFS_READ_SIZE)
+#define NFS_HASH_BYTES		(NFS_READ_SIZE / 2 * 10)
+
 #define NFS_RPC_ERR	1
 #define NFS_RPC_DROP	124
 
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
 static ulong nfs_timeout = NFS_TIMEOUT;
 
+/*
+ * READ requests are pipelined: up to NFS_READ_WINDOW of them are outstanding
+ * at once and replies are matched to their request by XID, so they may come
+ * back in any order. A slot with xid == 0 is free.
+ */
+struct nfs_read_slot {
+	unsigned long xid;
+	unsigned long prev_xid;	/* XID before the last retransmission */
+	unsigned int offset;
+	unsigned int len;
+	ulong sent;		/* get_timer() value of the last transmission */
+	int retries;
+};
+
+static struct nfs_read_slot nfs_reads[NFS_READ_WINDOW];
+static unsigned int nfs_read_next;	/* offset of the next new READ */
+static unsigned int nfs_read_eof;	/* file size once known */
+static unsigned int nfs_read_bytes;	/* bytes received, for the hashes */
+static unsigned int nfs_hashes;
+
+/*
+ * Requests are built and replies parsed in this buffer, which is too big for
+ * the stack with a large NFS_READ_SIZE. Each reply is done with before the
+ * next request is sent.
+ */
+static struct rpc_t rpc_pkt;
+
+/*
+ * Round-trip estimate in the style of RFC 6298: srtt is kept scaled by 8 and
+ * rttvar by 4, all in ms, and nfs_srtt is negative until the first sample.
+ * nfs_rto is the retransmission timeout of a READ that has not been
+ * retransmitted yet.
+ */
+static long nfs_srtt;
+static long nfs_rttvar;
+static ulong nfs_rto;
+
 static char dirfh[NFS_FHSIZE];	/* NFSv2 / NFSv3 file handle of directory */
 static char filefh[NFS3_FHSIZE]; /* NFSv2 / NFSv3 file handle */
 static int filefh3_length;	/* (variable) length of filefh when NFSv3 */
@@ -171,9 +221,9 @@ static uint32_t *rpc_add_credentials(uint32_t *p)
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
-static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+static unsigned long rpc_req(int rpc_prog, int rpc_proc, uint32_t *data,
+			     int datalen)
 {
-	struct rpc_t rpc_pkt;
 	unsigned long id;
 	uint32_t *p;
 	int pktlen;
@@ -216,6 +266,8 @@ static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 
 	net_send_udp_packet(net_server_ethaddr, nfs_server_ip, sport,
 			    nfs_our_port, pktlen);
+
+	return id;
 }
 
 /**************************************************************************
@@ -357,7 +409,7 @@ static void nfs_lookup_req(char *fname)
 /**************************************************************************
 NFS_READ - Read File on NFS Server
 **************************************************************************/
-static void nfs_read_req(int offset, int readlen)
+static unsigned long nfs_read_req(int offset, int readlen)
 {
 	uint32_t data[1024];
 	uint32_t *p;
@@ -384,7 +436,187 @@ static void nfs_read_req(int offset, int readlen)
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req(PROG_NFS, NFS_READ, data, len);
+	return rpc_req(PROG_NFS, NFS_READ, data, len);
+}
+
+/**************************************************************************
+NFS_READ window - keep several READ requests in flight
+**************************************************************************/
+static void nfs_read_send(struct nfs_read_slot *slot)
+{
+	slot->xid = nfs_read_req(slot->offset, slot->len);
+	slot->sent = get_timer(0);
+}
+
+static struct nfs_read_slot *nfs_read_find(unsigned long xid)
+{
+	struct nfs_read_slot *slot;
+
+	for (slot = nfs_reads; slot < nfs_reads + NFS_READ_WINDOW; slot++) {
+		if (slot->xid && (slot->xid == xid || slot->prev_xid == xid))
+			return slot;
+	}
+
+	return NULL;
+}
+
+static ulong nfs_read_timeout(struct nfs_read_slot *slot)
+{
+	return min(nfs_rto << min(slot->retries, 8), NFS_RTO_MAX);
+}
+
+static void nfs_read_timeout_handler(void);
+
+/* Arm the timer for the READ that will time out first */
+static void nfs_read_arm_timer(void)
+{
+	struct nfs_read_slot *slot;
+	ulong wait = NFS_RTO_MAX;
+
+	for (slot = nfs_reads; slot < nfs_reads + NFS_READ_WINDOW; slot++) {
+		ulong elapsed, tmo;
+
+		if (!slot->xid)
+			continue;
+		elapsed = get_timer(slot->sent);
+		tmo = nfs_read_timeout(slot);
+		wait = min(wait, elapsed < tmo ? tmo - elapsed : 0);
+	}
+
+	/* A zero interval would cancel the timer */
+	net_set_timeout_handler(max(wait, 1UL), nfs_read_timeout_handler);
+}
+
+/* Send new requests until the window is full or the whole file is asked for */
+static void nfs_read_fill(void)
+{
+	struct nfs_read_slot *slot;
+
+	for (slot = nfs_reads; slot < nfs_reads + NFS_READ_WINDOW; slot++) {
+		if (slot->xid)
+			continue;
+		if (nfs_read_next >= nfs_read_eof)
+			break;
+		slot->prev_xid = 0;
+		slot->offset = nfs_read_next;
+		slot->len = NFS_READ_SIZE;
+		slot->retries = 0;
+		nfs_read_send(slot);
+		nfs_read_next += NFS_READ_SIZE;
+	}
+
+	nfs_read_arm_timer();
+}
+
+static void nfs_read_start(void)
+{
+	memset(nfs_reads, 0, sizeof(nfs_reads));
+	nfs_read_next = 0;
+	nfs_read_eof = UINT_MAX;
+	nfs_read_bytes = 0;
+	nfs_hashes = 0;
+
+	nfs_read_fill();
+}
+
+static void nfs_read_timeout_handler(void)
+{
+	struct nfs_read_slot *slot;
+
+	for (slot = nfs_reads; slot < nfs_reads + NFS_READ_WINDOW; slot++) {
+		if (!slot->xid || get_timer(slot->sent) < nfs_read_timeout(slot))
+			continue;
+		if (++slot->retries > NFS_RETRY_COUNT) {
+			puts("\nRetry count exceeded; starting again\n");
+			net_start_again();
+			return;
+		}
+		puts("T ");
+		/* A late reply to the previous transmission is still good */
+		slot->prev_xid = slot->xid;
+		nfs_read_send(slot);
+	}
+
+	nfs_read_arm_timer();
+}
+
+/* Update the round-trip estimate from a READ that was sent only once */
+static void nfs_read_rtt_sample(struct nfs_read_slot *slot)
+{
+	long rtt, err;
+
+	if (slot->retries)
+		return;
+
+	rtt = get_timer(slot->sent);
+	if (nfs_srtt < 0) {
+		nfs_srtt = rtt << 3;
+		nfs_rttvar = rtt << 1;
+	} else {
+		err = rtt - (nfs_srtt >> 3);
+		nfs_srtt += err;
+		if (err < 0)
+			err = -err;
+		nfs_rttvar += err - (nfs_rttvar >> 2);
+	}
+	nfs_rto = clamp((ulong)((nfs_srtt >> 3) + nfs_rttvar), NFS_RTO_MIN,
+			NFS_TIMEOUT);
+}
+
+static void nfs_read_progress(unsigned int len)
+{
+	nfs_read_bytes += len;
+	while (nfs_hashes * NFS_HASH_BYTES < nfs_read_bytes) {
+		if (nfs_hashes && !(nfs_hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+		putc('#');
+		nfs_hashes++;
+	}
+}
+
+/*
+ * Account for the @rlen bytes that arrived for @slot and keep the window
+ * going. Returns true once the whole file has been received.
+ */
+static bool nfs_read_done(struct nfs_read_slot *slot, unsigned int rlen,
+			  bool eof)
+{
+	nfs_read_rtt_sample(slot);
+	nfs_read_progress(rlen);
+
+	if (eof) {
+		nfs_read_eof = min(nfs_read_eof, slot->offset + rlen);
+		slot->xid = 0;
+	} else if (rlen < slot->len) {
+		/* Short read before the end of the file: ask for the rest */
+		slot->prev_xid = 0;
+		slot->offset += rlen;
+		slot->len -= rlen;
+		slot->retries = 0;
+		nfs_read_send(slot);
+	} else {
+		slot->xid = 0;
+	}
+
+	/* Requests beyond the end of the file are of no use any more */
+	for (slot = nfs_reads; slot < nfs_reads + NFS_READ_WINDOW; slot++) {
+		if (slot->xid && slot->offset >= nfs_read_eof)
+			slot->xid = 0;
+	}
+
+	if (nfs_read_eof != UINT_MAX) {
+		for (slot = nfs_reads; slot < nfs_reads + NFS_READ_WINDOW;
+		     slot++) {
+			if (slot->xid)
+				break;
+		}
+		if (slot == nfs_reads + NFS_READ_WINDOW)
+			return true;
+	}
+
+	nfs_read_fill();
+
+	return false;
 }
 
 /**************************************************************************
@@ -417,7 +649,7 @@ static void nfs_send(void)
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_fill();
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -431,8 +663,6 @@ Handlers for the reply from server
 
 static int rpc_lookup_reply(int prog, uchar *pkt, unsigned len)
 {
-	struct rpc_t rpc_pkt;
-
 	memcpy(&rpc_pkt.u.data[0], pkt, len);
 
 	debug("%s\n", __func__);
@@ -461,8 +691,6 @@ static int rpc_lookup_reply(int prog, uchar *pkt, unsigned len)
 
 static int nfs_mount_reply(uchar *pkt, unsigned len)
 {
-	struct rpc_t rpc_pkt;
-
 	debug("%s\n", __func__);
 
 	memcpy(&rpc_pkt.u.data[0], pkt, len);
@@ -487,8 +715,6 @@ static int nfs_mount_reply(uchar *pkt, unsigned len)
 
 static int nfs_umountall_reply(uchar *pkt, unsigned len)
 {
-	struct rpc_t rpc_pkt;
-
 	debug("%s\n", __func__);
 
 	memcpy(&rpc_pkt.u.data[0], pkt, len);
@@ -511,8 +737,6 @@ static int nfs_umountall_reply(uchar *pkt, unsigned len)
 
 static int nfs_lookup_reply(uchar *pkt, unsigned len)
 {
-	struct rpc_t rpc_pkt;
-
 	debug("%s\n", __func__);
 
 	memcpy(&rpc_pkt.u.data[0], pkt, len);
@@ -612,7 +836,6 @@ static int nfs3_get_attributes_offset(uint32_t *data)
 
 static int nfs_readlink_reply(uchar *pkt, unsigned len)
 {
-	struct rpc_t rpc_pkt;
 	int rlen;
 	int nfsv3_data_offset = 0;
 
@@ -660,20 +883,23 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 	return 0;
 }
 
-static int nfs_read_reply(uchar *pkt, unsigned len)
+static int nfs_read_reply(uchar *pkt, unsigned len,
+			  struct nfs_read_slot **slotp, bool *eof)
 {
-	struct rpc_t rpc_pkt;
+	struct nfs_read_slot *slot;
 	int rlen;
 	uchar *data_ptr;
+	unsigned int data_off;
 
 	debug("%s\n", __func__);
 
-	memcpy(&rpc_pkt.u.data[0], pkt, sizeof(rpc_pkt.u.reply));
+	/* Only the header is copied, the data is stored straight from pkt */
+	memcpy(&rpc_pkt.u.data[0], pkt, NFS_READ_HDR_SIZE);
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
-		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	slot = nfs_read_find(ntohl(rpc_pkt.u.reply.id));
+	if (!slot)
 		return -NFS_RPC_DROP;
+	*slotp = slot;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -686,33 +912,33 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
-
 	if (supported_nfs_versions & NFSV2_FLAG) {
 		rlen = ntohl(rpc_pkt.u.reply.data[18]);
 		data_ptr = (uchar *)&(rpc_pkt.u.reply.data[19]);
+		/* NFSv2 has no EOF flag, a short read means end of file */
+		*eof = (unsigned int)rlen < slot->len;
 	} else {  /* NFSV3_FLAG */
 		int nfsv3_data_offset =
 			nfs3_get_attributes_offset(rpc_pkt.u.reply.data);
 
 		/* count value */
 		rlen = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
+		*eof = !!rpc_pkt.u.reply.data[2 + nfsv3_data_offset];
 		/* Skip unused values :
-			EOF:		32 bits value,
 			data_size:	32 bits value,
 		*/
 		data_ptr = (uchar *)
 			&(rpc_pkt.u.reply.data[4 + nfsv3_data_offset]);
 	}
+	if (!rlen)
+		*eof = true;
 
-	if (((uchar *)&(rpc_pkt.u.reply.data[0]) - (uchar *)(&rpc_pkt) + rlen) > len)
+	data_off = data_ptr - (uchar *)&rpc_pkt;
+	if (rlen < 0 || (unsigned int)rlen > slot->len ||
+	    data_off + rlen > len)
 			return -9999;
 
-	if (store_block(data_ptr, nfs_offset, rlen))
+	if (store_block(pkt + data_off, slot->offset, rlen))
 			return -9999;
 
 	return rlen;
@@ -738,6 +964,8 @@ static void nfs_timeout_handler(void)
 static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			unsigned src, unsigned len)
 {
+	struct nfs_read_slot *slot;
+	bool eof = false;
 	int rlen;
 	int reply;
 
@@ -810,9 +1038,7 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_send();
 		} else {
 			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
-			nfs_send();
+			nfs_read_start();
 		}
 		break;
 
@@ -835,22 +1061,24 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		break;
 
 	case STATE_READ_REQ:
-		rlen = nfs_read_reply(pkt, len);
+		rlen = nfs_read_reply(pkt, len, &slot, &eof);
 		if (rlen == -NFS_RPC_DROP)
 			break;
-		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
+		if (rlen >= 0) {
+			if (!nfs_read_done(slot, rlen, eof))
+				break;
+			nfs_download_state = NETLOOP_SUCCESS;
+			net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
+			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
+			net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
-				nfs_download_state = NETLOOP_SUCCESS;
-			if (rlen < 0)
-				debug("NFS READ error (%d)\n", rlen);
+			debug("NFS READ error (%d)\n", rlen);
+			net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		}
@@ -917,6 +1145,8 @@ void nfs_start(void)
 	net_set_udp_handler(nfs_handler);
 
 	nfs_timeout_count = 0;
+	nfs_srtt = -1;
+	nfs_rto = nfs_timeout;
 	nfs_state = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
 
 	/*nfs_our_port = 4096 + (get_ticks() % 3072);*/
@@ -0,0 +1,467 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Minimal TCP client
+ *
+ * Only what a boot loader needs to pull a file from a server: one actively
+ * opened connection, a single small outstanding transmit buffer and in-order
+ * receive. Received payload is handed to the protocol handler as soon as it
+ * arrives in sequence, so the handler can place it straight at its final
+ * address; anything out of order is dropped and triggers a duplicate ACK.
+ */
+
+#include <common.h>
+#include <net.h>
+#include <net/tcp.h>
+#include <linux/errno.h>
+#include "net_rand.h"
+
+/* Retransmission timeout, doubled on every retry */
+#define TCP_RTO_MIN_MS		200
+#define TCP_RTO_MAX_MS		3000
+/* Maximum time an ACK for a single segment is held back */
+#define TCP_DELACK_MS		20
+/* Give up after this many timeouts without hearing from the peer */
+#define TCP_RETRIES		10
+/* MSS assumed when the peer does not send the option (RFC 1122) */
+#define TCP_DEFAULT_MSS		536
+
+#define TCP_OPT_END		0
+#define TCP_OPT_NOP		1
+#define TCP_OPT_MSS		2
+#define TCP_OPT_MSS_SIZE	4
+
+enum tcp_state {
+	TCP_CLOSED,
+	TCP_SYN_SENT,
+	TCP_ESTABLISHED,
+	TCP_FIN_WAIT_1,
+	TCP_FIN_WAIT_2,
+	TCP_CLOSE_WAIT,
+	TCP_LAST_ACK,
+};
+
+/* TCP pseudo header used for the checksum */
+struct tcp_pseudo_hdr {
+	struct in_addr	src;
+	struct in_addr	dst;
+	u8		zero;
+	u8		proto;
+	u16		len;
+} __attribute__((packed));
+
+static enum tcp_state tcp_state;
+static tcp_handler_f *tcp_handler;
+static uchar tcp_ethaddr[ARP_HLEN];
+static struct in_addr tcp_remote_ip;
+static int tcp_remote_port;
+static int tcp_local_port;
+
+static u32 tcp_snd_una;		/* Oldest unacknowledged sequence number */
+static u32 tcp_snd_nxt;		/* Next sequence number to send */
+static u32 tcp_rcv_nxt;		/* Next sequence number expected */
+static unsigned int tcp_snd_mss;
+
+static uchar tcp_txbuf[TCP_MSS];
+static unsigned int tcp_txlen;	/* Bytes of tcp_txbuf not acknowledged */
+static bool tcp_fin_sent;
+
+static unsigned int tcp_ack_pending;	/* Segments received but not acked */
+static unsigned int tcp_retries;
+static ulong tcp_rto;
+
+static inline bool tcp_seq_after(u32 a, u32 b)
+{
+	return (s32)(a - b) > 0;
+}
+
+static u16 tcp_checksum(struct ip_tcp_hdr *ip, int tcp_len)
+{
+	struct tcp_pseudo_hdr pseudo;
+	unsigned int sum;
+
+	pseudo.src = ip->ip_src;
+	pseudo.dst = ip->ip_dst;
+	pseudo.zero = 0;
+	pseudo.proto = IPPROTO_TCP;
+	pseudo.len = htons(tcp_len);
+
+	sum = compute_ip_checksum(&pseudo, sizeof(pseudo));
+
+	return add_ip_checksums(sizeof(pseudo), sum,
+				compute_ip_checksum(&ip->tcp_src, tcp_len));
+}
+
+int tcp_set_tcp_header(uchar *pkt, struct in_addr dest, int dport, int sport,
+		       int payload_len, u8 action, u32 seq, u32 ack)
+{
+	struct ip_tcp_hdr *ip = (struct ip_tcp_hdr *)pkt;
+	int hdr_size = IP_TCP_HDR_SIZE;
+	uchar *opt;
+
+	if (action & TCP_SYN) {
+		opt = pkt + IP_TCP_HDR_SIZE;
+		opt[0] = TCP_OPT_MSS;
+		opt[1] = TCP_OPT_MSS_SIZE;
+		opt[2] = TCP_MSS >> 8;
+		opt[3] = TCP_MSS & 0xff;
+		hdr_size += TCP_OPT_MSS_SIZE;
+	}
+
+	net_set_ip_header(pkt, dest, net_ip, hdr_size + payload_len,
+			  IPPROTO_TCP);
+
+	ip->tcp_src = htons(sport);
+	ip->tcp_dst = htons(dport);
+	ip->tcp_seq = htonl(seq);
+	ip->tcp_ack = action & TCP_ACK ? htonl(ack) : 0;
+	ip->tcp_hlen = ((hdr_size - IP_HDR_SIZE) / 4) << 4;
+	ip->tcp_flags = action;
+	ip->tcp_win = htons(CONFIG_TCP_WINDOW);
+	ip->tcp_urg = 0;
+	ip->tcp_xsum = 0;
+	ip->tcp_xsum = tcp_checksum(ip, hdr_size - IP_HDR_SIZE + payload_len);
+
+	return hdr_size;
+}
+
+static void tcp_send_segment(u8 action, u32 seq, const void *data,
+			     unsigned int len)
+{
+	uchar *pkt = net_tx_packet + net_eth_hdr_size() + IP_TCP_HDR_SIZE;
+
+	if (len)
+		memcpy(pkt, data, len);
+	/* Every segment but the SYN acknowledges all data received so far */
+	tcp_ack_pending = 0;
+	net_send_ip_packet(tcp_ethaddr, tcp_remote_ip, tcp_remote_port,
+			   tcp_local_port, len, IPPROTO_TCP, action, seq,
+			   tcp_rcv_nxt);
+}
+
+static void tcp_send_ack(void)
+{
+	tcp_send_segment(TCP_ACK, tcp_snd_nxt, NULL, 0);
+}
+
+static void tcp_timeout_handler(void);
+
+static void tcp_arm_timer(void)
+{
+	if (tcp_state == TCP_CLOSED)
+		net_set_timeout_handler(0, NULL);
+	else if (tcp_ack_pending && tcp_snd_una == tcp_snd_nxt)
+		net_set_timeout_handler(TCP_DELACK_MS, tcp_timeout_handler);
+	else
+		net_set_timeout_handler(tcp_rto, tcp_timeout_handler);
+}
+
+static void tcp_event(enum tcp_event event, const uchar *data,
+		      unsigned int len)
+{
+	if (tcp_handler)
+		tcp_handler(event, data, len);
+}
+
+static void tcp_fail(void)
+{
+	tcp_state = TCP_CLOSED;
+	net_set_timeout_handler(0, NULL);
+	tcp_event(TCP_EV_ERROR, NULL, 0);
+}
+
+/* Send everything that is not acknowledged yet, starting at tcp_snd_una */
+static void tcp_retransmit(void)
+{
+	switch (tcp_state) {
+	case TCP_SYN_SENT:
+		tcp_send_segment(TCP_SYN, tcp_snd_una, NULL, 0);
+		return;
+	case TCP_ESTABLISHED:
+	case TCP_CLOSE_WAIT:
+	case TCP_FIN_WAIT_1:
+	case TCP_LAST_ACK:
+		if (tcp_txlen)
+			tcp_send_segment(TCP_ACK | TCP_PSH, tcp_snd_una,
+					 tcp_txbuf, tcp_txlen);
+		if (tcp_fin_sent && tcp_snd_una != tcp_snd_nxt)
+			tcp_send_segment(TCP_ACK | TCP_FIN, tcp_snd_nxt - 1,
+					 NULL, 0);
+		if (!tcp_txlen && tcp_snd_una == tcp_snd_nxt)
+			tcp_send_ack();
+		return;
+	default:
+		tcp_send_ack();
+		return;
+	}
+}
+
+static void tcp_timeout_handler(void)
+{
+	if (tcp_ack_pending && tcp_snd_una == tcp_snd_nxt) {
+		tcp_send_ack();
+		tcp_arm_timer();
+		return;
+	}
+
+	/*
+	 * Either our data is not acknowledged or the peer went silent; in
+	 * the latter case the ACK doubles as a prompt to retransmit.
+	 */
+	if (++tcp_retries > TCP_RETRIES) {
+		puts("\nTCP: connection timed out\n");
+		tcp_fail();
+		return;
+	}
+	tcp_retransmit();
+	tcp_rto = min_t(ulong, tcp_rto * 2, TCP_RTO_MAX_MS);
+	tcp_arm_timer();
+}
+
+void tcp_connect(struct in_addr dest, int dport, tcp_handler_f *handler)
+{
+	u32 iss;
+
+	/*
+	 * A previous connection may still be half closed if net_loop() ended
+	 * before the peer acknowledged our FIN; it is simply forgotten.
+	 */
+	iss = seed_mac() ^ timer_get_us();
+	memset(tcp_ethaddr, 0, ARP_HLEN);
+	tcp_remote_ip = dest;
+	tcp_remote_port = dport;
+	tcp_local_port = 1024 + (iss >> 8) % 31744;
+	tcp_handler = handler;
+	tcp_snd_una = iss;
+	tcp_snd_nxt = iss + 1;
+	tcp_rcv_nxt = 0;
+	tcp_snd_mss = TCP_DEFAULT_MSS;
+	tcp_txlen = 0;
+	tcp_fin_sent = false;
+	tcp_ack_pending = 0;
+	tcp_retries = 0;
+	tcp_rto = TCP_RTO_MIN_MS;
+	tcp_state = TCP_SYN_SENT;
+
+	tcp_send_segment(TCP_SYN, iss, NULL, 0);
+	tcp_arm_timer();
+}
+
+int tcp_send(const void *data, unsigned int len)
+{
+	if (tcp_state != TCP_ESTABLISHED && tcp_state != TCP_CLOSE_WAIT)
+		return -ENOTCONN;
+	if (len > tcp_snd_mss)
+		return -E2BIG;
+	if (tcp_txlen)
+		return -EBUSY;
+
+	memcpy(tcp_txbuf, data, len);
+	tcp_txlen = len;
+	tcp_send_segment(TCP_ACK | TCP_PSH, tcp_snd_nxt, tcp_txbuf, len);
+	tcp_snd_nxt += len;
+	tcp_arm_timer();
+
+	return 0;
+}
+
+void tcp_close(void)
+{
+	switch (tcp_state) {
+	case TCP_ESTABLISHED:
+		tcp_state = TCP_FIN_WAIT_1;
+		break;
+	case TCP_CLOSE_WAIT:
+		tcp_state = TCP_LAST_ACK;
+		break;
+	case TCP_SYN_SENT:
+		tcp_state = TCP_CLOSED;
+		net_set_timeout_handler(0, NULL);
+		return;
+	default:
+		return;
+	}
+
+	tcp_send_segment(TCP_ACK | TCP_FIN, tcp_snd_nxt, NULL, 0);
+	tcp_snd_nxt++;
+	tcp_fin_sent = true;
+	tcp_arm_timer();
+}
+
+void tcp_abort(void)
+{
+	if (tcp_state == TCP_CLOSED)
+		return;
+
+	if (tcp_state != TCP_SYN_SENT)
+		tcp_send_segment(TCP_ACK | TCP_RST, tcp_snd_nxt, NULL, 0);
+	tcp_state = TCP_CLOSED;
+	net_set_timeout_handler(0, NULL);
+}
+
+static void tcp_parse_options(const uchar *opt, int len)
+{
+	while (len > 0) {
+		if (opt[0] == TCP_OPT_END)
+			return;
+		if (opt[0] == TCP_OPT_NOP) {
+			opt++;
+			len--;
+			continue;
+		}
+		if (len < 2 || opt[1] < 2 || opt[1] > len)
+			return;
+		if (opt[0] == TCP_OPT_MSS && opt[1] == TCP_OPT_MSS_SIZE)
+			tcp_snd_mss = min_t(unsigned int, TCP_MSS,
+					    opt[2] << 8 | opt[3]);
+		len -= opt[1];
+		opt += opt[1];
+	}
+}
+
+/* Process an acknowledgment for data or a FIN we sent */
+static void tcp_ack_received(u32 ack)
+{
+	u32 acked;
+
+	if (!tcp_seq_after(ack, tcp_snd_una) ||
+	    tcp_seq_after(ack, tcp_snd_nxt))
+		return;
+
+	acked = min_t(u32, ack - tcp_snd_una, tcp_txlen);
+	if (acked && acked < tcp_txlen)
+		memmove(tcp_txbuf, tcp_txbuf + acked, tcp_txlen - acked);
+	tcp_txlen -= acked;
+	tcp_snd_una = ack;
+	tcp_rto = TCP_RTO_MIN_MS;
+
+	if (!tcp_fin_sent || ack != tcp_snd_nxt)
+		return;
+	if (tcp_state == TCP_FIN_WAIT_1)
+		tcp_state = TCP_FIN_WAIT_2;
+	else if (tcp_state == TCP_LAST_ACK)
+		tcp_state = TCP_CLOSED;
+}
+
+void tcp_receive(struct ip_tcp_hdr *ip, int len)
+{
+	int tcp_len = len - IP_HDR_SIZE;
+	unsigned int dlen;
+	const uchar *data;
+	u32 seq, ack;
+	int hlen;
+	u8 flags;
+
+	if (tcp_state == TCP_CLOSED || len < IP_TCP_HDR_SIZE)
+		return;
+	if (net_read_ip(&ip->ip_src).s_addr != tcp_remote_ip.s_addr ||
+	    ntohs(ip->tcp_src) != tcp_remote_port ||
+	    ntohs(ip->tcp_dst) != tcp_local_port)
+		return;
+	hlen = (ip->tcp_hlen >> 4) * 4;
+	if (hlen < TCP_HDR_SIZE || hlen > tcp_len)
+		return;
+	if (tcp_checksum(ip, tcp_len) & 0xfffe) {
+		debug("TCP: checksum bad\n");
+		return;
+	}
+
+	flags = ip->tcp_flags;
+	seq = ntohl(ip->tcp_seq);
+	ack = ntohl(ip->tcp_ack);
+	data = (uchar *)&ip->tcp_src + hlen;
+	dlen = tcp_len - hlen;
+
+	if (tcp_state == TCP_SYN_SENT) {
+		if ((flags & TCP_ACK) && ack != tcp_snd_nxt)
+			return;
+		if (flags & TCP_RST) {
+			if (flags & TCP_ACK) {
+				puts("\nTCP: connection refused\n");
+				tcp_fail();
+			}
+			return;
+		}
+		if ((flags & (TCP_SYN | TCP_ACK)) != (TCP_SYN | TCP_ACK))
+			return;
+
+		tcp_parse_options((uchar *)ip + IP_TCP_HDR_SIZE,
+				  hlen - TCP_HDR_SIZE);
+		tcp_rcv_nxt = seq + 1;
+		tcp_snd_una = ack;
+		tcp_retries = 0;
+		tcp_state = TCP_ESTABLISHED;
+		tcp_send_ack();
+		tcp_arm_timer();
+		tcp_event(TCP_EV_CONNECTED, NULL, 0);
+		return;
+	}
+
+	if (flags & TCP_RST) {
+		if (seq != tcp_rcv_nxt)
+			return;
+		puts("\nTCP: connection reset\n");
+		tcp_fail();
+		return;
+	}
+
+	tcp_retries = 0;
+	if (flags & TCP_ACK)
+		tcp_ack_received(ack);
+	if (tcp_state == TCP_CLOSED) {
+		net_set_timeout_handler(0, NULL);
+		return;
+	}
+
+	if (!dlen && !(flags & TCP_FIN)) {
+		tcp_arm_timer();
+		return;
+	}
+
+	/* Trim anything we already have from the start of the segment */
+	if (tcp_seq_after(tcp_rcv_nxt, seq) &&
+	    tcp_seq_after(seq + dlen, tcp_rcv_nxt)) {
+		data += tcp_rcv_nxt - seq;
+		dlen -= tcp_rcv_nxt - seq;
+		seq = tcp_rcv_nxt;
+	}
+	if (seq != tcp_rcv_nxt) {
+		/* Duplicate or out of order: tell the peer where we are */
+		tcp_send_ack();
+		tcp_arm_timer();
+		return;
+	}
+
+	if (dlen && (tcp_state == TCP_ESTABLISHED ||
+		     tcp_state == TCP_FIN_WAIT_1 ||
+		     tcp_state == TCP_FIN_WAIT_2)) {
+		tcp_rcv_nxt += dlen;
+		tcp_ack_pending++;
+		tcp_event(TCP_EV_DATA, data, dlen);
+		/* The handler may have closed or aborted the connection */
+		if (tcp_state == TCP_CLOSED)
+			return;
+	}
+
+	if (flags & TCP_FIN) {
+		tcp_rcv_nxt++;
+		tcp_send_ack();
+		switch (tcp_state) {
+		case TCP_ESTABLISHED:
+			tcp_state = TCP_CLOSE_WAIT;
+			tcp_arm_timer();
+			tcp_event(TCP_EV_CLOSED, NULL, 0);
+			return;
+		case TCP_FIN_WAIT_1:
+		case TCP_FIN_WAIT_2:
+			/* There is no TIME-WAIT, the port is not reused */
+			tcp_state = TCP_CLOSED;
+			net_set_timeout_handler(0, NULL);
+			return;
+		default:
+			break;
+		}
+	} else if ((flags & TCP_PSH) || tcp_ack_pending >= 2) {
+		tcp_send_ack();
+	}
+	tcp_arm_timer();
+}
@@ -8,8 +8,10 @@
 
 #include <common.h>
 #include <command.h>
+#include <decomp_stream.h>
 #include <efi_loader.h>
 #include <env.h>
+#include <image.h>
 #include <mapmem.h>
 #include <net.h>
 #include <net/tftp.h>
@@ -141,6 +143,86 @@ static char tftp_filename[MAX_LEN];
 static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = TFTP_MTU_BLOCKSIZE;
 
+/*
+ * RFC 7440: the server sends a window of blocks and only the last one of
+ * each window is acknowledged. A block out of sequence is answered once with
+ * an ack of the last block received in order, which makes the server resend
+ * the window from the block after it.
+ */
+static unsigned short tftp_window_size = 1;
+static unsigned short tftp_window_size_option = CONFIG_TFTP_WINDOWSIZE;
+/* block whose arrival completes the current window */
+static ulong	tftp_next_ack;
+/* an ack for a block out of sequence was sent and not yet answered */
+static int	tftp_gap_acked;
+
+#ifdef CONFIG_DECOMP_STREAM
+/*
+ * With tftpdecomp set, each block is handed to the decompressor as it
+ * arrives, so that the image is ready as soon as the last block is in.
+ */
+static struct decomp_stream tftp_decomp;
+/* compression given by tftpdecomp, or -1 to store the file as is */
+static int	tftp_decomp_comp = -1;
+/* tftp_decomp is in use for the current transfer */
+static int	tftp_decomp_active;
+
+/* Drop the decompressor of a transfer that did not complete */
+static void tftp_decomp_stop(void)
+{
+	size_t size;
+
+	if (tftp_decomp_active) {
+		decomp_stream_finish(&tftp_decomp, &size);
+		tftp_decomp_active = 0;
+	}
+}
+
+/* Pick up the compression from the environment, for the next transfer */
+static void tftp_decomp_setup(void)
+{
+	const char *ep = env_get("tftpdecomp");
+
+	tftp_decomp_stop();
+	tftp_decomp_comp = -1;
+	if (!ep)
+		return;
+	if (!strcmp(ep, "auto")) {
+		tftp_decomp_comp = DECOMP_STREAM_AUTO;
+	} else {
+		tftp_decomp_comp = genimg_get_comp_id(ep);
+		if (tftp_decomp_comp < 0)
+			printf("TFTP: unknown compression '%s', ignored\n",
+			       ep);
+	}
+}
+
+/* Set up decompression into the load buffer when the first block arrives */
+static int tftp_decomp_start(void)
+{
+	ulong size = -tftp_load_addr;
+	int ret;
+
+	tftp_decomp_stop();
+	if (tftp_decomp_comp == -1)
+		return 0;
+#ifdef CONFIG_LMB
+	if (tftp_load_size)
+		size = tftp_load_size;
+#endif
+	ret = decomp_stream_init(&tftp_decomp, tftp_decomp_comp,
+				 map_sysmem(tftp_load_addr, size), size);
+	if (ret) {
+		printf("\nTFTP error: cannot decompress (%d)\n", ret);
+		return ret;
+	}
+	tftp_decomp_active = 1;
+
+	return 0;
+}
+#endif
+
+
 static inline int store_block(int block, uchar *src, unsigned int len)
 {
 	ulong offset = block * tftp_block_size + tftp_block_wrap_offset;
@@ -148,7 +230,24 @@ static inline int store_block(int block, uchar *src, unsigned int len)
 	ulong store_addr = tftp_load_addr + offset;
 #ifdef CONFIG_SYS_DIRECT_FLASH_TFTP
 	int i, rc = 0;
+#endif
 
+#ifdef CONFIG_DECOMP_STREAM
+	if (tftp_decomp_active) {
+		int ret = decomp_stream_write(&tftp_decomp, src, len);
+
+		if (ret) {
+			printf("\nTFTP error: decompression failed (%d)\n",
+			       ret);
+			return ret;
+		}
+		/* Count what was received; tftp_complete() fixes it up */
+		if (net_boot_file_size < newsize)
+			net_boot_file_size = newsize;
+		return 0;
+	}
+#endif
+#ifdef CONFIG_SYS_DIRECT_FLASH_TFTP
 	for (i = 0; i < CONFIG_SYS_MAX_FLASH_BANKS; i++) {
 		/* start address in flash? */
 		if (flash_info[i].flash_id == FLASH_UNKNOWN)
@@ -200,6 +299,7 @@ static void new_transfer(void)
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	tftp_gap_acked = 0;
 #ifdef CONFIG_CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
@@ -307,6 +407,24 @@ static void tftp_complete(void)
 		print_size(net_boot_file_size /
 			time_start * 1000, "/s");
 	}
+#ifdef CONFIG_DECOMP_STREAM
+	if (tftp_decomp_active) {
+		size_t size;
+		int ret;
+
+		tftp_decomp_active = 0;
+		ret = decomp_stream_finish(&tftp_decomp, &size);
+		if (ret) {
+			printf("\nTFTP error: decompression failed (%d)\n",
+			       ret);
+			net_set_state(NETLOOP_FAIL);
+			return;
+		}
+		net_boot_file_size = size;
+		puts("\nUncompressed: ");
+		print_size(size, "");
+	}
+#endif
 	puts("\ndone\n");
 	net_set_state(NETLOOP_SUCCESS);
 }
@@ -352,6 +470,10 @@ static void tftp_send(void)
 		/* try for more effic. blk size */
 		pkt += sprintf((char *)pkt, "blksize%c%d%c",
 				0, tftp_block_size_option, 0);
+		/* only ask for a window if we're receiving */
+		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_option > 1)
+			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
+					0, tftp_window_size_option, 0);
 		len = pkt - xp;
 		break;
 
@@ -364,6 +486,9 @@ static void tftp_send(void)
 		s[0] = htons(TFTP_ACK);
 		s[1] = htons(tftp_cur_block);
 		pkt = (uchar *)(s + 2);
+		/* the server starts a new window after the block we ack */
+		tftp_next_ack = (tftp_cur_block + tftp_window_size) %
+				TFTP_SEQUENCE_SIZE;
 #ifdef CONFIG_CMD_TFTPPUT
 		if (tftp_put_active) {
 			int toload = tftp_block_size;
@@ -496,6 +621,19 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				debug("Blocksize ack: %s, %d\n",
 				      (char *)pkt + i + 8, tftp_block_size);
 			}
+			if (strcmp((char *)pkt + i, "windowsize") == 0) {
+				tftp_window_size = (unsigned short)
+					simple_strtoul((char *)pkt + i + 11,
+						       NULL, 10);
+				if (!tftp_window_size)
+					tftp_window_size = 1;
+				/* RFC 7440: never more than we asked for */
+				if (tftp_window_size > tftp_window_size_option)
+					tftp_window_size = max_t(unsigned short,
+						tftp_window_size_option, 1);
+				debug("Windowsize ack: %s, %d\n",
+				      (char *)pkt + i + 11, tftp_window_size);
+			}
 #ifdef CONFIG_TFTP_TSIZE
 			if (strcmp((char *)pkt+i, "tsize") == 0) {
 				tftp_tsize = simple_strtoul((char *)pkt + i + 6,
@@ -520,8 +658,6 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		len -= 2;
 		tftp_cur_block = ntohs(*(__be16 *)pkt);
 
-		update_block_number();
-
 		if (tftp_state == STATE_SEND_RRQ)
 			debug("Server did not acknowledge timeout option!\n");
 
@@ -531,8 +667,16 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			tftp_state = STATE_DATA;
 			tftp_remote_port = src;
 			new_transfer();
+#ifdef CONFIG_DECOMP_STREAM
+			if (tftp_decomp_start()) {
+				eth_halt();
+				net_set_state(NETLOOP_FAIL);
+				break;
+			}
+#endif
 
-			if (tftp_cur_block != 1) {	/* Assertion */
+			/* with a window, block 1 may just have been lost */
+			if (tftp_cur_block != 1 && tftp_window_size == 1) {
 				puts("\nTFTP error: ");
 				printf("First block is not block 1 (%ld)\n",
 				       tftp_cur_block);
@@ -547,6 +691,27 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			break;
 		}
 
+		if (tftp_cur_block !=
+		    (tftp_prev_block + 1) % TFTP_SEQUENCE_SIZE) {
+			/*
+			 * A block of the window went missing, or this is a
+			 * resent window that overlaps what we already have.
+			 * Ack the last block in sequence, once, so the server
+			 * goes back to it; the timeout covers a lost ack.
+			 */
+			debug("Got block %ld, expected %ld\n", tftp_cur_block,
+			      (tftp_prev_block + 1) % TFTP_SEQUENCE_SIZE);
+			tftp_cur_block = tftp_prev_block;
+			if (!tftp_gap_acked) {
+				tftp_gap_acked = 1;
+				tftp_send();
+			}
+			break;
+		}
+		tftp_gap_acked = 0;
+
+		update_block_number();
+
 		tftp_prev_block = tftp_cur_block;
 		timeout_count_max = tftp_timeout_count_max;
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
@@ -557,14 +722,17 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			break;
 		}
 
-		/*
-		 *	Acknowledge the block just received, which will prompt
-		 *	the remote for the next one.
-		 */
-		tftp_send();
-
-		if (len < tftp_block_size)
+		if (len < tftp_block_size) {
+			/* Acknowledge the last block, ending the transfer */
+			tftp_send();
 			tftp_complete();
+		} else if (tftp_cur_block == tftp_next_ack) {
+			/*
+			 *	Acknowledge the block ending the window, which
+			 *	will prompt the remote for the next window.
+			 */
+			tftp_send();
+		}
 		break;
 
 	case TFTP_ERROR:
@@ -638,6 +806,11 @@ void tftp_start(enum proto_t protocol)
 	if (ep != NULL)
 		tftp_block_size_option = simple_strtol(ep, NULL, 10);
 
+	tftp_window_size_option = CONFIG_TFTP_WINDOWSIZE;
+	ep = env_get("tftpwindowsize");
+	if (ep != NULL)
+		tftp_window_size_option = simple_strtol(ep, NULL, 10);
+
 	ep = env_get("tftptimeout");
 	if (ep != NULL)
 		timeout_ms = simple_strtol(ep, NULL, 10);
@@ -659,8 +832,8 @@ void tftp_start(enum proto_t protocol)
 	}
 #endif
 
-	debug("TFTP blocksize = %i, timeout = %ld ms\n",
-	      tftp_block_size_option, timeout_ms);
+	debug("TFTP blocksize = %i, windowsize = %i, timeout = %ld ms\n",
+	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
 
 	tftp_remote_ip = net_server_ip;
 	if (!net_parse_bootfile(&tftp_remote_ip, tftp_filename, MAX_LEN)) {
@@ -727,6 +900,9 @@ void tftp_start(enum proto_t protocol)
 			return;
 		}
 		printf("Load address: 0x%lx\n", tftp_load_addr);
+#ifdef CONFIG_DECOMP_STREAM
+		tftp_decomp_setup();
+#endif
 		puts("Loading: *\b");
 		tftp_state = STATE_SEND_RRQ;
 #ifdef CONFIG_CMD_BOOTEFI
@@ -761,6 +937,9 @@ void tftp_start(enum proto_t protocol)
 	memset(net_server_ethaddr, 0, 6);
 	/* Revert tftp_block_size to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	/* Until the server agrees to a window, every block is acked */
+	tftp_window_size = 1;
+	tftp_next_ack = 1;
 #ifdef CONFIG_TFTP_TSIZE
 	tftp_tsize = 0;
 	tftp_tsize_num_hash = 0;
@@ -783,6 +962,9 @@ void tftp_start_server(void)
 	printf("Using %s device\n", eth_get_name());
 	printf("Listening for TFTP transfer on %pI4\n", &net_ip);
 	printf("Load address: 0x%lx\n", tftp_load_addr);
+#ifdef CONFIG_DECOMP_STREAM
+	tftp_decomp_setup();
+#endif
 
 	puts("Loading: *\b");
 
@@ -793,6 +975,7 @@ void tftp_start_server(void)
 
 	/* Revert tftp_block_size to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_window_size = 1;
 	tftp_cur_block = 0;
 	tftp_our_port = WELL_KNOWN_PORT;
 
@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * HTTP download over TCP
+ *
+ * Issues a single HTTP/1.1 GET for the boot file and streams the response
+ * body straight to the load address as the segments arrive in order.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <env.h>
+#include <lmb.h>
+#include <mapmem.h>
+#include <net.h>
+#include <net/tcp.h>
+#include <net/wget.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#define WGET_DEFAULT_PORT	80
+/* Largest response header we are prepared to buffer */
+#define WGET_HDR_MAX		2048
+/* Print a hash mark every 64 KiB, 50 to a line */
+#define WGET_HASH_BYTES		(64 << 10)
+#define WGET_HASHES_PER_LINE	50
+
+enum wget_state {
+	WGET_CONNECTING,
+	WGET_HEADERS,
+	WGET_BODY,
+	WGET_DONE,
+};
+
+static enum wget_state wget_state;
+static struct in_addr wget_server_ip;
+static int wget_server_port;
+static char wget_path[1024];
+
+static ulong wget_load_addr;
+static ulong wget_load_size;	/* 0 if unlimited */
+
+static char wget_hdr[WGET_HDR_MAX + 1];
+static unsigned int wget_hdr_len;
+static long wget_content_len;	/* -1 if the server did not say */
+static ulong wget_received;
+static ulong wget_next_hash;
+static int wget_hashes;
+static ulong time_start;
+
+static void wget_fail(const char *msg)
+{
+	printf("\nwget error: %s\n", msg);
+	wget_state = WGET_DONE;
+	tcp_abort();
+	net_set_state(NETLOOP_FAIL);
+}
+
+static void wget_complete(void)
+{
+	wget_state = WGET_DONE;
+	tcp_close();
+	net_boot_file_size = wget_received;
+
+	puts("  ");
+	print_size(wget_received, "");
+	time_start = get_timer(time_start);
+	if (time_start > 0) {
+		puts("\n\t ");	/* Line up with "Loading: " */
+		print_size(wget_received / time_start * 1000, "/s");
+	}
+	puts("\ndone\n");
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+static void wget_store(const uchar *data, unsigned int len)
+{
+	void *ptr;
+
+	if (wget_content_len >= 0 &&
+	    wget_received + len > (ulong)wget_content_len)
+		len = wget_content_len - wget_received;
+	if (wget_load_size && wget_received + len > wget_load_size) {
+		wget_fail("trying to overwrite reserved memory");
+		return;
+	}
+
+	ptr = map_sysmem(wget_load_addr + wget_received, len);
+	memcpy(ptr, data, len);
+	unmap_sysmem(ptr);
+	wget_received += len;
+
+	while (wget_received >= wget_next_hash) {
+		if (++wget_hashes > WGET_HASHES_PER_LINE) {
+			puts("\n\t ");
+			wget_hashes = 1;
+		}
+		putc('#');
+		wget_next_hash += WGET_HASH_BYTES;
+	}
+
+	if (wget_content_len >= 0 && wget_received == (ulong)wget_content_len)
+		wget_complete();
+}
+
+/* Check the status line and pick up the headers we care about */
+static int wget_parse_headers(void)
+{
+	char *line, *p;
+	char msg[40];
+	ulong status;
+
+	if (strncmp(wget_hdr, "HTTP/1.", 7)) {
+		wget_fail("not an HTTP response");
+		return -1;
+	}
+	p = strchr(wget_hdr, ' ');
+	status = p ? simple_strtoul(p + 1, NULL, 10) : 0;
+	if (status != 200) {
+		snprintf(msg, sizeof(msg), "server returned status %lu", status);
+		wget_fail(msg);
+		return -1;
+	}
+
+	wget_content_len = -1;
+	for (line = strstr(wget_hdr, "\r\n") + 2; *line;
+	     line = strstr(line, "\r\n") + 2) {
+		p = strchr(line, ':');
+		if (!p)
+			continue;
+		for (p++; *p == ' ' || *p == '\t'; p++)
+			;
+		if (!strncasecmp(line, "Content-Length:", 15)) {
+			wget_content_len = simple_strtoul(p, NULL, 10);
+		} else if (!strncasecmp(line, "Transfer-Encoding:", 18) &&
+			   strncasecmp(p, "identity", 8)) {
+			wget_fail("unsupported transfer encoding");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void wget_headers(const uchar *data, unsigned int len)
+{
+	unsigned int old_len = wget_hdr_len;
+	unsigned int used;
+	char *end;
+
+	used = min(len, WGET_HDR_MAX - wget_hdr_len);
+	memcpy(wget_hdr + wget_hdr_len, data, used);
+	wget_hdr_len += used;
+	wget_hdr[wget_hdr_len] = '\0';
+
+	end = strstr(wget_hdr, "\r\n\r\n");
+	if (!end) {
+		if (wget_hdr_len == WGET_HDR_MAX)
+			wget_fail("response header too long");
+		return;
+	}
+	end[2] = '\0';
+	if (wget_parse_headers())
+		return;
+
+	wget_state = WGET_BODY;
+	if (!wget_content_len) {
+		wget_complete();
+		return;
+	}
+
+	/* Whatever followed the header in this segment is body */
+	used = end + 4 - wget_hdr - old_len;
+	if (used < len)
+		wget_store(data + used, len - used);
+}
+
+static void wget_handler(enum tcp_event event, const uchar *data,
+			 unsigned int len)
+{
+	char req[WGET_HDR_MAX];
+
+	if (wget_state == WGET_DONE)
+		return;
+
+	switch (event) {
+	case TCP_EV_CONNECTED:
+		len = snprintf(req, sizeof(req),
+			       "GET %s%s HTTP/1.1\r\n"
+			       "Host: %pI4\r\n"
+			       "User-Agent: U-Boot\r\n"
+			       "Connection: close\r\n\r\n",
+			       wget_path[0] == '/' ? "" : "/", wget_path,
+			       &wget_server_ip);
+		if (len >= sizeof(req) || tcp_send(req, len)) {
+			wget_fail("request too long");
+			return;
+		}
+		wget_state = WGET_HEADERS;
+		break;
+	case TCP_EV_DATA:
+		if (wget_state == WGET_HEADERS)
+			wget_headers(data, len);
+		else if (wget_state == WGET_BODY)
+			wget_store(data, len);
+		break;
+	case TCP_EV_CLOSED:
+		/* Without a Content-Length the body ends with the connection */
+		if (wget_state == WGET_BODY && wget_content_len < 0)
+			wget_complete();
+		else
+			wget_fail("connection closed by server");
+		break;
+	case TCP_EV_ERROR:
+		wget_state = WGET_DONE;
+		net_set_state(NETLOOP_FAIL);
+		break;
+	}
+}
+
+/* Initialize wget_load_addr and wget_load_size from load_addr and lmb */
+static int wget_init_load_addr(void)
+{
+#ifdef CONFIG_LMB
+	struct lmb lmb;
+	phys_size_t max_size;
+
+	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
+
+	max_size = lmb_get_free_size(&lmb, load_addr);
+	if (!max_size)
+		return -1;
+
+	wget_load_size = max_size;
+#endif
+	wget_load_addr = load_addr;
+	return 0;
+}
+
+void wget_start(void)
+{
+	wget_server_ip = net_server_ip;
+	if (!net_parse_bootfile(&wget_server_ip, wget_path,
+				sizeof(wget_path))) {
+		puts("*** ERROR: no file name given\n");
+		eth_halt();
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+	wget_server_port = env_get_ulong("httpdstp", 10, WGET_DEFAULT_PORT);
+
+	printf("Using %s device\n", eth_get_name());
+	printf("HTTP from server %pI4:%d; our IP address is %pI4\n",
+	       &wget_server_ip, wget_server_port, &net_ip);
+	printf("Filename '%s'.\n", wget_path);
+
+	wget_load_size = 0;
+	if (wget_init_load_addr()) {
+		eth_halt();
+		net_set_state(NETLOOP_FAIL);
+		puts("\nwget error: trying to overwrite reserved memory...\n");
+		return;
+	}
+	printf("Load address: 0x%lx\n", wget_load_addr);
+	puts("Loading: *\b");
+
+	wget_state = WGET_CONNECTING;
+	wget_hdr_len = 0;
+	wget_content_len = -1;
+	wget_received = 0;
+	wget_next_hash = WGET_HASH_BYTES;
+	wget_hashes = 0;
+	net_boot_file_size = 0;
+	time_start = get_timer(0);
+
+	tcp_connect(wget_server_ip, wget_server_port, wget_handler);
+}
@@ -6,13 +6,16 @@
 #include <common.h>
 #include <bootm.h>
 #include <command.h>
+#include <decomp_stream.h>
 #include <gzip.h>
 #include <lz4.h>
 #include <malloc.h>
 #include <mapmem.h>
 #include <asm/io.h>
+#include <linux/sizes.h>
 
 #include <u-boot/zlib.h>
+#include <u-boot/zstd_seek.h>
 #include <bzlib.h>
 
 #include <lzma/LzmaTypes.h>
@@ -438,6 +441,171 @@ static int compression_test_lz4(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_lz4, 0);
 
+/* Output size of the made-up LZ4 blocks used below */
+#define LZ4_TEST_SIZE		SZ_64K
+#define LZ4_BENCH_SIZE		SZ_1M
+#define LZ4_BENCH_LOOPS		20
+
+static u32 lz4_rand(u32 *state)
+{
+	/* xorshift32 */
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+static u8 *lz4_put_length(u8 *p, ulong len)
+{
+	for (len -= 15; len >= 255; len -= 255)
+		*p++ = 255;
+	*p++ = len;
+
+	return p;
+}
+
+/*
+ * There is no LZ4 compression in U-Boot, so make up a block of random
+ * sequences instead: mostly short literal runs and matches, with the odd
+ * long one, and offsets from 1 (a run of one byte) up to 64KiB. Returns the
+ * length of the block, and the data it decompresses to in @plain_out.
+ */
+static ulong lz4_make_block(u8 *block, u8 *plain_out, ulong size)
+{
+	u32 seed = 0x1234567;
+	ulong op = 0, lit, len, offset, i;
+	u8 *p = block;
+	u32 r;
+
+	while (1) {
+		r = lz4_rand(&seed);
+		lit = r & 7 ? r % 12 : r % 200;
+		if (!op && !lit)
+			lit = 1;
+		r = lz4_rand(&seed);
+		len = 4 + (r & 7 ? r % 16 : r % 300);
+		if (op + lit + len + 64 > size)
+			break;
+		r = lz4_rand(&seed);
+		offset = 1 + r % min(op + lit, r & 3 ? 65535UL : 16UL);
+
+		*p++ = min(lit, 15UL) << 4 | min(len - 4, 15UL);
+		if (lit >= 15)
+			p = lz4_put_length(p, lit);
+		for (i = 0; i < lit; i++)
+			*p++ = plain_out[op++] = 'a' + lz4_rand(&seed) % 16;
+		*p++ = offset;
+		*p++ = offset >> 8;
+		if (len - 4 >= 15)
+			p = lz4_put_length(p, len - 4);
+		for (i = 0; i < len; i++, op++)
+			plain_out[op] = plain_out[op - offset];
+	}
+
+	/* The last sequence has only literals */
+	lit = size - op;
+	*p++ = min(lit, 15UL) << 4;
+	if (lit >= 15)
+		p = lz4_put_length(p, lit);
+	for (i = 0; i < lit; i++)
+		*p++ = plain_out[op++] = 'a' + lz4_rand(&seed) % 16;
+
+	return p - block;
+}
+
+static int compression_test_lz4_block(struct unit_test_state *uts)
+{
+	u8 *block, *plain_out, *out;
+	ulong block_len;
+	size_t size;
+
+	block = malloc(LZ4_TEST_SIZE * 2);
+	plain_out = malloc(LZ4_TEST_SIZE);
+	out = malloc(LZ4_TEST_SIZE + 64);
+	ut_assertnonnull(block);
+	ut_assertnonnull(plain_out);
+	ut_assertnonnull(out);
+	block_len = lz4_make_block(block, plain_out, LZ4_TEST_SIZE);
+
+	/* Exactly the right size, which must not be overrun */
+	memset(out, 'A', LZ4_TEST_SIZE + 64);
+	size = LZ4_TEST_SIZE;
+	ut_assertok(ulz4_block(block, block_len, out, &size));
+	ut_asserteq(LZ4_TEST_SIZE, size);
+	ut_asserteq(0, memcmp(plain_out, out, size));
+	ut_asserteq('A', out[LZ4_TEST_SIZE]);
+
+	/* The reference decoder agrees */
+	memset(out, 'A', LZ4_TEST_SIZE + 64);
+	size = LZ4_TEST_SIZE + 64;
+	ut_assertok(ulz4_block_ref(block, block_len, out, &size));
+	ut_asserteq(LZ4_TEST_SIZE, size);
+	ut_asserteq(0, memcmp(plain_out, out, size));
+
+	/* Too little space, or too little data */
+	size = LZ4_TEST_SIZE - 1;
+	ut_asserteq(-EPROTO, ulz4_block(block, block_len, out, &size));
+	size = LZ4_TEST_SIZE;
+	ut_asserteq(-EPROTO, ulz4_block(block, block_len - 1, out, &size));
+
+	free(out);
+	free(plain_out);
+	free(block);
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_lz4_block, 0);
+
+static ulong lz4_bench(int (*decomp)(const void *src, size_t srcn, void *dst,
+				     size_t *dstn),
+		       const u8 *block, ulong block_len, u8 *out)
+{
+	ulong start, us;
+	size_t size;
+	int i;
+
+	start = timer_get_us();
+	for (i = 0; i < LZ4_BENCH_LOOPS; i++) {
+		size = LZ4_BENCH_SIZE;
+		if (decomp(block, block_len, out, &size))
+			return 0;
+	}
+	us = max(timer_get_us() - start, 1UL);
+
+	/* In MB/s, i.e. bytes per microsecond */
+	return (ulong)LZ4_BENCH_SIZE * LZ4_BENCH_LOOPS / us;
+}
+
+static int compression_test_lz4_speed(struct unit_test_state *uts)
+{
+	u8 *block, *plain_out, *out;
+	ulong block_len, fast, ref;
+
+	block = malloc(LZ4_BENCH_SIZE * 2);
+	plain_out = malloc(LZ4_BENCH_SIZE);
+	out = malloc(LZ4_BENCH_SIZE);
+	ut_assertnonnull(block);
+	ut_assertnonnull(plain_out);
+	ut_assertnonnull(out);
+	block_len = lz4_make_block(block, plain_out, LZ4_BENCH_SIZE);
+
+	ref = lz4_bench(ulz4_block_ref, block, block_len, out);
+	ut_assert(ref);
+	fast = lz4_bench(ulz4_block, block, block_len, out);
+	ut_assert(fast);
+	ut_asserteq(0, memcmp(plain_out, out, LZ4_BENCH_SIZE));
+	printf("\tlz4: %lu bytes from %lu: reference %lu MB/s, fast %lu MB/s\n",
+	       (ulong)LZ4_BENCH_SIZE, block_len, ref, fast);
+
+	free(out);
+	free(plain_out);
+	free(block);
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_lz4_speed, 0);
+
 static int compress_using_none(struct unit_test_state *uts,
 			       void *in, unsigned long in_size,
 			       void *out, unsigned long out_max,
@@ -534,6 +702,298 @@ static int compression_test_bootm_none(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_bootm_none, 0);
 
+#ifdef CONFIG_ZSTD
+/* zstd -19 -c /tmp/plain.txt > /tmp/plain.zst */
+static const char zstd_compressed[] =
+	"\x28\xb5\x2f\xfd\x64\x5e\x00\xad\x05\x00\x42\x4e\x26\x17\x90\x3b"
+	"\x07\x04\x5a\x13\x8b\xa7\x65\x34\x12\x21\x6d\xb0\x39\xbb\xae\xe8"
+	"\xba\xc9\xcd\x5e\x02\x49\xd0\x2b\xa9\xfa\x96\x92\xe7\x1f\x19\x19"
+	"\x7c\x8f\xf1\x9d\x54\x37\xfc\xd6\x0a\xf3\x0c\x93\x56\xc7\x52\x4f"
+	"\x0a\x62\x3e\xd1\xa5\x83\x17\x31\xab\x5d\x8f\x57\xf3\xcc\x3b\x58"
+	"\xf8\x91\x8c\xf1\x2a\x5c\x89\xdd\xf2\x9b\x15\xb7\x92\x5b\xbe\xba"
+	"\xab\xd5\xd1\x34\xdf\xf0\x02\x0e\x61\xcd\x7b\xd6\x01\xfc\xc2\xa7"
+	"\xd4\xd1\x3d\x26\x9c\x10\x49\xb8\x5b\xcd\xba\x7c\xf7\xac\x4b\xad"
+	"\xb7\x31\x1c\xbc\xf9\xcb\x62\x8e\x2e\x9b\x0f\xd3\x87\x57\x45\x12"
+	"\x16\xfa\x3a\x79\xde\x65\xf8\xcc\x48\xd5\x43\xa6\xbd\xc3\x91\x29"
+	"\x65\x29\xa7\x5b\x9a\x08\x08\x00\x60\x13\x00\x63\xa3\x8e\x28\x94"
+	"\x79\x41\x2a\x78\xc2\x91\x70\x9f\xaa\x6a\x21\x7a\xa1\xaa\x0c\xe4"
+	"\xf4\x6e\xfa";
+static const unsigned long zstd_compressed_size = 195;
+
+static int compress_using_zstd(struct unit_test_state *uts,
+			       void *in, unsigned long in_size,
+			       void *out, unsigned long out_max,
+			       unsigned long *out_size)
+{
+	/* There is no zstd compression in u-boot, so fake it. */
+	ut_asserteq(in_size,  strlen(plain));
+	ut_asserteq(0, memcmp(plain, in, in_size));
+
+	if (zstd_compressed_size > out_max)
+		return -1;
+
+	memcpy(out, zstd_compressed, zstd_compressed_size);
+	if (out_size)
+		*out_size = zstd_compressed_size;
+
+	return 0;
+}
+
+/*
+ * The first 120, next 120 and last 110 bytes of plain[], each compressed with
+ * zstd -19, followed by a seek table
+ */
+static const char zstd_frames_compressed[] =
+	"\x28\xb5\x2f\xfd\x24\x78\x8d\x01\x00\x94\x02\x49\x20\x61\x6d\x20"
+	"\x61\x20\x68\x69\x67\x68\x6c\x79\x20\x63\x6f\x6d\x70\x72\x65\x73"
+	"\x73\x61\x62\x6c\x65\x20\x62\x69\x74\x20\x6f\x66\x20\x74\x65\x78"
+	"\x74\x2e\x0a\x49\x01\x00\xe1\x85\xaa\x32\x32\x1c\x96\x9a\x28\xb5"
+	"\x2f\xfd\x24\x78\xed\x02\x00\xe2\x86\x14\x12\x90\xcf\x01\xec\x81"
+	"\x81\xa3\x4d\x90\x41\xe9\xd4\xff\xce\xa3\xfc\x5f\x3a\xf6\xb1\xbd"
+	"\xe1\x57\x6c\xb5\x36\x9d\x50\x22\x10\xdb\xbb\xc6\xae\x67\xe8\xc2"
+	"\xf7\xb9\x0d\x31\xbd\x2b\xb1\xbd\xa0\x6d\xa9\x64\xf5\x39\xe2\x93"
+	"\x2b\x02\x46\xc7\x06\x5f\xdb\x3b\xca\xd7\xc6\xec\xed\x3d\x17\x0d"
+	"\xdf\xae\xbd\xe7\x68\xe0\x9b\x9a\x37\x6d\x56\x02\x02\x00\x48\x90"
+	"\x4f\xf5\x52\x50\x03\x07\x59\x60\x28\xb5\x2f\xfd\x24\x6e\x9d\x02"
+	"\x00\xe2\xc6\x13\x11\xa0\xed\xf0\xaf\x9d\x1f\xdd\x2c\xd9\xf2\xbf"
+	"\xd5\xe3\x42\x55\xc6\x08\x40\x40\x3e\x0b\x21\x2f\xd0\x93\xfb\xfd"
+	"\x1a\x82\x37\xed\x5c\xd6\x9c\x51\x9f\xa5\x53\xf5\x5a\x73\xe7\xb8"
+	"\x88\xc9\x5b\x1f\xbe\x65\xe7\xf6\xa8\x24\x24\x41\xa0\x2b\x29\xdb"
+	"\x87\x56\xd5\x51\x27\xf9\x86\xcb\xea\x3d\x2e\xb8\xac\x72\x6f\xf8"
+	"\x92\x39\xa3\x00\x6d\x9e\x42\xc2\x5e\x2a\x4d\x18\x21\x00\x00\x00"
+	"\x3e\x00\x00\x00\x78\x00\x00\x00\x6a\x00\x00\x00\x78\x00\x00\x00"
+	"\x60\x00\x00\x00\x6e\x00\x00\x00\x03\x00\x00\x00\x00\xb1\xea\x92"
+	"\x8f";
+static const unsigned long zstd_frames_compressed_size = 305;
+static const unsigned long zstd_frames_table_size = 41;
+
+static int compress_using_zstd_frames(struct unit_test_state *uts,
+				      void *in, unsigned long in_size,
+				      void *out, unsigned long out_max,
+				      unsigned long *out_size)
+{
+	/* There is no zstd compression in u-boot, so fake it. */
+	ut_asserteq(in_size,  strlen(plain));
+	ut_asserteq(0, memcmp(plain, in, in_size));
+
+	if (zstd_frames_compressed_size > out_max)
+		return -1;
+
+	memcpy(out, zstd_frames_compressed, zstd_frames_compressed_size);
+	if (out_size)
+		*out_size = zstd_frames_compressed_size;
+
+	return 0;
+}
+
+static int uncompress_using_zstd(struct unit_test_state *uts,
+				 void *in, unsigned long in_size,
+				 void *out, unsigned long out_max,
+				 unsigned long *out_size)
+{
+	size_t size;
+	int ret;
+
+	ret = zstd_seek_decompress(in, in_size, out, out_max, &size);
+	if (out_size)
+		*out_size = size;
+
+	return ret;
+}
+
+static int compression_test_zstd(struct unit_test_state *uts)
+{
+	return run_test(uts, "zstd", compress_using_zstd,
+			uncompress_using_zstd);
+}
+COMPRESSION_TEST(compression_test_zstd, 0);
+
+static int compression_test_zstd_frames(struct unit_test_state *uts)
+{
+	return run_test(uts, "zstd frames", compress_using_zstd_frames,
+			uncompress_using_zstd);
+}
+COMPRESSION_TEST(compression_test_zstd_frames, 0);
+
+static int compression_test_zstd_seek_table(struct unit_test_state *uts)
+{
+	const unsigned long data_len = zstd_frames_compressed_size -
+		zstd_frames_table_size;
+	struct zstd_seek_table tbl;
+	struct zstd_seek_entry entry;
+	char table[64], buf[400];
+	size_t table_len, size;
+
+	ut_assertok(zstd_seek_table_find(zstd_frames_compressed,
+					 zstd_frames_compressed_size, &tbl));
+	ut_asserteq(3, tbl.count);
+	ut_asserteq(data_len, tbl.data_len);
+	zstd_seek_table_get(&tbl, 2, &entry);
+	ut_asserteq(96, entry.csize);
+	ut_asserteq(110, entry.dsize);
+	ut_asserteq(false, entry.has_checksum);
+
+	/* mkimage creates the same table from the frames alone */
+	ut_asserteq(-ENOENT, zstd_seek_table_find(zstd_frames_compressed,
+						  data_len, &tbl));
+	table_len = sizeof(table);
+	ut_asserteq(3, zstd_seek_table_create(zstd_frames_compressed,
+					      data_len, table, &table_len));
+	ut_asserteq(zstd_frames_table_size, table_len);
+	ut_asserteq(0, memcmp(zstd_frames_compressed + data_len, table,
+			      table_len));
+	table_len = zstd_frames_table_size - 1;
+	ut_asserteq(-ENOSPC, zstd_seek_table_create(zstd_frames_compressed,
+						    data_len, table,
+						    &table_len));
+
+	/* Without the table the frames are decompressed one after another */
+	ut_assertok(zstd_seek_decompress(zstd_frames_compressed, data_len,
+					 buf, sizeof(buf), &size));
+	ut_asserteq(strlen(plain), size);
+	ut_asserteq(0, memcmp(plain, buf, size));
+
+	/* A table which does not match the data is rejected */
+	ut_asserteq(-EINVAL, zstd_seek_table_find(zstd_frames_compressed + 1,
+						  zstd_frames_compressed_size -
+						  1, &tbl));
+	ut_asserteq(-EINVAL, zstd_seek_decompress(zstd_frames_compressed + 1,
+						  zstd_frames_compressed_size -
+						  1, buf, sizeof(buf), &size));
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_zstd_seek_table, 0);
+
+static int compression_test_bootm_zstd(struct unit_test_state *uts)
+{
+	return run_bootm_test(uts, IH_COMP_ZSTD, compress_using_zstd);
+}
+COMPRESSION_TEST(compression_test_bootm_zstd, 0);
+
+static int compression_test_bootm_zstd_frames(struct unit_test_state *uts)
+{
+	return run_bootm_test(uts, IH_COMP_ZSTD, compress_using_zstd_frames);
+}
+COMPRESSION_TEST(compression_test_bootm_zstd_frames, 0);
+#endif
+
+#ifdef CONFIG_DECOMP_STREAM
+/* Small and odd, so that headers and blocks are split across writes */
+#define STREAM_CHUNK_SIZE	7
+
+static int uncompress_using_stream(int comp, void *in, unsigned long in_size,
+				   void *out, unsigned long out_max,
+				   unsigned long *out_size)
+{
+	struct decomp_stream ds;
+	unsigned long pos, len;
+	size_t size;
+	int ret;
+
+	ret = decomp_stream_init(&ds, comp, out, out_max);
+	if (ret)
+		return ret;
+	for (pos = 0; pos < in_size; pos += len) {
+		len = min(in_size - pos, (unsigned long)STREAM_CHUNK_SIZE);
+		if (decomp_stream_write(&ds, in + pos, len))
+			break;
+	}
+	ret = decomp_stream_finish(&ds, &size);
+	if (out_size)
+		*out_size = size;
+
+	return ret;
+}
+
+static int uncompress_stream_gzip(struct unit_test_state *uts,
+				  void *in, unsigned long in_size,
+				  void *out, unsigned long out_max,
+				  unsigned long *out_size)
+{
+	return uncompress_using_stream(IH_COMP_GZIP, in, in_size, out,
+				       out_max, out_size);
+}
+
+static int uncompress_stream_lzma(struct unit_test_state *uts,
+				  void *in, unsigned long in_size,
+				  void *out, unsigned long out_max,
+				  unsigned long *out_size)
+{
+	return uncompress_using_stream(IH_COMP_LZMA, in, in_size, out,
+				       out_max, out_size);
+}
+
+static int uncompress_stream_lz4(struct unit_test_state *uts,
+				 void *in, unsigned long in_size,
+				 void *out, unsigned long out_max,
+				 unsigned long *out_size)
+{
+	return uncompress_using_stream(IH_COMP_LZ4, in, in_size, out,
+				       out_max, out_size);
+}
+
+static int uncompress_stream_zstd(struct unit_test_state *uts,
+				  void *in, unsigned long in_size,
+				  void *out, unsigned long out_max,
+				  unsigned long *out_size)
+{
+	return uncompress_using_stream(IH_COMP_ZSTD, in, in_size, out,
+				       out_max, out_size);
+}
+
+static int uncompress_stream_auto(struct unit_test_state *uts,
+				  void *in, unsigned long in_size,
+				  void *out, unsigned long out_max,
+				  unsigned long *out_size)
+{
+	return uncompress_using_stream(DECOMP_STREAM_AUTO, in, in_size, out,
+				       out_max, out_size);
+}
+
+static int compression_test_stream_gzip(struct unit_test_state *uts)
+{
+	return run_test(uts, "gzip stream", compress_using_gzip,
+			uncompress_stream_gzip);
+}
+COMPRESSION_TEST(compression_test_stream_gzip, 0);
+
+static int compression_test_stream_lzma(struct unit_test_state *uts)
+{
+	return run_test(uts, "lzma stream", compress_using_lzma,
+			uncompress_stream_lzma);
+}
+COMPRESSION_TEST(compression_test_stream_lzma, 0);
+
+static int compression_test_stream_lz4(struct unit_test_state *uts)
+{
+	return run_test(uts, "lz4 stream", compress_using_lz4,
+			uncompress_stream_lz4);
+}
+COMPRESSION_TEST(compression_test_stream_lz4, 0);
+
+static int compression_test_stream_zstd(struct unit_test_state *uts)
+{
+	return run_test(uts, "zstd stream", compress_using_zstd,
+			uncompress_stream_zstd);
+}
+COMPRESSION_TEST(compression_test_stream_zstd, 0);
+
+static int compression_test_stream_auto(struct unit_test_state *uts)
+{
+	ut_assertok(run_test(uts, "gzip auto stream", compress_using_gzip,
+			     uncompress_stream_auto));
+	ut_assertok(run_test(uts, "lz4 auto stream", compress_using_lz4,
+			     uncompress_stream_auto));
+	ut_assertok(run_test(uts, "zstd auto stream", compress_using_zstd,
+			     uncompress_stream_auto));
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_stream_auto, 0);
+
+#endif
+
 int do_ut_compression(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 {
 	struct unit_test *tests = ll_entry_start(struct unit_test,
@@ -4,7 +4,12 @@
  */
 
 #include <common.h>
+#include <blk.h>
 #include <dm.h>
+#include <hexdump.h>
+#include <malloc.h>
+#include <os.h>
+#include <sandboxblockdev.h>
 #include <usb.h>
 #include <asm/state.h>
 #include <dm/test.h>
@@ -162,3 +167,167 @@ static int dm_test_blk_get_from_parent(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_get_from_parent, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that queued requests complete with the right data */
+static int dm_test_blk_submit(struct unit_test_state *uts)
+{
+	const char *fname = "blk_submit.img";
+	/* more requests than the host device queues at once */
+	struct blk_req reqs[HOST_BLK_QUEUE_DEPTH * 2 + 1];
+	const int count = ARRAY_SIZE(reqs);
+	struct blk_req wr, rd;
+	struct blk_desc *desc;
+	u8 *data, *buf;
+	int i;
+
+	data = malloc(count * 512);
+	buf = calloc(count, 512);
+	ut_assertnonnull(data);
+	ut_assertnonnull(buf);
+	for (i = 0; i < count * 512; i++)
+		data[i] = i ^ (i >> 9);
+	ut_assertok(os_write_file(fname, data, count * 512));
+	ut_assertok(host_dev_bind(0, (char *)fname));
+	ut_assertok(blk_get_device_by_str("host", "0", &desc));
+
+	/* read one block per request, last block first */
+	for (i = 0; i < count; i++) {
+		reqs[i].start = count - 1 - i;
+		reqs[i].blkcnt = 1;
+		reqs[i].buffer = buf + reqs[i].start * 512;
+		reqs[i].write = false;
+		ut_assertok(blk_submit(desc, &reqs[i]));
+	}
+	ut_assertok(blk_wait_all(desc));
+	for (i = 0; i < count; i++) {
+		ut_assert(reqs[i].done);
+		ut_asserteq(1, reqs[i].result);
+	}
+	ut_asserteq_mem(data, buf, count * 512);
+
+	/* a write must be seen by a later read of the same blocks */
+	memset(data, 0xa5, 2 * 512);
+	wr.start = 2;
+	wr.blkcnt = 2;
+	wr.buffer = data;
+	wr.write = true;
+	ut_assertok(blk_submit(desc, &wr));
+	ut_asserteq(2, blk_wait(desc, &wr));
+
+	rd.start = 2;
+	rd.blkcnt = 2;
+	rd.buffer = buf;
+	rd.write = false;
+	ut_assertok(blk_submit(desc, &rd));
+	ut_asserteq(2, blk_wait(desc, &rd));
+	ut_asserteq_mem(data, buf, 2 * 512);
+
+	/*
+	 * A read queued behind a write of the same blocks may complete first
+	 * with the old data, which must not end up in the cache
+	 */
+	memset(data, 0x5a, 2 * 512);
+	ut_assertok(blk_submit(desc, &wr));
+	ut_assertok(blk_submit(desc, &rd));
+	ut_assertok(blk_wait_all(desc));
+	ut_assertok(blk_submit(desc, &rd));
+	ut_asserteq(2, blk_wait(desc, &rd));
+	ut_asserteq_mem(data, buf, 2 * 512);
+
+	ut_assertok(host_dev_bind(0, NULL));
+	os_unlink(fname);
+	free(buf);
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_submit, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test cache hits, eviction, invalidation and read-ahead */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	const char *fname = "blk_cache.img";
+	const int count = 256;
+	struct block_cache_stats stats;
+	struct blk_desc *desc;
+	u8 *data, *buf;
+	int i;
+
+	data = malloc(count * 512);
+	buf = malloc(count * 512);
+	ut_assertnonnull(data);
+	ut_assertnonnull(buf);
+	for (i = 0; i < count * 512; i++)
+		data[i] = i ^ (i >> 9);
+	ut_assertok(os_write_file(fname, data, count * 512));
+	ut_assertok(host_dev_bind(0, (char *)fname));
+	ut_assertok(blk_get_device_by_str("host", "0", &desc));
+
+	/*
+	 * a single set of four lines, each holding eight blocks; keep clear of
+	 * block 1, which follows on from the partition-table probe
+	 */
+	blkcache_configure(32, 4);
+
+	/* a miss reads the whole line, so the rest of it hits */
+	ut_asserteq(1, blk_dread(desc, 9, 1, buf));
+	ut_asserteq_mem(data + 9 * 512, buf, 512);
+	ut_asserteq(1, blk_dread(desc, 13, 1, buf));
+	ut_asserteq_mem(data + 13 * 512, buf, 512);
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.hits);
+	ut_asserteq(1, stats.misses);
+	ut_asserteq(1, stats.entries);
+
+	/* four more lines push out the least recently used one */
+	for (i = 2; i <= 5; i++)
+		ut_asserteq(1, blk_dread(desc, i * 16, 1, buf));
+	ut_asserteq(1, blk_dread(desc, 10, 1, buf));
+	ut_asserteq_mem(data + 10 * 512, buf, 512);
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits);
+	ut_asserteq(5, stats.misses);
+	ut_asserteq(4, stats.entries);
+
+	/* a write discards the cached blocks of the device */
+	ut_asserteq(1, blk_dread(desc, 10, 1, buf));
+	memset(data + 10 * 512, 0xa5, 512);
+	ut_asserteq(1, blk_dwrite(desc, 10, 1, data + 10 * 512));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.hits);
+	ut_asserteq(0, stats.entries);
+	ut_asserteq(1, blk_dread(desc, 10, 1, buf));
+	ut_asserteq_mem(data + 10 * 512, buf, 512);
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits);
+	ut_asserteq(1, stats.misses);
+
+	/* a read following on from the last one reads ahead */
+	blkcache_configure(32, 256);
+	ut_asserteq(8, blk_dread(desc, 96, 8, buf));
+	ut_asserteq(1, blk_dread(desc, 104, 1, buf));
+	ut_asserteq_mem(data + 104 * 512, buf, 512);
+	ut_asserteq(4, blk_dread(desc, 170, 4, buf));
+	ut_asserteq_mem(data + 170 * 512, buf, 4 * 512);
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.hits);
+	ut_asserteq(2, stats.misses);
+	ut_asserteq(1, stats.ndevs);
+	ut_asserteq(IF_TYPE_HOST, stats.devs[0].iftype);
+	ut_asserteq(CONFIG_BLOCK_CACHE_READAHEAD * 1024 / 512 + 8 - 1,
+		    stats.devs[0].readahead);
+
+	/* removing the device frees its slot */
+	ut_assertok(host_dev_bind(0, NULL));
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.ndevs);
+	ut_asserteq(0, stats.entries);
+
+	blkcache_configure_size(CONFIG_BLOCK_CACHE_SIZE_KB);
+	os_unlink(fname);
+	free(buf);
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
@@ -11,6 +11,7 @@
 #include <fdtdec.h>
 #include <malloc.h>
 #include <dm/device-internal.h>
+#include <dm/lists.h>
 #include <dm/root.h>
 #include <dm/util.h>
 #include <dm/test.h>
@@ -70,6 +71,11 @@ static struct driver_info driver_info_act_dma = {
 	.name = "test_act_dma_drv",
 };
 
+static struct driver_info driver_info_wait = {
+	.name = "test_wait_drv",
+	.platdata = &test_pdata_manual,
+};
+
 void dm_leak_check_start(struct unit_test_state *uts)
 {
 	uts->start = mallinfo();
@@ -904,3 +910,159 @@ static int dm_test_inactive_child(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_inactive_child, DM_TESTF_SCAN_PDATA);
+
+/* Find the first of_match entry for @compat, as a search of all drivers would */
+static const struct udevice_id *find_compat(const char *compat,
+					    struct driver **drvp)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *id;
+	struct driver *entry;
+
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (id = entry->of_match; id && id->compatible; id++) {
+			if (!strcmp(id->compatible, compat)) {
+				*drvp = entry;
+				return id;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static int dm_test_lookup_compat(struct unit_test_state *uts)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *id, *first, *found;
+	struct driver *entry, *drv = NULL;
+
+	/* Every compatible string gets the first driver which has it */
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (id = entry->of_match; id && id->compatible; id++) {
+			first = find_compat(id->compatible, &drv);
+			ut_asserteq_ptr(drv, lists_driver_lookup_compat(
+						id->compatible, &found));
+			ut_asserteq_ptr(first, found);
+		}
+	}
+	ut_assertnull(lists_driver_lookup_compat("denx,u-boot-no-such-driver",
+						 &found));
+
+	return 0;
+}
+DM_TEST(dm_test_lookup_compat, 0);
+
+/* Test that uclass lookups follow devices being probed, removed and moved */
+static int dm_test_uclass_index(struct unit_test_state *uts)
+{
+	struct udevice *dev, *dev2, *found;
+	ofnode node = ofnode_path("/");
+	int seq;
+
+	ut_assertok(uclass_get_device(UCLASS_TEST, 0, &dev));
+	seq = dev->seq;
+	ut_assert(seq >= 0);
+	ut_assertok(uclass_find_device_by_seq(UCLASS_TEST, seq, false, &found));
+	ut_asserteq_ptr(dev, found);
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	ut_asserteq(-ENODEV, uclass_find_device_by_seq(UCLASS_TEST, seq, false,
+						       &found));
+	ut_assertok(device_probe(dev));
+	ut_assertok(uclass_find_device_by_seq(UCLASS_TEST, seq, false, &found));
+	ut_asserteq_ptr(dev, found);
+
+	/* The test devices have no node until they are given one */
+	ut_assertok(uclass_find_device(UCLASS_TEST, 1, &dev2));
+	ut_asserteq(-ENODEV, uclass_find_device_by_ofnode(UCLASS_TEST, node,
+							  &found));
+	dev_set_ofnode(dev2, node);
+	ut_assertok(uclass_find_device_by_ofnode(UCLASS_TEST, node, &found));
+	ut_asserteq_ptr(dev2, found);
+
+	/* With two devices on one node, the first in the uclass wins */
+	dev_set_ofnode(dev, node);
+	ut_assertok(uclass_find_device_by_ofnode(UCLASS_TEST, node, &found));
+	ut_asserteq_ptr(dev, found);
+	dev_set_ofnode(dev, ofnode_null());
+	ut_assertok(uclass_find_device_by_ofnode(UCLASS_TEST, node, &found));
+	ut_asserteq_ptr(dev2, found);
+
+	ut_assertok(device_unbind(dev2));
+	ut_asserteq(-ENODEV, uclass_find_device_by_ofnode(UCLASS_TEST, node,
+							  &found));
+
+	return 0;
+}
+DM_TEST(dm_test_uclass_index, DM_TESTF_SCAN_PDATA);
+
+/* Test that every device with a node can be found by it */
+static int dm_test_uclass_index_fdt(struct unit_test_state *uts)
+{
+	struct udevice *dev, *first, *found;
+	struct uclass *uc;
+
+	list_for_each_entry(uc, &gd->uclass_root, sibling_node) {
+		uclass_foreach_dev(dev, uc) {
+			if (!dev_has_of_node(dev))
+				continue;
+			uclass_foreach_dev(first, uc) {
+				if (ofnode_equal(dev_ofnode(first),
+						 dev_ofnode(dev)))
+					break;
+			}
+			ut_assertok(uclass_find_device_by_ofnode(
+					uc->uc_drv->id, dev_ofnode(dev), &found));
+			ut_asserteq_ptr(first, found);
+		}
+	}
+
+	return 0;
+}
+DM_TEST(dm_test_uclass_index_fdt, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test probe methods which wait for the hardware */
+static int dm_test_probe_wait(struct unit_test_state *uts)
+{
+	struct dm_test_state *dms = uts->priv;
+	struct dm_test_wait_priv *priv;
+	struct udevice *dev[3];
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(dev); i++)
+		ut_assertok(device_bind_by_name(dms->root, false,
+						&driver_info_wait, &dev[i]));
+
+	/* On its own, a device is probed in one go */
+	ut_assertok(device_probe(dev[0]));
+	ut_assert(device_active(dev[0]));
+	ut_assert(!(dev[0]->flags & DM_FLAG_PROBE_WAIT));
+	priv = dev_get_priv(dev[0]);
+	ut_asserteq(DM_TEST_WAIT_STEPS + 1, priv->steps);
+#if CONFIG_IS_ENABLED(DM_PROBE_TIME)
+	ut_assert(dev[0]->probe_time >= DM_TEST_WAIT_STEPS * DM_TEST_WAIT_US);
+#endif
+	ut_assertok(device_remove(dev[0], DM_REMOVE_NORMAL));
+
+	/* Together, each is started before the first one is finished */
+	dm_testdrv_op_count[DM_TEST_OP_PROBE] = 0;
+	ut_assertok(uclass_probe_all(UCLASS_TEST));
+	for (i = 0; i < ARRAY_SIZE(dev); i++) {
+		ut_assert(device_active(dev[i]));
+		priv = dev_get_priv(dev[i]);
+		ut_asserteq(DM_TEST_WAIT_STEPS + 1, priv->steps);
+		if (!CONFIG_IS_ENABLED(DM_PROBE_ASYNC)) {
+			ut_asserteq(priv->first + DM_TEST_WAIT_STEPS,
+				    priv->last);
+			continue;
+		}
+		ut_asserteq(i + 1, priv->first);
+		ut_asserteq(ARRAY_SIZE(dev) * DM_TEST_WAIT_STEPS + i + 1,
+			    priv->last);
+	}
+
+	return 0;
+}
+DM_TEST(dm_test_probe_wait, 0);
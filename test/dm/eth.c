@@ -10,8 +10,12 @@
 #include <dm.h>
 #include <env.h>
 #include <fdtdec.h>
+#include <hexdump.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
+#include <net/tcp.h>
+#include <net/tftp.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
@@ -84,6 +88,48 @@ static int dm_test_eth_prime(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_eth_prime, DM_TESTF_SCAN_FDT);
 
+/*
+ * With CONFIG_DM_PROBE_DEFER nothing is probed at boot, so the first use of
+ * the network must pick ethprime and write the MAC address of that device.
+ * net_init() still probes the first device; the others must stay unprobed.
+ */
+static int dm_test_eth_first_use(struct unit_test_state *uts)
+{
+	const char *ethname[DM_TEST_ETH_NUM] = {"eth@10002000", "eth@10003000",
+						"sbe5", "eth@10004000"};
+	struct udevice *dev[DM_TEST_ETH_NUM];
+	struct eth_sandbox_priv *priv;
+	int i;
+
+	for (i = 0; i < DM_TEST_ETH_NUM; i++) {
+		ut_assertok(uclass_find_device_by_name(UCLASS_ETH,
+						       ethname[i], &dev[i]));
+		ut_assertok(device_remove(dev[i], DM_REMOVE_NORMAL));
+	}
+
+	net_ping_ip = string_to_ip("1.1.2.2");
+	env_set("ethact", NULL);
+	env_set("ethprime", "eth@10004000");
+	ut_assertok(net_loop(PING));
+	ut_asserteq_str("eth@10004000", env_get("ethact"));
+
+	/* each probed device had its MAC address written as it was probed */
+	priv = dev_get_priv(dev[0]);
+	ut_asserteq(1, priv->hwaddr_writes);
+	priv = dev_get_priv(dev[3]);
+	ut_asserteq(1, priv->hwaddr_writes);
+	ut_assert(!device_active(dev[1]));
+	ut_assert(!device_active(dev[2]));
+
+	env_set("ethprime", NULL);
+	env_set("ethact", NULL);
+	for (i = 0; i < DM_TEST_ETH_NUM; i++)
+		ut_assertok(device_probe(dev[i]));
+
+	return 0;
+}
+DM_TEST(dm_test_eth_first_use, DM_TESTF_SCAN_FDT);
+
 /**
  * This test case is trying to test the following scenario:
  *	- All ethernet devices are not probed
@@ -429,3 +475,751 @@ static int dm_test_eth_async_ping_reply(struct unit_test_state *uts)
 }
 
 DM_TEST(dm_test_eth_async_ping_reply, DM_TESTF_SCAN_FDT);
+
+static int sb_burst_handler(struct udevice *dev, void *packet,
+			    unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+
+	/* Queue a frame nobody handles and a runt ahead of the ping reply */
+	if (priv->recv_packets + 3 > PKTBUFSRX)
+		return -EOVERFLOW;
+
+	eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth->et_dest, net_ethaddr, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IPV6);
+	priv->recv_packet_length[priv->recv_packets++] = ETHER_HDR_SIZE + 40;
+	priv->recv_packet_length[priv->recv_packets++] = ETHER_HDR_SIZE - 2;
+
+	return sandbox_eth_ping_req_to_reply(dev, packet, len);
+}
+
+static int dm_test_eth_rx_stats(struct unit_test_state *uts)
+{
+	net_ping_ip = string_to_ip("1.1.2.2");
+
+	sandbox_eth_set_tx_handler(0, sb_burst_handler);
+	env_set("ethact", "eth@10002000");
+	ut_assertok(net_loop(PING));
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	/* The ARP reply arrives alone, the other three in a single poll */
+	ut_asserteq(4, net_stats.rx_packets);
+	ut_asserteq(2, net_stats.rx_batches);
+	ut_asserteq(1, net_stats.rx_arp);
+	ut_asserteq(1, net_stats.rx_icmp);
+	ut_asserteq(0, net_stats.rx_udp);
+	ut_asserteq(1, net_stats.rx_other);
+	ut_asserteq(1, net_stats.rx_errors);
+	ut_asserteq(2, net_stats.tx_packets);
+
+	return 0;
+}
+DM_TEST(dm_test_eth_rx_stats, DM_TESTF_SCAN_FDT);
+
+#if defined(CONFIG_NET_TFTP_VARS) || defined(CONFIG_CMD_NFS)
+/* Queue a UDP packet from the fake host to us, as if it came from the wire */
+static void sb_udp_queue(struct udevice *dev, int sport, int dport,
+			 const void *payload, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth;
+	struct ip_udp_hdr *ip;
+
+	/* Like a real network, drop what doesn't fit */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return;
+
+	eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth->et_dest, net_ethaddr, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	ip = (void *)eth + ETHER_HDR_SIZE;
+	memset(ip, 0, IP_UDP_HDR_SIZE);
+	ip->ip_hl_v = 0x45;
+	ip->ip_len = htons(IP_UDP_HDR_SIZE + len);
+	ip->ip_off = htons(IP_FLAGS_DFRAG);
+	ip->ip_ttl = 255;
+	ip->ip_p = IPPROTO_UDP;
+	net_write_ip(&ip->ip_src, priv->fake_host_ipaddr);
+	net_write_ip(&ip->ip_dst, net_ip);
+	ip->ip_sum = compute_ip_checksum(ip, IP_HDR_SIZE);
+	ip->udp_src = htons(sport);
+	ip->udp_dst = htons(dport);
+	ip->udp_len = htons(UDP_HDR_SIZE + len);
+	memcpy((void *)ip + IP_UDP_HDR_SIZE, payload, len);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+	++priv->recv_packets;
+}
+#endif
+
+#ifdef CONFIG_NET_TFTP_VARS
+/* TFTP server faked on the other side of the sandbox Ethernet device */
+#define SB_TFTP_RRQ		1
+#define SB_TFTP_DATA		3
+#define SB_TFTP_ACK		4
+#define SB_TFTP_OACK		6
+#define SB_TFTP_PORT		69
+#define SB_TFTP_SERVER_PORT	4321
+#define SB_TFTP_BLKSIZE		512
+#define SB_TFTP_WINDOW		3
+/* ten full blocks and a short one */
+#define SB_TFTP_SIZE		(10 * SB_TFTP_BLKSIZE + 100)
+#define SB_TFTP_LAST		(SB_TFTP_SIZE / SB_TFTP_BLKSIZE + 1)
+/* block lost the first time it is sent */
+#define SB_TFTP_DROP		2
+#define SB_TFTP_ADDR		0x1000000
+
+struct sb_tftp_server {
+	struct unit_test_state *uts;
+	int client_port;
+	int request;		/* window size the client should ask for */
+	int window;
+	int acks;
+	ulong msecs;		/* time taken by the transfer */
+	bool dropped;
+};
+
+static u8 sb_tftp_byte(int offset)
+{
+	return (offset * 7 + (offset >> 9)) & 0xff;
+}
+
+static void sb_tftp_send_block(struct udevice *dev, struct sb_tftp_server *srv,
+			       int block)
+{
+	u8 buf[4 + SB_TFTP_BLKSIZE];
+	int offset = (block - 1) * SB_TFTP_BLKSIZE;
+	int len = min(SB_TFTP_SIZE - offset, SB_TFTP_BLKSIZE);
+	int i;
+
+	*(__be16 *)buf = htons(SB_TFTP_DATA);
+	*(__be16 *)(buf + 2) = htons(block);
+	for (i = 0; i < len; i++)
+		buf[4 + i] = sb_tftp_byte(offset + i);
+
+	sb_udp_queue(dev, SB_TFTP_SERVER_PORT, srv->client_port, buf,
+		     4 + len);
+}
+
+static int sb_tftp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_tftp_server *srv = priv->priv;
+	struct unit_test_state *uts = srv->uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	__be16 *op = packet + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	char *opt, *end;
+	int block;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	switch (ntohs(op[0])) {
+	case SB_TFTP_RRQ: {
+		static const char oack[] = "\0\6blksize\0" "512\0"
+					   "windowsize\0" "3";
+
+		ut_asserteq(SB_TFTP_PORT, ntohs(ip->udp_dst));
+		srv->client_port = ntohs(ip->udp_src);
+
+		/* filename, mode, then option/value pairs */
+		opt = (char *)(op + 1);
+		end = (char *)ip + IP_HDR_SIZE + ntohs(ip->udp_len);
+		opt += strlen(opt) + 1;
+		opt += strlen(opt) + 1;
+		while (opt < end) {
+			if (!strcmp(opt, "windowsize"))
+				srv->window = simple_strtoul(opt + 11, NULL,
+							     10);
+			opt += strlen(opt) + 1;
+			opt += strlen(opt) + 1;
+		}
+		ut_asserteq(srv->request, srv->window);
+
+		/* always grant SB_TFTP_WINDOW, even if asked for less */
+		sb_udp_queue(dev, SB_TFTP_SERVER_PORT, srv->client_port,
+			     oack, sizeof(oack));
+		break;
+	}
+	case SB_TFTP_ACK:
+		srv->acks++;
+		for (block = ntohs(op[1]) + 1;
+		     block <= ntohs(op[1]) + srv->window &&
+		     block <= SB_TFTP_LAST; block++) {
+			if (block == SB_TFTP_DROP && !srv->dropped) {
+				srv->dropped = true;
+				continue;
+			}
+			sb_tftp_send_block(dev, srv, block);
+		}
+		break;
+	}
+
+	return 0;
+}
+
+/* Fetch the file asking for a window of @window blocks */
+static int sb_tftp_get(struct unit_test_state *uts,
+		       struct sb_tftp_server *srv, int window, bool drop)
+{
+	u8 *buf;
+	int i;
+
+	memset(srv, 0, sizeof(*srv));
+	srv->uts = uts;
+	srv->request = window;
+	srv->dropped = !drop;
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	sandbox_eth_set_priv(0, srv);
+
+	env_set("ethact", "eth@10002000");
+	env_set_ulong("tftpwindowsize", window);
+	net_server_ip = string_to_ip("1.1.2.2");
+	strcpy(net_boot_file_name, "window.bin");
+	load_addr = SB_TFTP_ADDR;
+	srv->msecs = get_timer(0);
+	ut_asserteq(SB_TFTP_SIZE, net_loop(TFTPGET));
+	srv->msecs = get_timer(srv->msecs);
+
+	buf = map_sysmem(SB_TFTP_ADDR, SB_TFTP_SIZE);
+	for (i = 0; i < SB_TFTP_SIZE; i++)
+		ut_asserteq(sb_tftp_byte(i), buf[i]);
+	unmap_sysmem(buf);
+
+	env_set("tftpwindowsize", NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	return 0;
+}
+
+static int dm_test_eth_tftp_window(struct unit_test_state *uts)
+{
+	struct sb_tftp_server srv;
+
+	/*
+	 * One ack per window, plus the ack for the first block after the
+	 * dropped one and the final ack: 0, 1, 4, 7, 10 and 11.
+	 */
+	ut_assertok(sb_tftp_get(uts, &srv, SB_TFTP_WINDOW, true));
+	ut_assert(srv.dropped);
+	ut_asserteq(6, srv.acks);
+
+	/*
+	 * A larger window in the OACK than asked for is not used, else the
+	 * client times out waiting for blocks the server never sends
+	 */
+	ut_assertok(sb_tftp_get(uts, &srv, SB_TFTP_WINDOW - 1, false));
+	ut_asserteq(7, srv.acks);
+	ut_assert(srv.msecs < tftp_timeout_ms);
+
+	return 0;
+}
+
+DM_TEST(dm_test_eth_tftp_window, DM_TESTF_SCAN_FDT);
+#endif
+
+#ifdef CONFIG_CMD_NFS
+/* NFS server faked on the other side of the sandbox Ethernet device */
+#define SB_RPC_PORTMAP		100000
+#define SB_RPC_NFS		100003
+#define SB_RPC_MOUNT		100005
+#define SB_RPC_PROG_MISMATCH	2
+#define SB_MOUNT_MNT		1
+#define SB_MOUNT_UMNTALL	4
+#define SB_NFS2_LOOKUP		4
+#define SB_NFS3_LOOKUP		3
+#define SB_NFS_READ		6
+#define SB_NFS_MOUNT_PORT	635
+#define SB_NFS_PORT		2049
+#define SB_NFS_FHSIZE		32
+/* most the server returns per READ, less than the client asks for */
+#define SB_NFS_BLKSIZE		1024
+/* three full READs and a short one */
+#define SB_NFS_SIZE		(3 * CONFIG_NFS_READ_SIZE + 1000)
+/* READ whose reply is lost the first time */
+#define SB_NFS_DROP		(2 * CONFIG_NFS_READ_SIZE)
+#define SB_NFS_ADDR		0x1000000
+
+struct sb_nfs_server {
+	struct unit_test_state *uts;
+	/* reply to the first READ, held back until after the next one */
+	__be32 held[6 + 5 + SB_NFS_BLKSIZE / 4];
+	int held_len;
+	int held_port;
+	bool reordered;
+	bool dropped;
+	int drop_reads;		/* READs seen for SB_NFS_DROP */
+	int umounts;
+};
+
+static u8 sb_nfs_byte(int offset)
+{
+	return (offset * 13 + (offset >> 10)) & 0xff;
+}
+
+static int sb_nfs_handler(struct udevice *dev, void *packet,
+			  unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_nfs_server *srv = priv->priv;
+	struct unit_test_state *uts = srv->uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	__be32 *call = packet + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	__be32 rep[6 + 5 + SB_NFS_BLKSIZE / 4];
+	__be32 *args, *data = rep + 6;
+	int sport, dport, words;
+	int offset, count, i;
+	u8 *bytes;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	sport = ntohs(ip->udp_dst);
+	dport = ntohs(ip->udp_src);
+
+	/* skip the credential and the verifier */
+	args = call + 6;
+	args += 2 + ntohl(args[1]) / 4;
+	args += 2 + ntohl(args[1]) / 4;
+
+	/* an accepted reply with an empty verifier */
+	memset(rep, 0, 6 * sizeof(*rep));
+	rep[0] = call[0];
+	rep[1] = htonl(1);
+
+	switch (ntohl(call[3])) {
+	case SB_RPC_PORTMAP:
+		ut_asserteq(111, sport);
+		data[0] = htonl(ntohl(args[0]) == SB_RPC_MOUNT ?
+				SB_NFS_MOUNT_PORT : SB_NFS_PORT);
+		words = 1;
+		break;
+	case SB_RPC_MOUNT:
+		ut_asserteq(SB_NFS_MOUNT_PORT, sport);
+		if (ntohl(call[5]) == SB_MOUNT_UMNTALL) {
+			srv->umounts++;
+			words = 0;
+			break;
+		}
+		ut_asserteq(SB_MOUNT_MNT, ntohl(call[5]));
+		data[0] = 0;
+		memset(data + 1, 0x5a, SB_NFS_FHSIZE);
+		words = 1 + SB_NFS_FHSIZE / 4;
+		break;
+	case SB_RPC_NFS:
+		ut_asserteq(SB_NFS_PORT, sport);
+		if (ntohl(call[4]) == 2) {
+			/* only NFSv3, so that the server can send short READs */
+			ut_asserteq(SB_NFS2_LOOKUP, ntohl(call[5]));
+			rep[5] = htonl(SB_RPC_PROG_MISMATCH);
+			data[0] = htonl(3);
+			data[1] = htonl(3);
+			words = 2;
+			break;
+		}
+		if (ntohl(call[5]) == SB_NFS3_LOOKUP) {
+			data[0] = 0;
+			data[1] = htonl(SB_NFS_FHSIZE);
+			memset(data + 2, 0xa5, SB_NFS_FHSIZE);
+			/* no object or directory attributes */
+			data[2 + SB_NFS_FHSIZE / 4] = 0;
+			data[3 + SB_NFS_FHSIZE / 4] = 0;
+			words = 4 + SB_NFS_FHSIZE / 4;
+			break;
+		}
+		ut_asserteq(SB_NFS_READ, ntohl(call[5]));
+
+		/* file handle, 64-bit offset and count */
+		args += 1 + ntohl(args[0]) / 4;
+		ut_asserteq(0, ntohl(args[0]));
+		offset = ntohl(args[1]);
+		count = min3((int)ntohl(args[2]), SB_NFS_BLKSIZE,
+			     SB_NFS_SIZE - offset);
+
+		if (offset == SB_NFS_DROP) {
+			srv->drop_reads++;
+			if (!srv->dropped) {
+				srv->dropped = true;
+				return 0;
+			}
+		}
+
+		data[0] = 0;
+		data[1] = 0;		/* no attributes */
+		data[2] = htonl(count);
+		data[3] = htonl(offset + count == SB_NFS_SIZE);
+		data[4] = htonl(count);
+		bytes = (u8 *)(data + 5);
+		for (i = 0; i < count; i++)
+			bytes[i] = sb_nfs_byte(offset + i);
+		words = 5 + (count + 3) / 4;
+
+		if (!offset && !srv->reordered) {
+			srv->reordered = true;
+			memcpy(srv->held, rep, (6 + words) * sizeof(*rep));
+			srv->held_len = (6 + words) * sizeof(*rep);
+			srv->held_port = sport;
+			return 0;
+		}
+		break;
+	default:
+		ut_assertf(false, "unexpected RPC program %u\n",
+			   ntohl(call[3]));
+	}
+
+	sb_udp_queue(dev, sport, dport, rep, (6 + words) * sizeof(*rep));
+	if (srv->held_len) {
+		sb_udp_queue(dev, srv->held_port, dport, srv->held,
+			     srv->held_len);
+		srv->held_len = 0;
+	}
+
+	return 0;
+}
+
+static int dm_test_eth_nfs_window(struct unit_test_state *uts)
+{
+	struct sb_nfs_server srv;
+	u8 *buf;
+	int i;
+
+	memset(&srv, 0, sizeof(srv));
+	srv.uts = uts;
+	sandbox_eth_set_tx_handler(0, sb_nfs_handler);
+	sandbox_eth_set_priv(0, &srv);
+
+	env_set("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+	strcpy(net_boot_file_name, "/export/window.bin");
+	load_addr = SB_NFS_ADDR;
+	ut_asserteq(SB_NFS_SIZE, net_loop(NFS));
+
+	buf = map_sysmem(SB_NFS_ADDR, SB_NFS_SIZE);
+	for (i = 0; i < SB_NFS_SIZE; i++)
+		ut_asserteq(sb_nfs_byte(i), buf[i]);
+	unmap_sysmem(buf);
+
+	/* the reply to the first READ came after the one to the second */
+	ut_assert(srv.reordered);
+	ut_assertok(srv.held_len);
+
+	/* the lost reply was asked for again */
+	ut_assert(srv.dropped);
+	ut_asserteq(2, srv.drop_reads);
+	ut_assert(srv.umounts >= 1);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	return 0;
+}
+
+DM_TEST(dm_test_eth_nfs_window, DM_TESTF_SCAN_FDT);
+#endif
+
+#ifdef CONFIG_CMD_WGET
+/* HTTP server faked on the other side of the sandbox Ethernet device */
+#define SB_HTTP_PORT		8080
+#define SB_HTTP_ISS		0x10000
+/* segment size of the server, below the MSS we ask for */
+#define SB_HTTP_SEG		1000
+#define SB_HTTP_BODY		(4 * SB_HTTP_SEG)
+#define SB_HTTP_ADDR		0x1000000
+/* first retransmission timeout of the client */
+#define SB_TCP_RTO_MS		200
+
+struct sb_http_server {
+	struct unit_test_state *uts;
+	bool content_length;	/* else the body ends with the server's FIN */
+	bool reorder;		/* swap the second and third segments once */
+	int drop_requests;	/* transmissions of the GET to ignore */
+	int reset_at;		/* if not 0, send a RST instead of this offset */
+	int client_port;
+	u32 rcv_nxt;		/* next sequence number from the client */
+	char resp[100 + SB_HTTP_BODY];
+	int resp_len;
+	u32 last_ack;
+	u32 rexmit_ack;		/* last ACK that caused a retransmission */
+	int requests;		/* transmissions of the GET seen */
+	ulong request_time[3];
+	int dupacks;
+	ulong msecs;		/* time taken by the transfer */
+	bool fin;		/* the client closed the connection */
+};
+
+static u8 sb_http_byte(int offset)
+{
+	return (offset * 11 + (offset >> 8)) & 0xff;
+}
+
+/* Queue a TCP segment from the server, acknowledging all the client sent */
+static void sb_tcp_queue(struct udevice *dev, struct sb_http_server *srv,
+			 u8 flags, u32 seq, const void *payload, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth;
+	struct ip_tcp_hdr *ip;
+	struct {
+		struct in_addr src;
+		struct in_addr dst;
+		u8 zero;
+		u8 proto;
+		__be16 len;
+	} __packed pseudo;
+	unsigned int sum;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return;
+
+	eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth->et_dest, net_ethaddr, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	ip = (void *)eth + ETHER_HDR_SIZE;
+	memset(ip, 0, IP_TCP_HDR_SIZE);
+	ip->ip_hl_v = 0x45;
+	ip->ip_len = htons(IP_TCP_HDR_SIZE + len);
+	ip->ip_off = htons(IP_FLAGS_DFRAG);
+	ip->ip_ttl = 255;
+	ip->ip_p = IPPROTO_TCP;
+	net_write_ip(&ip->ip_src, priv->fake_host_ipaddr);
+	net_write_ip(&ip->ip_dst, net_ip);
+	ip->ip_sum = compute_ip_checksum(ip, IP_HDR_SIZE);
+	ip->tcp_src = htons(SB_HTTP_PORT);
+	ip->tcp_dst = htons(srv->client_port);
+	ip->tcp_seq = htonl(seq);
+	ip->tcp_ack = htonl(srv->rcv_nxt);
+	ip->tcp_hlen = (TCP_HDR_SIZE / 4) << 4;
+	ip->tcp_flags = flags | TCP_ACK;
+	ip->tcp_win = htons(8192);
+	memcpy((void *)ip + IP_TCP_HDR_SIZE, payload, len);
+
+	pseudo.src = priv->fake_host_ipaddr;
+	pseudo.dst = net_ip;
+	pseudo.zero = 0;
+	pseudo.proto = IPPROTO_TCP;
+	pseudo.len = htons(TCP_HDR_SIZE + len);
+	sum = compute_ip_checksum(&pseudo, sizeof(pseudo));
+	ip->tcp_xsum = add_ip_checksums(sizeof(pseudo), sum,
+				compute_ip_checksum(&ip->tcp_src,
+						    TCP_HDR_SIZE + len));
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_TCP_HDR_SIZE + len;
+	++priv->recv_packets;
+}
+
+/* Send the response from @offset on, going back N on a retransmission */
+static void sb_http_send(struct udevice *dev, struct sb_http_server *srv,
+			 int offset)
+{
+	int segs[SB_HTTP_BODY / SB_HTTP_SEG + 2];
+	int count = 0;
+	int i, len;
+	u8 flags;
+
+	for (; offset < srv->resp_len; offset += SB_HTTP_SEG)
+		segs[count++] = offset;
+	if (srv->reorder && count > 2) {
+		swap(segs[1], segs[2]);
+		srv->reorder = false;
+	}
+
+	for (i = 0; i < count; i++) {
+		offset = segs[i];
+		if (srv->reset_at && offset == srv->reset_at) {
+			sb_tcp_queue(dev, srv, TCP_RST, SB_HTTP_ISS + 1 + offset,
+				     NULL, 0);
+			return;
+		}
+		len = min(srv->resp_len - offset, SB_HTTP_SEG);
+		flags = 0;
+		if (offset + len == srv->resp_len) {
+			flags = TCP_PSH;
+			if (!srv->content_length)
+				flags |= TCP_FIN;
+		}
+		sb_tcp_queue(dev, srv, flags, SB_HTTP_ISS + 1 + offset,
+			     srv->resp + offset, len);
+	}
+}
+
+static int sb_http_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	static const char get[] = "GET /window.bin HTTP/1.1\r\n";
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_http_server *srv = priv->priv;
+	struct unit_test_state *uts = srv->uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *ip = packet + ETHER_HDR_SIZE;
+	u32 seq, ack, end;
+	int hlen, dlen, i;
+	char *data, *p;
+	u8 flags;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_TCP)
+		return 0;
+
+	ut_asserteq(SB_HTTP_PORT, ntohs(ip->tcp_dst));
+	flags = ip->tcp_flags;
+	seq = ntohl(ip->tcp_seq);
+	ack = ntohl(ip->tcp_ack);
+	hlen = (ip->tcp_hlen >> 4) * 4;
+	data = (char *)&ip->tcp_src + hlen;
+	dlen = ntohs(ip->ip_len) - IP_HDR_SIZE - hlen;
+
+	if (flags & TCP_SYN) {
+		srv->client_port = ntohs(ip->tcp_src);
+		srv->rcv_nxt = seq + 1;
+		sb_tcp_queue(dev, srv, TCP_SYN, SB_HTTP_ISS, NULL, 0);
+		return 0;
+	}
+
+	if (flags & TCP_FIN) {
+		srv->fin = true;
+		return 0;
+	}
+
+	if (dlen) {
+		if (srv->requests < ARRAY_SIZE(srv->request_time))
+			srv->request_time[srv->requests] = get_timer(0);
+		if (srv->requests++ < srv->drop_requests)
+			return 0;
+		ut_asserteq_mem(get, data, sizeof(get) - 1);
+		srv->rcv_nxt = seq + dlen;
+
+		p = srv->resp;
+		p += sprintf(p, "HTTP/1.1 200 OK\r\n");
+		if (srv->content_length)
+			p += sprintf(p, "Content-Length: %d\r\n",
+				     SB_HTTP_BODY);
+		p += sprintf(p, "\r\n");
+		for (i = 0; i < SB_HTTP_BODY; i++)
+			*p++ = sb_http_byte(i);
+		srv->resp_len = p - srv->resp;
+		srv->last_ack = ack;
+		sb_http_send(dev, srv, 0);
+		return 0;
+	}
+
+	/* A repeated ACK short of the end means a segment went missing */
+	end = SB_HTTP_ISS + 1 + srv->resp_len;
+	if (srv->resp_len && ack == srv->last_ack && ack != end) {
+		srv->dupacks++;
+		if (ack != srv->rexmit_ack) {
+			srv->rexmit_ack = ack;
+			sb_http_send(dev, srv, ack - SB_HTTP_ISS - 1);
+		}
+	}
+	srv->last_ack = ack;
+
+	return 0;
+}
+
+/* Fetch the file, returning what net_loop() returns */
+static int sb_wget(struct sb_http_server *srv)
+{
+	int ret;
+
+	sandbox_eth_set_tx_handler(0, sb_http_handler);
+	sandbox_eth_set_priv(0, srv);
+
+	env_set("ethact", "eth@10002000");
+	env_set_ulong("httpdstp", SB_HTTP_PORT);
+	net_server_ip = string_to_ip("1.1.2.2");
+	strcpy(net_boot_file_name, "/window.bin");
+	load_addr = SB_HTTP_ADDR;
+	srv->msecs = get_timer(0);
+	ret = net_loop(WGET);
+	srv->msecs = get_timer(srv->msecs);
+
+	env_set("httpdstp", NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	return ret;
+}
+
+static int sb_http_check(struct unit_test_state *uts)
+{
+	u8 *buf;
+	int i;
+
+	buf = map_sysmem(SB_HTTP_ADDR, SB_HTTP_BODY);
+	for (i = 0; i < SB_HTTP_BODY; i++)
+		ut_asserteq(sb_http_byte(i), buf[i]);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+static int dm_test_eth_wget(struct unit_test_state *uts)
+{
+	struct sb_http_server srv;
+	ulong gap1, gap2;
+
+	/*
+	 * The third segment comes before the second: it is dropped and the
+	 * fourth one gets a duplicate ACK, which makes the server go back
+	 * without waiting for a timeout
+	 */
+	memset(&srv, 0, sizeof(srv));
+	srv.uts = uts;
+	srv.content_length = true;
+	srv.reorder = true;
+	ut_asserteq(SB_HTTP_BODY, sb_wget(&srv));
+	ut_assertok(sb_http_check(uts));
+	ut_assert(srv.dupacks >= 1);
+	ut_assert(srv.rexmit_ack);
+	ut_assert(srv.msecs < SB_TCP_RTO_MS);
+	/* with all the body received, we close the connection */
+	ut_assert(srv.fin);
+
+	/*
+	 * The request is lost twice; the retransmission timeout doubles. The
+	 * body ends with the server's FIN, which we answer with ours.
+	 */
+	memset(&srv, 0, sizeof(srv));
+	srv.uts = uts;
+	srv.drop_requests = 2;
+	ut_asserteq(SB_HTTP_BODY, sb_wget(&srv));
+	ut_assertok(sb_http_check(uts));
+	ut_asserteq(3, srv.requests);
+	gap1 = srv.request_time[1] - srv.request_time[0];
+	gap2 = srv.request_time[2] - srv.request_time[1];
+	ut_assert(gap1 >= SB_TCP_RTO_MS);
+	ut_assert(gap2 >= 2 * SB_TCP_RTO_MS);
+	ut_assert(srv.fin);
+
+	/* A reset in the middle of the body fails the download at once */
+	memset(&srv, 0, sizeof(srv));
+	srv.uts = uts;
+	srv.content_length = true;
+	srv.reset_at = 2 * SB_HTTP_SEG;
+	ut_assert(sb_wget(&srv) < 0);
+	ut_assert(srv.msecs < SB_TCP_RTO_MS);
+	ut_assert(!srv.fin);
+
+	return 0;
+}
+
+DM_TEST(dm_test_eth_wget, DM_TESTF_SCAN_FDT);
+#endif
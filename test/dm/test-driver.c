@@ -167,3 +167,26 @@ U_BOOT_DRIVER(test_act_dma_drv) = {
 	.unbind	= test_manual_unbind,
 	.flags	= DM_FLAG_ACTIVE_DMA,
 };
+
+/* Probe in steps, waiting for the pretend hardware in between */
+static int test_wait_probe(struct udevice *dev)
+{
+	struct dm_test_wait_priv *priv = dev_get_priv(dev);
+	int count = ++dm_testdrv_op_count[DM_TEST_OP_PROBE];
+
+	if (!priv->steps++)
+		priv->first = count;
+	priv->last = count;
+	if (priv->steps <= DM_TEST_WAIT_STEPS)
+		return device_probe_wait(dev, DM_TEST_WAIT_US);
+
+	return 0;
+}
+
+U_BOOT_DRIVER(test_wait_drv) = {
+	.name	= "test_wait_drv",
+	.id	= UCLASS_TEST,
+	.ops	= &test_manual_ops,
+	.probe	= test_wait_probe,
+	.priv_auto_alloc_size = sizeof(struct dm_test_wait_priv),
+};
@@ -11,12 +11,14 @@
 #include <asm/io.h>
 #include <dm/test.h>
 #include <dm/root.h>
+#include <dm/snapshot.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
 #include <dm/util.h>
 #include <dm/lists.h>
 #include <dm/of_access.h>
 #include <test/ut.h>
+#include <u-boot/crc.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -264,6 +266,68 @@ static int dm_test_fdt_pre_reloc(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_fdt_pre_reloc, 0);
 
+#if CONFIG_IS_ENABLED(DM_SNAPSHOT)
+/* Test binding devices from a snapshot of the device tree */
+static int dm_test_fdt_snapshot(struct unit_test_state *uts)
+{
+	const struct dm_snapshot *old = gd->dm_snapshot;
+	const void *blob = gd->fdt_blob;
+	struct dm_snapshot_node nodes[2];
+	struct dm_snapshot snap;
+	const s32 *childp;
+	struct udevice *dev;
+	struct uclass *uc;
+	s32 children[3];
+	int bus, ret;
+
+	/* List a-test and some-bus at the top level, and one bus child */
+	bus = fdt_path_offset(blob, "/some-bus");
+	children[0] = fdt_path_offset(blob, "/a-test");
+	children[1] = bus;
+	children[2] = fdt_path_offset(blob, "/some-bus/c-test@1");
+	nodes[0].offset = 0;
+	nodes[0].first = 0;
+	nodes[0].count = 2;
+	nodes[1].offset = bus;
+	nodes[1].first = 2;
+	nodes[1].count = 1;
+	snap.fdt_size = fdt_totalsize(blob);
+	snap.fdt_crc32 = crc32(0, blob, snap.fdt_size);
+	snap.node_count = ARRAY_SIZE(nodes);
+	snap.nodes = nodes;
+	snap.children = children;
+
+	ut_asserteq_ptr(&snap, dm_snapshot_check(&snap, blob));
+	ut_asserteq(2, dm_snapshot_get_children(&snap, 0, &childp));
+	ut_asserteq_ptr(children, childp);
+	ut_asserteq(1, dm_snapshot_get_children(&snap, bus, &childp));
+	ut_asserteq(children[2], *childp);
+	ut_asserteq(0, dm_snapshot_get_children(&snap, children[0], &childp));
+
+	/* Only the nodes in the snapshot are bound, including bus children */
+	gd->dm_snapshot = &snap;
+	ret = dm_scan_fdt(blob, false);
+	if (!ret)
+		ret = uclass_get_device(UCLASS_TEST_BUS, 0, &dev);
+	gd->dm_snapshot = old;
+	ut_assertok(ret);
+	ut_assertok(uclass_get(UCLASS_TEST_FDT, &uc));
+	ut_asserteq(2, list_count_items(&uc->dev_head));
+	ut_assertok(uclass_get(UCLASS_TEST_BUS, &uc));
+	ut_asserteq(1, list_count_items(&uc->dev_head));
+
+	/* A snapshot of another device tree is not used */
+	snap.fdt_crc32 ^= 1;
+	ut_assertnull(dm_snapshot_check(&snap, blob));
+	snap.fdt_crc32 ^= 1;
+	snap.fdt_size -= 4;
+	ut_assertnull(dm_snapshot_check(&snap, blob));
+
+	return 0;
+}
+DM_TEST(dm_test_fdt_snapshot, DM_TESTF_FLAT_TREE);
+#endif
+
 /* Test that sequence numbers are allocated properly */
 static int dm_test_fdt_uclass_seq(struct unit_test_state *uts)
 {
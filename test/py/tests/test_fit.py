@@ -5,6 +5,7 @@
 
 import os
 import pytest
+import re
 import struct
 import u_boot_utils as util
 
@@ -455,3 +456,138 @@ def test_fit(u_boot_console):
         # Go back to the original U-Boot with the correct dtb.
         cons.config.dtb = old_dtb
         cons.restart_uboot()
+
+# A FIT whose images all have hashes, with the data kept outside the FDT
+# (mkimage -E) so that an image may be loaded over the data of another
+hash_its = '''
+/dts-v1/;
+
+/ {
+        description = "FIT with hashed images";
+        #address-cells = <1>;
+
+        images {
+                kernel {
+                        data = /incbin/("%(kernel)s");
+                        type = "kernel";
+                        arch = "sandbox";
+                        os = "linux";
+                        compression = "none";
+                        load = <0x40000>;
+                        entry = <0x40000>;
+                        hash-1 {
+                                algo = "sha1";
+                        };
+                };
+                loadable-1 {
+                        data = /incbin/("%(loadable1)s");
+                        type = "kernel";
+                        arch = "sandbox";
+                        os = "linux";
+                        compression = "none";
+                        load = <%(loadable1_addr)#x>;
+                        entry = <0x0>;
+                        hash-1 {
+                                algo = "sha1";
+                        };
+                };
+                loadable-2 {
+                        data = /incbin/("%(loadable2)s");
+                        type = "ramdisk";
+                        arch = "sandbox";
+                        os = "linux";
+                        compression = "none";
+                        load = <0x140000>;
+                        hash-1 {
+                                algo = "sha1";
+                        };
+                };
+        };
+        configurations {
+                default = "conf-1";
+                conf-1 {
+                        kernel = "kernel";
+                        loadables = "loadable-1", "loadable-2";
+                };
+        };
+};
+'''
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('fit_parallel_hash')
+@pytest.mark.buildconfigspec('cmd_bootstage')
+@pytest.mark.requiredtool('dtc')
+def test_fit_hash_reuse(u_boot_console):
+    """Test that bootm reuses the hashes it checks before loading images
+
+    bootm checks the hashes of the images of the config before loading any of
+    them. It must not hash an image again when it loads it, unless an image
+    loaded earlier was written over its data.
+    """
+    cons = u_boot_console
+    build_dir = cons.config.build_dir
+    mkimage = build_dir + '/tools/mkimage'
+    its = os.path.join(build_dir, 'test-hash.its')
+    fit = os.path.join(build_dir, 'test-hash.fit')
+    fit_addr = 0x1000
+    max_records = int(cons.config.buildconfig.get(
+        'config_bootstage_record_count', 30))
+
+    def make_data(leaf, text):
+        fname = os.path.join(build_dir, leaf)
+        with open(fname, 'w') as fd:
+            for i in range(100):
+                print('%s %d is hashed only once' % (text, i), file=fd)
+        return fname
+
+    def make_fit(params):
+        with open(its, 'w') as fd:
+            print(hash_its % params, file=fd)
+        util.run_and_log(cons, [mkimage, '-E', '-f', its, fit])
+        with open(fit, 'rb') as fd:
+            return fd.read()
+
+    def run_bootm():
+        cons.restart_uboot()
+        with cons.disable_check('error_notification'):
+            output = '\n'.join(cons.run_command_list([
+                'host load hostfs 0 %x %s' % (fit_addr, fit),
+                'bootm start %x' % fit_addr,
+                'bootstage report']))
+
+        # A full table drops records, which could hide one for 'fit_hash'
+        records = int(re.search(r'\((\d+) records\)', output).group(1))
+        assert records < max_records
+        return output
+
+    params = {
+        'kernel': make_data('test-hash-kernel.bin', 'kernel'),
+        'loadable1': make_data('test-hash-loadable1.bin', 'loadable1'),
+        'loadable2': make_data('test-hash-loadable2.bin', 'loadable2'),
+        'loadable1_addr': 0x100000,
+    }
+
+    with open(params['loadable2'], 'rb') as fd:
+        loadable2 = fd.read()
+
+    try:
+        # Every hash is checked up front, so none is calculated on loading
+        offset = make_fit(params).find(loadable2)
+        with cons.log.section('Hashes reused'):
+            output = run_bootm()
+            assert 'Bad Data Hash' not in output
+            assert 'fit_hash_parallel' in output
+            assert not re.search(r'\bfit_hash\b', output)
+
+        # Load the first loadable over the data of the second, which must
+        # then be hashed again and found to be bad
+        assert offset > 0
+        params['loadable1_addr'] = fit_addr + offset
+        assert make_fit(params).find(loadable2) == offset
+        with cons.log.section('Hash forgotten after overlapping load'):
+            output = run_bootm()
+            assert re.search(r'\bfit_hash\b', output)
+            assert "Bad hash value for 'hash-1' hash node in 'loadable-2'" \
+                in output
+    finally:
+        cons.restart_uboot()
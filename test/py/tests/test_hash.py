@@ -0,0 +1,57 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# Test the hash command against Python's own hashes
+
+import hashlib
+import re
+import zlib
+
+import pytest
+import u_boot_utils
+
+# Sizes either side of the 64-byte block of SHA-1 and SHA-256, at an odd
+# address, so that the whole-block and the leftover paths both run
+SIZES = (1, 0x3f, 0x40, 0x41, 0x1003)
+
+def expected_digests(data):
+    return (
+        ('crc32', '%08x' % zlib.crc32(data)),
+        ('sha1', hashlib.sha1(data).hexdigest()),
+        ('sha256', hashlib.sha256(data).hexdigest()),
+    )
+
+def fill(u_boot_console, addr, size):
+    """Fill memory with a pattern which is not the same in every block"""
+    u_boot_console.run_command('mw.b %x 5a %x' % (addr, size))
+    data = bytearray(b'\x5a' * size)
+    for offset in range(0, size, (size // 16) | 1):
+        u_boot_console.run_command('mw.b %x %02x 1' % (addr + offset,
+                                                       offset & 0xff))
+        data[offset] = offset & 0xff
+    return bytes(data)
+
+@pytest.mark.buildconfigspec('cmd_hash')
+@pytest.mark.buildconfigspec('cmd_memory')
+def test_hash(u_boot_console):
+    """Test that hash gives the same digests as Python for various sizes."""
+
+    addr = u_boot_utils.find_ram_base(u_boot_console) + 1
+    for size in SIZES:
+        data = fill(u_boot_console, addr, size)
+        for algo, digest in expected_digests(data):
+            response = u_boot_console.run_command('hash %s %x %x' %
+                                                  (algo, addr, size))
+            assert response.endswith('==> ' + digest)
+
+@pytest.mark.buildconfigspec('hash_bench')
+@pytest.mark.buildconfigspec('cmd_memory')
+def test_hash_bench(u_boot_console):
+    """Test that hash -b gives the digest and the time taken."""
+
+    addr = u_boot_utils.find_ram_base(u_boot_console)
+    size = 0x10000
+    data = fill(u_boot_console, addr, size)
+    for algo, digest in expected_digests(data):
+        response = u_boot_console.run_command('hash -b %s %x %x' %
+                                              (algo, addr, size))
+        assert re.search(r'==> %s in \d+ us, \d+ KiB/s$' % digest, response)
@@ -14,6 +14,7 @@ static data.
 import collections
 import copy
 import sys
+import zlib
 
 import fdt
 import fdt_util
@@ -45,6 +46,9 @@ TYPE_NAMES = {
 STRUCT_PREFIX = 'dtd_'
 VAL_PREFIX = 'dtv_'
 
+# Largest number of children which the snapshot can list, across all nodes
+SNAPSHOT_MAX_CHILDREN = 0xffff
+
 # This holds information about a property which includes phandles.
 #
 # max_args: integer: Maximum number or arguments that any phandle uses (int).
@@ -548,6 +552,82 @@ class DtbPlatdata(object):
             self.output_node(node)
             nodes_to_output.remove(node)
 
+    def scan_snapshot(self, node, parents):
+        """Find the children which driver model binds devices for
+
+        This adds (node, children) to parents for the node and each of its
+        subnodes which has children to bind. Those are the enabled subnodes
+        with a compatible string, which are the ones that dm_scan_fdt_node()
+        passes to lists_bind_fdt().
+
+        Args:
+            node: Node to scan
+            parents: List to add to
+        """
+        children = []
+        for subnode in node.subnodes:
+            if 'compatible' not in subnode.props:
+                continue
+            status = subnode.props.get('status')
+            if status:
+                value = status.value
+                if isinstance(value, list):
+                    value = value[0]
+                if value not in ('okay', 'ok'):
+                    continue
+            children.append(subnode)
+        if children:
+            parents.append((node, children))
+        for subnode in node.subnodes:
+            self.scan_snapshot(subnode, parents)
+
+    def generate_snapshot(self):
+        """Generate a table of the nodes to bind devices for
+
+        This writes out the offsets of the children of each node which
+        dm_scan_fdt_node() would bind, along with the size and CRC32 of the
+        device tree. U-Boot uses the table instead of walking the device tree,
+        if the device tree it runs with is the same. See struct dm_snapshot
+        for the format.
+        """
+        parents = []
+        self.scan_snapshot(self._fdt.GetRoot(), parents)
+        fdt_size = self._fdt.GetFdtObj().totalsize()
+        crc = zlib.crc32(self._fdt.GetContents()[:fdt_size]) & 0xffffffff
+        if sum(len(children) for _, children in parents) > \
+                SNAPSHOT_MAX_CHILDREN:
+            raise ValueError('Too many nodes for a snapshot (max %d)' %
+                             SNAPSHOT_MAX_CHILDREN)
+
+        self.out_header()
+        self.out('#include <common.h>\n')
+        self.out('#include <dm/snapshot.h>\n')
+        self.out('\n')
+        self.out('static const s32 dm_snapshot_children[] = {\n')
+        for node, children in parents:
+            offsets = ['%#x' % child.Offset() for child in children]
+            self.out('\t/* %s */\n' % node.path)
+            for i in range(0, len(offsets), 8):
+                self.out('\t%s,\n' % ', '.join(offsets[i:i + 8]))
+        self.out('};\n')
+        self.out('\n')
+        self.out('static const struct dm_snapshot_node dm_snapshot_nodes[] = '
+                 '{\n')
+        first = 0
+        for node, children in parents:
+            self.out('\t{%#x, %d, %d},\t/* %s */\n' %
+                     (node.Offset(), first, len(children), node.path))
+            first += len(children)
+        self.out('};\n')
+        self.out('\n')
+        self.out('const struct dm_snapshot dm_snapshot = {\n')
+        self.out('\t.fdt_size\t= %#x,\n' % fdt_size)
+        self.out('\t.fdt_crc32\t= %#x,\n' % crc)
+        self.out('\t.node_count\t= ARRAY_SIZE(dm_snapshot_nodes),\n')
+        self.out('\t.nodes\t\t= dm_snapshot_nodes,\n')
+        self.out('\t.children\t= dm_snapshot_children,\n')
+        self.out('};\n')
+
 
 def run_steps(args, dtb_file, include_disabled, output):
     """Run all the steps of the dtoc tool
@@ -559,21 +639,28 @@ def run_steps(args, dtb_file, include_disabled, output):
         output: Name of output file
     """
     if not args:
-        raise ValueError('Please specify a command: struct, platdata')
+        raise ValueError('Please specify a command: struct, platdata, '
+                         'snapshot')
 
+    cmds = args[0].split(',')
     plat = DtbPlatdata(dtb_file, include_disabled)
     plat.scan_dtb()
-    plat.scan_tree()
-    plat.scan_reg_sizes()
     plat.setup_output(output)
-    structs = plat.scan_structs()
-    plat.scan_phandles()
 
-    for cmd in args[0].split(','):
+    # The snapshot covers the whole tree, without any platform data
+    if [cmd for cmd in cmds if cmd != 'snapshot']:
+        plat.scan_tree()
+        plat.scan_reg_sizes()
+        structs = plat.scan_structs()
+        plat.scan_phandles()
+
+    for cmd in cmds:
         if cmd == 'struct':
             plat.generate_structs(structs)
         elif cmd == 'platdata':
             plat.generate_tables()
+        elif cmd == 'snapshot':
+            plat.generate_snapshot()
         else:
-            raise ValueError("Unknown command '%s': (use: struct, platdata)" %
-                             cmd)
+            raise ValueError("Unknown command '%s': (use: struct, platdata, "
+                             "snapshot)" % cmd)
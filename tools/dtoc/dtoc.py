@@ -19,6 +19,10 @@ Dtoc produces two output files:
    dt-platdata.c - contains data from the device tree using the struct
                       definitions, as well as U-Boot driver definitions.
 
+It can also produce dm-snapshot.c, which lists the device tree nodes that
+driver model binds devices for. This allows U-Boot proper to bind its devices
+without walking the device tree, with CONFIG_DM_SNAPSHOT.
+
 This tool is used in U-Boot to provide device tree data to SPL without
 increasing the code size of SPL. This supports the CONFIG_SPL_OF_PLATDATA
 options. For more information about the use of this options and tool please
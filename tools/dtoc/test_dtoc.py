@@ -15,6 +15,7 @@ import collections
 import os
 import struct
 import unittest
+import zlib
 
 import dtb_platdata
 from dtb_platdata import conv_name_to_c
@@ -49,6 +50,15 @@ C_HEADER = '''/*
 #include <dt-structs.h>
 '''
 
+SNAPSHOT_HEADER = '''/*
+ * DO NOT MODIFY
+ *
+ * This file was generated by dtoc from a .dtb (device tree binary) file.
+ */
+
+#include <common.h>
+#include <dm/snapshot.h>
+'''
 
 
 def get_dtb_file(dts_fname, capture_stderr=False):
@@ -690,6 +700,51 @@ U_BOOT_DEVICE(spl_test2) = {
 
 ''', data)
 
+    def test_snapshot(self):
+        """Test output of the table of nodes to bind devices for"""
+        dtb_file = get_dtb_file('dtoc_test_snapshot.dts')
+        output = tools.GetOutputFilename('output')
+        dtb_platdata.run_steps(['snapshot'], dtb_file, False, output)
+        with open(output) as infile:
+            data = infile.read()
+
+        # Offsets and CRC depend on the dtc version, so work them out here
+        dtb = fdt.FdtScan(dtb_file)
+        def offset(path):
+            return dtb.GetNode(path).Offset()
+        contents = tools.ReadFile(dtb_file)
+        self._CheckStrings(SNAPSHOT_HEADER + '''
+static const s32 dm_snapshot_children[] = {
+\t/* / */
+\t%#x, %#x,
+\t/* /spl-test2 */
+\t%#x,
+\t/* /bus */
+\t%#x,
+\t/* /bus/i2c@0 */
+\t%#x,
+};
+
+static const struct dm_snapshot_node dm_snapshot_nodes[] = {
+\t{0x0, 0, 2},\t/* / */
+\t{%#x, 2, 1},\t/* /spl-test2 */
+\t{%#x, 3, 1},\t/* /bus */
+\t{%#x, 4, 1},\t/* /bus/i2c@0 */
+};
+
+const struct dm_snapshot dm_snapshot = {
+\t.fdt_size\t= %#x,
+\t.fdt_crc32\t= %#x,
+\t.node_count\t= ARRAY_SIZE(dm_snapshot_nodes),
+\t.nodes\t\t= dm_snapshot_nodes,
+\t.children\t= dm_snapshot_children,
+};
+''' % (offset('/spl-test'), offset('/spl-test3'),
+       offset('/spl-test2/spl-test5'), offset('/bus/i2c@0'),
+       offset('/bus/i2c@0/pmic@9'), offset('/spl-test2'), offset('/bus'),
+       offset('/bus/i2c@0'), len(contents),
+       zlib.crc32(contents) & 0xffffffff), data)
+
     def testStdout(self):
         """Test output to stdout"""
         dtb_file = get_dtb_file('dtoc_test_simple.dts')
@@ -700,7 +755,7 @@ U_BOOT_DEVICE(spl_test2) = {
         """Test running dtoc without a command"""
         with self.assertRaises(ValueError) as e:
             dtb_platdata.run_steps([], '', False, '')
-        self.assertIn("Please specify a command: struct, platdata",
+        self.assertIn("Please specify a command: struct, platdata, snapshot",
                       str(e.exception))
 
     def testBadCommand(self):
@@ -709,5 +764,5 @@ U_BOOT_DEVICE(spl_test2) = {
         output = tools.GetOutputFilename('output')
         with self.assertRaises(ValueError) as e:
             dtb_platdata.run_steps(['invalid-cmd'], dtb_file, False, output)
-        self.assertIn("Unknown command 'invalid-cmd': (use: struct, platdata)",
+        self.assertIn("Unknown command 'invalid-cmd': (use: struct, platdata, snapshot)",
                       str(e.exception))
@@ -20,6 +20,7 @@
 #include <stdarg.h>
 #include <version.h>
 #include <u-boot/crc.h>
+#include <u-boot/zstd_seek.h>
 
 static image_header_t header;
 
@@ -621,6 +622,168 @@ err_no_fd:
 	return ret;
 }
 
+/**
+ * fit_zstd_frames() - check whether an image should get a zstd seek table
+ *
+ * @fdt: FIT to check
+ * @node: image node
+ * @datap: returns the image data
+ * @lenp: returns the length of the image data
+ * @table_lenp: returns the length of the seek table to add
+ * @return number of frames to index, 0 or 1 to leave the image alone, or
+ * -ve if the data cannot be indexed
+ */
+static int fit_zstd_frames(const void *fdt, int node, const void **datap,
+			   int *lenp, size_t *table_lenp)
+{
+	struct zstd_seek_table tbl;
+	uint8_t comp;
+
+	if (fit_image_get_comp(fdt, node, &comp) || comp != IH_COMP_ZSTD)
+		return 0;
+	*datap = fdt_getprop(fdt, node, FIT_DATA_PROP, lenp);
+	if (!*datap || zstd_seek_table_find(*datap, *lenp, &tbl) != -ENOENT)
+		return 0;
+
+	return zstd_seek_table_create(*datap, *lenp, NULL, table_lenp);
+}
+
+/**
+ * fit_index_zstd() - add seek tables to zstd images made of several frames
+ *
+ * The frames of such an image can then be decompressed in parallel. Images
+ * which already have a seek table, or only have one frame, are left alone.
+ *
+ * @params: mkimage parameters
+ * @fname: FIT file to update
+ * @return 0 if OK, -ve on error
+ */
+static int fit_index_zstd(struct image_tool_params *params, const char *fname)
+{
+	void *fdt = NULL, *old_fdt;
+	const void *data;
+	size_t table_len;
+	int new_size, size;
+	int fd;
+	struct stat sbuf;
+	int ret;
+	int images;
+	int node;
+	int len;
+
+	fd = mmap_fdt(params->cmdname, fname, 0, &old_fdt, &sbuf, false, false);
+	if (fd < 0)
+		return -EIO;
+
+	images = fdt_path_offset(old_fdt, FIT_IMAGES_PATH);
+	if (images < 0) {
+		debug("%s: Cannot find /images node: %d\n", __func__, images);
+		ret = -EINVAL;
+		goto err_has_fd;
+	}
+
+	/* Each table takes 8 bytes per frame, padded to 4; size the FIT for them */
+	size = sbuf.st_size;
+	for (node = fdt_first_subnode(old_fdt, images);
+	     node >= 0;
+	     node = fdt_next_subnode(old_fdt, node)) {
+		ret = fit_zstd_frames(old_fdt, node, &data, &len, &table_len);
+		if (ret < 0)
+			fprintf(stderr, "%s: Cannot index zstd data of '%s': %s\n",
+				params->cmdname,
+				fit_get_name(old_fdt, node, NULL),
+				strerror(-ret));
+		else if (ret >= 2)
+			size += (table_len + 3) & ~3;
+	}
+	if (size == sbuf.st_size) {
+		ret = 0;
+		goto err_has_fd;
+	}
+
+	fdt = malloc(size);
+	if (!fdt) {
+		fprintf(stderr, "%s: Failed to allocate memory (%d bytes)\n",
+			__func__, size);
+		ret = -ENOMEM;
+		goto err_has_fd;
+	}
+	ret = fdt_open_into(old_fdt, fdt, size);
+	if (ret) {
+		debug("%s: Failed to expand FIT: %s\n", __func__,
+		      fdt_strerror(ret));
+		ret = -EINVAL;
+		goto err_has_fd;
+	}
+
+	images = fdt_path_offset(fdt, FIT_IMAGES_PATH);
+	if (images < 0) {
+		debug("%s: Cannot find /images node: %d\n", __func__, images);
+		ret = -EINVAL;
+		goto err_has_fd;
+	}
+
+	for (node = fdt_first_subnode(fdt, images);
+	     node >= 0;
+	     node = fdt_next_subnode(fdt, node)) {
+		void *buf;
+
+		ret = fit_zstd_frames(fdt, node, &data, &len, &table_len);
+		if (ret < 2)
+			continue;
+		debug("Indexing %d zstd frames\n", ret);
+
+		buf = malloc(len + table_len);
+		if (!buf) {
+			ret = -ENOMEM;
+			goto err_has_fd;
+		}
+		memcpy(buf, data, len);
+		zstd_seek_table_create(data, len, buf + len, &table_len);
+		ret = fdt_setprop(fdt, node, FIT_DATA_PROP, buf,
+				  len + table_len);
+		free(buf);
+		if (ret) {
+			debug("%s: Failed to write property: %s\n", __func__,
+			      fdt_strerror(ret));
+			ret = -EINVAL;
+			goto err_has_fd;
+		}
+	}
+
+	/* Close the old fd so we can re-use it. */
+	close(fd);
+
+	fdt_pack(fdt);
+
+	new_size = fdt_totalsize(fdt);
+	debug("Size expanded from %x to %x\n", fdt_totalsize(old_fdt),
+	      new_size);
+
+	fd = open(fname, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "%s: Can't open %s: %s\n",
+			params->cmdname, fname, strerror(errno));
+		ret = -EIO;
+		goto err_no_fd;
+	}
+	if (write(fd, fdt, new_size) != new_size) {
+		debug("%s: Failed to write seek tables to file %s\n",
+		      __func__, strerror(errno));
+		ret = -EIO;
+		goto err_has_fd;
+	}
+
+	ret = 0;
+
+err_has_fd:
+	close(fd);
+err_no_fd:
+	munmap(old_fdt, sbuf.st_size);
+	free(fdt);
+	return ret;
+}
+
 /**
  * fit_handle_file - main FIT file processing function
  *
@@ -681,6 +844,11 @@ static int fit_handle_file(struct image_tool_params *params)
 	if (ret)
 		goto err_system;
 
+	/* Let the frames of multi-frame zstd images be found quickly */
+	ret = fit_index_zstd(params, tmpfile);
+	if (ret)
+		goto err_system;
+
 	/*
 	 * Set hashes for images in the blob. Unfortunately we may need more
 	 * space in either FDT, so keep trying until we succeed.